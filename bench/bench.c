@@ -0,0 +1,1146 @@
+// photon_bench: render and edit benchmarks, run with --help for options
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include "../src/photon.h"
+#include "../src/editor.h"
+#include "../src/buffer.h"
+#include "../src/ui.h"
+#include "../src/ui_headless.h"
+#include "../src/trace.h"
+#include "../src/highlight.h"
+#include "../src/search.h"
+#include "../src/regex.h"
+#include "../src/grep.h"
+#include "../src/follow.h"
+#include "../src/wrap.h"
+#include "../src/cursors.h"
+#include "../src/undo.h"
+#include "../src/journal.h"
+#include "../src/pack.h"
+#include "../src/complete.h"
+#include "../src/nest.h"
+#include "../src/fold.h"
+#include "../src/pool.h"
+#include "../src/extensions.h"
+
+// allocations are counted by wrapping malloc at link time (see CMakeLists.txt)
+#if BENCH_COUNT_ALLOCS
+static atomic_size_t allocs, alloc_bytes;
+
+void *__real_malloc(size_t n);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t n);
+
+void *__wrap_malloc(size_t n){
+    atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&alloc_bytes, n, memory_order_relaxed);
+    return __real_malloc(n);
+}
+
+void *__wrap_calloc(size_t n, size_t size){
+    atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&alloc_bytes, n * size, memory_order_relaxed);
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t n){
+    atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&alloc_bytes, n, memory_order_relaxed);
+    return __real_realloc(p, n);
+}
+#endif
+
+static struct {
+    int rows, cols;
+    int runs;
+    double min_ms;
+    size_t lines;
+    int json;
+    int verify;
+    const char *filter;
+} opt = { 50, 200, 5, 500, 200000, 0, 0, NULL };
+
+// the terminal: counts what a frame costs, optionally feeding the vt emulator as well
+static size_t out_bytes, out_writes;
+
+static int _sink_init(void){
+    photon_headless_set_size(opt.rows, opt.cols);
+    return photon_ui_headless.init();
+}
+
+static void _sink_end(void){
+    photon_ui_headless.end();
+}
+
+static ssize_t _sink_write(const char *data, size_t n){
+    out_bytes += n;
+    out_writes++;
+    if (!opt.verify) return (ssize_t)n;
+    ssize_t r = photon_ui_headless.write(data, n);
+    photon_headless_reset();
+    return r;
+}
+
+static int _sink_size(int *rows, int *cols){
+    *rows = opt.rows;
+    *cols = opt.cols;
+    return 1;
+}
+
+static const photon_ui_backend_t bench_sink = {
+    .init = _sink_init,
+    .end = _sink_end,
+    .write = _sink_write,
+    .size = _sink_size
+};
+
+static uint64_t rng = 0x9e3779b97f4a7c15ull;
+
+static uint64_t _rand(void){
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+static double _now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// generated source text, every token remembers its color so the highlighted
+// screen doesn't pay for lexing
+#define C_TEXT    0xebdbb2
+#define C_KEYWORD 0xfb4934
+#define C_TYPE    0xfabd2f
+#define C_STRING  0xb8bb26
+#define C_NUMBER  0xd3869b
+#define C_COMMENT 0x928374
+#define C_PUNCT   0x8ec07c
+#define C_CALL    0x83a598
+#define BG_NORMAL 0x1c1c1c
+#define BG_ALT    0x282828
+
+typedef struct span {
+    unsigned short start, len;
+    int fg;
+} span_t;
+
+typedef struct gen_line {
+    char *text;
+    int len;
+    span_t *spans;
+    int num_span;
+} gen_line_t;
+
+static gen_line_t *src;
+static size_t num_src;
+static char *src_text; // all of it, newline separated
+static size_t src_len;
+
+static const struct { const char *str; int fg; } tokens[] = {
+    { "if", C_KEYWORD }, { "return", C_KEYWORD }, { "while", C_KEYWORD }, { "for", C_KEYWORD },
+    { "int", C_TYPE }, { "size_t", C_TYPE }, { "char", C_TYPE }, { "photon_line_t", C_TYPE },
+    { "\"hello, world\\n\"", C_STRING }, { "\"%s:%d\"", C_STRING },
+    { "0", C_NUMBER }, { "42", C_NUMBER }, { "0x1c1c1c", C_NUMBER },
+    { "(", C_PUNCT }, { ")", C_PUNCT }, { "{", C_PUNCT }, { "}", C_PUNCT }, { ";", C_PUNCT }, { "=", C_PUNCT }, { "->", C_PUNCT },
+    { "buf", C_TEXT }, { "editor", C_TEXT }, { "line", C_TEXT }, { "length", C_TEXT }, { "i", C_TEXT },
+    { "photon_draw_nstr", C_CALL }, { "memcpy", C_CALL }, { "free", C_CALL },
+};
+#define NUM_TOKENS (sizeof(tokens) / sizeof(tokens[0]))
+
+static void _gen_source(size_t n){
+    src = calloc(n, sizeof(gen_line_t));
+    char line[256];
+    span_t spans[64];
+    for (size_t i = 0; i < n; i++){
+        int len = 0, ns = 0;
+        int indent = (int)(_rand() % 4) * 4;
+        memset(line, ' ', indent);
+        len = indent;
+        int words = (int)(_rand() % 14);
+        if (_rand() % 10 == 0){
+            // a long comment now and then so some lines don't fit inline
+            len += sprintf(line + len, "// %.*s", (int)(_rand() % 90) + 20,
+                "the quick brown fox jumps over the lazy dog while the editor redraws the screen again and again");
+            spans[ns++] = (span_t){ indent, len - indent, C_COMMENT };
+            words = 0;
+        }
+        for (int w = 0; w < words && ns < 64; w++){
+            int t = (int)(_rand() % NUM_TOKENS);
+            int tl = (int)strlen(tokens[t].str);
+            if (len + tl + 1 >= (int)sizeof(line)) break;
+            spans[ns++] = (span_t){ len, tl, tokens[t].fg };
+            memcpy(line + len, tokens[t].str, tl);
+            len += tl;
+            line[len++] = ' ';
+        }
+        src[i].text = malloc(len + 1);
+        memcpy(src[i].text, line, len);
+        src[i].text[len] = 0;
+        src[i].len = len;
+        src[i].spans = malloc(ns * sizeof(span_t) + 1);
+        memcpy(src[i].spans, spans, ns * sizeof(span_t));
+        src[i].num_span = ns;
+        src_len += len + 1;
+    }
+    num_src = n;
+    src_text = malloc(src_len);
+    size_t off = 0;
+    for (size_t i = 0; i < n; i++){
+        memcpy(src_text + off, src[i].text, src[i].len);
+        off += src[i].len;
+        src_text[off++] = '\n';
+    }
+}
+
+static void _free_source(void){
+    for (size_t i = 0; i < num_src; i++){
+        free(src[i].text);
+        free(src[i].spans);
+    }
+    free(src);
+    free(src_text);
+}
+
+static photon_editor_t editor;
+
+static void _draw_bg(int bg){
+    editor.ui_hints = (photon_theme_attr_t){ .bg = bg, .fg = C_TEXT, .style = 0 };
+    photon_move_ui_cursor(0, 0);
+    photon_draw_box(&editor, opt.rows, opt.cols);
+}
+
+// one screen worth of source starting at first, plain or highlighted
+static void _draw_page(size_t first, int bg, int highlight){
+    _draw_bg(bg);
+    for (int y = 0; y < opt.rows; y++){
+        const gen_line_t *l = &src[(first + y) % num_src];
+        int len = l->len < opt.cols ? l->len : opt.cols;
+        if (!highlight){
+            photon_move_ui_cursor(y, 0);
+            photon_draw_nstr(&editor, l->text, len);
+            continue;
+        }
+        for (int i = 0; i < l->num_span; i++){
+            const span_t *s = &l->spans[i];
+            if (s->start >= len) break;
+            editor.ui_hints.fg = s->fg;
+            photon_move_ui_cursor(y, s->start);
+            photon_draw_nstr(&editor, l->text + s->start, s->start + s->len > len ? len - s->start : s->len);
+        }
+    }
+}
+
+// makes sure nothing on screen survives into the next scenario, the color
+// mode can change in between and unchanged cells wouldn't be repainted
+static void _invalidate(void){
+    photon_ui_clear();
+    editor.ui_hints = (photon_theme_attr_t){ .bg = 0x010203, .fg = 0x030201, .style = 0 };
+    for (int y = 0; y < opt.rows; y++){
+        photon_move_ui_cursor(y, 0);
+        for (int x = 0; x < opt.cols; x++)
+            photon_draw_nstr(&editor, "#", 1);
+    }
+    photon_ui_refresh();
+}
+
+typedef struct bench bench_t;
+struct bench {
+    const char *name;
+    const char *unit; // what one op is
+    int color_mode;
+    void (*setup)(void);
+    void (*run)(long ops);
+    void (*teardown)(void);
+    size_t op_bytes; // input bytes per op, 0 when it's a frame and the output is what counts
+    int frames;
+    int (*verify)(void); // what --verify checks when it isn't frames, returns the mismatches
+};
+
+static long frame_no;
+static photon_buffer_t *buf;
+// what's found goes here so it isn't optimized away
+static volatile size_t found_sink;
+
+static void _setup_frames(void){
+    frame_no = 0;
+    _invalidate();
+}
+
+static void _run_full_repaint(long ops){
+    for (long i = 0; i < ops; i++, frame_no++){
+        photon_ui_clear();
+        _draw_page((size_t)frame_no * opt.rows, frame_no & 1 ? BG_ALT : BG_NORMAL, 0);
+        photon_ui_refresh();
+    }
+}
+
+static void _run_one_cell(long ops){
+    for (long i = 0; i < ops; i++, frame_no++){
+        photon_ui_clear();
+        _draw_page(0, BG_NORMAL, 1);
+        // the cursor blinking over one cell, walking so it isn't always the same row
+        long cell = frame_no / 2 % ((long)opt.rows * opt.cols);
+        editor.ui_hints = (photon_theme_attr_t){ .bg = frame_no & 1 ? C_TEXT : BG_NORMAL, .fg = C_TEXT, .style = 0 };
+        photon_move_ui_cursor((int)(cell / opt.cols), (int)(cell % opt.cols));
+        photon_draw_nstr(&editor, "@", 1);
+        photon_ui_refresh();
+    }
+}
+
+static void _run_syntax(long ops){
+    for (long i = 0; i < ops; i++, frame_no++){
+        photon_ui_clear();
+        _draw_page((size_t)frame_no, BG_NORMAL, 1);
+        photon_ui_refresh();
+    }
+}
+
+static void _setup_buffer(void){
+    photon_buf_options_t options = { .type = BUF_SCRATCH, .x = 0, .y = 0, .rows = opt.rows, .cols = opt.cols, .name = "bench" };
+    buf = photon_create_buffer(&editor, &options);
+    if (!buf || !photon_buffer_insert(&editor, buf, 0, 0, src_text, src_len)){
+        fprintf(stderr, "photon_bench: %s\n", photon_editor_error_msg(&editor));
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void _teardown_buffer(void){
+    photon_delete_buffer(&editor, buf);
+    buf = NULL;
+}
+
+static void _setup_scroll(void){
+    _setup_frames();
+    _setup_buffer();
+}
+
+static void _run_scroll(long ops){
+    for (long i = 0; i < ops; i++, frame_no++){
+        buf->scroll = (int)(frame_no % (buf->text->num_line - opt.rows));
+        photon_editor_draw(&editor);
+        photon_ui_refresh();
+    }
+}
+
+// the text packed again before every frame (which only has to point the lines that were
+// unpacked back at their blocks) and a page somewhere else each time, so every frame
+// unpacks the blocks it shows
+static void _setup_scroll_packed(void){
+    _setup_scroll();
+    if (!photon_pack_text(buf->text)){
+        fprintf(stderr, "photon_bench: out of memory packing\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void _run_scroll_packed(long ops){
+    for (long i = 0; i < ops; i++, frame_no++){
+        photon_pack_text(buf->text);
+        buf->scroll = (int)((frame_no * 7919) % (buf->text->num_line - opt.rows));
+        photon_editor_draw(&editor);
+        photon_ui_refresh();
+    }
+}
+
+// packing all of it from scratch and unpacking it again
+static void _run_pack(long ops){
+    for (long i = 0; i < ops; i++){
+        if (!photon_pack_text(buf->text) || !photon_pack_thaw(buf->text)){
+            fprintf(stderr, "photon_bench: out of memory packing\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+// indexing all of the text's words from scratch
+static void _run_complete_index(long ops){
+    for (long i = 0; i < ops; i++){
+        photon_complete_forget(&editor, buf->text);
+        while (photon_complete_pending(&editor))
+            photon_complete_step(&editor, 1000000000);
+    }
+}
+
+static void _setup_complete(void){
+    _setup_buffer();
+    _run_complete_index(1);
+}
+
+// the ten most frequent words for a different two letter prefix every time
+static void _run_complete_query(long ops){
+    photon_completion_t out[10];
+    for (long i = 0; i < ops; i++){
+        char prefix[2] = { (char)('a' + i % 26), (char)('a' + i / 26 % 26) };
+        found_sink += photon_complete_query(&editor, prefix, 2, out, 10);
+    }
+}
+
+// typing a word into the middle of an indexed text and backspacing over it, asking for
+// completions of what's typed after every key. the line's words go out and in again each time
+static void _run_complete_key(long ops){
+    static const char word[] = "memcpy_count";
+    const size_t len = sizeof(word) - 1;
+    size_t line = buf->text->num_line / 2;
+    photon_completion_t out[10];
+    for (long i = 0; i < ops; i++){
+        size_t at = (size_t)i % (2 * len), typed = at < len ? at + 1 : 2 * len - at - 1;
+        int ok = at < len ? photon_buffer_insert(&editor, buf, line, at, &word[at], 1) : photon_buffer_erase(&editor, buf, line, typed, 1);
+        if (!ok){
+            fprintf(stderr, "photon_bench: %s\n", photon_editor_error_msg(&editor));
+            exit(EXIT_FAILURE);
+        }
+        found_sink += photon_complete_query(&editor, word, typed, out, 10);
+    }
+}
+
+// the same text as one long line, every frame jumps a page further down its wrapped rows
+static void _setup_scroll_wrapped(void){
+    _setup_frames();
+    char *text = malloc(src_len);
+    if (!text){
+        perror("photon_bench");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < src_len; i++)
+        text[i] = src_text[i] == '\n' ? ' ' : src_text[i];
+    photon_buf_options_t options = { .type = BUF_SCRATCH, .x = 0, .y = 0, .rows = opt.rows, .cols = opt.cols, .name = "bench" };
+    buf = photon_create_buffer(&editor, &options);
+    if (!buf || !photon_buffer_insert(&editor, buf, 0, 0, text, src_len)){
+        fprintf(stderr, "photon_bench: %s\n", photon_editor_error_msg(&editor));
+        exit(EXIT_FAILURE);
+    }
+    free(text);
+}
+
+static void _run_scroll_wrapped(long ops){
+    uint64_t rows = photon_wrap_total(buf) - opt.rows;
+    for (long i = 0; i < ops; i++, frame_no++){
+        photon_wrap_set_top(buf, (uint64_t)frame_no * opt.rows % rows);
+        photon_editor_draw(&editor);
+        photon_ui_refresh();
+    }
+}
+
+// every block in the text folded, so a page shows a few hundred lines. every frame jumps
+// a page further down the rows that are left
+static void _setup_scroll_folded(void){
+    _setup_scroll();
+    for (size_t line = 0; line < buf->text->num_line; line++){
+        if (photon_fold_toggle(&editor, buf, line))
+            line = buf->_fold.folds[buf->_fold.num - 1].last;
+    }
+}
+
+// the brackets a match starts from, spread over the text
+#define NUM_BRACKETS 1024
+static size_t brackets[NUM_BRACKETS][2];
+
+static void _setup_nest(void){
+    _setup_buffer();
+    size_t n = 0, step = buf->text->num_line / NUM_BRACKETS + 1;
+    for (size_t line = 0; line < buf->text->num_line && n < NUM_BRACKETS; line += step){
+        const char *s = photon_line_str(&buf->text->lines[line]);
+        const char *p = strpbrk(s, "{}()");
+        if (!p) continue;
+        brackets[n][0] = line;
+        brackets[n++][1] = (size_t)(p - s);
+    }
+    // all of it read up front, that's a one time cost
+    found_sink += (size_t)photon_nest_depth(buf, buf->text->num_line);
+}
+
+// a bracket typed at the top or taken out again, then the one at a bracket somewhere
+// further down matched: the edit is one line's entry and the nodes over it, the match a
+// walk down the tree from where the bracket is
+static void _run_nest_match(long ops){
+    for (long i = 0; i < ops; i++){
+        int ok = i & 1 ? photon_buffer_erase(&editor, buf, 0, 0, 1) : photon_buffer_insert(&editor, buf, 0, 0, "{", 1);
+        if (!ok){
+            fprintf(stderr, "photon_bench: %s\n", photon_editor_error_msg(&editor));
+            exit(EXIT_FAILURE);
+        }
+        size_t *at = brackets[(size_t)i * 7919 % NUM_BRACKETS], ml, mc;
+        found_sink += photon_nest_match(buf, at[0], at[1] + (i & 1 ? 0 : !at[0]), &ml, &mc);
+    }
+}
+
+// quantizing: random colors mostly miss the memo cache, a theme's few colors always hit
+#define NUM_COLORS 4096
+static int colors[NUM_COLORS];
+static volatile unsigned color_sink;
+
+static void _setup_colors_cold(void){
+    for (int i = 0; i < NUM_COLORS; i++)
+        colors[i] = (int)(_rand() & 0xffffff);
+}
+
+static void _setup_colors_hot(void){
+    static const int theme[] = { C_TEXT, C_KEYWORD, C_TYPE, C_STRING, C_NUMBER, C_COMMENT, C_PUNCT, C_CALL, BG_NORMAL, BG_ALT };
+    for (int i = 0; i < NUM_COLORS; i++)
+        colors[i] = theme[i % (sizeof(theme) / sizeof(theme[0]))];
+}
+
+static void _run_quantize(long ops){
+    unsigned acc = 0;
+    for (long i = 0; i < ops; i++)
+        acc += (unsigned)photon_ui_color(colors[i % NUM_COLORS]);
+    color_sink = acc;
+}
+
+static char file_path[64];
+
+static void _write_file(void){
+    if (file_path[0]) return;
+    strcpy(file_path, "/tmp/photon_bench.XXXXXX");
+    int fd = mkstemp(file_path);
+    if (fd == -1 || write(fd, src_text, src_len) != (ssize_t)src_len){
+        perror("photon_bench: can't write the test file");
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+}
+
+static void _run_load(long ops){
+    photon_buf_options_t options = { .type = BUF_FILE, .x = 0, .y = 0, .rows = opt.rows, .cols = opt.cols, .name = file_path };
+    for (long i = 0; i < ops; i++){
+        photon_buffer_t *b = photon_create_buffer(&editor, &options);
+        if (!b || !photon_buffer_load_file(&editor, b, file_path)){
+            fprintf(stderr, "photon_bench: %s\n", photon_editor_error_msg(&editor));
+            exit(EXIT_FAILURE);
+        }
+        photon_delete_buffer(&editor, b);
+    }
+}
+
+// a log of errors with stack traces out of a few frames, so most of its lines are
+// copies of others, loaded with and without dedup_lines
+#define LOG_FRAMES 48
+#define LOG_DEPTH 12
+
+static char dump_path[64];
+static size_t dump_len;
+
+static void _write_dump(void){
+    if (dump_path[0]) return;
+    strcpy(dump_path, "/tmp/photon_bench_dump.XXXXXX");
+    int fd = mkstemp(dump_path);
+    FILE *f = fd == -1 ? NULL : fdopen(fd, "w");
+    if (!f){
+        perror("photon_bench: can't write the test log");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < opt.lines; i += LOG_DEPTH + 1){
+        fprintf(f, "2026-10-19T%02zu:%02zu:%02zu.%03zuZ ERROR request %016llx failed: upstream timed out\n",
+                i / 3600000 % 24, i / 60000 % 60, i / 1000 % 60, i % 1000, (unsigned long long)_rand());
+        // the same few traces over and over, like a retry loop
+        size_t trace = _rand() % 4;
+        for (size_t k = 0; k < LOG_DEPTH; k++){
+            size_t frame = (trace * 7 + k) % LOG_FRAMES;
+            fprintf(f, "    at com.example.service.Handler%zu.process(Handler%zu.java:%zu)\n", frame, frame, 100 + frame * 13);
+        }
+    }
+    dump_len = (size_t)ftell(f);
+    fclose(f);
+}
+
+static void _load_dump(long ops, int dedup){
+    photon_buf_options_t options = { .type = BUF_FILE, .x = 0, .y = 0, .rows = opt.rows, .cols = opt.cols, .name = dump_path };
+    editor.dedup_lines = (char)dedup;
+    for (long i = 0; i < ops; i++){
+        photon_buffer_t *b = photon_create_buffer(&editor, &options);
+        if (!b || !photon_buffer_load_file(&editor, b, dump_path)){
+            fprintf(stderr, "photon_bench: %s\n", photon_editor_error_msg(&editor));
+            exit(EXIT_FAILURE);
+        }
+        photon_delete_buffer(&editor, b);
+    }
+    editor.dedup_lines = 0;
+}
+
+static void _run_load_log(long ops){
+    _load_dump(ops, 0);
+}
+
+static void _run_load_log_dedup(long ops){
+    _load_dump(ops, 1);
+}
+
+// a followed log that gets FOLLOW_LINES more lines before every frame, the view pinned to
+// the bottom so each one scrolls
+#define FOLLOW_LINES 100
+
+static char log_path[64];
+static FILE *log_out;
+
+static void _setup_follow(void){
+    _setup_frames();
+    strcpy(log_path, "/tmp/photon_bench_log.XXXXXX");
+    int fd = mkstemp(log_path);
+    if (fd == -1 || write(fd, src_text, src_len) != (ssize_t)src_len || !(log_out = fdopen(fd, "a"))){
+        perror("photon_bench: can't write the test log");
+        exit(EXIT_FAILURE);
+    }
+    photon_buf_options_t options = { .type = BUF_FILE, .x = 0, .y = 0, .rows = opt.rows, .cols = opt.cols, .name = log_path };
+    buf = photon_create_buffer(&editor, &options);
+    if (!buf || !photon_buffer_load_file(&editor, buf, log_path) || !photon_follow_start(&editor, buf)){
+        fprintf(stderr, "photon_bench: %s\n", photon_editor_error_msg(&editor));
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void _run_follow(long ops){
+    for (long i = 0; i < ops; i++, frame_no++){
+        for (int k = 0; k < FOLLOW_LINES; k++)
+            fprintf(log_out, "%s\n", src[(frame_no * FOLLOW_LINES + k) % num_src].text);
+        fflush(log_out);
+        // the editor only looks once inotify says so
+        struct pollfd fd = { .fd = photon_follow_fd(&editor), .events = POLLIN };
+        poll(&fd, 1, -1);
+        photon_editor_draw(&editor);
+        photon_ui_refresh();
+    }
+}
+
+static void _teardown_follow(void){
+    _teardown_buffer();
+    fclose(log_out);
+    unlink(log_path);
+}
+
+// a paste of PASTE_LINES lines a little way into the file
+#define PASTE_LINES 256
+
+static size_t _paste_len(void){
+    size_t n = 0;
+    for (size_t i = 0; i < PASTE_LINES; i++)
+        n += src[i].len + 1;
+    return n;
+}
+
+static void _run_insert(long ops){
+    size_t n = _paste_len();
+    for (long i = 0; i < ops; i++){
+        if (!photon_buffer_insert(&editor, buf, 100, 0, src_text, n)){
+            fprintf(stderr, "photon_bench: %s\n", photon_editor_error_msg(&editor));
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+// renaming memcpy at RENAME_SITES places at once with the search still on, and undoing
+// it, which selects them again for the next op
+#define RENAME_SITES 5000
+
+static void _setup_rename(void){
+    _setup_buffer();
+    if (!photon_search_start(&editor, buf, "memcpy", 6, 0) || !photon_cursors_select_matches(&editor, buf)){
+        fprintf(stderr, "photon_bench: %s\n", photon_editor_error_msg(&editor));
+        exit(EXIT_FAILURE);
+    }
+    if (buf->num_cursor > RENAME_SITES)
+        buf->num_cursor = RENAME_SITES;
+}
+
+static void _run_rename(long ops){
+    for (long i = 0; i < ops; i++){
+        if (!photon_cursors_insert(&editor, buf, "photon_copy", 11) || !photon_undo(&editor, buf)){
+            fprintf(stderr, "photon_bench: %s\n", photon_editor_error_msg(&editor));
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+// typing halfway down a highlighted file, a plain key only relexes its own line but
+// opening a comment relexes the rest of the screen and the lookahead until it's closed
+static void _setup_highlight(void){
+    _setup_scroll();
+    photon_set_grammar(&editor, buf, "c");
+    buf->scroll = (int)(buf->text->num_line / 2);
+    // everything above gets lexed here instead of in the first timed frame
+    photon_editor_draw(&editor);
+    photon_ui_refresh();
+}
+
+static void _run_keystroke(const char *str, long ops){
+    size_t n = strlen(str), line = buf->scroll + opt.rows / 2;
+    for (long i = 0; i < ops; i++, frame_no++){
+        int ok = i & 1 ? photon_buffer_erase(&editor, buf, line, 0, n) : photon_buffer_insert(&editor, buf, line, 0, str, n);
+        if (!ok){
+            fprintf(stderr, "photon_bench: %s\n", photon_editor_error_msg(&editor));
+            exit(EXIT_FAILURE);
+        }
+        photon_editor_draw(&editor);
+        photon_ui_refresh();
+    }
+}
+
+static void _run_type_key(long ops){
+    _run_keystroke("x", ops);
+}
+
+static void _run_type_comment(long ops){
+    _run_keystroke("/*", ops);
+}
+
+// the same file side by side, the right view further down: breaking a line in the left
+// one moves what the right one shows, both are drawn every frame
+static photon_buffer_t *split;
+
+static void _setup_split(void){
+    _setup_highlight();
+    int left = (opt.cols - 1) / 2;
+    photon_buf_options_t options = { .x = left + 1, .y = 0, .rows = opt.rows, .cols = opt.cols - left - 1 };
+    buf->cols = left;
+    if (!(split = photon_buffer_split(&editor, buf, &options))){
+        fprintf(stderr, "photon_bench: %s\n", photon_editor_error_msg(&editor));
+        exit(EXIT_FAILURE);
+    }
+    split->scroll = (int)(buf->text->num_line * 3 / 4);
+    editor.cur_buf = buf;
+    photon_editor_draw(&editor);
+    photon_ui_refresh();
+}
+
+static void _run_split_key(long ops){
+    _run_keystroke("\n", ops);
+}
+
+static void _teardown_split(void){
+    photon_delete_buffer(&editor, split);
+    split = NULL;
+    _teardown_buffer();
+}
+
+// typing into a journaled file, with the syncs an idle editor would make in between
+static void _setup_journal(void){
+    _write_file();
+    // the journal goes under /tmp instead of the real state dir
+    setenv("XDG_STATE_HOME", "/tmp", 1);
+    photon_buf_options_t options = { .type = BUF_FILE, .x = 0, .y = 0, .rows = opt.rows, .cols = opt.cols, .name = file_path };
+    buf = photon_create_buffer(&editor, &options);
+    if (!buf || !photon_buffer_load_file(&editor, buf, file_path) || !photon_journal_start(&editor, buf)){
+        fprintf(stderr, "photon_bench: %s\n", photon_editor_error_msg(&editor));
+        exit(EXIT_FAILURE);
+    }
+    // the idle slices would index the words first, that's complete_index
+    while (photon_complete_pending(&editor))
+        photon_complete_step(&editor, 1000000000);
+}
+
+static void _run_journal_key(long ops){
+    size_t line = buf->text->num_line / 2;
+    for (long i = 0; i < ops; i++){
+        int ok = i & 1 ? photon_buffer_erase(&editor, buf, line, 0, 1) : photon_buffer_insert(&editor, buf, line, 0, "x", 1);
+        if (!ok){
+            fprintf(stderr, "photon_bench: %s\n", photon_editor_error_msg(&editor));
+            exit(EXIT_FAILURE);
+        }
+        photon_editor_idle(&editor);
+    }
+    photon_journal_flush(&editor, buf, 1);
+}
+
+// the scanner on its own over the whole text, for a pattern that's nowhere in it
+static void _run_search_text(long ops){
+    photon_search_pat_t pat;
+    if (!photon_search_compile(&pat, "photon_redraw", 13)){
+        fprintf(stderr, "photon_bench: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    for (long i = 0; i < ops; i++)
+        found_sink += photon_search_find(&pat, src_text, src_len) != NULL;
+    photon_search_free(&pat);
+}
+
+// a search started in the middle of the buffer and stepped until it has every match
+static void _search_buffer(const char *pattern, int flags, long ops){
+    for (long i = 0; i < ops; i++){
+        if (!photon_search_start(&editor, buf, pattern, strlen(pattern), flags)){
+            fprintf(stderr, "photon_bench: %s\n", photon_editor_error_msg(&editor));
+            exit(EXIT_FAILURE);
+        }
+        while (photon_search_step(buf, UINT64_MAX));
+        found_sink += photon_search_count(buf, NULL);
+    }
+    photon_search_stop(buf);
+}
+
+static void _run_search_buffer(long ops){
+    _search_buffer("memcpy", 0, ops);
+}
+
+// the DFA only runs where the literal prefix turns up
+static void _run_search_regex(long ops){
+    _search_buffer("\\bphoton_[a-z_]+\\(", PHOTON_SEARCH_REGEX, ops);
+}
+
+// no prefix to skip with, every byte goes through the DFA
+static void _run_search_regex_class(long ops){
+    _search_buffer("[0-9]x[0-9a-f]+|[a-z]+_t\\b", PHOTON_SEARCH_REGEX, ops);
+}
+
+// matches perl gives, looking again from every position of the text the way search does.
+// lazy loops whose body can match nothing are where a DFA is easiest to get wrong
+static const struct { const char *pattern, *text, *want; } regex_cases[] = {
+    { "(x?\?)+",           "xx",      "0-0 1-1 2-2" },
+    { ".+?(x?\?)+",        "axc",     "0-1 1-2 2-3 -" },
+    { "\\b.+?(x?\?)+",     "b axc_b", "0-1 1-2 2-3 - - - - -" },
+    { "(|a)*",             "aa",      "0-0 1-1 2-2" },
+    { "(a|)*",             "aa",      "0-2 1-2 2-2" },
+    { "a*?",               "aa",      "0-0 1-1 2-2" },
+    { "(a|ab)(c|bcd)(d*)", "abcd",    "0-4 - - - -" },
+    { "x*\\b",             "ab c",    "0-0 2-2 2-2 3-3 4-4" },
+    { "(a+|b+)*?c",        "aabc",    "0-4 1-4 2-4 3-4 -" },
+    { "(?:a|b)+?b",        "aab",     "0-3 1-3 - -" },
+};
+
+static int _verify_regex(void){
+    int bad = 0;
+    for (size_t i = 0; i < sizeof(regex_cases) / sizeof(regex_cases[0]); i++){
+        const char *text = regex_cases[i].text;
+        size_t n = strlen(text), len = 0, start, end;
+        char got[256];
+        photon_regex_t *re = photon_regex_compile(regex_cases[i].pattern, strlen(regex_cases[i].pattern), 0, NULL);
+        if (!re){
+            bad++;
+            continue;
+        }
+        for (size_t from = 0; from <= n; from++){
+            if (photon_regex_find(re, text, n, from, &start, &end) > 0)
+                len += snprintf(got + len, sizeof(got) - len, "%s%zu-%zu", from ? " " : "", start, end);
+            else
+                len += snprintf(got + len, sizeof(got) - len, "%s-", from ? " " : "");
+        }
+        photon_regex_free(re);
+        if (strcmp(got, regex_cases[i].want)){
+            fprintf(stderr, "photon_bench: /%s/ on \"%s\": %s, want %s\n", regex_cases[i].pattern, text, got, regex_cases[i].want);
+            bad++;
+        }
+    }
+    return bad;
+}
+
+// the text split over TREE_DIRS directories of TREE_FILES files each, grepped to the end
+#define TREE_DIRS 16
+#define TREE_FILES 32
+
+static char tree_path[64];
+
+static void _tree_file(char *path, size_t size, int d, int f){
+    if (f < 0)
+        snprintf(path, size, "%s/d%d", tree_path, d);
+    else
+        snprintf(path, size, "%s/d%d/f%d.c", tree_path, d, f);
+}
+
+static void _write_tree(void){
+    if (tree_path[0]) return;
+    strcpy(tree_path, "/tmp/photon_bench_tree.XXXXXX");
+    if (!mkdtemp(tree_path)){
+        perror("photon_bench: can't make the test tree");
+        exit(EXIT_FAILURE);
+    }
+    size_t per = num_src / (TREE_DIRS * TREE_FILES) + 1, line = 0;
+    char path[128];
+    for (int d = 0; d < TREE_DIRS; d++){
+        _tree_file(path, sizeof(path), d, -1);
+        mkdir(path, 0700);
+        for (int f = 0; f < TREE_FILES; f++){
+            _tree_file(path, sizeof(path), d, f);
+            FILE *out = fopen(path, "w");
+            if (!out){
+                perror("photon_bench: can't write the test tree");
+                exit(EXIT_FAILURE);
+            }
+            for (size_t i = 0; i < per && line < num_src; i++, line++)
+                fprintf(out, "%s\n", src[line].text);
+            fclose(out);
+        }
+    }
+}
+
+static void _remove_tree(void){
+    char path[128];
+    for (int d = 0; d < TREE_DIRS; d++){
+        for (int f = 0; f < TREE_FILES; f++){
+            _tree_file(path, sizeof(path), d, f);
+            unlink(path);
+        }
+        _tree_file(path, sizeof(path), d, -1);
+        rmdir(path);
+    }
+    rmdir(tree_path);
+}
+
+static void _grep_tree(const char *pattern, int flags, long ops){
+    for (long i = 0; i < ops; i++){
+        photon_buffer_t *results = photon_grep_start(&editor, tree_path, pattern, strlen(pattern), flags);
+        if (!results){
+            fprintf(stderr, "photon_bench: %s\n", photon_editor_error_msg(&editor));
+            exit(EXIT_FAILURE);
+        }
+        // the way the editor waits for it, minus the keyboard
+        while (editor.grep){
+            struct pollfd fd = { .fd = photon_pool_wake_fd(editor.pool), .events = POLLIN };
+            poll(&fd, 1, -1);
+            photon_drain_jobs(&editor);
+            photon_grep_drain(&editor);
+        }
+        found_sink += results->text->num_line;
+        photon_delete_buffer(&editor, results);
+    }
+}
+
+static void _run_grep_text(long ops){
+    _grep_tree("memcpy", 0, ops);
+}
+
+static void _run_grep_regex(long ops){
+    _grep_tree("\\bphoton_[a-z_]+\\(", PHOTON_SEARCH_REGEX, ops);
+}
+
+static bench_t benches[] = {
+    { "frame_full_repaint",  "frame",  PHOTON_COLOR_TRUE, _setup_frames, _run_full_repaint, NULL, 0, 1 },
+    { "frame_one_cell",      "frame",  PHOTON_COLOR_TRUE, _setup_frames, _run_one_cell, NULL, 0, 1 },
+    { "frame_scroll",        "frame",  PHOTON_COLOR_TRUE, _setup_scroll, _run_scroll, _teardown_buffer, 0, 1 },
+    { "frame_scroll_wrapped", "frame", PHOTON_COLOR_TRUE, _setup_scroll_wrapped, _run_scroll_wrapped, _teardown_buffer, 0, 1 },
+    { "frame_scroll_folded", "frame",  PHOTON_COLOR_TRUE, _setup_scroll_folded, _run_scroll_wrapped, _teardown_buffer, 0, 1 },
+    { "frame_scroll_packed", "frame",  PHOTON_COLOR_TRUE, _setup_scroll_packed, _run_scroll_packed, _teardown_buffer, 0, 1 },
+    { "frame_syntax",        "frame",  PHOTON_COLOR_TRUE, _setup_frames, _run_syntax, NULL, 0, 1 },
+    { "frame_syntax_256",    "frame",  PHOTON_COLOR_256,  _setup_frames, _run_syntax, NULL, 0, 1 },
+    { "frame_syntax_16",     "frame",  PHOTON_COLOR_16,   _setup_frames, _run_syntax, NULL, 0, 1 },
+    { "quantize_256_cold",   "color",  PHOTON_COLOR_256,  _setup_colors_cold, _run_quantize, NULL, 0, 0 },
+    { "quantize_256_hot",    "color",  PHOTON_COLOR_256,  _setup_colors_hot, _run_quantize, NULL, 0, 0 },
+    { "quantize_16_cold",    "color",  PHOTON_COLOR_16,   _setup_colors_cold, _run_quantize, NULL, 0, 0 },
+    { "quantize_16_hot",     "color",  PHOTON_COLOR_16,   _setup_colors_hot, _run_quantize, NULL, 0, 0 },
+    { "load_file",           "load",   PHOTON_COLOR_TRUE, _write_file, _run_load, NULL, 0, 0 },
+    { "load_log",            "load",   PHOTON_COLOR_TRUE, _write_dump, _run_load_log, NULL, 0, 0 },
+    { "load_log_dedup",      "load",   PHOTON_COLOR_TRUE, _write_dump, _run_load_log_dedup, NULL, 0, 0 },
+    { "bulk_insert",         "paste",  PHOTON_COLOR_TRUE, _setup_buffer, _run_insert, _teardown_buffer, 0, 0 },
+    { "pack_text",           "pack",   PHOTON_COLOR_TRUE, _setup_buffer, _run_pack, _teardown_buffer, 0, 0 },
+    { "complete_index",      "index",  PHOTON_COLOR_TRUE, _setup_buffer, _run_complete_index, _teardown_buffer, 0, 0 },
+    { "complete_query",      "query",  PHOTON_COLOR_TRUE, _setup_complete, _run_complete_query, _teardown_buffer, 0, 0 },
+    { "complete_key",        "key",    PHOTON_COLOR_TRUE, _setup_complete, _run_complete_key, _teardown_buffer, 0, 0 },
+    { "nest_match",          "match",  PHOTON_COLOR_TRUE, _setup_nest, _run_nest_match, _teardown_buffer, 0, 0 },
+    { "highlight_key",       "key",    PHOTON_COLOR_TRUE, _setup_highlight, _run_type_key, _teardown_buffer, 0, 1 },
+    { "highlight_comment",   "key",    PHOTON_COLOR_TRUE, _setup_highlight, _run_type_comment, _teardown_buffer, 0, 1 },
+    { "split_key",           "key",    PHOTON_COLOR_TRUE, _setup_split, _run_split_key, _teardown_split, 0, 1 },
+    { "multi_cursor_rename", "rename", PHOTON_COLOR_TRUE, _setup_rename, _run_rename, _teardown_buffer, 0, 0 },
+    { "journal_key",         "key",    PHOTON_COLOR_TRUE, _setup_journal, _run_journal_key, _teardown_buffer, 0, 0 },
+    { "follow_log",          "frame",  PHOTON_COLOR_TRUE, _setup_follow, _run_follow, _teardown_follow, 0, 1 },
+    { "search_text",         "scan",   PHOTON_COLOR_TRUE, NULL, _run_search_text, NULL, 0, 0 },
+    { "search_buffer",       "scan",   PHOTON_COLOR_TRUE, _setup_scroll, _run_search_buffer, _teardown_buffer, 0, 0 },
+    { "search_regex",        "scan",   PHOTON_COLOR_TRUE, _setup_scroll, _run_search_regex, _teardown_buffer, 0, 0, _verify_regex },
+    { "search_regex_class",  "scan",   PHOTON_COLOR_TRUE, _setup_scroll, _run_search_regex_class, _teardown_buffer, 0, 0 },
+    { "grep_text",           "tree",   PHOTON_COLOR_TRUE, _write_tree, _run_grep_text, NULL, 0, 0 },
+    { "grep_regex",          "tree",   PHOTON_COLOR_TRUE, _write_tree, _run_grep_regex, NULL, 0, 0 },
+};
+#define NUM_BENCHES (sizeof(benches) / sizeof(benches[0]))
+
+typedef struct result {
+    long ops;
+    double ns_median, ns_min;
+    double bytes, writes, allocs, alloc_bytes; // per op
+    int mismatches;
+} result_t;
+
+static int _cmp_double(const void *a, const void *b){
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double _time_run(bench_t *b, long ops){
+    if (b->setup) b->setup();
+    double start = _now_ns();
+    b->run(ops);
+    double ns = _now_ns() - start;
+    if (b->teardown) b->teardown();
+    return ns;
+}
+
+static void _measure(bench_t *b, result_t *r){
+    photon_ui_set_color_mode(b->color_mode);
+    // find how many ops fill a run, the first one also warms things up
+    long ops = 1;
+    double ns;
+    while ((ns = _time_run(b, ops)) < 5e6 && ops < (1l << 30))
+        ops <<= 1;
+    double perRun = opt.min_ms * 1e6 / opt.runs;
+    ops = (long)(ops * perRun / ns);
+    if (ops < 1) ops = 1;
+
+    double *samples = malloc(opt.runs * sizeof(double));
+    size_t bytes = 0, writes = 0;
+#if BENCH_COUNT_ALLOCS
+    size_t a = 0, ab = 0;
+#endif
+    for (int i = 0; i < opt.runs; i++){
+        if (b->setup) b->setup();
+        out_bytes = out_writes = 0;
+#if BENCH_COUNT_ALLOCS
+        size_t a0 = atomic_load(&allocs);
+        size_t ab0 = atomic_load(&alloc_bytes);
+#endif
+        double start = _now_ns();
+        b->run(ops);
+        samples[i] = (_now_ns() - start) / ops;
+#if BENCH_COUNT_ALLOCS
+        a += atomic_load(&allocs) - a0;
+        ab += atomic_load(&alloc_bytes) - ab0;
+#endif
+        bytes += out_bytes;
+        writes += out_writes;
+        if (b->teardown) b->teardown();
+    }
+    qsort(samples, opt.runs, sizeof(double), _cmp_double);
+    double total = (double)ops * opt.runs;
+    r->ops = ops;
+    r->ns_min = samples[0];
+    r->ns_median = samples[opt.runs / 2];
+    r->bytes = b->frames ? bytes / total : (double)b->op_bytes;
+    r->writes = writes / total;
+#if BENCH_COUNT_ALLOCS
+    r->allocs = a / total;
+    r->alloc_bytes = ab / total;
+#else
+    r->allocs = r->alloc_bytes = -1;
+#endif
+    r->mismatches = -1;
+    if (opt.verify && b->frames){
+        int y, x;
+        r->mismatches = photon_headless_check(&y, &x);
+    } else if (opt.verify && b->verify)
+        r->mismatches = b->verify();
+    free(samples);
+}
+
+static const char *color_names[] = { "none", "16", "256", "true" };
+
+static void _print_json(bench_t *b, result_t *r, int first){
+    printf("%s\n    {\"name\": \"%s\", \"unit\": \"%s\", \"color\": \"%s\", \"ops\": %ld, "
+           "\"ns_per_op\": %.1f, \"ns_per_op_min\": %.1f, \"bytes_per_op\": %.1f, \"writes_per_op\": %.2f",
+           first ? "" : ",", b->name, b->unit, color_names[b->color_mode], r->ops * opt.runs,
+           r->ns_median, r->ns_min, r->bytes, r->writes);
+    if (r->allocs >= 0)
+        printf(", \"allocs_per_op\": %.2f, \"alloc_bytes_per_op\": %.1f", r->allocs, r->alloc_bytes);
+    else
+        printf(", \"allocs_per_op\": null, \"alloc_bytes_per_op\": null");
+    if (r->mismatches >= 0)
+        printf(", \"mismatches\": %d", r->mismatches);
+    printf("}");
+}
+
+static void _print_row(bench_t *b, result_t *r){
+    printf("%-20s %12.1f ns/%-5s %10.1f B %8.2f writes", b->name, r->ns_median, b->unit, r->bytes, r->writes);
+    if (r->allocs >= 0)
+        printf(" %8.2f allocs %10.1f B alloc", r->allocs, r->alloc_bytes);
+    if (r->mismatches >= 0)
+        printf("  %s", r->mismatches ? "MISMATCH" : "ok");
+    printf("\n");
+}
+
+static void _usage(const char *argv0){
+    fprintf(stderr,
+        "usage: %s [options] [filter]\n"
+        "  --json         print results as json\n"
+        "  --verify       run frames through the vt emulator and check the screen (slower),\n"
+        "                 and regexes against the matches perl gives\n"
+        "  --runs N       timed runs per benchmark, the median is reported (default %d)\n"
+        "  --time MS      total time per benchmark (default %.0f)\n"
+        "  --lines N      lines of generated source (default %zu)\n"
+        "  --size RxC     terminal size (default %dx%d)\n"
+        "  filter         only run benchmarks whose name contains it\n",
+        argv0, opt.runs, opt.min_ms, opt.lines, opt.rows, opt.cols);
+}
+
+int main(int argc, char **argv){
+    for (int i = 1; i < argc; i++){
+        const char *a = argv[i];
+        const char *v = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!strcmp(a, "--json")) opt.json = 1;
+        else if (!strcmp(a, "--verify")) opt.verify = 1;
+        else if (!strcmp(a, "--runs") && v) { opt.runs = atoi(v); i++; }
+        else if (!strcmp(a, "--time") && v) { opt.min_ms = atof(v); i++; }
+        else if (!strcmp(a, "--lines") && v) { opt.lines = strtoul(v, NULL, 10); i++; }
+        else if (!strcmp(a, "--size") && v) { sscanf(v, "%dx%d", &opt.rows, &opt.cols); i++; }
+        else if (a[0] != '-') opt.filter = a;
+        else {
+            _usage(argv[0]);
+            return a[1] == 'h' || !strcmp(a, "--help") ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (opt.runs < 1 || opt.rows < 1 || opt.cols < 1 || opt.lines < (size_t)opt.rows + PASTE_LINES){
+        _usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // to see what tracing costs
+    const char *tracePath = getenv("PHOTON_TRACE");
+    if (tracePath)
+        photon_trace_start(tracePath);
+
+    photon_ui_set_backend(&bench_sink);
+    if (!photon_ui_init(&editor)){
+        fprintf(stderr, "photon_bench: %s\n", photon_editor_error_msg(&editor));
+        return EXIT_FAILURE;
+    }
+    photon_editor_init(&editor);
+    _gen_source(opt.lines);
+    for (size_t i = 0; i < NUM_BENCHES; i++){
+        if (!strcmp(benches[i].name, "load_file"))
+            benches[i].op_bytes = src_len;
+        else if (!strncmp(benches[i].name, "load_log", 8) && (!opt.filter || strstr(benches[i].name, opt.filter))){
+            // its size is only known once it's written
+            _write_dump();
+            benches[i].op_bytes = dump_len;
+        }
+        else if (!strncmp(benches[i].name, "search_", 7) || !strncmp(benches[i].name, "grep_", 5))
+            benches[i].op_bytes = src_len;
+        else if (!strcmp(benches[i].name, "pack_text") || !strcmp(benches[i].name, "complete_index"))
+            benches[i].op_bytes = src_len;
+        else if (!strcmp(benches[i].name, "bulk_insert"))
+            benches[i].op_bytes = _paste_len();
+    }
+
+    if (opt.json)
+        printf("{\"rows\": %d, \"cols\": %d, \"lines\": %zu, \"verify\": %s, \"results\": [",
+               opt.rows, opt.cols, opt.lines, opt.verify ? "true" : "false");
+    int first = 1, failed = 0;
+    for (size_t i = 0; i < NUM_BENCHES; i++){
+        bench_t *b = &benches[i];
+        if (opt.filter && !strstr(b->name, opt.filter)) continue;
+        result_t r;
+        _measure(b, &r);
+        if (r.mismatches > 0) failed = 1;
+        if (opt.json)
+            _print_json(b, &r, first);
+        else
+            _print_row(b, &r);
+        fflush(stdout);
+        first = 0;
+    }
+    if (opt.json)
+        printf("\n]}\n");
+
+    if (file_path[0])
+        unlink(file_path);
+    if (dump_path[0])
+        unlink(dump_path);
+    if (tree_path[0])
+        _remove_tree();
+    photon_editor_cleanup(&editor);
+    photon_trace_stop();
+    photon_ui_end();
+    _free_source();
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
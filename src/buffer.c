@@ -2,34 +2,80 @@
 #include "ui.h"
 #include "photon.h"
 #include "extensions.h"
+#include "line_alloc.h"
+#include "highlight.h"
+#include "search.h"
+#include "grep.h"
+#include "follow.h"
+#include "wrap.h"
+#include "undo.h"
+#include "cursors.h"
+#include "journal.h"
+#include "handles.h"
+#include "pack.h"
+#include "complete.h"
+#include "nest.h"
+#include "fold.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #define err_and_ret(edit, err, val) edit->error = err; return val;
 
 extern photon_buffer_t *ctx;
 
-#define GROUP_SIZE 16
-
-typedef struct alloc_group {
-    void *ptrs[GROUP_SIZE];
-    unsigned char n;
-    unsigned char fail;
-} alloc_group_t;
+// one draw per run of the same token kind
+static void _draw_highlighted(photon_editor_t *editor, const char *text, int length, const unsigned char *kinds){
+    int start = 0;
+    while (start < length){
+        int end = start + 1;
+        while (end < length && kinds[end] == kinds[start])
+            end++;
+        const photon_theme_attr_t *attr = &editor->theme.syntax[kinds[start] < PHOTON_TOK_COUNT ? kinds[start] : 0];
+        editor->ui_hints.fg = attr->fg;
+        editor->ui_hints.style = attr->style;
+        photon_draw_nstr(editor, text + start, end - start);
+        start = end;
+    }
+    editor->ui_hints = editor->theme.normal;
+}
 
-void *group_alloc(alloc_group_t *group, size_t n, int zero){
-    if (group->n >= GROUP_SIZE) return NULL;
-    void *p = zero ? calloc(n, 1) : malloc(n);
-    if (p != NULL)
-        group->ptrs[group->n++] = p;
-    else
-        group->fail = 1;
-    return p;
+// search matches in the row of line i from off to off + n (drawn at row y) get the match
+// background, the cursor's one stands out
+static void _draw_matches(photon_editor_t *editor, photon_buffer_t *buf, size_t i, size_t off, size_t n, int y){
+    size_t count;
+    const photon_match_t *m = photon_search_range(buf, i, i + 1, &count);
+    for (size_t k = 0; k < count; k++){
+        size_t start = m[k].col, end = start + m[k].length;
+        if (end <= off || start >= off + n) continue;
+        start = start > off ? start : off;
+        end = end < off + n ? end : off + n;
+        int current = m[k].line == buf->_gap.line && (size_t)m[k].col == buf->_gap.col;
+        editor->ui_hints = current ? editor->theme.current_match : editor->theme.match;
+        photon_move_ui_cursor(y, buf->x + (int)(start - off));
+        photon_draw_box(editor, 1, (int)(end - start));
+    }
+    editor->ui_hints = editor->theme.normal;
 }
 
-void group_free(alloc_group_t *group){
-    for (int i = 0; i < group->n; i++)
-        free(group->ptrs);
+// how many lines are in there, after the end of the first one's last row if there's room
+static void _draw_fold(photon_editor_t *editor, photon_buffer_t *buf, const photon_fold_t *fold, size_t off, int y){
+    char marker[48];
+    int n = snprintf(marker, sizeof(marker), " ... %zu lines", fold->last - fold->first);
+    int x = (int)((size_t)buf->text->lines[fold->first].length - off);
+    if (n > buf->cols - x)
+        n = buf->cols - x;
+    if (n <= 0) return;
+    editor->ui_hints.fg = editor->theme.syntax[PHOTON_TOK_COMMENT].fg;
+    editor->ui_hints.style = editor->theme.syntax[PHOTON_TOK_COMMENT].style;
+    photon_move_ui_cursor(y, buf->x + x);
+    photon_draw_nstr(editor, marker, n);
+    editor->ui_hints = editor->theme.normal;
 }
 
 static void photon_draw_buf(const photon_api_t *api, photon_buffer_t *buf){
@@ -39,18 +85,89 @@ static void photon_draw_buf(const photon_api_t *api, photon_buffer_t *buf){
     editor->ui_hints = editor->theme.normal;
     photon_move_ui_cursor(buf->y, buf->x);
     photon_draw_box(editor, buf->rows, buf->cols);
-    int y = buf->y;
-    int i = buf->scroll;
-    while (y - buf->y < buf->rows){
-        if (i < buf->num_line) break;
-        photon_move_ui_cursor(y, buf->x);
-        photon_draw_str(editor, buf->lines[i].line);
-        photon_ui_cursor_loc(&y, NULL);
-        i++;
+    photon_pack_touch(buf->text);
+    photon_highlight_update(buf, buf->scroll + buf->rows + PHOTON_HL_LOOKAHEAD);
+    // one row at a time from the top of the view, only the part of a long line that's on
+    // screen is ever looked at
+    size_t width = buf->cols > 0 ? (size_t)buf->cols : 1;
+    size_t i = buf->scroll < 0 ? 0 : (size_t)buf->scroll;
+    size_t off = i < buf->text->num_line ? buf->scroll_off : 0;
+    if (i < buf->text->num_line && photon_fold_visible(buf, i) != i){
+        i = photon_fold_visible(buf, i); // folded away since
+        off = 0;
+    }
+    if (i < buf->text->num_line && off && off >= (size_t)buf->text->lines[i].length)
+        off = (photon_wrap_rows(buf, i) - 1) * width; // the line got shorter
+    off -= off % width; // or the width changed
+    // the folds from the top down, a line that has one goes on at the line after it
+    size_t num_fold;
+    const photon_fold_t *fold = photon_fold_from(buf, i, &num_fold);
+    for (int y = buf->y; y < buf->y + buf->rows && i < buf->text->num_line; i++, off = 0){
+        photon_line_t *line = &buf->text->lines[i];
+        const char *text = photon_line_str(line);
+        const unsigned char *kinds = photon_highlight_line(buf, i);
+        do {
+            size_t n = line->length - off < width ? line->length - off : width;
+            photon_move_ui_cursor(y, buf->x);
+            if (kinds)
+                _draw_highlighted(editor, text + off, (int)n, kinds + off);
+            else
+                photon_draw_nstr(editor, text + off, n);
+            if (buf->search)
+                _draw_matches(editor, buf, i, off, n, y);
+            if (buf->num_cursor)
+                photon_cursors_draw(editor, buf, i, off, y);
+            off += width;
+            y++;
+        } while (off < (size_t)line->length && y < buf->y + buf->rows);
+        if (num_fold && fold->first == i){
+            _draw_fold(editor, buf, fold, off - width, y - 1);
+            i = fold->last;
+            fold++;
+            num_fold--;
+        }
     }
     ctx = old_ctx;
 }
 
+// a new view of text that becomes the current buffer, NULL if there's no memory for it
+static photon_buffer_t *_view_new(photon_editor_t *editor, photon_text_t *text, const photon_buf_options_t *options, char type, const char *name){
+    photon_buffer_t *buf = malloc(sizeof(photon_buffer_t));
+    char *nameCopy = name ? strdup(name) : NULL;
+    if (!buf || (name && !nameCopy)){
+        free(buf);
+        free(nameCopy);
+        return NULL;
+    }
+    buf->x = options->x;
+    buf->y = options->y;
+    buf->rows = options->rows;
+    buf->cols = options->cols;
+    buf->scroll = 0;
+    buf->scroll_off = 0;
+    memset(&buf->_wrap, 0, sizeof(buf->_wrap));
+    memset(&buf->_fold, 0, sizeof(buf->_fold));
+    buf->type = type;
+    buf->name = nameCopy;
+    buf->draw = photon_draw_buf;
+    buf->userdata = NULL;
+    memset(&buf->_gap, 0, sizeof(buf->_gap));
+    buf->cursors = NULL;
+    buf->num_cursor = buf->cap_cursor = 0;
+    buf->search = NULL;
+    buf->follow = NULL;
+    if (!photon_handles_add(editor, buf)){
+        free(buf);
+        free(nameCopy);
+        return NULL;
+    }
+    buf->text = text;
+    buf->next_view = text->views;
+    text->views = buf;
+    editor->cur_buf = buf;
+    return buf;
+}
+
 photon_buffer_t *photon_create_buffer(photon_editor_t *editor, const photon_buf_options_t *options){
     const char *name = options->name;
     char type = options->type;
@@ -58,59 +175,744 @@ photon_buffer_t *photon_create_buffer(photon_editor_t *editor, const photon_buf_
         err_and_ret(editor, PHOTON_BAD_PARAM, NULL);
     }
 
-    alloc_group_t ag = {0};
-
-    photon_buffer_t *buf = group_alloc(&ag, sizeof(photon_buffer_t), 0);
-    photon_line_t *lines = group_alloc(&ag, 8 * sizeof(photon_line_t), 1);
-    char *emptyLine = group_alloc(&ag, 16, 0);
-    char *nameCopy = NULL;
-    size_t nameLen = 0;
-    if (name){
-        nameLen = strlen(name);
-        nameCopy = group_alloc(&ag, nameLen + 1, 0);
+    // the allocator rides along with the text
+    photon_text_t *text = malloc(sizeof(photon_text_t) + sizeof(photon_line_alloc_t));
+    photon_line_t *lines = calloc(8, sizeof(photon_line_t));
+    if (!text || !lines){
+        free(text);
+        free(lines);
+        err_and_ret(editor, PHOTON_NO_MEM, NULL);
     }
-    if (ag.fail){
-        group_free(&ag);
+    text->num_line = 1;
+    text->cap_line = 8;
+    text->lines = lines;
+    lines[0].capacity = PHOTON_LINE_SMALL;
+    text->alloc = (photon_line_alloc_t *)(text + 1);
+    photon_line_alloc_init(text->alloc);
+    memset(&text->_undo, 0, sizeof(text->_undo));
+    text->journal = NULL;
+    text->dedup_lines = text->dedup_bytes = 0;
+    text->pack = NULL;
+    photon_pack_touch(text);
+    text->_complete.words = NULL;
+    text->_complete.valid = 0;
+    memset(&text->_nest, 0, sizeof(text->_nest));
+    text->views = NULL;
+
+    photon_buffer_t *buf = _view_new(editor, text, options, type, name);
+    if (!buf){
+        free(lines);
+        free(text);
         err_and_ret(editor, PHOTON_NO_MEM, NULL);
     }
-    if (nameLen)
-        memcpy(nameCopy, name, nameLen + 1);
-    emptyLine[0] = 0;
-    
-    buf->x = options->x;
-    buf->y = options->y;
-    buf->rows = options->rows;
-    buf->cols = options->cols;
-    buf->next = editor->first_buf;
-    buf->prev = NULL;
-    buf->num_line = 1;
-    buf->cap_line = 8;
-    buf->lines = lines;
-    lines[0].line = emptyLine;
-    lines[0].capacity = 16;
-    buf->type = type;
-    buf->name = nameCopy;
-    buf->draw = photon_draw_buf;
-    buf->userdata = NULL;
-    editor->first_buf = buf;
+    photon_highlight_pick(editor, buf, type == BUF_FILE ? name : NULL);
     photon_trigger_hook(editor, PHOTON_HOOK_NEWBUF, (uintptr_t)buf);
     return buf;
 }
 
+photon_buffer_t *photon_buffer_split(photon_editor_t *editor, photon_buffer_t *buf, const photon_buf_options_t *options){
+    photon_buffer_t *view = _view_new(editor, buf->text, options, buf->type, buf->name);
+    if (!view){
+        err_and_ret(editor, PHOTON_NO_MEM, NULL);
+    }
+    // it starts out where the one it's split from is
+    view->scroll = buf->scroll;
+    view->scroll_off = buf->scroll_off;
+    view->_gap.line = buf->_gap.line;
+    view->_gap.col = buf->_gap.col;
+    photon_trigger_hook(editor, PHOTON_HOOK_NEWBUF, (uintptr_t)view);
+    return view;
+}
+
 void photon_delete_buffer(photon_editor_t *editor, photon_buffer_t *buffer){
-    if (buffer->prev == NULL){
-        editor->first_buf = buffer->next;
-        if (editor->first_buf)
-            editor->first_buf = NULL;
-    } else {
-        buffer->prev = buffer->next;
-        if (buffer->prev)
-            buffer->next->prev = buffer->prev;
-    }
-    for (int i = 0; i < buffer->num_line; i++){
-        free(buffer->lines[i].line);
-    }
-    free(buffer->lines);
+    photon_handles_remove(editor, buffer);
+    photon_text_t *text = buffer->text;
+    photon_buffer_t **link = &text->views;
+    while (*link != buffer)
+        link = &(*link)->next_view;
+    *link = buffer->next_view;
+    // another view of the same text if there is one
+    if (editor->cur_buf == buffer)
+        editor->cur_buf = text->views ? text->views : editor->num_buf ? editor->bufs[editor->num_buf - 1] : NULL;
+    photon_search_stop(buffer);
+    photon_grep_forget(editor, buffer);
+    photon_follow_stop(editor, buffer);
+    photon_wrap_free(buffer);
+    photon_fold_free(buffer);
+    photon_cursors_free(buffer);
+    if (!text->views){
+        photon_journal_stop(editor, buffer);
+        photon_undo_clear(buffer);
+        photon_complete_forget(editor, text);
+        photon_nest_free(text);
+        // line text is all in the allocator's chunks, or packed
+        photon_pack_free(text);
+        photon_line_alloc_destroy(text->alloc);
+        free(text->lines);
+        free(text);
+    }
     free(buffer->name);
     free(buffer);
 }
+
+static int _buf_reserve_lines(photon_buffer_t *buf, size_t n){
+    if (n <= buf->text->cap_line) return 1;
+    size_t newCap = buf->text->cap_line ? buf->text->cap_line : 8;
+    while (newCap < n)
+        newCap <<= 1;
+    photon_line_t *lines = realloc(buf->text->lines, newCap * sizeof(photon_line_t));
+    if (!lines) return 0;
+    buf->text->lines = lines;
+    buf->text->cap_line = newCap;
+    return 1;
+}
+
+// makes the line writable with room for n bytes + NUL, copying it out of shared storage if needed
+static int _line_reserve(photon_buffer_t *buf, photon_line_t *line, size_t n){
+    int cap;
+    if (line->capacity == PHOTON_LINE_SMALL){
+        if (n < PHOTON_LINE_INLINE) return 1;
+        char *p = photon_line_alloc(buf->text->alloc, n + 1, &cap);
+        if (!p) return 0;
+        memcpy(p, line->small, line->length + 1);
+        line->line = p;
+        line->capacity = cap;
+        return 1;
+    }
+    if (line->capacity > 0 && (size_t)line->capacity > n) return 1;
+    // shared text is copied out whole, an erase still reads what's past n
+    if (n < (size_t)line->length)
+        n = line->length;
+    if (line->capacity == 0 && n < PHOTON_LINE_INLINE){
+        // shared text that still fits moves inline, careful since line->line and small overlap
+        char tmp[PHOTON_LINE_INLINE];
+        memcpy(tmp, line->line, line->length + 1);
+        memcpy(line->small, tmp, line->length + 1);
+        line->capacity = PHOTON_LINE_SMALL;
+        return 1;
+    }
+    char *p = photon_line_realloc(buf->text->alloc, line->line, line->capacity, line->length + 1, n + 1, &cap);
+    if (!p) return 0;
+    line->line = p;
+    line->capacity = cap;
+    return 1;
+}
+
+// where line v ended up, lines first + 1 to first - delta are gone when delta is negative
+static size_t _shift(size_t v, size_t first, long delta){
+    if (v <= first) return v;
+    if (delta >= 0) return v + delta;
+    size_t gone = (size_t)-delta;
+    return v > first + gone ? v - gone : first;
+}
+
+// everything that indexes lines: lines first to last (after the edit) have new text
+// and the ones after moved by delta. every view of the text keeps its own layout and
+// matches, the other views only move when lines came or went above their top line
+static void _buf_edited(photon_buffer_t *buf, size_t first, size_t last, long delta){
+    photon_highlight_edit(buf, first, last, delta);
+    photon_complete_edit(buf->text, first, delta);
+    photon_nest_edit(buf->text, first, last, delta);
+    for (photon_buffer_t *view = buf->text->views; view; view = view->next_view){
+        photon_fold_edit(view, first, last, delta);
+        photon_wrap_edit(view, first, last, delta);
+        photon_search_edit(view, first, last, delta);
+        if (view == buf || !delta) continue;
+        if (view->scroll > 0 && (size_t)view->scroll > first)
+            view->scroll = (int)_shift(view->scroll, first, delta);
+        photon_cursors_edit(view, first, delta);
+    }
+}
+
+static int _line_set(photon_buffer_t *buf, photon_line_t *line, const char *str, size_t n){
+    line->hl_state = 0;
+    line->length = 0;
+    line->capacity = PHOTON_LINE_SMALL;
+    line->small[0] = 0;
+    if (!n) return 1;
+    if (!_line_reserve(buf, line, n)) return 0;
+    char *text = photon_line_str(line);
+    memcpy(text, str, n);
+    text[n] = 0;
+    line->length = (int)n;
+    return 1;
+}
+
+// bytes from line, col to endLine, endCol with a line break counting as one
+static size_t _span(const photon_buffer_t *buf, size_t line, size_t col, size_t endLine, size_t endCol){
+    if (line == endLine) return endCol - col;
+    size_t n = buf->text->lines[line].length - col + 1;
+    for (size_t i = line + 1; i < endLine; i++)
+        n += buf->text->lines[i].length + 1;
+    return n + endCol;
+}
+
+static void _copy_span(photon_buffer_t *buf, size_t line, size_t col, size_t endLine, size_t endCol, char *out){
+    for (; line < endLine; line++, col = 0){
+        size_t n = buf->text->lines[line].length - col;
+        memcpy(out, photon_line_str(&buf->text->lines[line]) + col, n);
+        out[n] = '\n';
+        out += n + 1;
+    }
+    memcpy(out, photon_line_str(&buf->text->lines[line]) + col, endCol - col);
+}
+
+// the long lines seen so far while loading with editor->dedup_lines, by their text
+typedef struct dedup_entry {
+    const char *from; // the first one in the file, NULL if the entry's empty
+    char *to;         // its copy in the arena, NULL until it's made
+    uint32_t len, hash;
+} dedup_entry_t;
+
+typedef struct dedup {
+    dedup_entry_t *entries;
+    size_t cap, num; // cap is a power of two
+} dedup_t;
+
+static uint32_t _line_hash(const char *p, size_t n){
+    uint64_t h = 0x9e3779b97f4a7c15ull ^ n, w;
+    for (; n >= 8; p += 8, n -= 8){
+        memcpy(&w, p, 8);
+        h = (h ^ w) * 0xff51afd7ed558ccdull;
+        h ^= h >> 29;
+    }
+    w = 0;
+    memcpy(&w, p, n);
+    h = (h ^ w) * 0xff51afd7ed558ccdull;
+    return (uint32_t)(h ^ h >> 32);
+}
+
+// the entry for that text, an empty one (from == NULL) where it goes if it isn't there
+static dedup_entry_t *_dedup_find(dedup_t *d, const char *p, size_t len, uint32_t hash){
+    size_t mask = d->cap - 1;
+    for (size_t at = hash & mask; ; at = (at + 1) & mask){
+        dedup_entry_t *e = &d->entries[at];
+        if (!e->from || (e->hash == hash && e->len == len && !memcmp(e->from, p, len)))
+            return e;
+    }
+}
+
+// 1 if the line is a copy of one before it, 0 if it's new, -1 if the table couldn't grow
+static int _dedup_add(dedup_t *d, const char *p, size_t len){
+    if ((d->num + 1) * 4 > d->cap * 3){
+        dedup_t bigger = { calloc(d->cap * 2, sizeof(dedup_entry_t)), d->cap * 2, d->num };
+        if (!bigger.entries) return -1;
+        for (size_t i = 0; i < d->cap; i++){
+            if (d->entries[i].from)
+                *_dedup_find(&bigger, d->entries[i].from, d->entries[i].len, d->entries[i].hash) = d->entries[i];
+        }
+        free(d->entries);
+        *d = bigger;
+    }
+    uint32_t hash = _line_hash(p, len);
+    dedup_entry_t *e = _dedup_find(d, p, len, hash);
+    if (e->from) return 1;
+    *e = (dedup_entry_t){ p, NULL, (uint32_t)len, hash };
+    d->num++;
+    return 0;
+}
+
+int photon_buffer_load_file(photon_editor_t *editor, photon_buffer_t *buf, const char *path){
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1){
+        if (fd != -1)
+            close(fd);
+        err_and_ret(editor, PHOTON_BAD_PARAM, 0);
+    }
+    size_t size = (size_t)st.st_size;
+    const char *text = "";
+    if (size){
+        text = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (text == MAP_FAILED){
+            close(fd);
+            err_and_ret(editor, PHOTON_NO_MEM, 0);
+        }
+        madvise((void *)text, size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+    const char *end = text + size;
+
+    // first pass counts lines and how much text is too long to live inline. the arena text
+    // is never written to (an edit copies the line out first), so with dedup_lines identical
+    // long lines can all point at one copy of it
+    dedup_t dedup = { NULL, 64, 0 };
+    if (editor->dedup_lines)
+        dedup.entries = calloc(dedup.cap, sizeof(dedup_entry_t));
+    size_t n = 0, spill = 0, dups = 0, dupBytes = 0;
+    const char *p = text, *nl;
+    do {
+        nl = memchr(p, '\n', end - p);
+        size_t len = (nl ? nl : end) - p;
+        if (len >= PHOTON_LINE_INLINE){
+            spill += len + 1;
+            int dup = dedup.entries ? _dedup_add(&dedup, p, len) : 0;
+            if (dup > 0){
+                dups++;
+                dupBytes += len + 1;
+            } else if (dup < 0){
+                // out of memory for the table, the rest of the lines get their own copies
+                free(dedup.entries);
+                dedup.entries = NULL;
+                dups = dupBytes = 0;
+            }
+        }
+        n++;
+        p += len + 1;
+    } while (nl && p < end);
+
+    spill -= dupBytes;
+    char *arena = spill ? photon_line_alloc_text(buf->text->alloc, spill) : NULL;
+    photon_line_t *lines = n > buf->text->cap_line ? realloc(buf->text->lines, n * sizeof(photon_line_t)) : buf->text->lines;
+    if ((spill && !arena) || !lines){
+        free(dedup.entries);
+        if (size)
+            munmap((void *)text, size);
+        err_and_ret(editor, PHOTON_NO_MEM, 0);
+    }
+    if (n > buf->text->cap_line){
+        buf->text->lines = lines;
+        buf->text->cap_line = n;
+    }
+    // the old lines are going, packed or not
+    photon_pack_free(buf->text);
+    photon_pack_touch(buf->text);
+    photon_complete_forget(editor, buf->text);
+    photon_nest_reset(buf->text);
+
+    p = text;
+    for (size_t i = 0; i < n; i++){
+        nl = memchr(p, '\n', end - p);
+        size_t len = (nl ? nl : end) - p;
+        photon_line_t *line = &lines[i];
+        line->length = (int)len;
+        if (len < PHOTON_LINE_INLINE){
+            // all of small in one go, that's cheaper than a copy of len bytes
+            memcpy(line->small, p, end - p >= PHOTON_LINE_INLINE ? PHOTON_LINE_INLINE : len);
+            line->small[len] = 0;
+            line->capacity = PHOTON_LINE_SMALL;
+        } else {
+            dedup_entry_t *e = dedup.entries ? _dedup_find(&dedup, p, len, _line_hash(p, len)) : NULL;
+            if (e && e->to){
+                line->line = e->to;
+            } else {
+                memcpy(arena, p, len);
+                arena[len] = 0;
+                line->line = arena;
+                arena += len + 1;
+                if (e)
+                    e->to = line->line;
+            }
+            line->capacity = 0;
+        }
+        p += len + 1;
+    }
+    free(dedup.entries);
+    buf->text->num_line = n;
+    buf->text->dedup_lines = dups;
+    buf->text->dedup_bytes = dupBytes;
+    if (size)
+        munmap((void *)text, size);
+    photon_highlight_pick(editor, buf, path);
+    // whatever was found is about text that's gone, in every view of it
+    for (photon_buffer_t *view = buf->text->views; view; view = view->next_view){
+        photon_search_stop(view);
+        photon_fold_clear(view);
+        photon_wrap_reset(view);
+        photon_cursors_clear(view);
+    }
+    photon_undo_clear(buf);
+    // it's a different text, the caller starts a journal for it if it wants one
+    photon_journal_stop(editor, buf);
+    return 1;
+}
+
+int photon_buffer_insert(photon_editor_t *editor, photon_buffer_t *buf, size_t lineNo, size_t col, const char *str, size_t n){
+    if (!photon_pack_thaw(buf->text)){
+        err_and_ret(editor, PHOTON_NO_MEM, 0);
+    }
+    if (lineNo >= buf->text->num_line || col > (size_t)buf->text->lines[lineNo].length){
+        err_and_ret(editor, PHOTON_BAD_PARAM, 0);
+    }
+    size_t newLines = 0;
+    for (const char *p = str; (p = memchr(p, '\n', str + n - p)); p++)
+        newLines++;
+    // undone by erasing what's inserted, a NULL step just clears the history
+    photon_undo_step_t *undo = photon_undo_step_new(1, 0);
+
+    photon_line_t *line = &buf->text->lines[lineNo];
+    if (!newLines){
+        if (!_line_reserve(buf, line, line->length + n)){
+            free(undo);
+            err_and_ret(editor, PHOTON_NO_MEM, 0);
+        }
+        // typing only changes the words around the cursor
+        int words = photon_complete_before(editor, buf->text, lineNo, lineNo);
+        if (words)
+            photon_complete_span(editor, buf->text, lineNo, col, col, -1);
+        char *text = photon_line_str(line);
+        memmove(text + col + n, text + col, line->length - col + 1);
+        memcpy(text + col, str, n);
+        line->length += (int)n;
+        _buf_edited(buf, lineNo, lineNo, 0);
+        if (words)
+            photon_complete_span(editor, buf->text, lineNo, col, col + n, 1);
+        if (undo)
+            undo->edits[0] = (photon_edit_t){ lineNo, col, lineNo, col + n, "", 0 };
+        photon_undo_push(buf, undo);
+        if (buf->text->journal)
+            photon_journal_record(buf, &(photon_edit_t){ lineNo, col, lineNo, col, str, n }, 1);
+        return 1;
+    }
+
+    if (!_buf_reserve_lines(buf, buf->text->num_line + newLines)){
+        free(undo);
+        err_and_ret(editor, PHOTON_NO_MEM, 0);
+    }
+    int words = photon_complete_before(editor, buf->text, lineNo, lineNo);
+    if (words)
+        photon_complete_lines(editor, buf->text, lineNo, lineNo, -1);
+    line = &buf->text->lines[lineNo];
+    memmove(&buf->text->lines[lineNo + 1 + newLines], &buf->text->lines[lineNo + 1], (buf->text->num_line - lineNo - 1) * sizeof(photon_line_t));
+    buf->text->num_line += newLines;
+    for (size_t i = 1; i <= newLines; i++)
+        _line_set(buf, &buf->text->lines[lineNo + i], NULL, 0);
+    // the old end of the line is now at the end of the last new one, so is its state
+    buf->text->lines[lineNo + newLines].hl_state = line->hl_state;
+    int ok = 0;
+
+    // the last new line gets the last piece of str followed by what was after the cursor
+    const char *lastPiece = str + n;
+    while (lastPiece[-1] != '\n')
+        lastPiece--;
+    size_t lastLen = str + n - lastPiece;
+    if (undo)
+        undo->edits[0] = (photon_edit_t){ lineNo, col, lineNo + newLines, lastLen, "", 0 };
+    size_t tailLen = line->length - col;
+    photon_line_t *last = &buf->text->lines[lineNo + newLines];
+    if (!_line_reserve(buf, last, lastLen + tailLen))
+        goto done;
+    char *lastText = photon_line_str(last);
+    memcpy(lastText, lastPiece, lastLen);
+    memcpy(lastText + lastLen, photon_line_str(line) + col, tailLen);
+    lastText[lastLen + tailLen] = 0;
+    last->length = (int)(lastLen + tailLen);
+
+    const char *piece = memchr(str, '\n', n);
+    size_t firstLen = piece - str;
+    if (!_line_reserve(buf, line, col + firstLen))
+        goto done;
+    char *text = photon_line_str(line);
+    memcpy(text + col, str, firstLen);
+    line->length = (int)(col + firstLen);
+    text[line->length] = 0;
+
+    for (size_t i = 1; i < newLines; i++){
+        const char *next = memchr(piece + 1, '\n', str + n - piece - 1);
+        if (!_line_set(buf, &buf->text->lines[lineNo + i], piece + 1, next - piece - 1))
+            goto done;
+        piece = next;
+    }
+    ok = 1;
+done:
+    // the lines moved even if it failed half way, there's no undoing that
+    _buf_edited(buf, lineNo, lineNo + newLines, (long)newLines);
+    if (words)
+        photon_complete_lines(editor, buf->text, lineNo, lineNo + newLines, 1);
+    if (!ok){
+        free(undo);
+        photon_undo_push(buf, NULL);
+        photon_journal_record(buf, NULL, 0);
+        err_and_ret(editor, PHOTON_NO_MEM, 0);
+    }
+    photon_undo_push(buf, undo);
+    if (buf->text->journal)
+        photon_journal_record(buf, &(photon_edit_t){ lineNo, col, lineNo, col, str, n }, 1);
+    return 1;
+}
+
+int photon_buffer_erase(photon_editor_t *editor, photon_buffer_t *buf, size_t lineNo, size_t col, size_t n){
+    if (!photon_pack_thaw(buf->text)){
+        err_and_ret(editor, PHOTON_NO_MEM, 0);
+    }
+    if (lineNo >= buf->text->num_line || col > (size_t)buf->text->lines[lineNo].length){
+        err_and_ret(editor, PHOTON_BAD_PARAM, 0);
+    }
+    // find where the erased range ends, a line break counts as one byte
+    size_t endLine = lineNo, endCol = col;
+    while (n){
+        size_t left = buf->text->lines[endLine].length - endCol;
+        if (n <= left){
+            endCol += n;
+            break;
+        }
+        if (endLine + 1 == buf->text->num_line){
+            endCol += left;
+            break;
+        }
+        n -= left + 1;
+        endLine++;
+        endCol = 0;
+    }
+
+    photon_line_t *line = &buf->text->lines[lineNo];
+    photon_line_t *end = &buf->text->lines[endLine];
+    size_t tailLen = end->length - endCol;
+    if (endLine == lineNo && endCol == col) return 1;
+    // undone by putting the text back
+    size_t bytes = _span(buf, lineNo, col, endLine, endCol);
+    photon_undo_step_t *undo = photon_undo_step_new(1, bytes);
+    if (undo){
+        char *saved = (char *)(undo->edits + 1);
+        _copy_span(buf, lineNo, col, endLine, endCol, saved);
+        undo->edits[0] = (photon_edit_t){ lineNo, col, lineNo, col, saved, bytes };
+    }
+    if (!_line_reserve(buf, line, col + tailLen)){
+        free(undo);
+        err_and_ret(editor, PHOTON_NO_MEM, 0);
+    }
+    int words = photon_complete_before(editor, buf->text, lineNo, endLine);
+    if (words && endLine == lineNo)
+        photon_complete_span(editor, buf->text, lineNo, col, endCol, -1);
+    else if (words)
+        photon_complete_lines(editor, buf->text, lineNo, endLine, -1);
+    end = &buf->text->lines[endLine];
+    char *text = photon_line_str(line);
+    memmove(text + col, photon_line_str(end) + endCol, tailLen);
+    line->length = (int)(col + tailLen);
+    text[line->length] = 0;
+
+    line->hl_state = end->hl_state;
+    if (endLine != lineNo){
+        for (size_t i = lineNo + 1; i <= endLine; i++)
+            photon_line_free(buf->text->alloc, buf->text->lines[i].line, buf->text->lines[i].capacity);
+        memmove(&buf->text->lines[lineNo + 1], &buf->text->lines[endLine + 1], (buf->text->num_line - endLine - 1) * sizeof(photon_line_t));
+        buf->text->num_line -= endLine - lineNo;
+    }
+    _buf_edited(buf, lineNo, lineNo, -(long)(endLine - lineNo));
+    if (words && endLine == lineNo)
+        photon_complete_span(editor, buf->text, lineNo, col, col, 1);
+    else if (words)
+        photon_complete_lines(editor, buf->text, lineNo, lineNo, 1);
+    photon_undo_push(buf, undo);
+    if (buf->text->journal)
+        photon_journal_record(buf, &(photon_edit_t){ lineNo, col, endLine, endCol, "", 0 }, 1);
+    return 1;
+}
+
+static int _pos_before(size_t line, size_t col, size_t line2, size_t col2){
+    return line < line2 || (line == line2 && col < col2);
+}
+
+static int _edit_valid(const photon_buffer_t *buf, const photon_edit_t *e){
+    return e->line < buf->text->num_line && e->col <= (size_t)buf->text->lines[e->line].length &&
+           e->end_line < buf->text->num_line && e->end_col <= (size_t)buf->text->lines[e->end_line].length &&
+           !_pos_before(e->end_line, e->end_col, e->line, e->col);
+}
+
+// the line being put together by photon_buffer_apply
+typedef struct line_build {
+    char *text;
+    size_t length, cap;
+} line_build_t;
+
+static int _build_add(line_build_t *b, const char *text, size_t n){
+    if (!n) return 1;
+    if (b->length + n > b->cap){
+        size_t cap = b->cap ? b->cap : 256;
+        while (cap < b->length + n)
+            cap <<= 1;
+        char *p = realloc(b->text, cap);
+        if (!p) return 0;
+        b->text = p;
+        b->cap = cap;
+    }
+    memcpy(b->text + b->length, text, n);
+    b->length += n;
+    return 1;
+}
+
+photon_undo_step_t *photon_buffer_apply(photon_editor_t *editor, photon_buffer_t *buf, const photon_edit_t *edits, size_t n){
+    if (!photon_pack_thaw(buf->text)){
+        err_and_ret(editor, PHOTON_NO_MEM, NULL);
+    }
+    // everything's checked and what goes is saved before anything changes
+    size_t bytes = 0;
+    long delta = 0;
+    for (size_t k = 0; k < n; k++){
+        const photon_edit_t *e = &edits[k];
+        if (!_edit_valid(buf, e) || (k && _pos_before(e->line, e->col, edits[k - 1].end_line, edits[k - 1].end_col))){
+            err_and_ret(editor, PHOTON_BAD_PARAM, NULL);
+        }
+        bytes += _span(buf, e->line, e->col, e->end_line, e->end_col);
+        for (const char *p = e->text; (p = memchr(p, '\n', e->text + e->length - p)); p++)
+            delta++;
+        delta -= (long)(e->end_line - e->line);
+    }
+    photon_undo_step_t *undo = photon_undo_step_new(n, bytes);
+    if (!undo){
+        err_and_ret(editor, PHOTON_NO_MEM, NULL);
+    }
+    char *saved = (char *)(undo->edits + n);
+    for (size_t k = 0; k < n; k++){
+        const photon_edit_t *e = &edits[k];
+        size_t len = _span(buf, e->line, e->col, e->end_line, e->end_col);
+        _copy_span(buf, e->line, e->col, e->end_line, e->end_col, saved);
+        undo->edits[k].text = saved;
+        undo->edits[k].length = len;
+        saved += len;
+    }
+    if (!n) return undo;
+
+    // lines first to oldLast are rebuilt into mid: the edited ones are put together a
+    // line at a time, the ones between edits only move
+    size_t first = edits[0].line, oldLast = edits[n - 1].end_line;
+    size_t count = (size_t)((long)(oldLast - first + 1) + delta);
+    photon_line_t *mid = malloc(count * (sizeof(photon_line_t) + 1));
+    if (!mid || !_buf_reserve_lines(buf, buf->text->num_line + (delta > 0 ? (size_t)delta : 0))){
+        free(mid);
+        free(undo);
+        err_and_ret(editor, PHOTON_NO_MEM, NULL);
+    }
+    char *made = (char *)(mid + count); // mid[i] is a new line, not one that moved
+    line_build_t cur = {0};
+    size_t line = first, at = 0, o = 0;
+#define FLUSH() \
+    do { \
+        if (!_line_set(buf, &mid[o], cur.text, cur.length)) goto fail; \
+        made[o++] = 1; \
+        cur.length = 0; \
+    } while (0)
+    for (size_t k = 0; k < n; k++){
+        const photon_edit_t *e = &edits[k];
+        photon_line_t *old = &buf->text->lines[line];
+        if (e->line > line){
+            // the rest of the line the last edit ended on, then the untouched ones
+            if (!_build_add(&cur, photon_line_str(old) + at, old->length - at))
+                goto fail;
+            FLUSH();
+            size_t untouched = e->line - line - 1;
+            memcpy(&mid[o], &buf->text->lines[line + 1], untouched * sizeof(photon_line_t));
+            memset(&made[o], 0, untouched);
+            o += untouched;
+            line = e->line;
+            at = 0;
+            old = &buf->text->lines[line];
+        }
+        if (!_build_add(&cur, photon_line_str(old) + at, e->col - at))
+            goto fail;
+        undo->edits[k].line = first + o;
+        undo->edits[k].col = cur.length;
+        const char *p = e->text, *end = e->text + e->length, *nl;
+        while ((nl = memchr(p, '\n', end - p))){
+            if (!_build_add(&cur, p, nl - p))
+                goto fail;
+            FLUSH();
+            p = nl + 1;
+        }
+        if (!_build_add(&cur, p, end - p))
+            goto fail;
+        undo->edits[k].end_line = first + o;
+        undo->edits[k].end_col = cur.length;
+        line = e->end_line;
+        at = e->end_col;
+    }
+    photon_line_t *old = &buf->text->lines[line];
+    if (!_build_add(&cur, photon_line_str(old) + at, old->length - at))
+        goto fail;
+    FLUSH();
+#undef FLUSH
+    // it ends like the old last line did, highlighting can stop early after it
+    mid[o - 1].hl_state = old->hl_state;
+
+    // the old text of every edited line goes, the untouched ones live on in mid (and keep
+    // their words in the index)
+    int words = photon_complete_before(editor, buf->text, first, oldLast);
+    size_t freed = first;
+    for (size_t k = 0; k < n; k++){
+        size_t from = freed > edits[k].line ? freed : edits[k].line;
+        if (words && from <= edits[k].end_line)
+            photon_complete_lines(editor, buf->text, from, edits[k].end_line, -1);
+        for (size_t i = from; i <= edits[k].end_line; i++)
+            photon_line_free(buf->text->alloc, buf->text->lines[i].line, buf->text->lines[i].capacity);
+        freed = edits[k].end_line + 1;
+    }
+    memmove(&buf->text->lines[first + count], &buf->text->lines[oldLast + 1], (buf->text->num_line - oldLast - 1) * sizeof(photon_line_t));
+    memcpy(&buf->text->lines[first], mid, count * sizeof(photon_line_t));
+    buf->text->num_line += delta;
+    free(cur.text);
+    _buf_edited(buf, first, first + count - 1, delta);
+    for (size_t i = 0; words && i < count; i++){
+        if (made[i])
+            photon_complete_lines(editor, buf->text, first + i, first + i, 1);
+    }
+    free(mid);
+    if (buf->text->journal)
+        photon_journal_record(buf, edits, n);
+    return undo;
+
+fail:
+    for (size_t i = 0; i < o; i++){
+        if (made[i])
+            photon_line_free(buf->text->alloc, mid[i].line, mid[i].capacity);
+    }
+    free(mid);
+    free(cur.text);
+    free(undo);
+    err_and_ret(editor, PHOTON_NO_MEM, NULL);
+}
+
+int photon_buffer_replace(photon_editor_t *editor, photon_buffer_t *buf, const photon_edit_t *edits, size_t n){
+    photon_undo_step_t *undo = photon_buffer_apply(editor, buf, edits, n);
+    if (!undo) return 0;
+    photon_cursors_place(buf, undo->edits, n, 0);
+    if (n)
+        photon_undo_push(buf, undo);
+    else
+        free(undo);
+    return 1;
+}
+
+typedef struct snapshot_block {
+    photon_snapshot_t snap;
+    atomic_int refs;
+} snapshot_block_t;
+
+photon_snapshot_t *photon_buffer_snapshot(photon_buffer_t *buffer){
+    size_t textLen = 0;
+    for (size_t i = 0; i < buffer->text->num_line; i++)
+        textLen += buffer->text->lines[i].length + 1;
+    // one allocation: header, offsets, then the text itself
+    size_t offLen = (buffer->text->num_line + 1) * sizeof(size_t);
+    snapshot_block_t *block = malloc(sizeof(snapshot_block_t) + offLen + textLen);
+    if (!block) return NULL;
+    size_t *offsets = (size_t *)(block + 1);
+    char *text = (char *)offsets + offLen;
+    size_t off = 0;
+    for (size_t i = 0; i < buffer->text->num_line; i++){
+        const photon_line_t *line = &buffer->text->lines[i];
+        offsets[i] = off;
+        memcpy(text + off, photon_line_str((photon_line_t *)line), line->length);
+        off += line->length;
+        text[off++] = 0;
+    }
+    offsets[buffer->text->num_line] = off;
+    block->snap.num_line = buffer->text->num_line;
+    block->snap.text = text;
+    block->snap.offsets = offsets;
+    atomic_init(&block->refs, 1);
+    return &block->snap;
+}
+
+photon_snapshot_t *photon_snapshot_retain(photon_snapshot_t *snapshot){
+    if (snapshot)
+        atomic_fetch_add(&((snapshot_block_t *)snapshot)->refs, 1);
+    return snapshot;
+}
+
+void photon_snapshot_release(photon_snapshot_t *snapshot){
+    if (!snapshot) return;
+    snapshot_block_t *block = (snapshot_block_t *)snapshot;
+    if (atomic_fetch_sub(&block->refs, 1) == 1)
+        free(block);
+}
@@ -1,11 +1,37 @@
 #ifndef __PHOTON_BUFFER_H__
 #define __PHOTON_BUFFER_H__
+#include <stddef.h>
 
 typedef struct photon_editor photon_editor_t;
 typedef struct photon_buffer photon_buffer_t;
 typedef struct photon_buf_options photon_buf_options_t;
+typedef struct photon_snapshot photon_snapshot_t;
+typedef struct photon_edit photon_edit_t;
 
 photon_buffer_t *photon_create_buffer(photon_editor_t *editor, const photon_buf_options_t *options);
+// another view of buf's text at options' place on screen (type and name are buf's), edits
+// made through either show in both. NULL and editor->error set on failure
+photon_buffer_t *photon_buffer_split(photon_editor_t *editor, photon_buffer_t *buf, const photon_buf_options_t *options);
+// the text goes with its last view. ids kept for it don't find anything from then on, and
+// if it was the current buffer another one (a view of the same text if there is one) is
 void photon_delete_buffer(photon_editor_t *editor, photon_buffer_t *buffer);
 
+// these return 0 and set editor->error on failure
+int photon_buffer_load_file(photon_editor_t *editor, photon_buffer_t *buf, const char *path);
+// str can contain newlines, the cursor position stays the same
+int photon_buffer_insert(photon_editor_t *editor, photon_buffer_t *buf, size_t line, size_t col, const char *str, size_t n);
+// erases n bytes forward, a line break counts as one
+int photon_buffer_erase(photon_editor_t *editor, photon_buffer_t *buf, size_t line, size_t col, size_t n);
+// edits sorted by position and not overlapping (one can start where the last one ended),
+// all made in a single pass over the lines and kept as one undo step. the cursors end up
+// after each edit's text. nothing changes on failure
+int photon_buffer_replace(photon_editor_t *editor, photon_buffer_t *buf, const photon_edit_t *edits, size_t n);
+// the same without the undo history or the cursors, returns the step that undoes it
+struct photon_undo_step *photon_buffer_apply(photon_editor_t *editor, photon_buffer_t *buf, const photon_edit_t *edits, size_t n);
+
+// snapshots are refcounted and can be released from any thread
+photon_snapshot_t *photon_buffer_snapshot(photon_buffer_t *buffer);
+photon_snapshot_t *photon_snapshot_retain(photon_snapshot_t *snapshot);
+void photon_snapshot_release(photon_snapshot_t *snapshot);
+
 #endif//__PHOTON_BUFFER_H__
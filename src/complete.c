@@ -0,0 +1,568 @@
+#include "complete.h"
+#include "photon.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NOT_SORTED UINT32_MAX
+// fresh words are looked through one by one, past this many they're merged in
+#define MAX_FRESH 1024
+// lines indexed between looks at the clock
+#define STEP_LINES 256
+
+typedef struct word {
+    uint32_t off;   // in chars, NUL terminated
+    uint32_t len;
+    uint32_t hash;
+    uint32_t count; // in every text
+    uint32_t pos;   // where it is in sorted, NOT_SORTED if it isn't
+    uint32_t fresh; // it's in fresh
+} word_t;
+
+typedef struct photon_complete {
+    word_t *words;
+    uint32_t num_word, cap_word;
+    uint32_t *table; // word + 1 by hash, 0 is empty. cap_table is a power of two
+    size_t cap_table;
+    char *chars;
+    size_t num_char, cap_char;
+    uint32_t *sorted; // the words with a count, in byte order
+    uint32_t num_sorted;
+    uint32_t *tree;   // max count over sorted, the leaves are from leaves on
+    size_t leaves;
+    uint32_t *fresh;  // words that got a count since sorted was made
+    uint32_t num_fresh, cap_fresh;
+} photon_complete_t;
+
+// a text's own counts, by word
+typedef struct photon_text_words {
+    uint32_t *ids; // word + 1, 0 is empty. cap is a power of two
+    uint32_t *counts;
+    size_t cap, num;
+} photon_text_words_t;
+
+static uint64_t _now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint32_t _hash(const char *p, size_t n){
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < n; i++)
+        h = (h ^ (unsigned char)p[i]) * 16777619u;
+    return h;
+}
+
+static int _word_char(unsigned char c){
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c >= 0x80;
+}
+
+static photon_complete_t *_index(photon_editor_t *editor){
+    if (!editor->complete)
+        editor->complete = calloc(1, sizeof(photon_complete_t));
+    return editor->complete;
+}
+
+static uint32_t _find(const photon_complete_t *c, const char *p, size_t n, uint32_t hash){
+    if (!c->cap_table) return NOT_SORTED;
+    size_t mask = c->cap_table - 1;
+    for (size_t at = hash & mask; c->table[at]; at = (at + 1) & mask){
+        const word_t *w = &c->words[c->table[at] - 1];
+        if (w->hash == hash && w->len == n && !memcmp(c->chars + w->off, p, n))
+            return c->table[at] - 1;
+    }
+    return NOT_SORTED;
+}
+
+static void _table_put(photon_complete_t *c, uint32_t id){
+    size_t mask = c->cap_table - 1, at = c->words[id].hash & mask;
+    while (c->table[at])
+        at = (at + 1) & mask;
+    c->table[at] = id + 1;
+}
+
+// the word's id, a new one if it's not there. NOT_SORTED if out of memory
+static uint32_t _intern(photon_complete_t *c, const char *p, size_t n, uint32_t hash){
+    uint32_t id = _find(c, p, n, hash);
+    if (id != NOT_SORTED) return id;
+    if ((size_t)(c->num_word + 1) * 4 > c->cap_table * 3){
+        size_t cap = c->cap_table ? c->cap_table * 2 : 1024;
+        uint32_t *table = calloc(cap, sizeof(uint32_t));
+        if (!table) return NOT_SORTED;
+        free(c->table);
+        c->table = table;
+        c->cap_table = cap;
+        for (uint32_t i = 0; i < c->num_word; i++)
+            _table_put(c, i);
+    }
+    if (c->num_word == c->cap_word){
+        if (c->cap_word >= UINT32_MAX / 2) return NOT_SORTED;
+        uint32_t cap = c->cap_word ? c->cap_word * 2 : 1024;
+        word_t *words = realloc(c->words, cap * sizeof(word_t));
+        if (!words) return NOT_SORTED;
+        c->words = words;
+        c->cap_word = cap;
+    }
+    if (c->num_char + n + 1 > c->cap_char){
+        size_t cap = c->cap_char ? c->cap_char : 16384;
+        while (cap < c->num_char + n + 1)
+            cap *= 2;
+        if (cap > UINT32_MAX) return NOT_SORTED;
+        char *chars = realloc(c->chars, cap);
+        if (!chars) return NOT_SORTED;
+        c->chars = chars;
+        c->cap_char = cap;
+    }
+    memcpy(c->chars + c->num_char, p, n);
+    c->chars[c->num_char + n] = 0;
+    id = c->num_word++;
+    c->words[id] = (word_t){ (uint32_t)c->num_char, (uint32_t)n, hash, 0, NOT_SORTED, 0 };
+    c->num_char += n + 1;
+    _table_put(c, id);
+    return id;
+}
+
+static void _count(photon_complete_t *c, uint32_t id, long delta){
+    word_t *w = &c->words[id];
+    w->count = (uint32_t)(w->count + delta);
+    if (w->pos != NOT_SORTED){
+        size_t i = c->leaves + w->pos;
+        c->tree[i] = w->count;
+        // up until a node that stays the same, then so does everything above it
+        for (i >>= 1; i; i >>= 1){
+            uint32_t max = c->tree[2 * i] > c->tree[2 * i + 1] ? c->tree[2 * i] : c->tree[2 * i + 1];
+            if (c->tree[i] == max) break;
+            c->tree[i] = max;
+        }
+    } else if (w->count && !w->fresh){
+        if (c->num_fresh == c->cap_fresh){
+            uint32_t cap = c->cap_fresh ? c->cap_fresh * 2 : 64;
+            uint32_t *fresh = realloc(c->fresh, cap * sizeof(uint32_t));
+            // it only shows up once sorted is made again
+            if (!fresh) return;
+            c->fresh = fresh;
+            c->cap_fresh = cap;
+        }
+        c->fresh[c->num_fresh++] = id;
+        w->fresh = 1;
+    }
+}
+
+// for qsort, which has no room for the index
+static const photon_complete_t *sorting;
+
+static int _cmp_words(const void *a, const void *b){
+    const word_t *x = &sorting->words[*(const uint32_t *)a], *y = &sorting->words[*(const uint32_t *)b];
+    return strcmp(sorting->chars + x->off, sorting->chars + y->off);
+}
+
+// sorted again with the fresh words in and the ones without a count out
+static int _merge(photon_complete_t *c){
+    sorting = c;
+    qsort(c->fresh, c->num_fresh, sizeof(uint32_t), &_cmp_words);
+    uint32_t *sorted = malloc(((size_t)c->num_sorted + c->num_fresh + 1) * sizeof(uint32_t));
+    size_t leaves = 1;
+    while (leaves < (size_t)c->num_sorted + c->num_fresh)
+        leaves <<= 1;
+    uint32_t *tree = calloc(2 * leaves, sizeof(uint32_t));
+    if (!sorted || !tree){
+        free(sorted);
+        free(tree);
+        return 0;
+    }
+    uint32_t n = 0, a = 0, b = 0;
+    while (a < c->num_sorted || b < c->num_fresh){
+        uint32_t id;
+        if (b == c->num_fresh || (a < c->num_sorted && _cmp_words(&c->sorted[a], &c->fresh[b]) < 0))
+            id = c->sorted[a++];
+        else
+            id = c->fresh[b++];
+        word_t *w = &c->words[id];
+        w->fresh = 0;
+        w->pos = NOT_SORTED;
+        if (!w->count) continue;
+        w->pos = n;
+        tree[leaves + n] = w->count;
+        sorted[n++] = id;
+    }
+    for (size_t i = leaves - 1; i; i--)
+        tree[i] = tree[2 * i] > tree[2 * i + 1] ? tree[2 * i] : tree[2 * i + 1];
+    free(c->sorted);
+    free(c->tree);
+    c->sorted = sorted;
+    c->num_sorted = n;
+    c->tree = tree;
+    c->leaves = leaves;
+    c->num_fresh = 0;
+    return 1;
+}
+
+static uint32_t *_text_slot(photon_text_words_t *tw, uint32_t id){
+    size_t mask = tw->cap - 1;
+    for (size_t at = (id * 2654435761u) & mask; ; at = (at + 1) & mask){
+        if (!tw->ids[at] || tw->ids[at] == id + 1)
+            return &tw->ids[at];
+    }
+}
+
+// the words nobody has any more go for good: the words, their chars and the table are
+// made again from the ones with a count, which get new ids, and the texts' counts are
+// made again with those. sorted has to be just merged. nothing changes if it's out of memory
+static int _compact(photon_editor_t *editor, photon_complete_t *c){
+    uint32_t live = 0;
+    size_t num_char = 0;
+    for (uint32_t i = 0; i < c->num_word; i++){
+        if (!c->words[i].count) continue;
+        live++;
+        num_char += c->words[i].len + 1;
+    }
+    size_t cap_table = 1024, cap_char = 16384;
+    while ((size_t)(live + 1) * 4 > cap_table * 3)
+        cap_table *= 2;
+    while (cap_char < num_char)
+        cap_char *= 2;
+    uint32_t cap_word = 1024;
+    while (cap_word < live)
+        cap_word *= 2;
+    uint32_t *map = malloc(c->num_word * sizeof(uint32_t));
+    word_t *words = malloc(cap_word * sizeof(word_t));
+    char *chars = malloc(cap_char);
+    uint32_t *table = calloc(cap_table, sizeof(uint32_t));
+    photon_text_words_t *texts = calloc(editor->num_buf, sizeof(photon_text_words_t));
+    int ok = map && words && chars && table && texts;
+    for (size_t i = 0; ok && i < editor->num_buf; i++){
+        photon_text_words_t *tw = editor->bufs[i]->text->_complete.words;
+        if (editor->bufs[i]->text->views != editor->bufs[i] || !tw) continue;
+        size_t num = 0, cap = 256;
+        for (size_t k = 0; k < tw->cap; k++)
+            num += tw->ids[k] && tw->counts[k];
+        while ((num + 1) * 4 > cap * 3)
+            cap *= 2;
+        texts[i] = (photon_text_words_t){ calloc(cap, sizeof(uint32_t)), calloc(cap, sizeof(uint32_t)), cap, num };
+        ok = texts[i].ids && texts[i].counts;
+    }
+    if (!ok){
+        for (size_t i = 0; texts && i < editor->num_buf; i++){
+            free(texts[i].ids);
+            free(texts[i].counts);
+        }
+        free(map);
+        free(words);
+        free(chars);
+        free(table);
+        free(texts);
+        return 0;
+    }
+
+    uint32_t n = 0;
+    size_t off = 0;
+    for (uint32_t i = 0; i < c->num_word; i++){
+        const word_t *w = &c->words[i];
+        map[i] = NOT_SORTED;
+        if (!w->count) continue;
+        memcpy(chars + off, c->chars + w->off, w->len + 1);
+        words[n] = *w;
+        words[n].off = (uint32_t)off;
+        off += w->len + 1;
+        map[i] = n++;
+    }
+    // every word in sorted has a count, it was just merged
+    for (uint32_t i = 0; i < c->num_sorted; i++)
+        c->sorted[i] = map[c->sorted[i]];
+    for (size_t i = 0; i < editor->num_buf; i++){
+        photon_text_words_t *tw = editor->bufs[i]->text->_complete.words;
+        if (!texts[i].cap) continue;
+        for (size_t k = 0; k < tw->cap; k++){
+            if (!tw->ids[k] || !tw->counts[k]) continue;
+            uint32_t *slot = _text_slot(&texts[i], map[tw->ids[k] - 1]);
+            *slot = map[tw->ids[k] - 1] + 1;
+            texts[i].counts[slot - texts[i].ids] = tw->counts[k];
+        }
+        free(tw->ids);
+        free(tw->counts);
+        *tw = texts[i];
+    }
+    free(c->words);
+    free(c->chars);
+    free(c->table);
+    c->words = words;
+    c->num_word = n;
+    c->cap_word = cap_word;
+    c->chars = chars;
+    c->num_char = off;
+    c->cap_char = cap_char;
+    c->table = table;
+    c->cap_table = cap_table;
+    for (uint32_t i = 0; i < n; i++)
+        _table_put(c, i);
+    free(map);
+    free(texts);
+    return 1;
+}
+
+// the text's count for the word, NULL if there's no memory for it
+static uint32_t *_text_count(photon_text_t *text, uint32_t id, int add){
+    photon_text_words_t *tw = text->_complete.words;
+    if (!tw){
+        if (!add || !(tw = text->_complete.words = calloc(1, sizeof(photon_text_words_t)))) return NULL;
+    }
+    if (add && (tw->num + 1) * 4 > tw->cap * 3){
+        size_t cap = tw->cap ? tw->cap * 2 : 256;
+        photon_text_words_t bigger = { calloc(cap, sizeof(uint32_t)), calloc(cap, sizeof(uint32_t)), cap, tw->num };
+        if (!bigger.ids || !bigger.counts){
+            free(bigger.ids);
+            free(bigger.counts);
+            return NULL;
+        }
+        for (size_t i = 0; i < tw->cap; i++){
+            if (!tw->ids[i]) continue;
+            uint32_t *slot = _text_slot(&bigger, tw->ids[i] - 1);
+            *slot = tw->ids[i];
+            bigger.counts[slot - bigger.ids] = tw->counts[i];
+        }
+        free(tw->ids);
+        free(tw->counts);
+        *tw = bigger;
+    }
+    if (!tw->cap) return NULL;
+    uint32_t *slot = _text_slot(tw, id);
+    if (!*slot){
+        if (!add) return NULL;
+        *slot = id + 1;
+        tw->num++;
+    }
+    return &tw->counts[slot - tw->ids];
+}
+
+static void _word(photon_complete_t *c, photon_text_t *text, const char *p, size_t n, int dir){
+    uint32_t hash = _hash(p, n);
+    uint32_t id = dir > 0 ? _intern(c, p, n, hash) : _find(c, p, n, hash);
+    if (id == NOT_SORTED) return;
+    uint32_t *count = _text_count(text, id, dir > 0);
+    // a word that couldn't be counted going in isn't taken out either
+    if (!count || (dir < 0 && !*count)) return;
+    *count += dir > 0 ? 1 : -1;
+    _count(c, id, dir > 0 ? 1 : -1);
+}
+
+// the words from s + at to s + n, at is where one starts
+static void _words(photon_complete_t *c, photon_text_t *text, const char *s, size_t at, size_t n, int dir){
+    while (at < n){
+        if (!_word_char(s[at])){
+            at++;
+            continue;
+        }
+        size_t start = at;
+        while (at < n && _word_char(s[at]))
+            at++;
+        size_t len = at - start;
+        if (len >= PHOTON_COMPLETE_MIN && len <= PHOTON_COMPLETE_MAX && !(s[start] >= '0' && s[start] <= '9'))
+            _word(c, text, s + start, len, dir);
+    }
+}
+
+void photon_complete_lines(photon_editor_t *editor, photon_text_t *text, size_t first, size_t last, int dir){
+    photon_complete_t *c = _index(editor);
+    if (!c) return;
+    for (size_t i = first; i <= last && i < text->num_line; i++)
+        _words(c, text, photon_line_str(&text->lines[i]), 0, text->lines[i].length, dir);
+}
+
+void photon_complete_span(photon_editor_t *editor, photon_text_t *text, size_t line, size_t from, size_t to, int dir){
+    photon_complete_t *c = _index(editor);
+    if (!c) return;
+    const char *s = photon_line_str(&text->lines[line]);
+    size_t n = text->lines[line].length;
+    while (from && _word_char(s[from - 1]))
+        from--;
+    while (to < n && _word_char(s[to]))
+        to++;
+    _words(c, text, s, from, to, dir);
+}
+
+int photon_complete_before(photon_editor_t *editor, photon_text_t *text, size_t first, size_t last){
+    size_t valid = text->_complete.valid;
+    if (first >= valid) return 0;
+    if (last < valid) return 1;
+    // the edit goes past what's indexed, where the lines after it end up is for the
+    // indexing to find out
+    photon_complete_lines(editor, text, first, valid - 1, -1);
+    text->_complete.valid = first;
+    return 0;
+}
+
+void photon_complete_edit(photon_text_t *text, size_t first, long delta){
+    if (text->_complete.valid > first)
+        text->_complete.valid += delta;
+}
+
+void photon_complete_forget(photon_editor_t *editor, photon_text_t *text){
+    photon_text_words_t *tw = text->_complete.words;
+    text->_complete.words = NULL;
+    text->_complete.valid = 0;
+    if (!tw) return;
+    for (size_t i = 0; i < tw->cap; i++){
+        if (tw->ids[i] && tw->counts[i])
+            _count(editor->complete, tw->ids[i] - 1, -(long)tw->counts[i]);
+    }
+    free(tw->ids);
+    free(tw->counts);
+    free(tw);
+}
+
+void photon_complete_step(photon_editor_t *editor, uint64_t budget_ns){
+    uint64_t until = _now_ns() + budget_ns;
+    for (size_t i = 0; i < editor->num_buf; i++){
+        photon_text_t *text = editor->bufs[i]->text;
+        if (text->views != editor->bufs[i]) continue;
+        while (text->_complete.valid < text->num_line){
+            size_t first = text->_complete.valid;
+            size_t last = first + STEP_LINES < text->num_line ? first + STEP_LINES : text->num_line;
+            photon_complete_lines(editor, text, first, last - 1, 1);
+            text->_complete.valid = last;
+            if (_now_ns() >= until) return;
+        }
+    }
+    photon_complete_t *c = editor->complete;
+    if (!c) return;
+    // words that lost their count are only dropped from sorted, once there's more of
+    // them than words that are left they go altogether. it's only ever done here, so the
+    // words a query gave out stay good until the next idle slice
+    uint32_t live = c->num_sorted + c->num_fresh;
+    if (c->num_word - live > live + MAX_FRESH){
+        if (_merge(c))
+            _compact(editor, c);
+    } else if (c->num_fresh > MAX_FRESH){
+        _merge(c);
+    }
+}
+
+int photon_complete_pending(const photon_editor_t *editor){
+    for (size_t i = 0; i < editor->num_buf; i++){
+        if (editor->bufs[i]->text->_complete.valid < editor->bufs[i]->text->num_line)
+            return 1;
+    }
+    return 0;
+}
+
+// tree nodes by their counts, biggest first
+typedef struct heap {
+    const uint32_t *tree;
+    size_t *nodes;
+    size_t len, cap;
+    size_t stack[256];
+} heap_t;
+
+// nodes without a count aren't worth keeping, and out of memory it's a few less words
+static void _heap_push(heap_t *h, size_t node){
+    if (!h->tree[node]) return;
+    if (h->len == h->cap){
+        size_t *nodes = malloc(2 * h->cap * sizeof(size_t));
+        if (!nodes) return;
+        memcpy(nodes, h->nodes, h->len * sizeof(size_t));
+        if (h->nodes != h->stack)
+            free(h->nodes);
+        h->nodes = nodes;
+        h->cap *= 2;
+    }
+    size_t at = h->len++;
+    for (; at && h->tree[h->nodes[(at - 1) / 2]] < h->tree[node]; at = (at - 1) / 2)
+        h->nodes[at] = h->nodes[(at - 1) / 2];
+    h->nodes[at] = node;
+}
+
+static size_t _heap_pop(heap_t *h){
+    size_t top = h->nodes[0], last = h->nodes[--h->len], at = 0;
+    for (;;){
+        size_t big = 2 * at + 1;
+        if (big >= h->len) break;
+        if (big + 1 < h->len && h->tree[h->nodes[big + 1]] > h->tree[h->nodes[big]])
+            big++;
+        if (h->tree[h->nodes[big]] <= h->tree[last]) break;
+        h->nodes[at] = h->nodes[big];
+        at = big;
+    }
+    h->nodes[at] = last;
+    return top;
+}
+
+// out has the num best so far, most frequent first
+static void _offer(const photon_complete_t *c, uint32_t id, photon_completion_t *out, size_t *num, size_t k){
+    const word_t *w = &c->words[id];
+    if (*num == k && w->count <= out[k - 1].count) return;
+    size_t i = *num < k ? (*num)++ : k - 1;
+    for (; i && out[i - 1].count < w->count; i--)
+        out[i] = out[i - 1];
+    out[i] = (photon_completion_t){ c->chars + w->off, w->len, w->count };
+}
+
+size_t photon_complete_query(photon_editor_t *editor, const char *prefix, size_t n, photon_completion_t *out, size_t k){
+    photon_complete_t *c = editor->complete;
+    if (!c || !k) return 0;
+    if (c->num_fresh > MAX_FRESH)
+        _merge(c);
+    // the words with the prefix are one run of sorted
+    size_t lo = 0, hi = c->num_sorted;
+    while (lo < hi){
+        size_t mid = (lo + hi) / 2;
+        if (strncmp(c->chars + c->words[c->sorted[mid]].off, prefix, n) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    size_t end = c->num_sorted;
+    hi = lo;
+    while (hi < end){
+        size_t mid = (hi + end) / 2;
+        if (strncmp(c->chars + c->words[c->sorted[mid]].off, prefix, n) <= 0)
+            hi = mid + 1;
+        else
+            end = mid;
+    }
+
+    // the tree nodes that cover lo to hi in a heap by their counts, then the biggest one is
+    // split until k leaves came out
+    heap_t heap;
+    heap.tree = c->tree;
+    heap.nodes = heap.stack;
+    heap.len = 0;
+    heap.cap = sizeof(heap.stack) / sizeof(heap.stack[0]);
+    size_t num = 0;
+    for (size_t l = lo + c->leaves, r = hi + c->leaves; l < r; l >>= 1, r >>= 1){
+        if (l & 1)
+            _heap_push(&heap, l++);
+        if (r & 1)
+            _heap_push(&heap, --r);
+    }
+    while (heap.len && num < k){
+        size_t node = _heap_pop(&heap);
+        if (node >= c->leaves){
+            _offer(c, c->sorted[node - c->leaves], out, &num, k);
+        } else {
+            _heap_push(&heap, 2 * node);
+            _heap_push(&heap, 2 * node + 1);
+        }
+    }
+    if (heap.nodes != heap.stack)
+        free(heap.nodes);
+    for (uint32_t i = 0; i < c->num_fresh; i++){
+        const word_t *w = &c->words[c->fresh[i]];
+        if (w->count && w->len >= n && !memcmp(c->chars + w->off, prefix, n))
+            _offer(c, c->fresh[i], out, &num, k);
+    }
+    return num;
+}
+
+void photon_complete_free(photon_editor_t *editor){
+    photon_complete_t *c = editor->complete;
+    if (!c) return;
+    free(c->words);
+    free(c->table);
+    free(c->chars);
+    free(c->sorted);
+    free(c->tree);
+    free(c->fresh);
+    free(c);
+    editor->complete = NULL;
+}
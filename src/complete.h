@@ -0,0 +1,49 @@
+#ifndef __COMPLETE_H__
+#define __COMPLETE_H__
+#include <stddef.h>
+#include <stdint.h>
+
+// word completion: every word (PHOTON_COMPLETE_MIN to PHOTON_COMPLETE_MAX bytes of
+// letters, digits, '_' and anything past ASCII, not starting with a digit) in every open
+// buffer is counted in one index. edits take the words of the lines they change out and
+// put the new ones in, a new or reloaded text is indexed while the editor is idle, from
+// the top down. each text also keeps its own counts, so closing it doesn't read it again.
+// the index is a hash of the words for counting plus the words in byte order with a max
+// tree over their counts, so the most frequent words with a prefix come out in
+// O(k log n). words that are new since the last time it was sorted are kept on the side
+// and looked through one by one until there's enough of them to be worth merging. words
+// that are nowhere any more (the prefixes of one that's being typed, say) are dropped
+// from the index while the editor is idle, once they outnumber the rest.
+
+typedef struct photon_editor photon_editor_t;
+typedef struct photon_text photon_text_t;
+typedef struct photon_completion photon_completion_t;
+
+#define PHOTON_COMPLETE_MIN 3
+#define PHOTON_COMPLETE_MAX 64
+
+// up to k of the most frequent words starting with prefix, fewer if there's not that many.
+// the words stay good until the next edit or idle slice. only what's been indexed so far is there
+size_t photon_complete_query(photon_editor_t *editor, const char *prefix, size_t n, photon_completion_t *out, size_t k);
+
+// the buffer calls this before an edit of (old) lines first to last, 1 if they're
+// indexed: then it takes the words of the ones that change out and puts the new ones in
+// with photon_complete_lines. if only some of them are, the text is indexed again from first
+int photon_complete_before(photon_editor_t *editor, photon_text_t *text, size_t first, size_t last);
+// the words of lines first to last go in (dir > 0) or out (dir < 0)
+void photon_complete_lines(photon_editor_t *editor, photon_text_t *text, size_t first, size_t last, int dir);
+// the same for only the words of line that touch from to to, enough for an edit within the
+// line: the words that don't are the same before and after
+void photon_complete_span(photon_editor_t *editor, photon_text_t *text, size_t line, size_t from, size_t to, int dir);
+// lines after first moved by delta
+void photon_complete_edit(photon_text_t *text, size_t first, long delta);
+// the text's words go, its lines are indexed again from the top
+void photon_complete_forget(photon_editor_t *editor, photon_text_t *text);
+
+// indexes what's left for at most budget_ns
+void photon_complete_step(photon_editor_t *editor, uint64_t budget_ns);
+// a text hasn't been indexed all the way
+int photon_complete_pending(const photon_editor_t *editor);
+void photon_complete_free(photon_editor_t *editor);
+
+#endif//__COMPLETE_H__
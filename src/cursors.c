@@ -0,0 +1,300 @@
+#include "cursors.h"
+#include "buffer.h"
+#include "search.h"
+#include "ui.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define err_and_ret(edit, err, val) edit->error = err; return val;
+
+typedef struct pos {
+    size_t line, col;
+} pos_t;
+
+static int _before(pos_t a, pos_t b){
+    return a.line < b.line || (a.line == b.line && a.col < b.col);
+}
+
+static pos_t _start(const photon_cursor_t *c){
+    pos_t p = { c->line, c->col }, a = { c->anchor_line, c->anchor_col };
+    return _before(a, p) ? a : p;
+}
+
+static pos_t _end(const photon_cursor_t *c){
+    pos_t p = { c->line, c->col }, a = { c->anchor_line, c->anchor_col };
+    return _before(a, p) ? p : a;
+}
+
+// the closest place that's in the buffer, edits made since may have taken it away
+static pos_t _clamp(const photon_buffer_t *buf, pos_t p){
+    if (p.line >= buf->text->num_line){
+        p.line = buf->text->num_line - 1;
+        p.col = SIZE_MAX;
+    }
+    if (p.col > (size_t)buf->text->lines[p.line].length)
+        p.col = buf->text->lines[p.line].length;
+    return p;
+}
+
+static int _reserve(photon_buffer_t *buf, size_t n){
+    if (n <= buf->cap_cursor) return 1;
+    size_t cap = buf->cap_cursor ? buf->cap_cursor : 8;
+    while (cap < n)
+        cap <<= 1;
+    photon_cursor_t *cursors = realloc(buf->cursors, cap * sizeof(photon_cursor_t));
+    if (!cursors) return 0;
+    buf->cursors = cursors;
+    buf->cap_cursor = cap;
+    return 1;
+}
+
+static void _sync_gap(photon_buffer_t *buf){
+    if (!buf->num_cursor) return;
+    buf->_gap.line = buf->cursors[0].line;
+    buf->_gap.col = buf->cursors[0].col;
+}
+
+// a covers from its start to the end of both, it's the one that moves
+static void _merge(photon_cursor_t *a, const photon_cursor_t *b){
+    pos_t s = _start(a), e = _end(a), be = _end(b);
+    if (_before(e, be))
+        e = be;
+    a->anchor_line = s.line;
+    a->anchor_col = s.col;
+    a->line = e.line;
+    a->col = e.col;
+}
+
+// b (starting no sooner) starts inside a, or they're in the same place and one of them
+// has nothing selected. selections that only touch stay apart
+static int _overlaps(const photon_cursor_t *a, const photon_cursor_t *b){
+    pos_t ae = _end(a), bs = _start(b);
+    if (_before(bs, ae)) return 1;
+    if (_before(ae, bs)) return 0;
+    return !_before(_start(a), ae) || !_before(bs, _end(b));
+}
+
+// merges whatever overlaps, from cursor i on
+static void _merge_from(photon_buffer_t *buf, size_t i){
+    size_t out = i;
+    for (size_t k = i + 1; k < buf->num_cursor; k++){
+        if (_overlaps(&buf->cursors[out], &buf->cursors[k]))
+            _merge(&buf->cursors[out], &buf->cursors[k]);
+        else
+            buf->cursors[++out] = buf->cursors[k];
+    }
+    if (buf->num_cursor)
+        buf->num_cursor = out + 1;
+}
+
+static int _add(photon_editor_t *editor, photon_buffer_t *buf, photon_cursor_t c){
+    if (c.line >= buf->text->num_line || c.col > (size_t)buf->text->lines[c.line].length ||
+        c.anchor_line >= buf->text->num_line || c.anchor_col > (size_t)buf->text->lines[c.anchor_line].length){
+        err_and_ret(editor, PHOTON_BAD_PARAM, 0);
+    }
+    if (!_reserve(buf, buf->num_cursor + 2)){
+        err_and_ret(editor, PHOTON_NO_MEM, 0);
+    }
+    if (!buf->num_cursor){
+        pos_t gap = _clamp(buf, (pos_t){ buf->_gap.line, buf->_gap.col });
+        buf->cursors[0] = (photon_cursor_t){ gap.line, gap.col, gap.line, gap.col };
+        buf->num_cursor = 1;
+    }
+    // goes after the ones starting before it
+    pos_t s = _start(&c);
+    size_t lo = 0, hi = buf->num_cursor;
+    while (lo < hi){
+        size_t mid = (lo + hi) / 2;
+        if (_before(s, _start(&buf->cursors[mid])))
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    memmove(&buf->cursors[lo + 1], &buf->cursors[lo], (buf->num_cursor - lo) * sizeof(photon_cursor_t));
+    buf->cursors[lo] = c;
+    buf->num_cursor++;
+    _merge_from(buf, lo ? lo - 1 : 0);
+    _sync_gap(buf);
+    return 1;
+}
+
+int photon_cursors_add(photon_editor_t *editor, photon_buffer_t *buf, size_t line, size_t col){
+    return _add(editor, buf, (photon_cursor_t){ line, col, line, col });
+}
+
+int photon_cursors_select(photon_editor_t *editor, photon_buffer_t *buf, size_t anchor_line, size_t anchor_col, size_t line, size_t col){
+    return _add(editor, buf, (photon_cursor_t){ line, col, anchor_line, anchor_col });
+}
+
+int photon_cursors_select_matches(photon_editor_t *editor, photon_buffer_t *buf){
+    if (!buf->search){
+        err_and_ret(editor, PHOTON_BAD_PARAM, 0);
+    }
+    while (photon_search_step(buf, 1000000000));
+    size_t n;
+    const photon_match_t *m = photon_search_range(buf, 0, buf->text->num_line, &n);
+    if (!n){
+        photon_cursors_clear(buf);
+        return 1;
+    }
+    if (!_reserve(buf, n)){
+        err_and_ret(editor, PHOTON_NO_MEM, 0);
+    }
+    // they're in order already, and matches don't overlap
+    for (size_t i = 0; i < n; i++)
+        buf->cursors[i] = (photon_cursor_t){ m[i].line, m[i].col + m[i].length, m[i].line, m[i].col };
+    buf->num_cursor = n;
+    _sync_gap(buf);
+    return 1;
+}
+
+void photon_cursors_clear(photon_buffer_t *buf){
+    buf->num_cursor = 0;
+}
+
+// n bytes on from p with a line break counting as one, as far as the buffer goes
+static pos_t _advance(const photon_buffer_t *buf, pos_t p, size_t n){
+    while (n){
+        size_t left = buf->text->lines[p.line].length - p.col;
+        if (n <= left || p.line + 1 == buf->text->num_line){
+            p.col += n < left ? n : left;
+            break;
+        }
+        n -= left + 1;
+        p.line++;
+        p.col = 0;
+    }
+    return p;
+}
+
+// every cursor as an edit that puts str over its selection, or over the n bytes after it
+static int _edit_all(photon_editor_t *editor, photon_buffer_t *buf, const char *str, size_t len, size_t n){
+    photon_cursor_t one = { buf->_gap.line, buf->_gap.col, buf->_gap.line, buf->_gap.col };
+    photon_cursor_t *cursors = &one;
+    size_t count = 1;
+    if (buf->num_cursor){
+        // edits since they were placed may have moved text out from under them
+        for (size_t i = 0; i < buf->num_cursor; i++){
+            photon_cursor_t *c = &buf->cursors[i];
+            pos_t p = _clamp(buf, (pos_t){ c->line, c->col }), a = _clamp(buf, (pos_t){ c->anchor_line, c->anchor_col });
+            *c = (photon_cursor_t){ p.line, p.col, a.line, a.col };
+        }
+        _merge_from(buf, 0);
+        cursors = buf->cursors;
+        count = buf->num_cursor;
+    } else {
+        pos_t p = _clamp(buf, (pos_t){ one.line, one.col });
+        one = (photon_cursor_t){ p.line, p.col, p.line, p.col };
+    }
+    photon_edit_t *edits = malloc(count * sizeof(photon_edit_t));
+    if (!edits){
+        err_and_ret(editor, PHOTON_NO_MEM, 0);
+    }
+    for (size_t i = 0; i < count; i++){
+        pos_t s = _start(&cursors[i]), e = _end(&cursors[i]);
+        if (n && s.line == e.line && s.col == e.col){
+            e = _advance(buf, s, n);
+            // up to the next one at most, they'd overlap otherwise
+            if (i + 1 < count && _before(_start(&cursors[i + 1]), e))
+                e = _start(&cursors[i + 1]);
+        }
+        edits[i] = (photon_edit_t){ s.line, s.col, e.line, e.col, str, len };
+    }
+    int ok = photon_buffer_replace(editor, buf, edits, count);
+    free(edits);
+    return ok;
+}
+
+int photon_cursors_insert(photon_editor_t *editor, photon_buffer_t *buf, const char *str, size_t n){
+    return _edit_all(editor, buf, str, n, 0);
+}
+
+int photon_cursors_erase(photon_editor_t *editor, photon_buffer_t *buf, size_t n){
+    return _edit_all(editor, buf, "", 0, n);
+}
+
+void photon_cursors_place(photon_buffer_t *buf, const photon_edit_t *edits, size_t n, int select){
+    if (!n) return;
+    if (n == 1 && (!select || (edits[0].line == edits[0].end_line && edits[0].col == edits[0].end_col))){
+        buf->num_cursor = 0;
+        buf->_gap.line = edits[0].end_line;
+        buf->_gap.col = edits[0].end_col;
+        return;
+    }
+    if (!_reserve(buf, n)){
+        // out of memory, there's still the one
+        buf->num_cursor = 0;
+        buf->_gap.line = edits[0].end_line;
+        buf->_gap.col = edits[0].end_col;
+        return;
+    }
+    for (size_t i = 0; i < n; i++){
+        const photon_edit_t *e = &edits[i];
+        buf->cursors[i] = select ? (photon_cursor_t){ e->end_line, e->end_col, e->line, e->col }
+                                 : (photon_cursor_t){ e->end_line, e->end_col, e->end_line, e->end_col };
+    }
+    buf->num_cursor = n;
+    // edits that touched can leave two in the same place
+    _merge_from(buf, 0);
+    _sync_gap(buf);
+}
+
+// where line v ended up, lines first + 1 to first - delta are gone when delta is negative
+static size_t _shift(size_t v, size_t first, long delta){
+    if (v <= first) return v;
+    if (delta >= 0) return v + delta;
+    size_t gone = (size_t)-delta;
+    return v > first + gone ? v - gone : first;
+}
+
+void photon_cursors_edit(photon_buffer_t *buf, size_t first, long delta){
+    buf->_gap.line = _shift(buf->_gap.line, first, delta);
+    // they're in order, nothing to do if the last one is before the edit
+    if (!buf->num_cursor || _end(&buf->cursors[buf->num_cursor - 1]).line <= first) return;
+    for (size_t i = 0; i < buf->num_cursor; i++){
+        photon_cursor_t *c = &buf->cursors[i];
+        c->line = _shift(c->line, first, delta);
+        c->anchor_line = _shift(c->anchor_line, first, delta);
+    }
+    // the ones on lines that went are all on first now
+    if (delta < 0)
+        _merge_from(buf, 0);
+    _sync_gap(buf);
+}
+
+void photon_cursors_free(photon_buffer_t *buf){
+    free(buf->cursors);
+    buf->cursors = NULL;
+    buf->num_cursor = buf->cap_cursor = 0;
+}
+
+void photon_cursors_draw(photon_editor_t *editor, photon_buffer_t *buf, size_t line, size_t off, int y){
+    size_t width = buf->cols > 0 ? (size_t)buf->cols : 1, length = buf->text->lines[line].length;
+    // the first one that doesn't end before the row
+    pos_t row = { line, off };
+    size_t lo = 0, hi = buf->num_cursor;
+    while (lo < hi){
+        size_t mid = (lo + hi) / 2;
+        if (_before(_end(&buf->cursors[mid]), row))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    editor->ui_hints = editor->theme.selection;
+    for (size_t k = lo; k < buf->num_cursor; k++){
+        pos_t s = _start(&buf->cursors[k]), e = _end(&buf->cursors[k]);
+        if (s.line > line || (s.line == line && s.col >= off + width)) break;
+        // a selected line break is the cell after the line, a cursor is the cell it's on
+        size_t from = s.line < line ? 0 : s.col;
+        size_t to = e.line > line ? length + 1 : e.col;
+        if (from == to)
+            to++;
+        from = from > off ? from : off;
+        to = to < off + width ? to : off + width;
+        if (from >= to) continue;
+        photon_move_ui_cursor(y, buf->x + (int)(from - off));
+        photon_draw_box(editor, 1, (int)(to - from));
+    }
+    editor->ui_hints = editor->theme.normal;
+}
@@ -0,0 +1,37 @@
+#ifndef __CURSORS_H__
+#define __CURSORS_H__
+#include <stddef.h>
+#include "photon.h"
+
+// multiple cursors: the one in buf->_gap is all there is until another one is added or
+// something is selected, then buf->cursors has every one of them in order (the first is
+// also in _gap) and none overlap. typing at all of them is one photon_buffer_replace: a
+// single pass over the lines, one undo step and one round of highlighting, wrapping and
+// search updates however many cursors there are.
+
+// returns 0 and sets editor->error on failure, PHOTON_BAD_PARAM if it's not in the buffer.
+// one that overlaps another merges with it
+int photon_cursors_add(photon_editor_t *editor, photon_buffer_t *buf, size_t line, size_t col);
+int photon_cursors_select(photon_editor_t *editor, photon_buffer_t *buf, size_t anchor_line, size_t anchor_col, size_t line, size_t col);
+// selects every match of the buffer's search (finishing it first), PHOTON_BAD_PARAM if
+// there's none going
+int photon_cursors_select_matches(photon_editor_t *editor, photon_buffer_t *buf);
+// back to just the one in _gap
+void photon_cursors_clear(photon_buffer_t *buf);
+
+// str replaces every selection and goes in at every other cursor, which all end up after it
+int photon_cursors_insert(photon_editor_t *editor, photon_buffer_t *buf, const char *str, size_t n);
+// erases the selections, and n bytes after the cursors without one
+int photon_cursors_erase(photon_editor_t *editor, photon_buffer_t *buf, size_t n);
+
+// a cursor at the end of each edit's range, selecting it if select is set. the buffer
+// calls this after a batch
+void photon_cursors_place(photon_buffer_t *buf, const photon_edit_t *edits, size_t n, int select);
+// another view of the text was edited: lines after first moved by delta (see
+// photon_highlight_edit), the cursors on them go along
+void photon_cursors_edit(photon_buffer_t *buf, size_t first, long delta);
+void photon_cursors_free(photon_buffer_t *buf);
+// the selections and cursors on the row of line that starts at off, drawn at y
+void photon_cursors_draw(photon_editor_t *editor, photon_buffer_t *buf, size_t line, size_t off, int y);
+
+#endif//__CURSORS_H__
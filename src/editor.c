@@ -0,0 +1,505 @@
+#include "editor.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+#include <time.h>
+#include "photon.h"
+#include "extensions.h"
+#include "input.h"
+#include "buffer.h"
+#include "ui.h"
+#include "pool.h"
+#include "trace.h"
+#include "highlight.h"
+#include "search.h"
+#include "grep.h"
+#include "follow.h"
+#include "wrap.h"
+#include "undo.h"
+#include "cursors.h"
+#include "pack.h"
+#include "complete.h"
+#include "nest.h"
+#include "fold.h"
+#include "journal.h"
+#include "handles.h"
+
+static const char *errorMessages[] = {
+    NULL,
+    "Invalid parameters",
+    "Not enough memory"
+};
+
+photon_buffer_t *ctx = NULL;
+
+static int predraw(photon_draw_req_t *req){
+    if (!ctx) return 1;
+    int y = req->y, x = req->x;
+    int p_y = ctx->y, p_x = ctx->x;
+    int rows = ctx->rows, cols = ctx->cols;
+    if (y < p_y || y - p_y >= rows) return 0;
+    if (x < p_x || x - p_x >= cols) return 0;
+    return 1;
+}
+
+static uint64_t _now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+#define OVERLAY_ROWS 9
+#define OVERLAY_COLS 40
+
+// top right corner, drawn last so it's on top of everything
+// K for the overlay, capped so a line can't run past it
+static unsigned _kb(size_t bytes){
+    return bytes >> 10 < 999999 ? (unsigned)(bytes >> 10) : 999999;
+}
+
+static void _draw_stats_overlay(photon_editor_t *editor){
+    const photon_frame_stats_t *avg = photon_ui_stats_average();
+    int w = photon_ui_width(), h = photon_ui_height();
+    if (w < OVERLAY_COLS || h < OVERLAY_ROWS) return;
+    photon_theme_attr_t hints = editor->ui_hints;
+    editor->ui_hints = (photon_theme_attr_t){ .bg = 0x3c3836, .fg = 0xfabd2f, .style = 0 };
+    int x = w - OVERLAY_COLS;
+    char line[OVERLAY_ROWS][OVERLAY_COLS + 1];
+    snprintf(line[0], sizeof(line[0]), " frame stats, avg of %d", PHOTON_STATS_WINDOW);
+    snprintf(line[1], sizeof(line[1]), " draw %7.1fus  pre_frame %7.1fus", avg->draw_ns / 1e3, avg->pre_frame_ns / 1e3);
+    snprintf(line[2], sizeof(line[2]), " diff %7.1fus  flush     %7.1fus", avg->diff_ns / 1e3, avg->flush_ns / 1e3);
+    snprintf(line[3], sizeof(line[3]), " cells %6u drawn %6u changed", avg->cells_drawn, avg->cells_changed);
+    snprintf(line[4], sizeof(line[4]), " out %7u B %5u seq %3u writes", avg->bytes, avg->sequences, avg->writes);
+    snprintf(line[5], sizeof(line[5]), " color %6u lookups %5u misses", avg->color_lookups, avg->color_misses);
+    photon_pack_stats_t pack = {0};
+    if (editor->cur_buf){
+        photon_pack_stats(editor->cur_buf, &pack);
+        snprintf(line[6], sizeof(line[6]), " text %6uK  dedup saved %6uK", _kb(pack.bytes), _kb(editor->cur_buf->text->dedup_bytes));
+        snprintf(line[7], sizeof(line[7]), " packed %6uK of %6uK, %5u out", _kb(pack.packed), _kb(pack.raw),
+                 pack.unpacked < 99999 ? (unsigned)pack.unpacked : 99999);
+    } else {
+        snprintf(line[6], sizeof(line[6]), " no buffer");
+        line[7][0] = 0;
+    }
+    if (pack.failed)
+        snprintf(line[8], sizeof(line[8]), " out of memory unpacking %5u times", pack.failed < 99999 ? (unsigned)pack.failed : 99999);
+    else
+        snprintf(line[8], sizeof(line[8]), " ^T to hide");
+    for (int i = 0; i < OVERLAY_ROWS; i++){
+        // pad it out, whatever was under the overlay has to go
+        size_t n = strlen(line[i]);
+        memset(line[i] + n, ' ', OVERLAY_COLS - n);
+        photon_move_ui_cursor(i, x);
+        photon_draw_nstr(editor, line[i], OVERLAY_COLS);
+    }
+    editor->ui_hints = hints;
+}
+
+// the bottom row while searching
+static void _draw_find_bar(photon_editor_t *editor){
+    photon_buffer_t *buf = editor->cur_buf;
+    int w = photon_ui_width(), h = photon_ui_height();
+    if (!buf || w < 1 || h < 1) return;
+    char right[64] = "";
+    if (editor->find.invalid)
+        snprintf(right, sizeof(right), "bad regex ");
+    if (buf->search){
+        int done;
+        size_t count = photon_search_count(buf, &done);
+        size_t n, rank = photon_search_rank(buf, buf->_gap.line, (int)buf->_gap.col);
+        const photon_match_t *m = photon_search_range(buf, buf->_gap.line, buf->_gap.line + 1, &n);
+        int onMatch = 0;
+        for (size_t i = 0; i < n && !onMatch; i++)
+            onMatch = (size_t)m[i].col == buf->_gap.col;
+        if (!done)
+            snprintf(right, sizeof(right), "%zu so far, searching ", count);
+        else if (onMatch)
+            snprintf(right, sizeof(right), "%zu/%zu ", rank + 1, count);
+        else
+            snprintf(right, sizeof(right), "%zu matches ", count);
+    }
+    char *line = malloc(w + 1);
+    if (!line) return;
+    memset(line, ' ', w);
+    line[w] = 0;
+    int n = snprintf(line, w + 1, " %s: %.*s%s", editor->find.regex ? "regex" : "find", editor->find.length,
+                     editor->find.pattern, editor->find.prompting ? "_" : "");
+    if (n < w)
+        line[n] = ' ';
+    int len = (int)strlen(right);
+    if (len < w)
+        memcpy(line + w - len, right, len);
+    photon_theme_attr_t hints = editor->ui_hints;
+    editor->ui_hints = (photon_theme_attr_t){ .bg = 0x3c3836, .fg = 0xebdbb2, .style = 0 };
+    photon_move_ui_cursor(h - 1, 0);
+    photon_draw_nstr(editor, line, w);
+    editor->ui_hints = hints;
+    free(line);
+}
+
+// every buffer searches for the pattern, the matches on screen are found right away
+static void _find_restart(photon_editor_t *editor){
+    int flags = editor->find.regex ? PHOTON_SEARCH_REGEX : 0;
+    editor->find.invalid = 0;
+    for (size_t i = 0; i < editor->num_buf; i++){
+        photon_buffer_t *buf = editor->bufs[i];
+        if (!photon_search_start(editor, buf, editor->find.pattern, editor->find.length, flags) && editor->error == PHOTON_BAD_PARAM)
+            editor->find.invalid = 1; // half typed, most likely
+    }
+}
+
+// the cursor to line, col, out of any fold it's in
+static void _jump(photon_buffer_t *buf, size_t line, size_t col){
+    photon_fold_reveal(buf, line);
+    buf->_gap.line = line;
+    buf->_gap.col = col;
+    // off screen, it goes in the middle
+    uint64_t row = photon_wrap_row(buf, line, col), top = photon_wrap_top(buf);
+    if (row < top || row >= top + buf->rows)
+        photon_wrap_set_top(buf, row > (uint64_t)buf->rows / 2 ? row - buf->rows / 2 : 0);
+}
+
+static void _find_jump(photon_editor_t *editor, int dir){
+    photon_buffer_t *buf = editor->cur_buf;
+    photon_match_t m;
+    if (!buf || !photon_search_next(buf, buf->_gap.line, (int)buf->_gap.col, dir, &m)){
+        putchar(7);
+        fflush(stdout);
+        return;
+    }
+    _jump(buf, m.line, m.col);
+}
+
+// ^]: over to the bracket matching the one under the cursor
+static void _bracket_jump(photon_editor_t *editor){
+    photon_buffer_t *buf = editor->cur_buf;
+    size_t line, col;
+    if (!buf || !photon_nest_match(buf, buf->_gap.line, buf->_gap.col, &line, &col)){
+        putchar(7);
+        fflush(stdout);
+        return;
+    }
+    _jump(buf, line, col);
+}
+
+// the pattern in every file under the working directory, the results buffer comes up with
+// the matches marked
+static void _find_grep(photon_editor_t *editor){
+    int flags = editor->find.regex ? PHOTON_SEARCH_REGEX : 0;
+    photon_buffer_t *buf;
+    if (!editor->find.length || !(buf = photon_grep_start(editor, ".", editor->find.pattern, editor->find.length, flags))){
+        putchar(7);
+        fflush(stdout);
+        return;
+    }
+    editor->find.prompting = 0;
+    photon_search_start(editor, buf, editor->find.pattern, editor->find.length, flags);
+}
+
+// returns 1 if the key went into the pattern
+static int _find_key(photon_editor_t *editor, int key){
+    if (key == '\r' || key == '\n' || key == 6){ // ^F again
+        editor->find.prompting = 0;
+        if (editor->find.length)
+            _find_jump(editor, 1);
+    } else if (key == 18){ // ^R
+        editor->find.regex ^= 1;
+        _find_restart(editor);
+    } else if (key == 7){ // ^G
+        _find_grep(editor);
+    } else if (key == 127 || key == 8){
+        if (editor->find.length){
+            editor->find.length--;
+            _find_restart(editor);
+        }
+    } else if (key >= ' ' && key < 127){
+        if (editor->find.length + 1 < (int)sizeof(editor->find.pattern)){
+            editor->find.pattern[editor->find.length++] = (char)key;
+            editor->find.pattern[editor->find.length] = 0;
+            _find_restart(editor);
+        }
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+// ^V: the current view splits in two side by side, the new one on the right. in a split
+// it goes instead and the view next to it gets its columns back
+static void _split(photon_editor_t *editor){
+    photon_buffer_t *buf = editor->cur_buf;
+    if (buf && (buf->text->views != buf || buf->next_view)){
+        for (photon_buffer_t *view = buf->text->views; view; view = view->next_view){
+            if (view == buf || view->y != buf->y || view->rows != buf->rows) continue;
+            if (view->x + view->cols + 1 == buf->x){
+                view->cols += buf->cols + 1;
+            } else if (buf->x + buf->cols + 1 == view->x){
+                view->x = buf->x;
+                view->cols += buf->cols + 1;
+            } else {
+                continue;
+            }
+            photon_delete_buffer(editor, buf);
+            editor->cur_buf = view;
+            return;
+        }
+    } else if (buf && buf->cols >= 3){
+        // a column between them for the bar
+        int left = (buf->cols - 1) / 2;
+        photon_buf_options_t options = { .x = buf->x + left + 1, .y = buf->y, .rows = buf->rows, .cols = buf->cols - left - 1 };
+        buf->cols = left;
+        if (photon_buffer_split(editor, buf, &options)) return;
+        buf->cols = left + 1 + options.cols;
+    }
+    putchar(7);
+    fflush(stdout);
+}
+
+// the current buffer and the other views of its text, with a bar left of the ones that
+// don't start at the left edge
+static void _draw_views(photon_editor_t *editor){
+    photon_buffer_t *cur = editor->cur_buf;
+    for (photon_buffer_t *view = cur->text->views; view; view = view->next_view){
+        if (view != cur)
+            view->draw(&editor->api, view);
+        if (view->x <= 0) continue;
+        for (int y = view->y; y < view->y + view->rows; y++){
+            photon_move_ui_cursor(y, view->x - 1);
+            photon_draw_nstr(editor, "|", 1);
+        }
+    }
+    cur->draw(&editor->api, cur);
+}
+
+void photon_editor_init(photon_editor_t *editor){
+    editor->api.editor = editor;
+    editor->api.buffer.create = &photon_create_buffer;
+    editor->api.buffer.delete = &photon_delete_buffer;
+    editor->api.buffer.split = &photon_buffer_split;
+    editor->api.buffer.get = &photon_buffer_get;
+    editor->api.buffer.find = &photon_buffer_find;
+    editor->api.buffer.insert = &photon_buffer_insert;
+    editor->api.buffer.erase = &photon_buffer_erase;
+    editor->api.ui.draw_str = &photon_draw_str;
+    editor->api.ui.draw_nstr = &photon_draw_nstr;
+    editor->api.ui.tint_line = &photon_tint_line;
+    editor->api.ui.width = photon_ui_width();
+    editor->api.ui.height = photon_ui_height();
+    editor->api.get_error_msg = &photon_editor_error_msg;
+    editor->api.jobs.submit = &photon_submit_job;
+    editor->api.stats.last = photon_ui_stats_last();
+    editor->api.stats.average = photon_ui_stats_average();
+    editor->api.highlight.add_grammar = &photon_add_grammar;
+    editor->api.highlight.set_grammar = &photon_set_grammar;
+    editor->api.search.start = &photon_search_start;
+    editor->api.search.next = &photon_search_next;
+    editor->api.search.count = &photon_search_count;
+    editor->api.grep.start = &photon_grep_start;
+    editor->api.grep.stop = &photon_grep_stop;
+    editor->api.follow.start = &photon_follow_start;
+    editor->api.follow.stop = &photon_follow_stop;
+    editor->api.edit.replace = &photon_buffer_replace;
+    editor->api.edit.undo = &photon_undo;
+    editor->api.edit.redo = &photon_redo;
+    editor->api.cursors.add = &photon_cursors_add;
+    editor->api.cursors.select = &photon_cursors_select;
+    editor->api.cursors.select_matches = &photon_cursors_select_matches;
+    editor->api.cursors.clear = &photon_cursors_clear;
+    editor->api.cursors.insert = &photon_cursors_insert;
+    editor->api.cursors.erase = &photon_cursors_erase;
+    editor->api.pack.stats = &photon_pack_stats;
+    editor->api.complete.query = &photon_complete_query;
+    editor->api.nest.depth = &photon_nest_depth;
+    editor->api.nest.match = &photon_nest_match;
+    editor->api.nest.block = &photon_nest_block;
+    editor->api.fold.toggle = &photon_fold_toggle;
+    editor->api.fold.from = &photon_fold_from;
+    editor->api.fold.clear = &photon_fold_clear;
+    editor->show_stats = getenv("PHOTON_STATS") != NULL;
+    editor->dedup_lines = getenv("PHOTON_DEDUP") != NULL;
+    // PHOTON_PACK_AFTER in seconds, PHOTON_MEM_BUDGET in MB
+    const char *after = getenv("PHOTON_PACK_AFTER"), *budget = getenv("PHOTON_MEM_BUDGET");
+    editor->pack.after = after ? atoi(after) : 60;
+    editor->pack.budget = budget ? (size_t)atol(budget) << 20 : 0;
+    editor->theme.normal = (photon_theme_attr_t){ .bg = 0x1c1c1c, .fg = 0xebdbb2, .style = 0 };
+    editor->theme.syntax[PHOTON_TOK_NORMAL] = (photon_theme_attr_t){ .fg = 0xebdbb2, .style = 0 };
+    editor->theme.syntax[PHOTON_TOK_KEYWORD] = (photon_theme_attr_t){ .fg = 0xfb4934, .style = 0 };
+    editor->theme.syntax[PHOTON_TOK_TYPE] = (photon_theme_attr_t){ .fg = 0xfabd2f, .style = 0 };
+    editor->theme.syntax[PHOTON_TOK_STRING] = (photon_theme_attr_t){ .fg = 0xb8bb26, .style = 0 };
+    editor->theme.syntax[PHOTON_TOK_NUMBER] = (photon_theme_attr_t){ .fg = 0xd3869b, .style = 0 };
+    editor->theme.syntax[PHOTON_TOK_COMMENT] = (photon_theme_attr_t){ .fg = 0x928374, .style = PHOTON_ITALIC };
+    editor->theme.syntax[PHOTON_TOK_PREPROC] = (photon_theme_attr_t){ .fg = 0x8ec07c, .style = 0 };
+    editor->theme.match = (photon_theme_attr_t){ .bg = 0x504945 };
+    editor->theme.current_match = (photon_theme_attr_t){ .bg = 0x7c6f64 };
+    editor->theme.selection = (photon_theme_attr_t){ .bg = 0x076678 };
+    editor->ui_hints = editor->theme.normal;
+    editor->pre_draw = &predraw;
+    // extensions can add more (or replace it) once they're loaded
+    photon_add_grammar(editor, &photon_grammar_c);
+    // not fatal, jobs.submit just fails without a pool
+    editor->pool = photon_pool_create(0);
+    editor->inotify = -1;
+    editor->api.jobs.workers = editor->pool ? photon_pool_size(editor->pool) : 0;
+}
+
+void photon_editor_draw(photon_editor_t *editor){
+    PHOTON_TRACE_BEGIN("editor.draw", 0, 0);
+    photon_drain_jobs(editor);
+    photon_grep_drain(editor);
+    photon_follow_poll(editor);
+    photon_frame_stats_t *stats = photon_ui_stats();
+    uint64_t start = _now_ns();
+    photon_ui_clear();
+    if (editor->cur_buf)
+        _draw_views(editor);
+    uint64_t drawEnd = _now_ns();
+    stats->draw_ns += drawEnd - start;
+    photon_extension_t *it = editor->first_ext;
+    while (it){
+        if (it->loaded && it->pre_frame){
+            photon_setup_api(editor, it);
+            it->pre_frame(&editor->api);
+        }
+        it = it->next;
+    }
+    stats->pre_frame_ns += _now_ns() - drawEnd;
+    if (editor->find.prompting || (editor->cur_buf && editor->cur_buf->search))
+        _draw_find_bar(editor);
+    if (editor->show_stats)
+        _draw_stats_overlay(editor);
+    PHOTON_TRACE_END("editor.draw");
+}
+
+void photon_handle_keypress(photon_editor_t *editor, int key){
+    if (key == PHOTON_INVALID_KEY) return;
+    PHOTON_TRACE("editor.key(key)", key, 0);
+    if (photon_trigger_hook(editor, PHOTON_HOOK_KEYPRESS, key)) return;
+    if (editor->find.prompting && _find_key(editor, key)) return;
+    if (key == 17){ // ^Q
+        editor->should_quit = 1;
+    } else if (key == 6) { // ^F
+        editor->find.prompting = 1;
+    } else if (key == 14 || key == 16) { // ^N, ^P
+        _find_jump(editor, key == 14 ? 1 : -1);
+    } else if (key == 23) { // ^W
+        photon_buffer_t *buf = editor->cur_buf;
+        if (buf && buf->follow)
+            photon_follow_stop(editor, buf);
+        else if (!buf || !photon_follow_start(editor, buf)){
+            putchar(7);
+            fflush(stdout);
+        }
+    } else if (key == 26 || key == 25) { // ^Z, ^Y
+        photon_buffer_t *buf = editor->cur_buf;
+        if (!buf || !(key == 26 ? photon_undo(editor, buf) : photon_redo(editor, buf))){
+            putchar(7);
+            fflush(stdout);
+        }
+    } else if (key == 22) { // ^V
+        _split(editor);
+    } else if (key == 11) { // ^K
+        photon_buffer_t *buf = editor->cur_buf;
+        if (!buf || !photon_fold_toggle(editor, buf, buf->_gap.line)){
+            putchar(7);
+            fflush(stdout);
+        }
+    } else if (key == 29) { // ^]
+        _bracket_jump(editor);
+    } else if (key == 15) { // ^O
+        // over to the next view of the text
+        photon_buffer_t *buf = editor->cur_buf;
+        if (buf && (buf->next_view || buf->text->views != buf))
+            editor->cur_buf = buf->next_view ? buf->next_view : buf->text->views;
+    } else if (key == 20) { // ^T
+        editor->show_stats = !editor->show_stats;
+    } else if (key == 7) { // ^G
+        putchar(7);
+        fflush(stdout);
+    }
+}
+
+// how long one idle slice can take, a key that comes in meanwhile waits at most this
+#define IDLE_SLICE_NS 4000000
+
+int photon_editor_busy(photon_editor_t *editor){
+    for (size_t i = 0; i < editor->num_buf; i++){
+        photon_buffer_t *buf = editor->bufs[i];
+        if (photon_search_pending(buf) || photon_follow_pending(buf))
+            return 1;
+    }
+    return photon_complete_pending(editor) || photon_pack_pending(editor);
+}
+
+int photon_editor_timeout(photon_editor_t *editor){
+    int journal = photon_journal_timeout(editor), pack = photon_pack_timeout(editor);
+    return journal < 0 || (pack >= 0 && pack < journal) ? pack : journal;
+}
+
+void photon_editor_idle(photon_editor_t *editor){
+    for (size_t i = 0; i < editor->num_buf; i++)
+        photon_journal_flush(editor, editor->bufs[i], 0);
+    uint64_t until = _now_ns() + IDLE_SLICE_NS;
+    for (size_t i = 0; i < editor->num_buf; i++){
+        photon_buffer_t *buf = editor->bufs[i];
+        uint64_t now = _now_ns();
+        if (now >= until) break;
+        photon_search_step(buf, until - now);
+        if (photon_follow_pending(buf))
+            photon_follow_step(editor, buf);
+    }
+    // whatever's left of the slice, words first so packing doesn't have to unpack for them
+    uint64_t now = _now_ns();
+    if (now < until)
+        photon_complete_step(editor, until - now);
+    if ((now = _now_ns()) < until)
+        photon_pack_step(editor, until - now);
+}
+
+int photon_editor_fds(photon_editor_t *editor, int *fds){
+    int n = 0;
+    if (editor->pool)
+        fds[n++] = photon_pool_wake_fd(editor->pool);
+    if (photon_follow_fd(editor) >= 0)
+        fds[n++] = photon_follow_fd(editor);
+    return n;
+}
+
+void photon_editor_cleanup(photon_editor_t *editor){
+    if (editor->pool){
+        // finish whatever is in flight so extensions get their done callbacks before unloading,
+        // greps are stopped first so they wind down instead of walking the whole tree
+        photon_grep_stop(editor);
+        photon_pool_stop(editor->pool);
+        photon_drain_jobs(editor);
+        photon_grep_drain(editor);
+        photon_pool_destroy(editor->pool);
+        editor->pool = NULL;
+    }
+    while (editor->num_buf){
+        photon_delete_buffer(editor, editor->bufs[editor->num_buf - 1]);
+    }
+    photon_handles_free(editor);
+    photon_complete_free(editor);
+    while (editor->first_ext){
+        photon_extension_t *next = editor->first_ext->next;
+        if (editor->first_ext->loaded && editor->first_ext->on_unload){
+            photon_setup_api(editor, editor->first_ext);
+            editor->first_ext->on_unload(&editor->api);
+        }
+        if (editor->first_ext->handle)
+            dlclose(editor->first_ext->handle);
+        free(editor->first_ext->path);
+        free(editor->first_ext);
+        editor->first_ext = next;
+    }
+    photon_highlight_cleanup(editor);
+    photon_follow_cleanup(editor);
+}
+
+const char *photon_editor_error_msg(photon_editor_t *editor){
+    if (editor->error < 1 || editor->error > PHOTON_NO_MEM){
+        return "Undefined error";
+    }
+    return errorMessages[editor->error];
+}
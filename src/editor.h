@@ -0,0 +1,24 @@
+#ifndef __EDITOR_H__
+#define __EDITOR_H__
+
+typedef struct photon_editor photon_editor_t;
+
+// fills in the api, theme and worker pool, call after photon_ui_init
+void photon_editor_init(photon_editor_t *editor);
+// everything up to photon_ui_refresh: finished jobs, buffers and extension ui
+void photon_editor_draw(photon_editor_t *editor);
+void photon_handle_keypress(photon_editor_t *editor, int key);
+// background work that runs between frames while no keys come in (searches that aren't
+// done, bursts of a followed file, journals to sync)
+int photon_editor_busy(photon_editor_t *editor);
+// ms the main loop can wait for a key when it's not busy before idle has something to
+// do, -1 to wait for as long as it takes
+int photon_editor_timeout(photon_editor_t *editor);
+void photon_editor_idle(photon_editor_t *editor);
+// fds the main loop should wake up for besides the keyboard, returns how many (at most
+// PHOTON_INPUT_MAX_FDS)
+int photon_editor_fds(photon_editor_t *editor, int *fds);
+void photon_editor_cleanup(photon_editor_t *editor);
+const char *photon_editor_error_msg(photon_editor_t *editor);
+
+#endif//__EDITOR_H__
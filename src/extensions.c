@@ -1,9 +1,323 @@
 #include "extensions.h"
 #include "photon.h"
+#include "buffer.h"
+#include "pool.h"
+#include "trace.h"
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#define err_and_ret(edit, err, val) edit->error = err; return val;
+
+typedef struct photon_job {
+    photon_task_t task;
+    photon_mpsc_node_t node;
+    photon_editor_t *editor;
+    photon_extension_t *ext;
+    photon_snapshot_t *snapshot;
+    photon_job_run_t run;
+    photon_job_done_t done;
+    void *userdata;
+} photon_job_t;
+
+#define NUM_HOOKS (int)(sizeof(((photon_hooks_t *)0)->hooks) / sizeof(((photon_hooks_t *)0)->hooks[0]))
+#define MANIFEST_MAGIC "photon-extensions 1"
+
+// lazy extensions can't set their hooks before on_load, so they export them under these names
+static const char *hookSymbols[] = {
+    "photon_on_keypress",
+    "photon_on_new_buf"
+};
+
+typedef struct ext_loader {
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+    int remaining;
+} ext_loader_t;
+
+typedef struct ext_entry {
+    photon_task_t task;
+    ext_loader_t *loader;
+    char path[PATH_MAX];
+    const char *name;
+    long long mtime, size;
+    unsigned flags;
+    int cached;
+    void *handle;
+    char error[256];
+} ext_entry_t;
+
+typedef struct manifest_entry {
+    long long mtime, size;
+    unsigned flags;
+    char name[NAME_MAX + 1];
+} manifest_entry_t;
+
+static unsigned _ext_probe(void *handle){
+    unsigned flags = 0;
+    if (dlsym(handle, "photon_on_load"))
+        flags |= EXT_HAS_ON_LOAD;
+    if (dlsym(handle, "photon_on_unload"))
+        flags |= EXT_HAS_ON_UNLOAD;
+    if (dlsym(handle, "photon_pre_frame"))
+        flags |= EXT_HAS_PRE_FRAME;
+    for (int i = 0; i < NUM_HOOKS; i++)
+        if (dlsym(handle, hookSymbols[i]))
+            flags |= EXT_HAS_HOOK_BASE << i;
+    const int *lazy = dlsym(handle, "photon_lazy");
+    if (lazy && *lazy)
+        flags |= EXT_LAZY;
+    return flags;
+}
+
+static void _ext_resolve(photon_task_t *task){
+    ext_entry_t *entry = (ext_entry_t *)((char *)task - offsetof(ext_entry_t, task));
+    entry->handle = dlopen(entry->path, RTLD_LAZY);
+    if (entry->handle){
+        entry->flags = _ext_probe(entry->handle);
+    } else {
+        const char *msg = dlerror();
+        snprintf(entry->error, sizeof(entry->error), "%s", msg ? msg : "unknown error");
+    }
+    ext_loader_t *loader = entry->loader;
+    if (!loader) return;
+    pthread_mutex_lock(&loader->lock);
+    if (--loader->remaining == 0)
+        pthread_cond_signal(&loader->done);
+    pthread_mutex_unlock(&loader->lock);
+}
+
+static void _ext_bind(photon_extension_t *ext){
+    ext->on_load = (void (*)(const photon_api_t *api))dlsym(ext->handle, "photon_on_load");
+    ext->on_unload = (void (*)(const photon_api_t *api))dlsym(ext->handle, "photon_on_unload");
+    ext->pre_frame = (void (*)(const photon_api_t *api))dlsym(ext->handle, "photon_pre_frame");
+}
+
+static int _ext_activate(photon_editor_t *editor, photon_extension_t *ext){
+    if (ext->loaded) return 1;
+    if (!ext->handle){
+        ext->handle = dlopen(ext->path, RTLD_LAZY);
+        if (!ext->handle){
+            // don't keep trying on every hook
+            ext->flags = 0;
+            return 0;
+        }
+        _ext_bind(ext);
+    }
+    ext->loaded = 1;
+    if (ext->on_load){
+        photon_setup_api(editor, ext);
+        ext->on_load(&editor->api);
+    }
+    for (int i = 0; i < NUM_HOOKS; i++){
+        if (!ext->hooks.hooks[i])
+            ext->hooks.hooks[i] = (void (*)(const photon_api_t *, photon_event_t *))dlsym(ext->handle, hookSymbols[i]);
+    }
+    return 1;
+}
+
+static manifest_entry_t *_manifest_read(const char *path, int *n){
+    *n = 0;
+    FILE *f = fopen(path, "r");
+    if (!f) return NULL;
+    char line[PATH_MAX + 64];
+    if (!fgets(line, sizeof(line), f) || strncmp(line, MANIFEST_MAGIC, strlen(MANIFEST_MAGIC)) != 0){
+        fclose(f);
+        return NULL;
+    }
+    int cap = 0;
+    manifest_entry_t *entries = NULL;
+    while (fgets(line, sizeof(line), f)){
+        if (*n == cap){
+            cap = cap ? cap << 1 : 32;
+            manifest_entry_t *newEntries = realloc(entries, cap * sizeof(manifest_entry_t));
+            if (!newEntries) break;
+            entries = newEntries;
+        }
+        manifest_entry_t *e = &entries[*n];
+        int off = 0;
+        if (sscanf(line, "%lld %lld %x %n", &e->mtime, &e->size, &e->flags, &off) < 3 || !off) continue;
+        size_t len = strcspn(line + off, "\n");
+        if (len == 0 || len > NAME_MAX) continue;
+        memcpy(e->name, line + off, len);
+        e->name[len] = 0;
+        (*n)++;
+    }
+    fclose(f);
+    return entries;
+}
+
+static void _manifest_write(const char *path, ext_entry_t *entries, int n){
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "w");
+    if (!f) return;
+    fprintf(f, MANIFEST_MAGIC "\n");
+    for (int i = 0; i < n; i++){
+        if (entries[i].error[0]) continue;
+        fprintf(f, "%lld %lld %x %s\n", entries[i].mtime, entries[i].size, entries[i].flags, entries[i].name);
+    }
+    if (fclose(f) == 0)
+        rename(tmp, path);
+    else
+        remove(tmp);
+}
+
+static int _ext_collect(const char *dirPath, ext_entry_t **out, int *n){
+    *out = NULL;
+    *n = 0;
+    DIR *dir = opendir(dirPath);
+    if (!dir){
+        if (errno != ENOENT){
+            fprintf(stderr, "failed to open directory %s: %s\r\n", dirPath, strerror(errno));
+            return LOAD_ERROR;
+        }
+        return LOAD_OK;
+    }
+    int cap = 0;
+    struct dirent *ent;
+    while ((ent = readdir(dir))){
+        const char *name = ent->d_name;
+        size_t len = strlen(name);
+        if (len < 3 || strcmp(name + len - 3, ".so") != 0 || strncmp(name, "--", 2) == 0) continue;
+        if (*n == cap){
+            cap = cap ? cap << 1 : 16;
+            ext_entry_t *newEntries = realloc(*out, cap * sizeof(ext_entry_t));
+            if (!newEntries){
+                closedir(dir);
+                return LOAD_FATAL_ERR;
+            }
+            *out = newEntries;
+        }
+        ext_entry_t *e = &(*out)[*n];
+        memset(e, 0, sizeof(ext_entry_t));
+        int pathLen = snprintf(e->path, PATH_MAX, "%s/%s", dirPath, name);
+        e->name = e->path + pathLen - len;
+        struct stat st;
+        if (stat(e->path, &st) == -1) continue;
+        e->mtime = (long long)st.st_mtime;
+        e->size = (long long)st.st_size;
+        (*n)++;
+    }
+    closedir(dir);
+    return LOAD_OK;
+}
+
+int photon_load_extensions(photon_editor_t *editor){
+    char extDirPath[PATH_MAX] = {0};
+    char manifestPath[PATH_MAX] = {0};
+    const char *home = getenv("HOME");
+    if (!home){
+        return LOAD_OK;
+    }
+    snprintf(extDirPath, PATH_MAX, "%s/.config/photon/extensions", home);
+    snprintf(manifestPath, PATH_MAX, "%s/.config/photon/extensions.manifest", home);
+
+    ext_entry_t *entries;
+    int n;
+    int err = _ext_collect(extDirPath, &entries, &n);
+    if (err != LOAD_OK || n == 0){
+        free(entries);
+        return err;
+    }
+
+    int numCached;
+    manifest_entry_t *cached = _manifest_read(manifestPath, &numCached);
+    int stale = numCached != n;
+    for (int i = 0; i < n; i++){
+        ext_entry_t *e = &entries[i];
+        for (int j = 0; j < numCached; j++){
+            if (cached[j].mtime == e->mtime && cached[j].size == e->size && strcmp(cached[j].name, e->name) == 0){
+                e->cached = 1;
+                e->flags = cached[j].flags;
+                break;
+            }
+        }
+        if (!e->cached) stale = 1;
+    }
+    free(cached);
+
+    // dlopen + symbol lookup for everything that isn't a known lazy extension, spread over the pool
+    ext_loader_t loader = {0};
+    pthread_mutex_init(&loader.lock, NULL);
+    pthread_cond_init(&loader.done, NULL);
+    for (int i = 0; i < n; i++){
+        ext_entry_t *e = &entries[i];
+        if (e->cached && (e->flags & EXT_LAZY)) continue;
+        e->task.run = _ext_resolve;
+        e->loader = &loader;
+        pthread_mutex_lock(&loader.lock);
+        loader.remaining++;
+        pthread_mutex_unlock(&loader.lock);
+        if (!editor->pool || !photon_pool_submit(editor->pool, &e->task))
+            _ext_resolve(&e->task);
+    }
+    pthread_mutex_lock(&loader.lock);
+    while (loader.remaining)
+        pthread_cond_wait(&loader.done, &loader.lock);
+    pthread_mutex_unlock(&loader.lock);
+    pthread_mutex_destroy(&loader.lock);
+    pthread_cond_destroy(&loader.done);
+
+    // on_load touches the editor, so the rest happens here in directory order
+    for (int i = 0; i < n; i++){
+        ext_entry_t *e = &entries[i];
+        if (e->error[0]){
+            fprintf(stderr, "failed to load extension %s: %s\r\n", e->name, e->error);
+            err = LOAD_ERROR;
+            continue;
+        }
+        photon_extension_t *ext = calloc(1, sizeof(photon_extension_t));
+        char *path = strdup(e->path);
+        if (!ext || !path){
+            fprintf(stderr, "failed to allocate extension %s: %s\r\n", e->name, strerror(errno));
+            free(ext);
+            free(path);
+            if (e->handle)
+                dlclose(e->handle);
+            for (int j = i + 1; j < n; j++)
+                if (entries[j].handle)
+                    dlclose(entries[j].handle);
+            err = LOAD_FATAL_ERR;
+            break;
+        }
+        ext->path = path;
+        ext->handle = e->handle;
+        ext->flags = e->flags;
+        ext->errorValue = PHOTON_OK;
+        if (ext->handle)
+            _ext_bind(ext);
+        ext->next = editor->first_ext;
+        editor->first_ext = ext;
+
+        if (!(ext->flags & EXT_LAZY))
+            _ext_activate(editor, ext);
+    }
+
+    if (stale && err != LOAD_FATAL_ERR)
+        _manifest_write(manifestPath, entries, n);
+    free(entries);
+    return err;
+}
+
+int photon_extensions_deferred(photon_editor_t *editor){
+    int n = 0;
+    for (photon_extension_t *it = editor->first_ext; it; it = it->next)
+        n += !it->loaded;
+    return n;
+}
 
 void photon_setup_api(photon_editor_t *editor, photon_extension_t *ext){
     editor->api.hooks = &ext->hooks;
     editor->error = ext->errorValue;
+    editor->cur_ext = ext;
 }
 
 int photon_trigger_hook(photon_editor_t *editor, int id, uintptr_t data){
@@ -12,6 +326,8 @@ int photon_trigger_hook(photon_editor_t *editor, int id, uintptr_t data){
     event.data = data;
     photon_extension_t *it = editor->first_ext;
     while (it){
+        if (!it->loaded && (it->flags & (EXT_HAS_HOOK_BASE << id)))
+            _ext_activate(editor, it);
         if (it->hooks.hooks[id]){
             photon_setup_api(editor, it);
             it->hooks.hooks[id](&editor->api, &event);
@@ -21,3 +337,55 @@ int photon_trigger_hook(photon_editor_t *editor, int id, uintptr_t data){
     return event.cancelled;
 }
 
+static void _job_run(photon_task_t *task){
+    photon_job_t *job = (photon_job_t *)((char *)task - offsetof(photon_job_t, task));
+    job->run(job->snapshot, job->userdata);
+    photon_pool_complete(job->editor->pool, &job->node);
+}
+
+int photon_submit_job(photon_editor_t *editor, photon_buffer_t *buffer, photon_job_run_t run, photon_job_done_t done, void *userdata){
+    if (!run){
+        err_and_ret(editor, PHOTON_BAD_PARAM, 0);
+    }
+    if (!editor->pool){
+        err_and_ret(editor, PHOTON_NO_MEM, 0);
+    }
+    photon_job_t *job = malloc(sizeof(photon_job_t));
+    if (!job){
+        err_and_ret(editor, PHOTON_NO_MEM, 0);
+    }
+    job->snapshot = NULL;
+    if (buffer && (job->snapshot = photon_buffer_snapshot(buffer)) == NULL){
+        free(job);
+        err_and_ret(editor, PHOTON_NO_MEM, 0);
+    }
+    job->task.run = _job_run;
+    job->editor = editor;
+    job->ext = editor->cur_ext;
+    job->run = run;
+    job->done = done;
+    job->userdata = userdata;
+    if (!photon_pool_submit(editor->pool, &job->task)){
+        photon_snapshot_release(job->snapshot);
+        free(job);
+        err_and_ret(editor, PHOTON_NO_MEM, 0);
+    }
+    return 1;
+}
+
+void photon_drain_jobs(photon_editor_t *editor){
+    if (!editor->pool) return;
+    photon_pool_ack(editor->pool);
+    photon_mpsc_node_t *node;
+    while ((node = photon_pool_next_done(editor->pool))){
+        photon_job_t *job = (photon_job_t *)((char *)node - offsetof(photon_job_t, node));
+        PHOTON_TRACE("jobs.done", 0, 0);
+        if (job->done){
+            if (job->ext)
+                photon_setup_api(editor, job->ext);
+            job->done(&editor->api, job->userdata);
+        }
+        photon_snapshot_release(job->snapshot);
+        free(job);
+    }
+}
@@ -4,8 +4,30 @@
 
 typedef struct photon_editor photon_editor_t;
 typedef struct photon_extension photon_extension_t;
+typedef struct photon_api photon_api_t;
 
+#define LOAD_FATAL_ERR (-1)
+#define LOAD_ERROR 0
+#define LOAD_OK 1
+
+// symbols found in an extension, cached in the manifest so unchanged libraries don't have to be opened
+#define EXT_HAS_ON_LOAD    0x01
+#define EXT_HAS_ON_UNLOAD  0x02
+#define EXT_HAS_PRE_FRAME  0x04
+#define EXT_HAS_HOOK_BASE  0x08 // EXT_HAS_HOOK_BASE << hook id
+#define EXT_LAZY           0x80
+
+int photon_load_extensions(photon_editor_t *editor);
+int photon_extensions_deferred(photon_editor_t *editor);
 void photon_setup_api(photon_editor_t *editor, photon_extension_t *ext);
 int photon_trigger_hook(photon_editor_t *editor, int id, uintptr_t data);
 
+typedef struct photon_buffer photon_buffer_t;
+typedef struct photon_snapshot photon_snapshot_t;
+typedef void (*photon_job_run_t)(const photon_snapshot_t *snapshot, void *userdata);
+typedef void (*photon_job_done_t)(const photon_api_t *api, void *userdata);
+
+int photon_submit_job(photon_editor_t *editor, photon_buffer_t *buffer, photon_job_run_t run, photon_job_done_t done, void *userdata);
+void photon_drain_jobs(photon_editor_t *editor);
+
 #endif//__EXTENSIONS_H__
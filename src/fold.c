@@ -0,0 +1,125 @@
+#include "fold.h"
+#include "photon.h"
+#include "nest.h"
+#include "wrap.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define err_and_ret(edit, err, val) edit->error = err; return val;
+
+// the first fold that ends at line or after, num if there's none
+static size_t _find(const photon_buffer_t *buf, size_t line){
+    size_t lo = 0, hi = buf->_fold.num;
+    while (lo < hi){
+        size_t mid = lo + (hi - lo) / 2;
+        if (buf->_fold.folds[mid].last < line)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+size_t photon_fold_visible(const photon_buffer_t *buf, size_t line){
+    if (!buf->_fold.num) return line;
+    size_t k = _find(buf, line);
+    return k < buf->_fold.num && buf->_fold.folds[k].first < line ? buf->_fold.folds[k].first : line;
+}
+
+const photon_fold_t *photon_fold_from(const photon_buffer_t *buf, size_t line, size_t *count){
+    size_t k = _find(buf, line);
+    *count = buf->_fold.num - k;
+    return buf->_fold.folds + k;
+}
+
+static void _remove(photon_buffer_t *buf, size_t k, size_t n){
+    photon_wrap_invalidate(buf, buf->_fold.folds[k].first);
+    memmove(buf->_fold.folds + k, buf->_fold.folds + k + n, (buf->_fold.num - k - n) * sizeof(photon_fold_t));
+    buf->_fold.num -= n;
+}
+
+void photon_fold_reveal(photon_buffer_t *buf, size_t line){
+    size_t k = _find(buf, line);
+    if (k < buf->_fold.num && buf->_fold.folds[k].first < line)
+        _remove(buf, k, 1);
+}
+
+int photon_fold_toggle(photon_editor_t *editor, photon_buffer_t *buf, size_t line){
+    if (line >= buf->text->num_line){
+        err_and_ret(editor, PHOTON_BAD_PARAM, 0);
+    }
+    size_t k = _find(buf, line);
+    if (k < buf->_fold.num && buf->_fold.folds[k].first <= line){
+        _remove(buf, k, 1);
+        return 1;
+    }
+    size_t last;
+    if (!photon_nest_block(buf, line, &last)){
+        err_and_ret(editor, PHOTON_BAD_PARAM, 0);
+    }
+    // the ones inside it go, it ends where the last of them does if that's further
+    size_t n = 0;
+    while (k + n < buf->_fold.num && buf->_fold.folds[k + n].first <= last){
+        if (buf->_fold.folds[k + n].last > last)
+            last = buf->_fold.folds[k + n].last;
+        n++;
+    }
+    if (!n && buf->_fold.num == buf->_fold.cap){
+        size_t cap = buf->_fold.cap ? buf->_fold.cap * 2 : 8;
+        photon_fold_t *folds = realloc(buf->_fold.folds, cap * sizeof(photon_fold_t));
+        if (!folds){
+            err_and_ret(editor, PHOTON_NO_MEM, 0);
+        }
+        buf->_fold.folds = folds;
+        buf->_fold.cap = cap;
+    }
+    if (n)
+        _remove(buf, k, n - 1);
+    else
+        memmove(buf->_fold.folds + k + 1, buf->_fold.folds + k, (buf->_fold.num++ - k) * sizeof(photon_fold_t));
+    buf->_fold.folds[k] = (photon_fold_t){ line, last };
+    photon_wrap_invalidate(buf, line);
+    // the cursor and the top of the view don't stay in there
+    if (buf->_gap.line > line && buf->_gap.line <= last){
+        buf->_gap.line = line;
+        buf->_gap.col = 0;
+    }
+    if (buf->scroll > (int)line && (size_t)buf->scroll <= last){
+        buf->scroll = (int)line;
+        buf->scroll_off = 0;
+    }
+    return 1;
+}
+
+void photon_fold_clear(photon_buffer_t *buf){
+    if (buf->_fold.num)
+        photon_wrap_invalidate(buf, buf->_fold.folds[0].first);
+    buf->_fold.num = 0;
+}
+
+void photon_fold_edit(photon_buffer_t *buf, size_t first, size_t last, long delta){
+    if (!buf->_fold.num) return;
+    // the edit had (old) lines first to oldLast
+    size_t oldLast = (size_t)((long)last - delta);
+    size_t k = _find(buf, first), n = 0;
+    while (k + n < buf->_fold.num && buf->_fold.folds[k + n].first <= oldLast){
+        photon_fold_t *f = &buf->_fold.folds[k + n];
+        // typing on the line it's folded behind leaves it be
+        if (!delta && first == f->first && last == f->first) break;
+        n++;
+    }
+    if (n)
+        _remove(buf, k, n);
+    if (delta){
+        for (size_t i = k; i < buf->_fold.num; i++){
+            buf->_fold.folds[i].first += delta;
+            buf->_fold.folds[i].last += delta;
+        }
+    }
+}
+
+void photon_fold_free(photon_buffer_t *buf){
+    free(buf->_fold.folds);
+    buf->_fold.folds = NULL;
+    buf->_fold.num = buf->_fold.cap = 0;
+}
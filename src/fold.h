@@ -0,0 +1,31 @@
+#ifndef __FOLD_H__
+#define __FOLD_H__
+#include <stddef.h>
+
+// folds: a view can hide a block (see nest.h) behind its first line. each view keeps its
+// closed folds in order, drawing goes from a fold's first line straight on to the line after
+// it and wrapping counts no rows for the hidden lines, so scrolling goes past them too and
+// nothing on the way to the screen ever reads them. an edit that touches a fold's hidden
+// lines (or adds or removes lines at its first one) opens it.
+
+typedef struct photon_editor photon_editor_t;
+typedef struct photon_buffer photon_buffer_t;
+typedef struct photon_fold photon_fold_t;
+
+// hides the block starting at line (the folds in it go into the new one), or shows it
+// again if it's hidden already. 0 if there's nothing to fold
+int photon_fold_toggle(photon_editor_t *editor, photon_buffer_t *buf, size_t line);
+// opens whatever hides line
+void photon_fold_reveal(photon_buffer_t *buf, size_t line);
+// the line that shows line: itself, or the first line of the fold it's hidden in
+size_t photon_fold_visible(const photon_buffer_t *buf, size_t line);
+// the folds that end at line or after, *count of them
+const photon_fold_t *photon_fold_from(const photon_buffer_t *buf, size_t line, size_t *count);
+void photon_fold_clear(photon_buffer_t *buf);
+
+// the buffer calls these like photon_wrap_edit, before it. a fold that opens has the
+// view's wrap counted again from there
+void photon_fold_edit(photon_buffer_t *buf, size_t first, size_t last, long delta);
+void photon_fold_free(photon_buffer_t *buf);
+
+#endif//__FOLD_H__
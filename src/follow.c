@@ -0,0 +1,228 @@
+#include "follow.h"
+#include "photon.h"
+#include "buffer.h"
+#include "wrap.h"
+#include "journal.h"
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#define err_and_ret(edit, err, val) edit->error = err; return val;
+
+#define FILE_EVENTS (IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF)
+#define DIR_EVENTS (IN_CREATE | IN_MOVED_TO)
+
+struct photon_follow {
+    int fd;         // -1 while there's nothing under the path (rotated away)
+    int wd, dir_wd; // the file's watch and its directory's, -1 if there's none
+    dev_t dev;
+    ino_t ino;
+    off_t offset;   // bytes of the file that are in the buffer
+    char held;      // the last byte read was a newline, it goes in with the next line
+    char pending;   // there was more than a step could take
+    char changed;   // inotify had something about it
+    const char *name; // the file's name in its directory, points into buf->name
+};
+
+// a watch can be shared by buffers following the same file, only the last one removes it
+static void _unwatch(photon_editor_t *editor, photon_buffer_t *self, int wd){
+    if (wd < 0) return;
+    for (size_t i = 0; i < editor->num_buf; i++){
+        photon_buffer_t *buf = editor->bufs[i];
+        if (buf != self && buf->follow && (buf->follow->wd == wd || buf->follow->dir_wd == wd))
+            return;
+    }
+    inotify_rm_watch(editor->inotify, wd);
+}
+
+static int _open(photon_editor_t *editor, photon_buffer_t *buf){
+    photon_follow_t *f = buf->follow;
+    struct stat st;
+    int fd = open(buf->name, O_RDONLY | O_CLOEXEC);
+    if (fd == -1 || fstat(fd, &st) == -1){
+        if (fd != -1)
+            close(fd);
+        return 0;
+    }
+    f->fd = fd;
+    f->dev = st.st_dev;
+    f->ino = st.st_ino;
+    f->offset = 0;
+    f->wd = inotify_add_watch(editor->inotify, buf->name, FILE_EVENTS);
+    return 1;
+}
+
+static void _close(photon_editor_t *editor, photon_buffer_t *buf){
+    photon_follow_t *f = buf->follow;
+    if (f->fd != -1)
+        close(f->fd);
+    _unwatch(editor, buf, f->wd);
+    f->fd = f->wd = -1;
+}
+
+int photon_follow_start(photon_editor_t *editor, photon_buffer_t *buf){
+    if (buf->type != BUF_FILE || !buf->name){
+        err_and_ret(editor, PHOTON_BAD_PARAM, 0);
+    }
+    // one view of a text follows the file, the others would append the same lines again
+    for (photon_buffer_t *view = buf->text->views; view; view = view->next_view)
+        photon_follow_stop(editor, view);
+    // what's appended is in the file already, there's nothing to recover
+    photon_journal_stop(editor, buf);
+    if (editor->inotify < 0 && (editor->inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1){
+        err_and_ret(editor, PHOTON_NO_MEM, 0);
+    }
+    photon_follow_t *f = calloc(1, sizeof(photon_follow_t));
+    if (!f){
+        err_and_ret(editor, PHOTON_NO_MEM, 0);
+    }
+    buf->follow = f;
+    f->fd = f->wd = f->dir_wd = -1;
+    if (!_open(editor, buf)){
+        free(f);
+        buf->follow = NULL;
+        err_and_ret(editor, PHOTON_BAD_PARAM, 0);
+    }
+    // a rotated file comes back as a new entry in the directory
+    const char *slash = strrchr(buf->name, '/');
+    f->name = slash ? slash + 1 : buf->name;
+    if (slash){
+        char *dir = strndup(buf->name, slash == buf->name ? 1 : slash - buf->name);
+        if (dir)
+            f->dir_wd = inotify_add_watch(editor->inotify, dir, DIR_EVENTS);
+        free(dir);
+    } else {
+        f->dir_wd = inotify_add_watch(editor->inotify, ".", DIR_EVENTS);
+    }
+    // carries on from the end, like tail -f
+    struct stat st;
+    char last = 0;
+    if (fstat(f->fd, &st) == 0 && st.st_size > 0){
+        f->offset = st.st_size;
+        if (pread(f->fd, &last, 1, st.st_size - 1) == 1)
+            f->held = last == '\n';
+    }
+    photon_wrap_to_bottom(buf);
+    return 1;
+}
+
+void photon_follow_stop(photon_editor_t *editor, photon_buffer_t *buf){
+    photon_follow_t *f = buf->follow;
+    if (!f) return;
+    _close(editor, buf);
+    _unwatch(editor, buf, f->dir_wd);
+    free(f);
+    buf->follow = NULL;
+}
+
+int photon_follow_fd(const photon_editor_t *editor){
+    return editor->inotify;
+}
+
+int photon_follow_pending(const photon_buffer_t *buf){
+    return buf->follow && buf->follow->pending;
+}
+
+// everything goes, the file starts over
+static void _truncated(photon_editor_t *editor, photon_buffer_t *buf){
+    photon_buffer_erase(editor, buf, 0, 0, SIZE_MAX);
+    memset(&buf->_gap, 0, sizeof(buf->_gap));
+    photon_wrap_set_top(buf, 0);
+    buf->follow->offset = 0;
+    buf->follow->held = 0;
+}
+
+int photon_follow_step(photon_editor_t *editor, photon_buffer_t *buf){
+    photon_follow_t *f = buf->follow;
+    if (!f || f->fd == -1) return 0;
+    struct stat st;
+    if (fstat(f->fd, &st) == -1) return f->pending = 0;
+    if (st.st_size < f->offset)
+        _truncated(editor, buf);
+    off_t avail = st.st_size - f->offset;
+    if (!avail) return f->pending = 0;
+    size_t n = avail < PHOTON_FOLLOW_CHUNK ? (size_t)avail : PHOTON_FOLLOW_CHUNK;
+    char *text = malloc(n + 1);
+    if (!text) return f->pending = 0;
+    PHOTON_TRACE_BEGIN("follow.step(bytes)", n, 0);
+    // a newline held back from last time goes in first
+    text[0] = '\n';
+    ssize_t got = pread(f->fd, text + f->held, n, f->offset);
+    if (got > 0){
+        size_t len = f->held + got;
+        char held = text[len - 1] == '\n';
+        len -= held;
+        int pinned = photon_wrap_at_bottom(buf);
+        size_t last = buf->text->num_line - 1;
+        if (photon_buffer_insert(editor, buf, last, buf->text->lines[last].length, text, len)){
+            f->offset += got;
+            f->held = held;
+        } else {
+            got = 0; // out of memory, the same bytes are tried again next time
+        }
+        if (pinned)
+            photon_wrap_to_bottom(buf);
+    }
+    free(text);
+    PHOTON_TRACE_END("follow.step");
+    return f->pending = got > 0 && f->offset < st.st_size;
+}
+
+// the path points at another file now (or nothing), what's left of the old one is read first
+static void _rotated(photon_editor_t *editor, photon_buffer_t *buf){
+    photon_follow_t *f = buf->follow;
+    struct stat st;
+    int moved = stat(buf->name, &st) == -1 || st.st_dev != f->dev || st.st_ino != f->ino;
+    if (f->fd != -1 && !moved) return;
+    if (f->fd != -1){
+        while (photon_follow_step(editor, buf));
+        _close(editor, buf);
+    }
+    _open(editor, buf);
+}
+
+static void _changed(photon_editor_t *editor, const struct inotify_event *ev){
+    for (size_t i = 0; i < editor->num_buf; i++){
+        photon_follow_t *f = editor->bufs[i]->follow;
+        if (!f) continue;
+        // an overflow lost events, everything gets looked at
+        if (ev->mask & IN_Q_OVERFLOW)
+            f->changed = 1;
+        else if (ev->wd == f->wd)
+            f->changed = 1;
+        else if (ev->wd == f->dir_wd && ev->len && !strcmp(ev->name, f->name))
+            f->changed = 1;
+    }
+}
+
+void photon_follow_poll(photon_editor_t *editor){
+    if (editor->inotify < 0) return;
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t n;
+    // a burst of writes is one read of the file however many events it made
+    while ((n = read(editor->inotify, events, sizeof(events))) > 0){
+        for (char *p = events; p < events + n; ){
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            _changed(editor, ev);
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+    for (size_t i = 0; i < editor->num_buf; i++){
+        photon_buffer_t *buf = editor->bufs[i];
+        if (!buf->follow || !buf->follow->changed) continue;
+        buf->follow->changed = 0;
+        _rotated(editor, buf);
+        photon_follow_step(editor, buf);
+    }
+}
+
+void photon_follow_cleanup(photon_editor_t *editor){
+    if (editor->inotify >= 0)
+        close(editor->inotify);
+    editor->inotify = -1;
+}
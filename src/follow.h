@@ -0,0 +1,32 @@
+#ifndef __FOLLOW_H__
+#define __FOLLOW_H__
+
+// following a growing file, a log usually: inotify says when it changed and only the bytes
+// past what was already read get appended, split into lines the way loading does. the
+// view stays at the bottom if it was there. a file that got shorter was truncated and is
+// read again from the start, one that was moved or deleted was rotated, the rest of it is
+// read and the new file under the same path is followed from its start once it shows up.
+
+typedef struct photon_editor photon_editor_t;
+typedef struct photon_buffer photon_buffer_t;
+typedef struct photon_follow photon_follow_t;
+
+// bytes appended per step at most, a bigger burst is finished while the editor is idle
+#define PHOTON_FOLLOW_CHUNK (1 << 20)
+
+// buf->name is the file, it's followed from its current end so load it first. returns 0
+// and sets editor->error on failure, PHOTON_BAD_PARAM if it's not a file buffer. another
+// view of the same text that was following stops
+int photon_follow_start(photon_editor_t *editor, photon_buffer_t *buf);
+void photon_follow_stop(photon_editor_t *editor, photon_buffer_t *buf);
+
+// readable when a followed file changed, -1 if nothing was ever followed
+int photon_follow_fd(const photon_editor_t *editor);
+// takes in what inotify has to say, photon_editor_draw calls it
+void photon_follow_poll(photon_editor_t *editor);
+// appends up to PHOTON_FOLLOW_CHUNK more bytes, returns 1 if there's still some left
+int photon_follow_step(photon_editor_t *editor, photon_buffer_t *buf);
+int photon_follow_pending(const photon_buffer_t *buf);
+void photon_follow_cleanup(photon_editor_t *editor);
+
+#endif//__FOLLOW_H__
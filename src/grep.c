@@ -0,0 +1,452 @@
+#include "grep.h"
+#include "photon.h"
+#include "buffer.h"
+#include "search.h"
+#include "regex.h"
+#include "pool.h"
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define err_and_ret(edit, err, val) edit->error = err; return val;
+
+// a file with a NUL this early on is binary
+#define BINARY_PROBE 8192
+
+// matching lines on their way to the ui thread, "path:line:col: text\n" each
+typedef struct grep_batch {
+    photon_mpsc_node_t node;
+    char *text;
+    size_t length, cap;
+} grep_batch_t;
+
+struct photon_grep {
+    photon_pool_t *pool;
+    photon_buffer_t *buf; // NULL once the buffer is gone, only the ui thread touches it
+    struct photon_grep *next;
+
+    int flags;
+    char *pattern;
+    size_t n;
+    photon_search_pat_t pat; // read only, shared by every worker
+
+    // regexes can't be shared, so scan tasks take one from here (or compile their own)
+    // and put it back after, there are about as many as there are workers
+    pthread_mutex_t lock;
+    photon_regex_t **spare;
+    int num_spare, cap_spare;
+
+    atomic_int cancel;
+    atomic_int failed;    // something ran out of memory, results are missing
+    atomic_size_t tasks;  // not finished yet, the last one out queues done
+    atomic_size_t searched, files, lines;
+
+    photon_mpsc_t out; // batches, then done
+    photon_mpsc_node_t done;
+};
+
+typedef struct grep_task {
+    photon_task_t task;
+    photon_grep_t *grep;
+    char *paths; // a directory, or up to PHOTON_GREP_BATCH files one after the other
+    size_t length, cap;
+    int count;
+} grep_task_t;
+
+static int _add_path(grep_task_t *t, const char *dir, const char *name){
+    size_t d = strlen(dir), n = strlen(name);
+    // "." stays out of the results, they read like the paths people type
+    if (d == 1 && dir[0] == '.')
+        d = 0;
+    int sep = d && dir[d - 1] != '/';
+    size_t need = t->length + d + sep + n + 1;
+    if (need > t->cap){
+        size_t cap = t->cap ? t->cap : 256;
+        while (cap < need)
+            cap <<= 1;
+        char *paths = realloc(t->paths, cap);
+        if (!paths){
+            atomic_store(&t->grep->failed, 1);
+            return 0;
+        }
+        t->paths = paths;
+        t->cap = cap;
+    }
+    char *p = t->paths + t->length;
+    memcpy(p, dir, d);
+    if (sep)
+        p[d] = '/';
+    memcpy(p + d + sep, name, n + 1);
+    t->length = need;
+    t->count++;
+    return 1;
+}
+
+static grep_task_t *_task(photon_grep_t *g, photon_task_fn_t run, const char *dir, const char *name){
+    grep_task_t *t = calloc(1, sizeof(grep_task_t));
+    if (!t){
+        atomic_store(&g->failed, 1);
+        return NULL;
+    }
+    t->task.run = run;
+    t->grep = g;
+    if (!_add_path(t, dir, name)){
+        free(t);
+        return NULL;
+    }
+    return t;
+}
+
+static void _finish(grep_task_t *t){
+    photon_grep_t *g = t->grep;
+    photon_pool_t *pool = g->pool;
+    free(t->paths);
+    free(t);
+    // g can be freed as soon as done is queued
+    if (atomic_fetch_sub(&g->tasks, 1) == 1){
+        photon_mpsc_push(&g->out, &g->done);
+        photon_pool_notify(pool);
+    }
+}
+
+static void _submit(grep_task_t *t){
+    atomic_fetch_add(&t->grep->tasks, 1);
+    // the deque couldn't grow, it still gets done, just not in parallel
+    if (!photon_pool_submit(t->grep->pool, &t->task))
+        t->task.run(&t->task);
+}
+
+static void _hand_over(photon_grep_t *g, grep_batch_t *b){
+    photon_mpsc_push(&g->out, &b->node);
+    photon_pool_notify(g->pool);
+}
+
+static int _emit(photon_grep_t *g, grep_batch_t **batch, const char *path, size_t lineNo, size_t col, const char *line, size_t length){
+    grep_batch_t *b = *batch;
+    if (!b && !(b = *batch = calloc(1, sizeof(grep_batch_t)))){
+        atomic_store(&g->failed, 1);
+        return 0;
+    }
+    if (length && line[length - 1] == '\r')
+        length--;
+    if (length > PHOTON_GREP_COLS)
+        length = PHOTON_GREP_COLS;
+    size_t need = b->length + strlen(path) + length + 64;
+    if (need > b->cap){
+        size_t cap = b->cap ? b->cap : PHOTON_GREP_FLUSH;
+        while (cap < need)
+            cap <<= 1;
+        char *text = realloc(b->text, cap);
+        if (!text){
+            atomic_store(&g->failed, 1);
+            return 0;
+        }
+        b->text = text;
+        b->cap = cap;
+    }
+    char *p = b->text + b->length;
+    p += sprintf(p, "%s:%zu:%zu: ", path, lineNo, col + 1);
+    memcpy(p, line, length);
+    // past the binary probe a NUL can still turn up, it would end the line early
+    for (char *nul; (nul = memchr(p, 0, length)); )
+        *nul = ' ';
+    p[length] = '\n';
+    b->length = p + length + 1 - b->text;
+    atomic_fetch_add_explicit(&g->lines, 1, memory_order_relaxed);
+    if (b->length >= PHOTON_GREP_FLUSH){
+        _hand_over(g, b);
+        *batch = NULL;
+    }
+    return 1;
+}
+
+// the first match of every matching line goes out, returns how many lines matched
+static size_t _grep_text(photon_grep_t *g, photon_regex_t *re, const char *path, const char *text, size_t size, grep_batch_t **batch){
+    const char *p = text, *end = text + size; // p is at the start of line lineNo
+    size_t lineNo = 1, found = 0;
+    while (p < end){
+        const char *bol = p, *eol, *at;
+        if (re){
+            eol = memchr(p, '\n', end - p);
+            if (!eol)
+                eol = end;
+            size_t start, stop;
+            int r = photon_regex_find(re, bol, eol - bol, 0, &start, &stop);
+            if (r < 0){
+                atomic_store(&g->failed, 1);
+                break;
+            }
+            at = bol + start;
+            if (!r){
+                if (eol == end) break;
+                p = eol + 1;
+                lineNo++;
+                continue;
+            }
+        } else {
+            if (!(at = photon_search_find(&g->pat, p, end - p))) break;
+            for (const char *nl; (nl = memchr(bol, '\n', at - bol)); bol = nl + 1)
+                lineNo++;
+            eol = memchr(at, '\n', end - at);
+            if (!eol)
+                eol = end;
+        }
+        if (!_emit(g, batch, path, lineNo, at - bol, bol, eol - bol)) break;
+        found++;
+        if (eol == end) break;
+        p = eol + 1;
+        lineNo++;
+    }
+    return found;
+}
+
+static void _scan_file(photon_grep_t *g, photon_regex_t *re, const char *path, grep_batch_t **batch){
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return;
+    struct stat st;
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || !st.st_size){
+        close(fd);
+        return;
+    }
+    size_t size = (size_t)st.st_size;
+    const char *text = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (text == MAP_FAILED) return;
+    atomic_fetch_add_explicit(&g->searched, 1, memory_order_relaxed);
+    if (!memchr(text, 0, size < BINARY_PROBE ? size : BINARY_PROBE) && _grep_text(g, re, path, text, size, batch))
+        atomic_fetch_add_explicit(&g->files, 1, memory_order_relaxed);
+    munmap((void *)text, size);
+}
+
+static photon_regex_t *_take_regex(photon_grep_t *g){
+    photon_regex_t *re = NULL;
+    pthread_mutex_lock(&g->lock);
+    if (g->num_spare)
+        re = g->spare[--g->num_spare];
+    pthread_mutex_unlock(&g->lock);
+    if (!re && !(re = photon_regex_compile(g->pattern, g->n, 0, NULL)))
+        atomic_store(&g->failed, 1);
+    return re;
+}
+
+static void _give_regex(photon_grep_t *g, photon_regex_t *re){
+    if (!re) return;
+    pthread_mutex_lock(&g->lock);
+    if (g->num_spare < g->cap_spare){
+        g->spare[g->num_spare++] = re;
+        re = NULL;
+    }
+    pthread_mutex_unlock(&g->lock);
+    if (re)
+        photon_regex_free(re);
+}
+
+static void _scan(photon_task_t *task){
+    grep_task_t *t = (grep_task_t *)task;
+    photon_grep_t *g = t->grep;
+    PHOTON_TRACE_BEGIN("grep.scan(files)", t->count, 0);
+    photon_regex_t *re = NULL;
+    if (!(g->flags & PHOTON_SEARCH_REGEX) || (re = _take_regex(g))){
+        grep_batch_t *batch = NULL;
+        const char *path = t->paths;
+        for (int i = 0; i < t->count && !atomic_load_explicit(&g->cancel, memory_order_relaxed); i++){
+            _scan_file(g, re, path, &batch);
+            path += strlen(path) + 1;
+        }
+        if (batch)
+            _hand_over(g, batch);
+        _give_regex(g, re);
+    }
+    PHOTON_TRACE_END("grep.scan");
+    _finish(t);
+}
+
+// subdirectories become tasks of their own right away, files are handed out a batch at a time
+static void _walk(photon_task_t *task){
+    grep_task_t *t = (grep_task_t *)task;
+    photon_grep_t *g = t->grep;
+    PHOTON_TRACE_BEGIN("grep.walk", 0, 0);
+    DIR *dir = atomic_load(&g->cancel) ? NULL : opendir(t->paths);
+    if (dir){
+        grep_task_t *files = NULL;
+        struct dirent *e;
+        while ((e = readdir(dir)) && !atomic_load_explicit(&g->cancel, memory_order_relaxed)){
+            if (e->d_name[0] == '.') continue; // hidden, and . and .. too
+            int type = e->d_type;
+            if (type == DT_UNKNOWN){
+                struct stat st;
+                if (fstatat(dirfd(dir), e->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1) continue;
+                type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+            }
+            if (type == DT_DIR){
+                grep_task_t *sub = _task(g, _walk, t->paths, e->d_name);
+                if (sub)
+                    _submit(sub);
+            } else if (type == DT_REG){
+                if (!files)
+                    files = _task(g, _scan, t->paths, e->d_name);
+                else
+                    _add_path(files, t->paths, e->d_name);
+                if (files && files->count == PHOTON_GREP_BATCH){
+                    _submit(files);
+                    files = NULL;
+                }
+            }
+        }
+        if (files)
+            _submit(files);
+        closedir(dir);
+    }
+    PHOTON_TRACE_END("grep.walk");
+    _finish(t);
+}
+
+static void _free(photon_grep_t *g){
+    for (int i = 0; i < g->num_spare; i++)
+        photon_regex_free(g->spare[i]);
+    free(g->spare);
+    free(g->pattern);
+    photon_search_free(&g->pat);
+    pthread_mutex_destroy(&g->lock);
+    free(g);
+}
+
+photon_buffer_t *photon_grep_start(photon_editor_t *editor, const char *dir, const char *pattern, size_t n, int flags){
+    struct stat st;
+    if (!dir || !n || memchr(pattern, '\n', n) || stat(dir, &st) == -1 || (!S_ISDIR(st.st_mode) && !S_ISREG(st.st_mode))){
+        err_and_ret(editor, PHOTON_BAD_PARAM, NULL);
+    }
+    if (!editor->pool){
+        err_and_ret(editor, PHOTON_NO_MEM, NULL);
+    }
+    photon_grep_t *g = calloc(1, sizeof(photon_grep_t));
+    if (!g){
+        err_and_ret(editor, PHOTON_NO_MEM, NULL);
+    }
+    pthread_mutex_init(&g->lock, NULL);
+    photon_mpsc_init(&g->out);
+    g->pool = editor->pool;
+    g->flags = flags;
+    g->n = n;
+    g->cap_spare = photon_pool_size(editor->pool);
+    int ok = (g->pattern = malloc(n)) && (g->spare = calloc(g->cap_spare, sizeof(photon_regex_t *)));
+    if (ok)
+        memcpy(g->pattern, pattern, n);
+    if (ok && (flags & PHOTON_SEARCH_REGEX)){
+        // compiled here to catch a bad pattern, then it's the first spare
+        const char *error;
+        photon_regex_t *re = photon_regex_compile(pattern, n, 0, &error);
+        if (!re && strcmp(error, "out of memory")){
+            _free(g);
+            err_and_ret(editor, PHOTON_BAD_PARAM, NULL);
+        }
+        if ((ok = re != NULL))
+            g->spare[g->num_spare++] = re;
+    } else if (ok){
+        ok = photon_search_compile(&g->pat, pattern, n);
+    }
+    grep_task_t *root = ok ? _task(g, S_ISDIR(st.st_mode) ? _walk : _scan, ".", dir) : NULL;
+    if (!root){
+        _free(g);
+        err_and_ret(editor, PHOTON_NO_MEM, NULL);
+    }
+    atomic_store(&g->tasks, 1);
+    if (!photon_pool_submit(g->pool, &root->task)){
+        free(root->paths);
+        free(root);
+        _free(g);
+        err_and_ret(editor, PHOTON_NO_MEM, NULL);
+    }
+    // it's running now, so it goes on the list even if there's nowhere to put the results
+    g->next = editor->grep;
+    editor->grep = g;
+
+    char name[64];
+    snprintf(name, sizeof(name), "grep: %.*s", n > 48 ? 48 : (int)n, pattern);
+    photon_buf_options_t options = { .type = BUF_SCRATCH, .name = name, .x = 0, .y = 0 };
+    if (editor->cur_buf){
+        options.x = editor->cur_buf->x;
+        options.y = editor->cur_buf->y;
+        options.rows = editor->cur_buf->rows;
+        options.cols = editor->cur_buf->cols;
+    } else {
+        options.rows = editor->api.ui.height;
+        options.cols = editor->api.ui.width;
+    }
+    if (!(g->buf = photon_create_buffer(editor, &options)))
+        atomic_store(&g->cancel, 1);
+    return g->buf;
+}
+
+void photon_grep_stop(photon_editor_t *editor){
+    for (photon_grep_t *g = editor->grep; g; g = g->next)
+        atomic_store(&g->cancel, 1);
+}
+
+void photon_grep_forget(photon_editor_t *editor, photon_buffer_t *buf){
+    for (photon_grep_t *g = editor->grep; g; g = g->next){
+        if (g->buf == buf){
+            g->buf = NULL;
+            atomic_store(&g->cancel, 1);
+        }
+    }
+}
+
+static void _append(photon_editor_t *editor, photon_grep_t *g, const char *text, size_t n){
+    photon_buffer_t *buf = g->buf;
+    size_t last = buf->text->num_line - 1;
+    if (!photon_buffer_insert(editor, buf, last, buf->text->lines[last].length, text, n)){
+        atomic_store(&g->failed, 1);
+        atomic_store(&g->cancel, 1);
+    }
+}
+
+void photon_grep_drain(photon_editor_t *editor){
+    size_t budget = PHOTON_GREP_DRAIN;
+    photon_grep_t **link = &editor->grep;
+    while (*link){
+        photon_grep_t *g = *link;
+        photon_mpsc_node_t *node;
+        int finished = 0;
+        // a stopped grep's results are thrown away without counting against the budget
+        while ((budget || atomic_load(&g->cancel)) && (node = photon_mpsc_pop(&g->out))){
+            if (node == &g->done){
+                finished = 1;
+                break;
+            }
+            grep_batch_t *b = (grep_batch_t *)((char *)node - offsetof(grep_batch_t, node));
+            if (g->buf && !atomic_load(&g->cancel)){
+                PHOTON_TRACE("grep.append(bytes)", b->length, 0);
+                _append(editor, g, b->text, b->length);
+                budget = b->length < budget ? budget - b->length : 0;
+            }
+            free(b->text);
+            free(b);
+        }
+        if (!finished){
+            // more than fits in a frame, or a worker is halfway through handing some over
+            if (!photon_mpsc_empty(&g->out))
+                photon_pool_notify(g->pool);
+            link = &g->next;
+            continue;
+        }
+        if (g->buf){
+            char summary[160];
+            int len = snprintf(summary, sizeof(summary), "%zu matching lines in %zu files, %zu searched%s\n",
+                               atomic_load(&g->lines), atomic_load(&g->files), atomic_load(&g->searched),
+                               atomic_load(&g->failed) ? " (out of memory, some are missing)" :
+                               atomic_load(&g->cancel) ? " (stopped)" : "");
+            _append(editor, g, summary, len);
+        }
+        *link = g->next;
+        _free(g);
+    }
+}
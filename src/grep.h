@@ -0,0 +1,34 @@
+#ifndef __GREP_H__
+#define __GREP_H__
+#include <stddef.h>
+
+// project grep: a directory tree is walked and searched on the worker pool, one task per
+// directory and one per few files. files are mapped and run through the search scanner
+// (or a regex), workers hand the matching lines over in batches and the ui thread appends
+// them to a scratch buffer when it draws, so results come in while the walk goes on.
+// hidden files and directories, symlinks and binary files are skipped.
+
+typedef struct photon_editor photon_editor_t;
+typedef struct photon_buffer photon_buffer_t;
+typedef struct photon_grep photon_grep_t;
+
+// files a scan task takes
+#define PHOTON_GREP_BATCH 16
+// a worker hands over what it found once it has this many bytes
+#define PHOTON_GREP_FLUSH (64 << 10)
+// bytes of results appended per frame at most, the rest waits for the next one
+#define PHOTON_GREP_DRAIN (1 << 20)
+// longer lines are cut in the results
+#define PHOTON_GREP_COLS 256
+
+// greps the files under dir for pattern (flags are PHOTON_SEARCH_*), the results go into
+// a new scratch buffer that's returned. NULL and editor->error set on failure
+photon_buffer_t *photon_grep_start(photon_editor_t *editor, const char *dir, const char *pattern, size_t n, int flags);
+// stops every grep, what was found so far stays
+void photon_grep_stop(photon_editor_t *editor);
+// appends what the workers found so far, photon_editor_draw calls it
+void photon_grep_drain(photon_editor_t *editor);
+// the buffer is being deleted, a grep writing into it stops
+void photon_grep_forget(photon_editor_t *editor, photon_buffer_t *buf);
+
+#endif//__GREP_H__
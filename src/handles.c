@@ -0,0 +1,161 @@
+#include "handles.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+// a name entry is its buffer's slot + 1, 0 is an empty one
+#define GONE UINT32_MAX // a name that was removed, lookups go on past it
+#define MIN_NAMES 16
+
+typedef struct slot {
+    photon_buffer_t *buf; // NULL while it's free
+    uint32_t gen;
+    uint32_t next_free;   // the next free slot + 1 while it's free, 0 ends the list
+    uint32_t hash;        // of the buffer's name
+    uint32_t live;        // where the buffer is in editor->bufs
+} slot_t;
+
+typedef struct photon_handles {
+    slot_t *slots;
+    uint32_t num_slot, cap_slot;
+    uint32_t free;        // the first free slot + 1
+    uint32_t *names;      // open addressing on the names' hashes, cap_name is a power of two
+    size_t cap_name;
+    size_t num_name;      // the ones that are there
+    size_t used_name;     // and the GONE ones, which probes still have to go past
+} photon_handles_t;
+
+static uint32_t _hash(const char *name){
+    uint32_t h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++)
+        h = (h ^ *p) * 16777619u;
+    return h;
+}
+
+static void _name_put(photon_handles_t *h, uint32_t i){
+    size_t mask = h->cap_name - 1;
+    for (size_t at = h->slots[i].hash & mask; ; at = (at + 1) & mask){
+        uint32_t e = h->names[at];
+        if (e && e != GONE) continue;
+        h->used_name += !e;
+        h->num_name++;
+        h->names[at] = i + 1;
+        return;
+    }
+}
+
+// a new table with room for one more name, without the GONE ones
+static int _rehash(photon_handles_t *h){
+    size_t cap = MIN_NAMES;
+    while (cap < (h->num_name + 1) * 2)
+        cap <<= 1;
+    uint32_t *names = calloc(cap, sizeof(uint32_t));
+    if (!names) return 0;
+    free(h->names);
+    h->names = names;
+    h->cap_name = cap;
+    h->num_name = h->used_name = 0;
+    for (uint32_t i = 0; i < h->num_slot; i++){
+        if (h->slots[i].buf && h->slots[i].buf->name)
+            _name_put(h, i);
+    }
+    return 1;
+}
+
+int photon_handles_add(photon_editor_t *editor, photon_buffer_t *buf){
+    photon_handles_t *h = editor->handles;
+    if (!h && !(h = editor->handles = calloc(1, sizeof(photon_handles_t)))) return 0;
+    // room everywhere first, so there's nothing to take back
+    if (editor->num_buf == editor->cap_buf){
+        size_t cap = editor->cap_buf ? editor->cap_buf * 2 : 16;
+        photon_buffer_t **bufs = realloc(editor->bufs, cap * sizeof(photon_buffer_t *));
+        if (!bufs) return 0;
+        editor->bufs = bufs;
+        editor->cap_buf = cap;
+    }
+    if (!h->free && h->num_slot == h->cap_slot){
+        if (h->cap_slot >= UINT32_MAX / 2) return 0;
+        uint32_t cap = h->cap_slot ? h->cap_slot * 2 : 16;
+        slot_t *slots = realloc(h->slots, cap * sizeof(slot_t));
+        if (!slots) return 0;
+        h->slots = slots;
+        h->cap_slot = cap;
+    }
+    if (buf->name && (h->used_name + 1) * 4 > h->cap_name * 3 && !_rehash(h)) return 0;
+
+    uint32_t i;
+    if (h->free){
+        i = h->free - 1;
+        h->free = h->slots[i].next_free;
+    } else {
+        i = h->num_slot++;
+        h->slots[i].gen = 1;
+    }
+    slot_t *s = &h->slots[i];
+    s->buf = buf;
+    s->live = (uint32_t)editor->num_buf;
+    editor->bufs[editor->num_buf++] = buf;
+    buf->id = (photon_buf_id_t)s->gen << 32 | i;
+    if (buf->name){
+        s->hash = _hash(buf->name);
+        _name_put(h, i);
+    }
+    return 1;
+}
+
+void photon_handles_remove(photon_editor_t *editor, photon_buffer_t *buf){
+    photon_handles_t *h = editor->handles;
+    uint32_t i = (uint32_t)buf->id;
+    slot_t *s = &h->slots[i];
+    if (buf->name){
+        size_t mask = h->cap_name - 1;
+        size_t at = s->hash & mask;
+        while (h->names[at] != i + 1)
+            at = (at + 1) & mask;
+        h->names[at] = GONE;
+        h->num_name--;
+    }
+    // the last one takes its place
+    photon_buffer_t *last = editor->bufs[--editor->num_buf];
+    editor->bufs[s->live] = last;
+    h->slots[(uint32_t)last->id].live = s->live;
+    s->buf = NULL;
+    if (!++s->gen)
+        s->gen = 1;
+    s->next_free = h->free;
+    h->free = i + 1;
+}
+
+photon_buffer_t *photon_buffer_get(const photon_editor_t *editor, photon_buf_id_t id){
+    const photon_handles_t *h = editor->handles;
+    uint32_t i = (uint32_t)id;
+    if (!h || i >= h->num_slot || h->slots[i].gen != (uint32_t)(id >> 32)) return NULL;
+    return h->slots[i].buf;
+}
+
+photon_buffer_t *photon_buffer_find(const photon_editor_t *editor, const char *name){
+    const photon_handles_t *h = editor->handles;
+    if (!h || !h->num_name) return NULL;
+    uint32_t hash = _hash(name);
+    size_t mask = h->cap_name - 1;
+    for (size_t at = hash & mask; h->names[at]; at = (at + 1) & mask){
+        uint32_t e = h->names[at];
+        if (e == GONE || h->slots[e - 1].hash != hash) continue;
+        if (!strcmp(h->slots[e - 1].buf->name, name))
+            return h->slots[e - 1].buf;
+    }
+    return NULL;
+}
+
+void photon_handles_free(photon_editor_t *editor){
+    photon_handles_t *h = editor->handles;
+    if (h){
+        free(h->slots);
+        free(h->names);
+        free(h);
+    }
+    free(editor->bufs);
+    editor->handles = NULL;
+    editor->bufs = NULL;
+    editor->num_buf = editor->cap_buf = 0;
+}
@@ -0,0 +1,23 @@
+#ifndef __HANDLES_H__
+#define __HANDLES_H__
+#include <stddef.h>
+#include "photon.h"
+
+// every buffer has a slot in the editor's table and its id is the slot's index (low 32
+// bits) with the slot's generation (high 32), which goes up whenever the slot is freed.
+// an id kept after its buffer was deleted finds nothing instead of whatever took the slot
+// over. the live buffers are also packed into editor->bufs for going over all of them,
+// and there's a hash of the names so looking one up by name doesn't go through them.
+
+// NULL if the buffer's gone
+photon_buffer_t *photon_buffer_get(const photon_editor_t *editor, photon_buf_id_t id);
+// a buffer with that name (any of them if there's more than one, splits share it), NULL
+// if there's none
+photon_buffer_t *photon_buffer_find(const photon_editor_t *editor, const char *name);
+
+// the buffer calls these, add sets buf->id and returns 0 if out of memory
+int photon_handles_add(photon_editor_t *editor, photon_buffer_t *buf);
+void photon_handles_remove(photon_editor_t *editor, photon_buffer_t *buf);
+void photon_handles_free(photon_editor_t *editor);
+
+#endif//__HANDLES_H__
@@ -0,0 +1,422 @@
+#include "highlight.h"
+#include "photon.h"
+#include "regex.h"
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define err_and_ret(edit, err, val) edit->error = err; return val;
+
+// token kinds for photon_highlight_line, ui thread only
+static unsigned char *kinds;
+static size_t cap_kinds;
+
+static int _suffix_matches(const photon_grammar_t *grammar, const char *path){
+    const char *slash = strrchr(path, '/');
+    const char *dot = strrchr(slash ? slash : path, '.');
+    if (!dot || !dot[1] || !grammar->suffixes) return 0;
+    size_t len = strlen(++dot);
+    const char *p = grammar->suffixes;
+    while (*p){
+        size_t n = strcspn(p, " ");
+        if (n == len && !memcmp(p, dot, n))
+            return 1;
+        p += n;
+        while (*p == ' ')
+            p++;
+    }
+    return 0;
+}
+
+// a rule grammar, a regex for every pattern and end
+struct photon_hl_rules {
+    const photon_hl_rule_t *rules;
+    int n, regions;
+    photon_regex_t **begin, **end;
+    size_t *start, *stop; // each rule's next match on the line being lexed
+};
+
+static void _free_rules(struct photon_hl_rules *hl){
+    if (!hl) return;
+    for (int r = 0; r < hl->n; r++){
+        photon_regex_free(hl->begin[r]);
+        photon_regex_free(hl->end[r]);
+    }
+    free(hl->begin);
+    free(hl->end);
+    free(hl->start);
+    free(hl->stop);
+    free(hl);
+}
+
+// sets editor->error if it returns NULL
+static struct photon_hl_rules *_compile_rules(photon_editor_t *editor, const photon_hl_rule_t *rules){
+    struct photon_hl_rules *hl = calloc(1, sizeof(struct photon_hl_rules));
+    int n = 0;
+    while (rules[n].pattern)
+        n++;
+    if (!hl || !(hl->begin = calloc(n + 1, sizeof(photon_regex_t *))) || !(hl->end = calloc(n + 1, sizeof(photon_regex_t *)))
+        || !(hl->start = malloc((n + 1) * sizeof(size_t))) || !(hl->stop = malloc((n + 1) * sizeof(size_t)))){
+        _free_rules(hl);
+        editor->error = PHOTON_NO_MEM;
+        return NULL;
+    }
+    hl->rules = rules;
+    for (; hl->n < n; hl->n++){
+        const photon_hl_rule_t *rule = &rules[hl->n];
+        const char *error = NULL;
+        hl->begin[hl->n] = photon_regex_compile(rule->pattern, strlen(rule->pattern), 0, &error);
+        if (hl->begin[hl->n] && rule->end)
+            hl->end[hl->n] = photon_regex_compile(rule->end, strlen(rule->end), 0, &error);
+        if (error){
+            hl->n++;
+            _free_rules(hl);
+            editor->error = strcmp(error, "out of memory") ? PHOTON_BAD_PARAM : PHOTON_NO_MEM;
+            return NULL;
+        }
+        hl->regions |= rule->end != NULL;
+    }
+    return hl;
+}
+
+static void _set(photon_buffer_t *buf, const photon_grammar_t *grammar, struct photon_hl_rules *rules){
+    buf->text->_hl.grammar = grammar;
+    buf->text->_hl.rules = rules;
+    photon_highlight_reset(buf);
+}
+
+int photon_add_grammar(photon_editor_t *editor, const photon_grammar_t *grammar){
+    if (!grammar || !grammar->name || (!grammar->lex && !grammar->rules)){
+        err_and_ret(editor, PHOTON_BAD_PARAM, 0);
+    }
+    struct photon_hl_rules *rules = NULL;
+    if (!grammar->lex && !(rules = _compile_rules(editor, grammar->rules))) return 0;
+    const photon_grammar_t **grammars = realloc(editor->grammars, (editor->num_grammar + 1) * sizeof(photon_grammar_t *));
+    if (grammars)
+        editor->grammars = grammars;
+    struct photon_hl_rules **compiled = realloc(editor->grammar_rules, (editor->num_grammar + 1) * sizeof(struct photon_hl_rules *));
+    if (compiled)
+        editor->grammar_rules = compiled;
+    if (!grammars || !compiled){
+        _free_rules(rules);
+        err_and_ret(editor, PHOTON_NO_MEM, 0);
+    }
+    grammars[editor->num_grammar] = grammar;
+    compiled[editor->num_grammar++] = rules;
+    // files opened before the grammar showed up (lazy extensions) get it too
+    for (size_t i = 0; i < editor->num_buf; i++){
+        photon_buffer_t *buf = editor->bufs[i];
+        if (!buf->text->_hl.grammar && buf->type == BUF_FILE && buf->name && _suffix_matches(grammar, buf->name))
+            _set(buf, grammar, rules);
+    }
+    return 1;
+}
+
+void photon_highlight_cleanup(photon_editor_t *editor){
+    for (int i = 0; i < editor->num_grammar; i++)
+        _free_rules(editor->grammar_rules[i]);
+    free(editor->grammars);
+    free(editor->grammar_rules);
+    editor->grammars = NULL;
+    editor->grammar_rules = NULL;
+    editor->num_grammar = 0;
+}
+
+int photon_set_grammar(photon_editor_t *editor, photon_buffer_t *buf, const char *name){
+    if (!name){
+        _set(buf, NULL, NULL);
+        return 1;
+    }
+    for (int i = editor->num_grammar - 1; i >= 0; i--){
+        if (!strcmp(editor->grammars[i]->name, name)){
+            _set(buf, editor->grammars[i], editor->grammar_rules[i]);
+            return 1;
+        }
+    }
+    err_and_ret(editor, PHOTON_BAD_PARAM, 0);
+}
+
+void photon_highlight_pick(photon_editor_t *editor, photon_buffer_t *buf, const char *path){
+    for (int i = editor->num_grammar - 1; path && i >= 0; i--){
+        if (_suffix_matches(editor->grammars[i], path)){
+            _set(buf, editor->grammars[i], editor->grammar_rules[i]);
+            return;
+        }
+    }
+    _set(buf, NULL, NULL);
+}
+
+void photon_highlight_reset(photon_buffer_t *buf){
+    buf->text->_hl.clean = buf->text->_hl.lexed = buf->text->_hl.dirty = 0;
+}
+
+static void _mark(unsigned char *kinds, int from, int to, int kind){
+    if (kinds)
+        memset(kinds + from, kind, to - from);
+}
+
+#define NONE ((size_t)-1)
+
+// rule r's next match from from on, empty ones would mark nothing and never move on
+static void _find_rule(struct photon_hl_rules *hl, int r, const char *text, size_t n, size_t from){
+    size_t start, end;
+    hl->start[r] = NONE;
+    while (photon_regex_find(hl->begin[r], text, n, from, &start, &end) > 0){
+        if (end > start){
+            hl->start[r] = start;
+            hl->stop[r] = end;
+            return;
+        }
+        from = end + 1;
+    }
+}
+
+// the state is 0, or the rule whose region the line ends in + 1
+static uint32_t _lex_rules(struct photon_hl_rules *hl, uint32_t state, const char *text, int length, unsigned char *kinds){
+    size_t n = (size_t)length, pos = 0, start, end;
+    // without regions no line can change how the next one starts
+    if (!kinds && !hl->regions) return 0;
+    _mark(kinds, 0, length, PHOTON_TOK_NORMAL);
+    if (state && state <= (uint32_t)hl->n && hl->end[state - 1]){
+        int kind = hl->rules[state - 1].kind;
+        if (photon_regex_find(hl->end[state - 1], text, n, 0, &start, &end) <= 0){
+            _mark(kinds, 0, length, kind);
+            return state;
+        }
+        _mark(kinds, 0, (int)end, kind);
+        pos = end;
+    }
+    for (int r = 0; r < hl->n; r++)
+        _find_rule(hl, r, text, n, pos);
+    for (;;){
+        int best = -1;
+        for (int r = 0; r < hl->n; r++){
+            if (hl->start[r] != NONE && hl->start[r] < pos)
+                _find_rule(hl, r, text, n, pos);
+            if (hl->start[r] != NONE && (best < 0 || hl->start[r] < hl->start[best]))
+                best = r;
+        }
+        if (best < 0) return 0;
+        start = hl->start[best];
+        end = hl->stop[best];
+        if (hl->end[best]){
+            size_t closeStart;
+            if (photon_regex_find(hl->end[best], text, n, end, &closeStart, &end) <= 0){
+                _mark(kinds, (int)start, length, hl->rules[best].kind);
+                return best + 1;
+            }
+        }
+        _mark(kinds, (int)start, (int)end, hl->rules[best].kind);
+        pos = end;
+    }
+}
+
+static uint32_t _lex(photon_buffer_t *buf, uint32_t state, const char *text, int length, unsigned char *kinds){
+    if (buf->text->_hl.rules)
+        return _lex_rules(buf->text->_hl.rules, state, text, length, kinds);
+    return buf->text->_hl.grammar->lex(state, text, length, kinds);
+}
+
+// where line v ended up, lines first + 1 to first - delta are gone when delta is negative
+static size_t _shift(size_t v, size_t first, long delta){
+    if (v <= first) return v;
+    if (delta >= 0) return v + delta;
+    size_t gone = (size_t)-delta;
+    return v > first + gone ? v - gone : first;
+}
+
+void photon_highlight_edit(photon_buffer_t *buf, size_t first, size_t last, long delta){
+    if (buf->text->_hl.clean > first)
+        buf->text->_hl.clean = first;
+    buf->text->_hl.lexed = _shift(buf->text->_hl.lexed, first, delta);
+    size_t dirty = _shift(buf->text->_hl.dirty, first, delta);
+    buf->text->_hl.dirty = dirty > last + 1 ? dirty : last + 1;
+}
+
+void photon_highlight_update(photon_buffer_t *buf, size_t n){
+    const photon_grammar_t *grammar = buf->text->_hl.grammar;
+    if (!grammar) return;
+    if (n > buf->text->num_line)
+        n = buf->text->num_line;
+    if (buf->text->_hl.clean >= n) return;
+    PHOTON_TRACE_BEGIN("highlight.update(from,to)", buf->text->_hl.clean, n);
+    size_t i = buf->text->_hl.clean, lexed = buf->text->_hl.lexed;
+    uint32_t state = i ? buf->text->lines[i - 1].hl_state : 0;
+    while (i < n){
+        photon_line_t *line = &buf->text->lines[i];
+        uint32_t next = _lex(buf, state, photon_line_str(line), line->length, NULL);
+        if (next == line->hl_state && i < lexed && i + 1 >= buf->text->_hl.dirty){
+            // ends like it did before and nothing after it changed, so neither did their states
+            i = lexed;
+            state = buf->text->lines[i - 1].hl_state;
+            continue;
+        }
+        line->hl_state = state = next;
+        i++;
+    }
+    buf->text->_hl.clean = i;
+    if (buf->text->_hl.lexed < i)
+        buf->text->_hl.lexed = i;
+    PHOTON_TRACE_END("highlight.update");
+}
+
+const unsigned char *photon_highlight_line(photon_buffer_t *buf, size_t i){
+    const photon_grammar_t *grammar = buf->text->_hl.grammar;
+    if (!grammar || i >= buf->text->num_line) return NULL;
+    photon_line_t *line = &buf->text->lines[i];
+    if ((size_t)line->length >= cap_kinds){
+        size_t cap = cap_kinds ? cap_kinds : 256;
+        while (cap <= (size_t)line->length)
+            cap <<= 1;
+        unsigned char *p = realloc(kinds, cap);
+        if (!p) return NULL;
+        kinds = p;
+        cap_kinds = cap;
+    }
+    photon_highlight_update(buf, i);
+    _lex(buf, i ? buf->text->lines[i - 1].hl_state : 0, photon_line_str(line), line->length, kinds);
+    return kinds;
+}
+
+// C: block comments and strings can go on past the end of a line, and so can a
+// directive ending in a backslash
+#define C_COMMENT 1
+#define C_STRING  2
+#define C_MACRO   4
+
+static const char *c_keywords[] = {
+    "auto", "break", "case", "const", "continue", "default", "do", "else", "enum", "extern",
+    "for", "goto", "if", "inline", "register", "restrict", "return", "sizeof", "static",
+    "struct", "switch", "typedef", "union", "volatile", "while", "_Alignas", "_Alignof",
+    "_Atomic", "_Generic", "_Noreturn", "_Static_assert", "_Thread_local", "NULL", NULL
+};
+
+static const char *c_types[] = {
+    "char", "double", "float", "int", "long", "short", "signed", "unsigned", "void",
+    "_Bool", "bool", "FILE", NULL
+};
+
+static int _c_is_word(char c){
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+static int _c_in(const char **words, const char *w, int n){
+    for (; *words; words++){
+        if (!strncmp(*words, w, n) && !(*words)[n])
+            return 1;
+    }
+    return 0;
+}
+
+static int _c_word_kind(const char *w, int n, int base){
+    if (_c_in(c_keywords, w, n)) return PHOTON_TOK_KEYWORD;
+    // foo_t is a type as far as anyone's concerned
+    if (_c_in(c_types, w, n) || (n > 2 && w[n - 2] == '_' && w[n - 1] == 't')) return PHOTON_TOK_TYPE;
+    return base;
+}
+
+// past the closing */, -1 if the line ends first
+static int _c_comment_end(const char *s, int n, int i){
+    for (; i + 1 < n; i++){
+        if (s[i] == '*' && s[i + 1] == '/')
+            return i + 2;
+    }
+    return -1;
+}
+
+// past the closing quote, -1 if the line ends first
+static int _c_string_end(const char *s, int n, int i, char quote){
+    for (; i < n; i++){
+        if (s[i] == '\\')
+            i++;
+        else if (s[i] == quote)
+            return i + 1;
+    }
+    return -1;
+}
+
+static uint32_t _lex_c(uint32_t state, const char *s, int n, unsigned char *kinds){
+    int base = state & C_MACRO ? PHOTON_TOK_PREPROC : PHOTON_TOK_NORMAL;
+    int continues = n && s[n - 1] == '\\';
+    int i = 0, end;
+    if (state & C_COMMENT){
+        if ((end = _c_comment_end(s, n, 0)) < 0){
+            _mark(kinds, 0, n, PHOTON_TOK_COMMENT);
+            return C_COMMENT | (state & C_MACRO && continues ? C_MACRO : 0);
+        }
+        _mark(kinds, 0, end, PHOTON_TOK_COMMENT);
+        i = end;
+    } else if (state & C_STRING){
+        if ((end = _c_string_end(s, n, 0, '"')) < 0){
+            _mark(kinds, 0, n, PHOTON_TOK_STRING);
+            return continues ? state : state & C_MACRO;
+        }
+        _mark(kinds, 0, end, PHOTON_TOK_STRING);
+        i = end;
+    }
+    int lead = i;
+    while (lead < n && (s[lead] == ' ' || s[lead] == '\t'))
+        lead++;
+    if (!state && lead < n && s[lead] == '#'){
+        // the directive itself, the rest of the line keeps its colors but plain text is preproc
+        base = PHOTON_TOK_PREPROC;
+        i = lead + 1;
+        while (i < n && (s[i] == ' ' || s[i] == '\t'))
+            i++;
+        int word = i;
+        while (i < n && _c_is_word(s[i]))
+            i++;
+        _mark(kinds, 0, i, PHOTON_TOK_PREPROC);
+        const char *close;
+        if (i - word == 7 && !memcmp(s + word, "include", 7)){
+            while (i < n && s[i] == ' ')
+                i++;
+            // <header> is as much a string as "header" is
+            if (i < n && s[i] == '<' && (close = memchr(s + i, '>', n - i))){
+                _mark(kinds, i, (int)(close - s) + 1, PHOTON_TOK_STRING);
+                i = (int)(close - s) + 1;
+            }
+        }
+    }
+    while (i < n){
+        char c = s[i];
+        int start = i;
+        if (c == '/' && i + 1 < n && s[i + 1] == '/'){
+            _mark(kinds, i, n, PHOTON_TOK_COMMENT);
+            break;
+        }
+        if (c == '/' && i + 1 < n && s[i + 1] == '*'){
+            if ((end = _c_comment_end(s, n, i + 2)) < 0){
+                _mark(kinds, i, n, PHOTON_TOK_COMMENT);
+                return C_COMMENT | (base == PHOTON_TOK_PREPROC && continues ? C_MACRO : 0);
+            }
+            _mark(kinds, i, end, PHOTON_TOK_COMMENT);
+            i = end;
+        } else if (c == '"' || c == '\''){
+            if ((end = _c_string_end(s, n, i + 1, c)) < 0){
+                _mark(kinds, i, n, PHOTON_TOK_STRING);
+                if (c == '"' && continues)
+                    return C_STRING | (base == PHOTON_TOK_PREPROC ? C_MACRO : 0);
+                break;
+            }
+            _mark(kinds, i, end, PHOTON_TOK_STRING);
+            i = end;
+        } else if ((c >= '0' && c <= '9') || (c == '.' && i + 1 < n && s[i + 1] >= '0' && s[i + 1] <= '9')){
+            while (i < n && (_c_is_word(s[i]) || s[i] == '.'))
+                i++;
+            _mark(kinds, start, i, PHOTON_TOK_NUMBER);
+        } else if (_c_is_word(c)){
+            while (i < n && _c_is_word(s[i]))
+                i++;
+            if (kinds)
+                _mark(kinds, start, i, _c_word_kind(s + start, i - start, base));
+        } else {
+            if (kinds)
+                kinds[i] = base;
+            i++;
+        }
+    }
+    return base == PHOTON_TOK_PREPROC && continues ? C_MACRO : 0;
+}
+
+const photon_grammar_t photon_grammar_c = { .name = "c", .suffixes = "c h", .lex = _lex_c };
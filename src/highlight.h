@@ -0,0 +1,38 @@
+#ifndef __HIGHLIGHT_H__
+#define __HIGHLIGHT_H__
+#include <stddef.h>
+
+// incremental highlighting: every line keeps the lexer state at its end (hl_state), so
+// after an edit lexing restarts at the first changed line and stops as soon as a line
+// ends in the same state it did before. only what's about to be drawn is brought up
+// to date, the rest of the file catches up when it's scrolled to.
+
+typedef struct photon_editor photon_editor_t;
+typedef struct photon_buffer photon_buffer_t;
+typedef struct photon_grammar photon_grammar_t;
+
+// lines past the bottom of the screen kept up to date, so scrolling a little doesn't lex
+#define PHOTON_HL_LOOKAHEAD 100
+
+extern const photon_grammar_t photon_grammar_c;
+
+// these return 0 and set editor->error on failure, a rule that doesn't compile is a
+// PHOTON_BAD_PARAM
+int photon_add_grammar(photon_editor_t *editor, const photon_grammar_t *grammar);
+int photon_set_grammar(photon_editor_t *editor, photon_buffer_t *buf, const char *name);
+// by the path's extension, none if nothing matches
+void photon_highlight_pick(photon_editor_t *editor, photon_buffer_t *buf, const char *path);
+// forgets every grammar
+void photon_highlight_cleanup(photon_editor_t *editor);
+
+// the buffer calls these: lines first to last (after the edit) have new text and the
+// lines after last moved by delta
+void photon_highlight_edit(photon_buffer_t *buf, size_t first, size_t last, long delta);
+void photon_highlight_reset(photon_buffer_t *buf);
+
+// makes the states of the first n lines right
+void photon_highlight_update(photon_buffer_t *buf, size_t n);
+// token kinds of line i, good until the next call. NULL if the buffer has no grammar
+const unsigned char *photon_highlight_line(photon_buffer_t *buf, size_t i);
+
+#endif//__HIGHLIGHT_H__
@@ -3,6 +3,9 @@
 #include <setjmp.h>
 #include <ctype.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
 
 typedef struct photon_termkey {
     char prefix;
@@ -12,13 +15,84 @@ typedef struct photon_termkey {
 
 static jmp_buf err_handler;
 
+// read(2) straight from stdin instead of stdio so poll() and our buffer agree on what's pending
+static unsigned char in_buf[256];
+static int in_len, in_pos;
+static photon_input_reader_t reader;
+static photon_input_tap_t tap;
+static int in_fd = STDIN_FILENO;
+static int in_writable;
+static int size_rows, size_cols;
+
 #define BELL() (putchar(7), fflush(stdout))
+// a nonblocking fd (a client's socket) gets this long for the rest of a key, then it's
+// taken as gone
+#define KEY_REST_MS 100
 
 static int _photon_getch(void){
-    int ch = getchar();
-    if (ch == EOF)
-        longjmp(err_handler, 67);
-    return ch;
+    if (in_pos == in_len){
+        ssize_t n;
+        if (reader)
+            n = reader(in_buf, sizeof(in_buf));
+        else while ((n = read(in_fd, in_buf, sizeof(in_buf))) == -1){
+            if (errno == EINTR) continue;
+            struct pollfd p = { .fd = in_fd, .events = POLLIN };
+            if (errno != EAGAIN || poll(&p, 1, KEY_REST_MS) != 1) break;
+        }
+        if (n <= 0)
+            longjmp(err_handler, 67);
+        if (tap)
+            tap(in_buf, (size_t)n);
+        in_len = (int)n;
+        in_pos = 0;
+    }
+    return in_buf[in_pos++];
+}
+
+void photon_input_set_reader(photon_input_reader_t newReader){
+    reader = newReader;
+}
+
+void photon_input_set_tap(photon_input_tap_t newTap){
+    tap = newTap;
+}
+
+void photon_input_set_fd(int fd){
+    in_fd = fd;
+    in_pos = in_len = 0;
+}
+
+void photon_input_wait_writable(int on){
+    in_writable = on;
+}
+
+void photon_input_size(int *rows, int *cols){
+    *rows = size_rows;
+    *cols = size_cols;
+}
+
+int photon_input_pending(void){
+    return in_pos != in_len;
+}
+
+int photon_input_wait(const int *fds, int n, int timeout){
+    if (photon_input_pending()) return 1;
+    struct pollfd p[PHOTON_INPUT_MAX_FDS + 1] = { { .fd = in_fd, .events = POLLIN | (in_writable ? POLLOUT : 0) } };
+    if (n > PHOTON_INPUT_MAX_FDS)
+        n = PHOTON_INPUT_MAX_FDS;
+    for (int i = 0; i < n; i++)
+        p[i + 1] = (struct pollfd){ .fd = fds[i], .events = POLLIN };
+    if (reader){
+        // the reader always has something, only stop for work that's already done
+        return !n || poll(p + 1, n, 0) < 1;
+    }
+    int ready;
+    while ((ready = poll(p, n + 1, timeout)) == -1){
+        if (errno != EINTR) return 1;
+    }
+    if (!ready) return 0;
+    // let the key win if both are ready, the other fds will still be readable next time
+    return (p[0].revents & (POLLIN | POLLHUP | POLLERR)) != 0;
 }
 
 static int _photon_handle_tilde(const photon_termkey_t *key){
@@ -102,6 +176,13 @@ int photon_input_read_key(void){
         case '~':
             val = _photon_handle_tilde(&key);
             break;
+        case 't':
+            // the window size report, CSI 8 ; rows ; cols t
+            if (key.n != 3 || key.P[0] != 8 || key.P[1] <= 0 || key.P[2] <= 0) goto err;
+            size_rows = key.P[1];
+            size_cols = key.P[2];
+            val = PHOTON_KRESIZE;
+            break;
         default: goto err;
         }
         goto skip;
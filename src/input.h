@@ -1,6 +1,9 @@
 #ifndef __INPUT_H__
 #define __INPUT_H__
 
+#include <stddef.h>
+#include <sys/types.h>
+
 #define PHOTON_INVALID_KEY (-2763)
 #define PHOTON_KUP 0601
 #define PHOTON_KDOWN 0602
@@ -8,7 +11,26 @@
 #define PHOTON_KRIGHT 0604
 #define PHOTON_KHOME 0605
 #define PHOTON_KEND 0606
+// the terminal changed size, photon_input_size has the new one
+#define PHOTON_KRESIZE 0607
+
+// replaces read(2) on stdin, returning 0 ends the input
+typedef ssize_t (*photon_input_reader_t)(unsigned char *buf, size_t n);
+// sees every chunk of raw input as it comes in
+typedef void (*photon_input_tap_t)(const unsigned char *buf, size_t n);
+void photon_input_set_reader(photon_input_reader_t reader);
+void photon_input_set_tap(photon_input_tap_t tap);
+// where keys are read from instead of stdin, -1 for nowhere
+void photon_input_set_fd(int fd);
+// photon_input_wait also comes back (with 0) once that fd can be written to
+void photon_input_wait_writable(int on);
+void photon_input_size(int *rows, int *cols);
 
 int photon_input_read_key(void);
+int photon_input_pending(void);
+// waits until a key can be read (returns 1), one of the n fds becomes readable or timeout
+// ms went by (returns 0). timeout -1 waits as long as it takes
+#define PHOTON_INPUT_MAX_FDS 8
+int photon_input_wait(const int *fds, int n, int timeout);
 
 #endif//__INPUT_H__
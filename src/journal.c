@@ -0,0 +1,582 @@
+#include "journal.h"
+#include "photon.h"
+#include "buffer.h"
+#include "extensions.h"
+#include "cursors.h"
+#include "undo.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define err_and_ret(edit, err, val) edit->error = err; return val;
+
+// the header is the magic, the file's size and mtime (ns), the length of its path and
+// the path. frames follow: their payload's length (8 bytes), its checksum (4) and the
+// payload, which is records one after another
+#define MAGIC "PHOTONJ1"
+#define MAGIC_LEN 8
+#define HEADER_FIXED (MAGIC_LEN + 8 + 8 + 4)
+#define FRAME_HEADER 12
+
+// a record is its type and then varints
+#define REC_EDITS 'E' // how many, then line, col, end_line, end_col, length and the text of each
+#define REC_TEXT 'S'  // the length of the whole text and the text
+
+#define VARINT_MAX 10
+#define FNV_BASIS 2166136261u
+#define COPY_CHUNK (64 << 10)
+
+typedef struct bytes {
+    char *data;
+    size_t n, cap;
+} bytes_t;
+
+struct photon_journal {
+    int fd;
+    char *path, *tmp_path;
+    char *file;           // the file's absolute path
+    uint64_t file_size;   // what the header says about it
+    int64_t file_mtime;
+    photon_text_t *text;  // NULL once the text's gone and a compaction still has this
+    bytes_t pending;      // records that aren't written yet
+    bytes_t since;        // records since the compaction's snapshot was taken
+    uint64_t pending_ns;  // when the oldest pending record was made
+    off_t size;           // of the file
+    off_t compact_at;
+    char compacting;
+    char lost;            // a record couldn't be made, nothing more goes in
+    // only the compaction's worker touches these until it's done
+    int tmp_fd;           // its new journal, -1 if it failed
+    off_t tmp_size;
+    size_t tmp_text;      // bytes of text in it
+};
+
+static uint64_t _now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint32_t _fnv(uint32_t h, const void *data, size_t n){
+    const unsigned char *p = data;
+    for (size_t i = 0; i < n; i++)
+        h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
+static int _reserve(bytes_t *b, size_t n){
+    if (b->n + n <= b->cap) return 1;
+    size_t cap = b->cap ? b->cap : 4096;
+    while (cap < b->n + n)
+        cap <<= 1;
+    char *data = realloc(b->data, cap);
+    if (!data) return 0;
+    b->data = data;
+    b->cap = cap;
+    return 1;
+}
+
+static size_t _put_varint(char *out, uint64_t v){
+    size_t n = 0;
+    while (v >= 0x80){
+        out[n++] = (char)(v | 0x80);
+        v >>= 7;
+    }
+    out[n++] = (char)v;
+    return n;
+}
+
+static int _get_varint(const char **p, const char *end, uint64_t *v){
+    *v = 0;
+    for (int shift = 0; *p < end && shift < 64; shift += 7){
+        unsigned char c = (unsigned char)*(*p)++;
+        *v |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80)) return 1;
+    }
+    return 0;
+}
+
+static int _put_edits(bytes_t *b, const photon_edit_t *edits, size_t n){
+    size_t need = 1 + VARINT_MAX;
+    for (size_t k = 0; k < n; k++)
+        need += 5 * VARINT_MAX + edits[k].length;
+    if (!_reserve(b, need)) return 0;
+    char *p = b->data + b->n;
+    *p++ = REC_EDITS;
+    p += _put_varint(p, n);
+    for (size_t k = 0; k < n; k++){
+        const photon_edit_t *e = &edits[k];
+        p += _put_varint(p, e->line);
+        p += _put_varint(p, e->col);
+        p += _put_varint(p, e->end_line);
+        p += _put_varint(p, e->end_col);
+        p += _put_varint(p, e->length);
+        if (e->length)
+            memcpy(p, e->text, e->length);
+        p += e->length;
+    }
+    b->n = p - b->data;
+    return 1;
+}
+
+static size_t _text_bytes(const photon_buffer_t *buf){
+    size_t n = buf->text->num_line - 1;
+    for (size_t i = 0; i < buf->text->num_line; i++)
+        n += buf->text->lines[i].length;
+    return n;
+}
+
+static int _put_text(bytes_t *b, photon_buffer_t *buf){
+    size_t bytes = _text_bytes(buf);
+    if (!_reserve(b, 1 + VARINT_MAX + bytes)) return 0;
+    char *p = b->data + b->n;
+    *p++ = REC_TEXT;
+    p += _put_varint(p, bytes);
+    for (size_t i = 0; i < buf->text->num_line; i++){
+        if (i)
+            *p++ = '\n';
+        memcpy(p, photon_line_str(&buf->text->lines[i]), buf->text->lines[i].length);
+        p += buf->text->lines[i].length;
+    }
+    b->n = p - b->data;
+    return 1;
+}
+
+static int _pwrite_all(int fd, const void *data, size_t n, off_t at){
+    const char *p = data;
+    while (n){
+        ssize_t w = pwrite(fd, p, n, at);
+        if (w == -1){
+            if (errno == EINTR) continue;
+            return 0;
+        }
+        p += w;
+        at += w;
+        n -= (size_t)w;
+    }
+    return 1;
+}
+
+static void _frame_header(char *out, uint64_t len, uint32_t sum){
+    memcpy(out, &len, 8);
+    memcpy(out + 8, &sum, 4);
+}
+
+// everything in b as one frame at the end of the journal
+static int _write_frame(int fd, off_t at, const bytes_t *b){
+    char head[FRAME_HEADER];
+    _frame_header(head, b->n, _fnv(FNV_BASIS, b->data, b->n));
+    return _pwrite_all(fd, head, FRAME_HEADER, at) && _pwrite_all(fd, b->data, b->n, at + FRAME_HEADER);
+}
+
+static size_t _header(const photon_journal_t *j, char *out){
+    uint32_t len = (uint32_t)strlen(j->file);
+    memcpy(out, MAGIC, MAGIC_LEN);
+    memcpy(out + MAGIC_LEN, &j->file_size, 8);
+    memcpy(out + MAGIC_LEN + 8, &j->file_mtime, 8);
+    memcpy(out + MAGIC_LEN + 16, &len, 4);
+    memcpy(out + HEADER_FIXED, j->file, len);
+    return HEADER_FIXED + len;
+}
+
+static int _write_header(const photon_journal_t *j, int fd, off_t *size){
+    char *head = malloc(HEADER_FIXED + strlen(j->file));
+    if (!head) return 0;
+    size_t n = _header(j, head);
+    int ok = _pwrite_all(fd, head, n, 0);
+    free(head);
+    *size = (off_t)n;
+    return ok;
+}
+
+// so a rename or a new journal survives a crash too
+static void _sync_dir(const char *path){
+    char dir[PATH_MAX];
+    const char *slash = strrchr(path, '/');
+    if (!slash || (size_t)(slash - path) >= sizeof(dir)) return;
+    memcpy(dir, path, slash - path);
+    dir[slash - path] = 0;
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) return;
+    fsync(fd);
+    close(fd);
+}
+
+// $XDG_STATE_HOME/photon/journal or ~/.config/photon/journal, made if it isn't there
+static int _dir(char *out, size_t size){
+    const char *state = getenv("XDG_STATE_HOME"), *home = getenv("HOME");
+    int n;
+    if (state && *state)
+        n = snprintf(out, size, "%s/photon", state);
+    else if (home)
+        n = snprintf(out, size, "%s/.config/photon", home);
+    else
+        return 0;
+    if (n < 0 || (size_t)n + sizeof("/journal") > size) return 0;
+    for (char *p = out + 1; *p; p++){
+        if (*p != '/') continue;
+        *p = 0;
+        mkdir(out, 0700);
+        *p = '/';
+    }
+    mkdir(out, 0700);
+    strcat(out, "/journal");
+    return mkdir(out, 0700) == 0 || errno == EEXIST;
+}
+
+// the same file has the same journal however it was named, one that doesn't exist yet
+// is taken relative to the working directory
+static char *_file_path(const char *name){
+    char *path = realpath(name, NULL);
+    if (path || name[0] == '/') return path ? path : strdup(name);
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) return strdup(name);
+    path = malloc(strlen(cwd) + strlen(name) + 2);
+    if (path)
+        sprintf(path, "%s/%s", cwd, name);
+    return path;
+}
+
+static void _free(photon_journal_t *j){
+    if (j->fd != -1)
+        close(j->fd);
+    free(j->path);
+    free(j->tmp_path);
+    free(j->file);
+    free(j->pending.data);
+    free(j->since.data);
+    free(j);
+}
+
+// the records of one frame, 0 if one doesn't make sense or can't be made
+static int _replay_frame(photon_editor_t *editor, photon_buffer_t *buf, const char *p, const char *end){
+    while (p < end){
+        char type = *p++;
+        uint64_t n;
+        if (!_get_varint(&p, end, &n)) return 0;
+        if (type == REC_TEXT){
+            if (n > (uint64_t)(end - p)) return 0;
+            size_t last = buf->text->num_line - 1;
+            photon_edit_t all = { 0, 0, last, buf->text->lines[last].length, p, n };
+            photon_undo_step_t *undo = photon_buffer_apply(editor, buf, &all, 1);
+            if (!undo) return 0;
+            free(undo);
+            photon_cursors_clear(buf);
+            memset(&buf->_gap, 0, sizeof(buf->_gap));
+            p += n;
+            continue;
+        }
+        // an edit takes 5 bytes at least
+        if (type != REC_EDITS || n > (uint64_t)(end - p) / 5) return 0;
+        photon_edit_t *edits = malloc((n ? n : 1) * sizeof(photon_edit_t));
+        if (!edits) return 0;
+        for (size_t k = 0; k < n; k++){
+            uint64_t v[5];
+            for (int i = 0; i < 5; i++){
+                if (!_get_varint(&p, end, &v[i])){
+                    free(edits);
+                    return 0;
+                }
+            }
+            if (v[4] > (uint64_t)(end - p)){
+                free(edits);
+                return 0;
+            }
+            edits[k] = (photon_edit_t){ v[0], v[1], v[2], v[3], p, v[4] };
+            p += v[4];
+        }
+        photon_undo_step_t *undo = photon_buffer_apply(editor, buf, edits, n);
+        free(edits);
+        if (!undo) return 0;
+        // the cursor ends up where the last edits were made
+        photon_cursors_place(buf, undo->edits, undo->num_edit, 0);
+        free(undo);
+    }
+    return 1;
+}
+
+// replays the journal if it's for the file as it was loaded and returns where its valid
+// part ends, 0 if none of it is. stale is set if it's for something else, resync if a
+// frame could only be replayed in part
+static off_t _replay(photon_editor_t *editor, photon_buffer_t *buf, photon_journal_t *j, int *stale, int *resync){
+    struct stat st;
+    if (fstat(j->fd, &st) == -1 || !st.st_size) return 0;
+    size_t size = (size_t)st.st_size;
+    const char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, j->fd, 0);
+    if (map == MAP_FAILED){
+        *stale = 1;
+        return 0;
+    }
+    uint64_t fileSize;
+    int64_t mtime;
+    uint32_t len = 0;
+    if (size >= HEADER_FIXED){
+        memcpy(&fileSize, map + MAGIC_LEN, 8);
+        memcpy(&mtime, map + MAGIC_LEN + 8, 8);
+        memcpy(&len, map + MAGIC_LEN + 16, 4);
+    }
+    if (size < HEADER_FIXED || memcmp(map, MAGIC, MAGIC_LEN) || len > size - HEADER_FIXED ||
+        len != strlen(j->file) || memcmp(map + HEADER_FIXED, j->file, len) ||
+        fileSize != j->file_size || mtime != j->file_mtime){
+        munmap((void *)map, size);
+        *stale = 1;
+        return 0;
+    }
+    size_t off = HEADER_FIXED + len;
+    PHOTON_TRACE_BEGIN("journal.replay(bytes)", size, 0);
+    while (size - off >= FRAME_HEADER){
+        uint64_t n;
+        uint32_t sum;
+        memcpy(&n, map + off, 8);
+        memcpy(&sum, map + off + 8, 4);
+        const char *payload = map + off + FRAME_HEADER;
+        // a torn write at the end, the crash came before it was synced
+        if (n > size - off - FRAME_HEADER || _fnv(FNV_BASIS, payload, n) != sum) break;
+        if (!_replay_frame(editor, buf, payload, payload + n)){
+            *resync = 1;
+            break;
+        }
+        off += FRAME_HEADER + n;
+    }
+    PHOTON_TRACE_END("journal.replay");
+    munmap((void *)map, size);
+    return (off_t)off;
+}
+
+static void _compact_run(const photon_snapshot_t *snapshot, void *userdata){
+    photon_journal_t *j = userdata;
+    int fd = open(j->tmp_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1) return;
+    PHOTON_TRACE_BEGIN("journal.compact(lines)", snapshot->num_line, 0);
+    // the snapshot's lines end in NULs, they're the line breaks here
+    size_t bytes = snapshot->offsets[snapshot->num_line] - 1;
+    char *chunk = malloc(COPY_CHUNK + FRAME_HEADER + 1 + VARINT_MAX);
+    off_t head;
+    int ok = chunk && _write_header(j, fd, &head);
+    if (ok){
+        char *rec = chunk + FRAME_HEADER;
+        rec[0] = REC_TEXT;
+        size_t recLen = 1 + _put_varint(rec + 1, bytes);
+        uint32_t sum = _fnv(FNV_BASIS, rec, recLen);
+        off_t at = head + FRAME_HEADER;
+        ok = _pwrite_all(fd, rec, recLen, at);
+        at += recLen;
+        for (size_t done = 0; ok && done < bytes; ){
+            size_t n = bytes - done < COPY_CHUNK ? bytes - done : COPY_CHUNK;
+            memcpy(chunk, snapshot->text + done, n);
+            for (char *p = chunk; (p = memchr(p, 0, chunk + n - p)); p++)
+                *p = '\n';
+            sum = _fnv(sum, chunk, n);
+            ok = _pwrite_all(fd, chunk, n, at);
+            at += n;
+            done += n;
+        }
+        _frame_header(chunk, recLen + bytes, sum);
+        ok = ok && _pwrite_all(fd, chunk, FRAME_HEADER, head) && fdatasync(fd) == 0;
+        j->tmp_size = at;
+        j->tmp_text = bytes;
+    }
+    free(chunk);
+    PHOTON_TRACE_END("journal.compact");
+    if (!ok){
+        close(fd);
+        unlink(j->tmp_path);
+        return;
+    }
+    j->tmp_fd = fd;
+}
+
+// the new journal takes over with what was recorded since its snapshot, the records
+// that are still pending were made before it or are in there too
+static void _compact_done(const photon_api_t *api, void *userdata){
+    (void)api;
+    photon_journal_t *j = userdata;
+    j->compacting = 0;
+    if (!j->text){
+        if (j->tmp_fd != -1){
+            close(j->tmp_fd);
+            unlink(j->tmp_path);
+        }
+        _free(j);
+        return;
+    }
+    int ok = j->tmp_fd != -1 && flock(j->tmp_fd, LOCK_EX | LOCK_NB) == 0;
+    if (ok && j->since.n){
+        ok = _write_frame(j->tmp_fd, j->tmp_size, &j->since) && fdatasync(j->tmp_fd) == 0;
+        j->tmp_size += FRAME_HEADER + j->since.n;
+    }
+    if (ok && rename(j->tmp_path, j->path) == 0){
+        _sync_dir(j->path);
+        close(j->fd);
+        j->fd = j->tmp_fd;
+        j->size = j->tmp_size;
+        j->compact_at = j->size + (j->tmp_text > PHOTON_JOURNAL_MIN ? j->tmp_text : PHOTON_JOURNAL_MIN);
+        j->pending.n = 0;
+    } else {
+        if (j->tmp_fd != -1){
+            close(j->tmp_fd);
+            unlink(j->tmp_path);
+        }
+        // tried again once it's grown as much again
+        j->compact_at = j->size + PHOTON_JOURNAL_MIN;
+    }
+    j->tmp_fd = -1;
+    j->since.n = 0;
+}
+
+static void _compact(photon_editor_t *editor, photon_journal_t *j){
+    // it's the editor's job, there's no extension to set the api up for when it's done
+    photon_extension_t *ext = editor->cur_ext;
+    int error = editor->error;
+    editor->cur_ext = NULL;
+    j->tmp_fd = -1;
+    j->since.n = 0;
+    j->compacting = (char)photon_submit_job(editor, j->text->views, _compact_run, _compact_done, j);
+    editor->cur_ext = ext;
+    editor->error = error;
+    if (!j->compacting)
+        j->compact_at = j->size + PHOTON_JOURNAL_MIN;
+}
+
+int photon_journal_start(photon_editor_t *editor, photon_buffer_t *buf){
+    if (buf->type != BUF_FILE || !buf->name){
+        err_and_ret(editor, PHOTON_BAD_PARAM, 0);
+    }
+    photon_journal_stop(editor, buf);
+    char dir[PATH_MAX];
+    if (!_dir(dir, sizeof(dir))){
+        err_and_ret(editor, PHOTON_BAD_PARAM, 0);
+    }
+    photon_journal_t *j = calloc(1, sizeof(photon_journal_t));
+    size_t len = strlen(dir) + sizeof("/0123456789abcdef.journal.tmp");
+    if (!j){
+        err_and_ret(editor, PHOTON_NO_MEM, 0);
+    }
+    j->fd = j->tmp_fd = -1;
+    j->path = malloc(len);
+    j->tmp_path = malloc(len);
+    j->file = _file_path(buf->name);
+    if (!j->path || !j->tmp_path || !j->file){
+        _free(j);
+        err_and_ret(editor, PHOTON_NO_MEM, 0);
+    }
+    uint64_t h = 14695981039346656037ull;
+    for (const unsigned char *p = (const unsigned char *)j->file; *p; p++)
+        h = (h ^ *p) * 1099511628211ull;
+    snprintf(j->path, len, "%s/%016llx.journal", dir, (unsigned long long)h);
+    snprintf(j->tmp_path, len, "%s.tmp", j->path);
+    struct stat st;
+    if (stat(j->file, &st) == 0){
+        j->file_size = (uint64_t)st.st_size;
+        j->file_mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    }
+
+    // another photon has the file open if it's locked
+    j->fd = open(j->path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (j->fd == -1 || flock(j->fd, LOCK_EX | LOCK_NB) == -1){
+        _free(j);
+        err_and_ret(editor, PHOTON_BAD_PARAM, 0);
+    }
+    int stale = 0, resync = 0;
+    off_t good = _replay(editor, buf, j, &stale, &resync);
+    if (stale){
+        // not for the file as it is now, it's kept next to it in case it's wanted
+        char old[PATH_MAX];
+        snprintf(old, sizeof(old), "%s.old", j->path);
+        rename(j->path, old);
+        close(j->fd);
+        j->fd = open(j->path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (j->fd == -1 || flock(j->fd, LOCK_EX | LOCK_NB) == -1){
+            _free(j);
+            err_and_ret(editor, PHOTON_BAD_PARAM, 0);
+        }
+    }
+    int ok = good ? ftruncate(j->fd, good) == 0 : ftruncate(j->fd, 0) == 0 && _write_header(j, j->fd, &good);
+    if (!ok || fdatasync(j->fd) == -1){
+        _free(j);
+        err_and_ret(editor, PHOTON_BAD_PARAM, 0);
+    }
+    _sync_dir(j->path);
+    j->size = good;
+    size_t bytes = _text_bytes(buf);
+    j->compact_at = j->size + (bytes > PHOTON_JOURNAL_MIN ? bytes : PHOTON_JOURNAL_MIN);
+    j->text = buf->text;
+    buf->text->journal = j;
+    // what was replayed of a broken frame is only in the buffer, its text starts over
+    if (resync)
+        photon_journal_record(buf, NULL, 0);
+    return 1;
+}
+
+void photon_journal_stop(photon_editor_t *editor, photon_buffer_t *buf){
+    (void)editor;
+    photon_journal_t *j = buf->text->journal;
+    if (!j) return;
+    buf->text->journal = NULL;
+    unlink(j->path);
+    if (j->compacting){
+        // freed when it's done
+        close(j->fd);
+        j->fd = -1;
+        j->text = NULL;
+        return;
+    }
+    _free(j);
+}
+
+void photon_journal_record(photon_buffer_t *buf, const photon_edit_t *edits, size_t n){
+    photon_journal_t *j = buf->text->journal;
+    if (!j || j->lost) return;
+    if (!j->pending.n)
+        j->pending_ns = _now_ns();
+    // a text record makes whatever came before it not matter
+    int ok = edits ? _put_edits(&j->pending, edits, n) : _put_text(&j->pending, buf);
+    if (ok && j->compacting)
+        ok = edits ? _put_edits(&j->since, edits, n) : _put_text(&j->since, buf);
+    // recovery gets back to before this, it's the best there is without memory
+    if (!ok)
+        j->lost = 1;
+}
+
+void photon_journal_flush(photon_editor_t *editor, photon_buffer_t *buf, int force){
+    photon_journal_t *j = buf->text->journal;
+    if (!j || !j->pending.n) return;
+    if (!force && _now_ns() - j->pending_ns < (uint64_t)PHOTON_JOURNAL_DELAY_MS * 1000000) return;
+    PHOTON_TRACE_BEGIN("journal.flush(bytes)", j->pending.n, 0);
+    if (_write_frame(j->fd, j->size, &j->pending) && fdatasync(j->fd) == 0){
+        j->size += FRAME_HEADER + j->pending.n;
+        j->pending.n = 0;
+    } else {
+        // whatever part made it would only look torn, it's tried again after a while
+        if (ftruncate(j->fd, j->size)){}
+        j->pending_ns = _now_ns();
+    }
+    PHOTON_TRACE_END("journal.flush");
+    if (!j->compacting && j->size >= j->compact_at)
+        _compact(editor, j);
+}
+
+int photon_journal_timeout(const photon_editor_t *editor){
+    uint64_t now = _now_ns(), delay = (uint64_t)PHOTON_JOURNAL_DELAY_MS * 1000000;
+    int timeout = -1;
+    for (size_t i = 0; i < editor->num_buf; i++){
+        photon_buffer_t *buf = editor->bufs[i];
+        photon_journal_t *j = buf->text->journal;
+        if (!j || !j->pending.n) continue;
+        uint64_t due = j->pending_ns + delay;
+        int ms = due > now ? (int)((due - now + 999999) / 1000000) : 0;
+        if (timeout < 0 || ms < timeout)
+            timeout = ms;
+    }
+    return timeout;
+}
@@ -0,0 +1,40 @@
+#ifndef __JOURNAL_H__
+#define __JOURNAL_H__
+#include <stddef.h>
+
+// crash recovery: every edit to a file buffer is appended to a journal under
+// $XDG_STATE_HOME/photon/journal (~/.config/photon/journal without it), named after a
+// hash of the file's path. an edit only costs copying it into the pending records, they're
+// written as one checksummed frame and synced while the editor is idle, at most every
+// PHOTON_JOURNAL_DELAY_MS. the header has the file's size and mtime, so after a crash
+// the journal is only replayed on top of the file it was made against, and a torn last
+// frame is dropped. once the edits in it outgrow the buffer a worker writes the text as
+// a new journal that takes its place. closing the buffer removes it.
+
+typedef struct photon_editor photon_editor_t;
+typedef struct photon_buffer photon_buffer_t;
+typedef struct photon_edit photon_edit_t;
+typedef struct photon_journal photon_journal_t;
+
+// how long pending edits wait for a sync at most
+#define PHOTON_JOURNAL_DELAY_MS 200
+// journals under this aren't compacted however small the buffer is
+#define PHOTON_JOURNAL_MIN (1 << 20)
+
+// journals buf's edits from now on, first replaying what a crash left for the file it
+// has loaded. returns 0 and sets editor->error on failure, PHOTON_BAD_PARAM if it's not
+// a file buffer or another photon is journaling the file
+int photon_journal_start(photon_editor_t *editor, photon_buffer_t *buf);
+// the buffer's text is what it should be, the journal goes
+void photon_journal_stop(photon_editor_t *editor, photon_buffer_t *buf);
+
+// the buffer calls this after every edit, edits as they were passed to
+// photon_buffer_apply. NULL means it couldn't finish one and the journal starts over
+void photon_journal_record(photon_buffer_t *buf, const photon_edit_t *edits, size_t n);
+// writes and syncs what's pending if it waited long enough (or now if force is set),
+// and starts a compaction when it's time
+void photon_journal_flush(photon_editor_t *editor, photon_buffer_t *buf, int force);
+// ms until a journal wants flushing, -1 if none does
+int photon_journal_timeout(const photon_editor_t *editor);
+
+#endif//__JOURNAL_H__
@@ -0,0 +1,129 @@
+#include "line_alloc.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+struct la_chunk {
+    la_chunk_t *prev, *next;
+    size_t used, cap;
+    // keep the data 16 byte aligned, the free lists live inside the blocks
+    _Alignas(16) char data[];
+};
+
+static la_chunk_t *_la_new_chunk(photon_line_alloc_t *la, size_t cap){
+    la_chunk_t *chunk = malloc(sizeof(la_chunk_t) + cap);
+    if (!chunk) return NULL;
+    chunk->used = 0;
+    chunk->cap = cap;
+    chunk->prev = NULL;
+    chunk->next = la->chunks;
+    if (la->chunks)
+        la->chunks->prev = chunk;
+    la->chunks = chunk;
+    la->num_chunks++;
+    la->bytes += cap;
+    return chunk;
+}
+
+static void _la_drop_chunk(photon_line_alloc_t *la, la_chunk_t *chunk){
+    if (chunk->prev)
+        chunk->prev->next = chunk->next;
+    else
+        la->chunks = chunk->next;
+    if (chunk->next)
+        chunk->next->prev = chunk->prev;
+    la->num_chunks--;
+    la->bytes -= chunk->cap;
+    free(chunk);
+}
+
+static int _la_class(size_t n){
+    int c = 0;
+    while ((size_t)(16 << c) < n) c++;
+    return c;
+}
+
+void photon_line_alloc_init(photon_line_alloc_t *la){
+    memset(la, 0, sizeof(photon_line_alloc_t));
+}
+
+void photon_line_alloc_destroy(photon_line_alloc_t *la){
+    la_chunk_t *it = la->chunks;
+    while (it){
+        la_chunk_t *next = it->next;
+        free(it);
+        it = next;
+    }
+    photon_line_alloc_init(la);
+}
+
+char *photon_line_alloc_text(photon_line_alloc_t *la, size_t n){
+    // big loads get a chunk of their own instead of wasting the tail of the current one
+    if (n > LA_CHUNK_SIZE / 4){
+        la_chunk_t *chunk = _la_new_chunk(la, n);
+        if (!chunk) return NULL;
+        chunk->used = n;
+        return chunk->data;
+    }
+    if (!la->arena || la->arena->cap - la->arena->used < n){
+        if (!(la->arena = _la_new_chunk(la, LA_CHUNK_SIZE)))
+            return NULL;
+    }
+    char *p = la->arena->data + la->arena->used;
+    la->arena->used += n;
+    return p;
+}
+
+char *photon_line_alloc(photon_line_alloc_t *la, size_t n, int *capacity){
+    if (n > LA_MAX_CLASS){
+        // round up a bit so appending to a long line doesn't copy it every time
+        size_t cap = (n + n / 2 + 15) & ~(size_t)15;
+        if (cap > INT32_MAX) return NULL;
+        la_chunk_t *chunk = _la_new_chunk(la, cap);
+        if (!chunk) return NULL;
+        chunk->used = cap;
+        *capacity = (int)cap;
+        return chunk->data;
+    }
+    int c = _la_class(n);
+    int size = 16 << c;
+    char *p = la->free_list[c];
+    if (p){
+        memcpy(&la->free_list[c], p, sizeof(void *));
+    } else {
+        if (!la->slab || la->slab->cap - la->slab->used < (size_t)size){
+            if (!(la->slab = _la_new_chunk(la, LA_CHUNK_SIZE)))
+                return NULL;
+        }
+        p = la->slab->data + la->slab->used;
+        la->slab->used += size;
+    }
+    *capacity = size;
+    return p;
+}
+
+void photon_line_free(photon_line_alloc_t *la, char *p, int capacity){
+    // text in the arena goes away with its chunk
+    if (!p || capacity <= 0) return;
+    if (capacity > LA_MAX_CLASS){
+        _la_drop_chunk(la, (la_chunk_t *)(p - offsetof(la_chunk_t, data)));
+        return;
+    }
+    int c = _la_class(capacity);
+    memcpy(p, &la->free_list[c], sizeof(void *));
+    la->free_list[c] = p;
+}
+
+char *photon_line_realloc(photon_line_alloc_t *la, char *p, int capacity, size_t used, size_t n, int *newCapacity){
+    if (capacity > 0 && (size_t)capacity >= n){
+        *newCapacity = capacity;
+        return p;
+    }
+    char *np = photon_line_alloc(la, n, newCapacity);
+    if (!np) return NULL;
+    // only what fits if it got smaller
+    if (used)
+        memcpy(np, p, used < n ? used : n);
+    photon_line_free(la, p, capacity);
+    return np;
+}
@@ -0,0 +1,35 @@
+#ifndef __LINE_ALLOC_H__
+#define __LINE_ALLOC_H__
+#include <stddef.h>
+
+// size classes are 16 << i
+#define LA_NUM_CLASSES 6
+#define LA_MAX_CLASS (16 << (LA_NUM_CLASSES - 1))
+#define LA_CHUNK_SIZE (64 * 1024)
+
+typedef struct la_chunk la_chunk_t;
+
+// per buffer line storage: slabs for short editable lines, a bump arena for
+// text that was bulk loaded and never touched since. everything lives in
+// chunks so tearing a buffer down is one free per chunk.
+typedef struct photon_line_alloc {
+    la_chunk_t *chunks; // every chunk, including dedicated ones for huge lines
+    la_chunk_t *slab;   // chunk size classes are carved from
+    la_chunk_t *arena;  // chunk immutable text is bumped from
+    void *free_list[LA_NUM_CLASSES];
+    size_t num_chunks;
+    size_t bytes;       // total bytes held in chunks
+} photon_line_alloc_t;
+
+void photon_line_alloc_init(photon_line_alloc_t *la);
+void photon_line_alloc_destroy(photon_line_alloc_t *la);
+
+// immutable text, can't be freed on its own (capacity 0 in photon_line_t)
+char *photon_line_alloc_text(photon_line_alloc_t *la, size_t n);
+
+// editable storage, *capacity gets the real size of the block
+char *photon_line_alloc(photon_line_alloc_t *la, size_t n, int *capacity);
+char *photon_line_realloc(photon_line_alloc_t *la, char *p, int capacity, size_t used, size_t n, int *newCapacity);
+void photon_line_free(photon_line_alloc_t *la, char *p, int capacity);
+
+#endif//__LINE_ALLOC_H__
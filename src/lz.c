@@ -0,0 +1,125 @@
+#include "lz.h"
+#include <stdint.h>
+#include <string.h>
+
+#define MIN_MATCH 4
+#define MAX_OFFSET 65535
+#define HASH_BITS 12
+
+static uint32_t _read32(const unsigned char *p){
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static uint32_t _hash(uint32_t v){
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// the 255 runs after a nibble that's 15
+static unsigned char *_put_len(unsigned char *op, size_t n){
+    for (; n >= 255; n -= 255)
+        *op++ = 255;
+    *op++ = (unsigned char)n;
+    return op;
+}
+
+// literals lit to lit + numLit then a match of matchLen at offset, no match if matchLen is 0
+static unsigned char *_put_seq(unsigned char *op, unsigned char *end, const unsigned char *lit, size_t numLit, size_t offset, size_t matchLen){
+    // the worst case for the lengths is generous, it's only a bound check
+    if ((size_t)(end - op) < numLit + numLit / 255 + matchLen / 255 + 8) return NULL;
+    size_t m = matchLen ? matchLen - MIN_MATCH : 0;
+    unsigned char *token = op++;
+    *token = (unsigned char)((numLit < 15 ? numLit : 15) << 4 | (m < 15 ? m : 15));
+    if (numLit >= 15)
+        op = _put_len(op, numLit - 15);
+    memcpy(op, lit, numLit);
+    op += numLit;
+    if (!matchLen) return op;
+    *op++ = (unsigned char)offset;
+    *op++ = (unsigned char)(offset >> 8);
+    if (m >= 15)
+        op = _put_len(op, m - 15);
+    return op;
+}
+
+size_t photon_lz_compress(const void *src, size_t n, void *dst, size_t cap){
+    const unsigned char *in = src, *anchor = in, *end = in + n;
+    unsigned char *op = dst, *opEnd = op + cap;
+    // positions + 1, 0 is none
+    uint32_t table[1 << HASH_BITS] = {0};
+    const unsigned char *p = in;
+    while (n >= MIN_MATCH && p <= end - MIN_MATCH){
+        uint32_t v = _read32(p), h = _hash(v);
+        const unsigned char *cand = table[h] ? in + table[h] - 1 : NULL;
+        table[h] = (uint32_t)(p - in) + 1;
+        if (!cand || p - cand > MAX_OFFSET || _read32(cand) != v){
+            // the longer it's been since a match, the bigger the steps
+            p += 1 + ((p - anchor) >> 6);
+            continue;
+        }
+        size_t len = MIN_MATCH;
+        while (p + len < end && p[len] == cand[len])
+            len++;
+        if (!(op = _put_seq(op, opEnd, anchor, p - anchor, p - cand, len))) return 0;
+        p += len;
+        anchor = p;
+        if (p - 2 <= end - MIN_MATCH)
+            table[_hash(_read32(p - 2))] = (uint32_t)(p - 2 - in) + 1;
+    }
+    if (!(op = _put_seq(op, opEnd, anchor, end - anchor, 0, 0))) return 0;
+    return op - (unsigned char *)dst;
+}
+
+// a length's 255 runs, SIZE_MAX if the input ends in the middle of them
+static size_t _get_len(const unsigned char **ip, const unsigned char *end){
+    size_t n = 0;
+    unsigned char b;
+    do {
+        if (*ip == end) return SIZE_MAX;
+        b = *(*ip)++;
+        n += b;
+    } while (b == 255);
+    return n;
+}
+
+int photon_lz_decompress(const void *src, size_t size, void *dst, size_t n){
+    const unsigned char *ip = src, *end = ip + size;
+    unsigned char *out = dst, *op = out, *opEnd = out + n;
+    while (ip < end){
+        unsigned token = *ip++;
+        size_t lit = token >> 4;
+        if (lit == 15){
+            size_t more = _get_len(&ip, end);
+            if (more == SIZE_MAX) return 0;
+            lit += more;
+        }
+        if (lit > (size_t)(end - ip) || lit > (size_t)(opEnd - op)) return 0;
+        memcpy(op, ip, lit);
+        ip += lit;
+        op += lit;
+        if (ip == end) break;
+
+        if (end - ip < 2) return 0;
+        size_t offset = ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        size_t len = token & 15;
+        if (len == 15){
+            size_t more = _get_len(&ip, end);
+            if (more == SIZE_MAX) return 0;
+            len += more;
+        }
+        len += MIN_MATCH;
+        if (!offset || offset > (size_t)(op - out) || len > (size_t)(opEnd - op)) return 0;
+        const unsigned char *from = op - offset;
+        if (offset >= len){
+            memcpy(op, from, len);
+            op += len;
+        } else {
+            // overlapping, it repeats what it's copying
+            while (len--)
+                *op++ = *from++;
+        }
+    }
+    return op == opEnd;
+}
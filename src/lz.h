@@ -0,0 +1,20 @@
+#ifndef __LZ_H__
+#define __LZ_H__
+#include <stddef.h>
+
+// a small LZ77 codec in the spirit of LZ4, for packing text that isn't being looked at
+// (see pack.h). a stream is sequences of a token (literal count in the high nibble, match
+// length - 4 in the low one, 15 means more follows in bytes up to one that isn't 255),
+// the literals, then a 2 byte little endian offset back into what's been decoded. the
+// last sequence is only literals. no state carries over between calls, so every block
+// can be decoded on its own.
+
+// the most compressing n bytes can take
+#define PHOTON_LZ_BOUND(n) ((n) + (n) / 255 + 16)
+
+// bytes written to dst, 0 if they didn't fit in cap
+size_t photon_lz_compress(const void *src, size_t n, void *dst, size_t cap);
+// 1 if src decoded to exactly n bytes, 0 if it's corrupt
+int photon_lz_decompress(const void *src, size_t size, void *dst, size_t n);
+
+#endif//__LZ_H__
@@ -1,9 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <dirent.h>
-#include <errno.h>
-#include <dlfcn.h>
+#include <time.h>
 #include <limits.h>
 #include "photon.h"
 #include "photon_debug.h"
@@ -11,153 +9,87 @@
 #include "input.h"
 #include "buffer.h"
 #include "ui.h"
-
-static const char *errorMessages[] = {
-    NULL,
-    "Invalid parameters",
-    "Not enough memory"
-};
-
-photon_buffer_t *ctx = NULL;
-
-static int predraw(photon_draw_req_t *req){
-    if (!ctx) return 1;
-    int y = req->y, x = req->x;
-    int p_y = ctx->y, p_x = ctx->x;
-    int rows = ctx->rows, cols = ctx->cols;
-    if (y < p_y || y - p_y >= rows) {
-        if (ctx->y + 1 == rows) return 0;
-        ctx->y++;
-        ctx->x = p_x;
-        return 0;
-    }
-    if (x < p_x || x - p_x >= cols) return 0;
-    return 1;
-}
-
-void photon_handle_keypress(photon_editor_t *editor, int key){
-    if (key == PHOTON_INVALID_KEY) return;
-    if (photon_trigger_hook(editor, PHOTON_HOOK_KEYPRESS, key)) return;
-    if (key == 17){ // ^Q
-        editor->should_quit = 1;
-    } else if (key == 7) { // ^G
-        putchar(7);
-        fflush(stdout);
-    }
-}
-
-void photon_editor_cleanup(photon_editor_t *editor){
-    while (editor->first_buf){
-        photon_delete_buffer(editor, editor->first_buf);
-    }
-    while (editor->first_ext){
-        photon_extension_t *next = editor->first_ext->next;
-        if (editor->first_ext->on_unload){
-            photon_setup_api(editor, editor->first_ext);
-            editor->first_ext->on_unload(&editor->api);
-        }
-        dlclose(editor->first_ext->handle);
-        free(editor->first_ext);
-        editor->first_ext = next;
-    }
+#include "pool.h"
+#include "editor.h"
+#include "follow.h"
+#include "journal.h"
+#include "server.h"
+#include "replay.h"
+#include "trace.h"
+
+static double elapsed_ms(const struct timespec *since){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since->tv_sec) * 1e3 + (now.tv_nsec - since->tv_nsec) / 1e6;
 }
 
-const char *photon_editor_error_msg(photon_editor_t *editor){
-    if (editor->error < 1 || editor->error > PHOTON_NO_MEM){
-        return "Undefined error";
-    }
-    return errorMessages[editor->error];
-}
+int main(int argc, char **argv){
+    struct timespec startTime;
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+    atexit(&photon_ui_end);
 
-#define LOAD_FATAL_ERR (-1)
-#define LOAD_ERROR 0
-#define LOAD_OK 1
+    photon_editor_t editor = {0};
 
-static int load_extensions(photon_editor_t *editor){
-    // load extensions
-    char extDirPath[PATH_MAX] = {0};
-    const char *home = getenv("HOME");
-    if (!home){
-        return LOAD_OK;
-    }
-    snprintf(extDirPath, PATH_MAX, "%s/.config/photon/extensions", home);
-    DIR *dir = opendir(extDirPath);
-    if (!dir){
-        if (errno != ENOENT){
-            fprintf(stderr, "failed to open directory %s: %s\r\n", extDirPath, strerror(errno));
-            return LOAD_ERROR;
-        }
-        return LOAD_OK;
+    // before anything starts threads so they all get named
+    const char *tracePath = getenv("PHOTON_TRACE");
+    if (tracePath && photon_trace_start(tracePath))
+        photon_trace_thread_name("ui");
+
+    const char *path = NULL, *recordPath = NULL, *replayPath = NULL;
+    int follow = 0, server = 0, attach = 0, stop = 0;
+    for (int i = 1; i < argc; i++){
+        if (!strcmp(argv[i], "--follow") || !strcmp(argv[i], "-f"))
+            follow = 1;
+        else if (!strcmp(argv[i], "--daemon"))
+            server = 1;
+        else if (!strcmp(argv[i], "--attach") || !strcmp(argv[i], "-a"))
+            attach = 1;
+        else if (!strcmp(argv[i], "--stop"))
+            stop = 1;
+        else if (!strcmp(argv[i], "--record") && i + 1 < argc)
+            recordPath = argv[++i];
+        else if (!strcmp(argv[i], "--replay") && i + 1 < argc)
+            replayPath = argv[++i];
+        else if (!path)
+            path = argv[i];
     }
-    int err = LOAD_OK;
-
-    struct dirent *ent;
-    while ((ent = readdir(dir))){
-        const char *name = ent->d_name;
-        uint16_t len = ent->d_namlen;
-        if (len >= 3 && strcmp(name + len - 3, ".so") == 0 && strncmp(name, "--", 2) != 0){
-            char extPath[PATH_MAX] = {0};
-            snprintf(extPath, PATH_MAX, "%s/%s", extDirPath, name);
-
-            void *handle = dlopen(extPath, RTLD_LAZY);
-            if (handle == NULL){
-                fprintf(stderr, "failed to load extension %s: %s\r\n", name, dlerror());
-                err = LOAD_ERROR;
-                continue;
-            }
-
-            photon_extension_t *ext = malloc(sizeof(photon_extension_t));
-            if (!ext){
-                fprintf(stderr, "failed to allocate extension %s: %s\r\n", name, strerror(errno));
-                photon_editor_cleanup(editor);
-                err = LOAD_FATAL_ERR;
-                break;
-            }
-            
-            // get the functions
-            ext->on_load = (void (*)(const photon_api_t *api))dlsym(handle, "photon_on_load");
-            ext->on_unload = (void (*)(const photon_api_t *api))dlsym(handle, "photon_on_unload");
-            ext->pre_frame = (void (*)(const photon_api_t *api))dlsym(handle, "photon_pre_frame");
-
-            ext->next = editor->first_ext;
-            ext->errorValue = PHOTON_OK;
-            ext->handle = handle;
-            memset(&ext->hooks, 0, sizeof(photon_hooks_t));
-            editor->first_ext = ext;
-
-            if (ext->on_load){
-                photon_setup_api(editor, ext);
-                ext->on_load(&editor->api);
-            }
+    // a client is just a terminal for the daemon, none of the editor is set up here
+    char socketPath[PATH_MAX];
+    photon_server_socket_path(socketPath, sizeof(socketPath));
+    if (attach || stop)
+        return photon_client_run(socketPath, path, stop);
+    if (server && !photon_server_start(socketPath))
+        return EXIT_FAILURE;
+    if (replayPath){
+        const char *recorded;
+        if (!photon_replay_open(replayPath, &recorded)){
+            fprintf(stderr, "can't replay %s: not a recording\n", replayPath);
+            return EXIT_FAILURE;
         }
+        if (!path)
+            path = recorded;
     }
 
-    closedir(dir);
-    return err;
-}
-
-int main(void){
-    atexit(&photon_ui_end);
-
-    photon_editor_t editor = {0};
-
     if (!photon_ui_init(&editor)){
         fprintf(stderr, "failed to initialize library: %s\n", photon_editor_error_msg(&editor));
         return EXIT_FAILURE;
     }
-    editor.api.editor = &editor;
-    editor.api.buffer.create = &photon_create_buffer;
-    editor.api.buffer.delete = &photon_delete_buffer;
-    editor.api.ui.draw_str = &photon_draw_str;
-    editor.api.ui.draw_nstr = &photon_draw_nstr;
-    editor.api.ui.tint_line = &photon_tint_line;
-    editor.api.get_error_msg = &photon_editor_error_msg;
-    editor.theme.normal = (photon_theme_attr_t){ .bg = 0x1c1c1c, .fg = 0xebdbb2, .style = 0 };
-    editor.ui_hints = editor.theme.normal;
-    editor.pre_draw = &predraw;
+    photon_editor_init(&editor);
+    const char *capturePath = getenv("PHOTON_CAPTURE");
+    if (capturePath && !photon_ui_capture_start(capturePath)){
+        photon_editor_cleanup(&editor);
+        photon_ui_end();
+        perror(capturePath);
+        return EXIT_FAILURE;
+    }
 
-    switch (load_extensions(&editor)){
-        case LOAD_FATAL_ERR: return EXIT_FAILURE;
+    PHOTON_TRACE_BEGIN("main.load_extensions", 0, 0);
+    int loadResult = photon_load_extensions(&editor);
+    PHOTON_TRACE_END("main.load_extensions");
+    switch (loadResult){
+        case LOAD_FATAL_ERR:
+            photon_editor_cleanup(&editor);
+            return EXIT_FAILURE;
         case LOAD_ERROR: {
             // TODO: improve and use UI instead of stdio
             printf("\x1b[7mPress any key to continue");
@@ -168,51 +100,100 @@ int main(void){
         case LOAD_OK: break;
         default: break;
     }
+    if (replayPath)
+        photon_replay_check_extensions(&editor);
+    if (recordPath && !photon_record_start(&editor, recordPath, path)){
+        photon_editor_cleanup(&editor);
+        photon_ui_end();
+        perror(recordPath);
+        return EXIT_FAILURE;
+    }
 
     photon_buffer_t *buf;
     photon_buf_options_t options;
     options.x = options.y = 0;
     options.rows = photon_ui_height();
     options.cols = photon_ui_width();
-    options.name = NULL;
+    options.name = path;
     options.type = BUF_FILE;
     if ((buf = photon_create_buffer(&editor, &options)) == NULL){
         return 1;
     }
-    buf->num_line = 1;
-
-    editor.api.ui.width = photon_ui_width();
-    editor.api.ui.height = photon_ui_height();
+    // a path that doesn't exist yet is just a new file
+    if (path){
+        PHOTON_TRACE_BEGIN("main.load_file", 0, 0);
+        photon_buffer_load_file(&editor, buf, path);
+        PHOTON_TRACE_END("main.load_file");
+        // not fatal either, ^W tries again
+        if (follow)
+            photon_follow_start(&editor, buf);
+        // edits made before a crash are put back, a replay is better off without them
+        else if (!replayPath)
+            photon_journal_start(&editor, buf);
+    }
 
+    double firstFrameMs = -1;
     PHOTON_DEBUG_OPT(int capture = 0);
     // logic...
     while (!editor.should_quit){
-        photon_ui_clear();
-        editor.first_buf->draw(&editor.api, editor.first_buf);
-        photon_extension_t *it = editor.first_ext;
-        while (it){
-            if (it->pre_frame){
-                photon_setup_api(&editor, it);
-                it->pre_frame(&editor.api);
-            }
-            it = it->next;
+        if (server){
+            // a client attaching, or one asking the daemon to stop
+            photon_server_poll(&editor);
+            if (editor.should_quit) break;
         }
+        photon_editor_draw(&editor);
         PHOTON_DEBUG_OPT(if (capture) {
-            char nameBack[64] = {0};
-            char nameFront[64] = {0};
-            sprintf(nameFront, "front-%d.bin", photon_ui_frame_number());
-            sprintf(nameBack, "back-%d.bin", photon_ui_frame_number());
-            photon_ui_snapshot(nameFront, nameBack);
+            char name[64] = {0};
+            sprintf(name, "snapshot-%d.snap", photon_ui_frame_number());
+            photon_ui_snapshot(name);
             capture = 0;
         })
         photon_ui_refresh();
+        if (firstFrameMs < 0)
+            firstFrameMs = elapsed_ms(&startTime);
+        if (replayPath){
+            photon_replay_frame_end();
+            if (photon_replay_done()) break;
+        }
 
-        int key = photon_input_read_key();
+        // wake up for finished jobs and followed files that changed too, they're taken in at
+        // the top of the loop. background work gets a slice whenever no key is waiting, then
+        // the frame shows how far it got. work that's only due later (syncing the journal)
+        // is a timeout
+        int busy = photon_editor_busy(&editor);
+        int fds[PHOTON_INPUT_MAX_FDS];
+        int n = photon_editor_fds(&editor, fds);
+        if (server)
+            n += photon_server_fds(fds + n);
+        if (!photon_input_wait(fds, n, busy ? 0 : photon_editor_timeout(&editor))){
+            photon_editor_idle(&editor);
+            continue;
+        }
+        if (replayPath)
+            photon_replay_frame_begin();
+        int key = server ? photon_server_read_key(&editor) : photon_input_read_key();
     all_good:
         PHOTON_DEBUG_OPT(if (key == 19) capture = 1); // ^S
         photon_handle_keypress(&editor, key);
+        // ^Q only lets go of the terminal, the daemon keeps everything for the next one
+        if (server && editor.should_quit)
+            editor.should_quit = (char)photon_server_quit();
     }
 
+    int deferred = photon_extensions_deferred(&editor);
+    photon_record_stop();
     photon_editor_cleanup(&editor);
+    if (server)
+        photon_server_stop();
+    photon_trace_stop();
+    if (replayPath){
+        photon_ui_end();
+        photon_replay_report();
+        photon_replay_close();
+    }
+    if (getenv("PHOTON_STARTUP_TIME")){
+        photon_ui_end();
+        fprintf(stderr, "first frame after %.2f ms (%d extensions never loaded)\n", firstFrameMs, deferred);
+    }
     return EXIT_SUCCESS;
 }
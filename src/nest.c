@@ -0,0 +1,317 @@
+#include "nest.h"
+#include "photon.h"
+#include <stdlib.h>
+#include <string.h>
+
+// lines read at a time when a search runs past what's been read
+#define EXTEND_MIN 4096
+
+typedef struct photon_nest_node {
+    int32_t depth;   // brackets opened minus closed
+    int32_t low;     // the lowest the depth gets from the start, 0 or less
+    uint16_t indent; // the least indent of a line with text, PHOTON_NEST_BLANK if there's none
+} nest_node_t;
+
+static nest_node_t _join(nest_node_t a, nest_node_t b){
+    nest_node_t n;
+    n.depth = a.depth + b.depth;
+    n.low = a.low < a.depth + b.low ? a.low : a.depth + b.low;
+    n.indent = a.indent < b.indent ? a.indent : b.indent;
+    return n;
+}
+
+static int _delta(char c){
+    return c == '(' || c == '[' || c == '{' ? 1 : c == ')' || c == ']' || c == '}' ? -1 : 0;
+}
+
+static nest_node_t _leaf(photon_line_t *line){
+    const char *s = photon_line_str(line);
+    size_t n = line->length, i = 0;
+    while (i < n && (s[i] == ' ' || s[i] == '\t'))
+        i++;
+    nest_node_t leaf = { 0, 0, i == n ? PHOTON_NEST_BLANK : i < PHOTON_NEST_BLANK ? (uint16_t)i : PHOTON_NEST_BLANK - 1 };
+    for (; i < n; i++){
+        int d = _delta(s[i]);
+        if (!d) continue;
+        leaf.depth += d;
+        if (leaf.depth < leaf.low)
+            leaf.low = leaf.depth;
+    }
+    return leaf;
+}
+
+// room for n lines, the tree has to be put back together when it grows
+static int _reserve(photon_text_t *text, size_t n){
+    if (n <= text->_nest.size) return 1;
+    size_t size = text->_nest.size ? text->_nest.size : 256;
+    while (size < n)
+        size <<= 1;
+    nest_node_t *tree = malloc(2 * size * sizeof(nest_node_t));
+    if (!tree) return 0;
+    // nodes over lines that aren't read yet get joined too, they start out empty
+    for (size_t i = 0; i < 2 * size; i++)
+        tree[i] = (nest_node_t){ 0, 0, PHOTON_NEST_BLANK };
+    if (text->_nest.tree)
+        memcpy(tree + size, text->_nest.tree + text->_nest.size, text->_nest.scanned * sizeof(nest_node_t));
+    free(text->_nest.tree);
+    text->_nest.tree = tree;
+    text->_nest.size = size;
+    text->_nest.valid = 0;
+    return 1;
+}
+
+// the first n lines read and the tree right over them, 0 if out of memory
+static int _validate(photon_text_t *text, size_t n){
+    if (n > text->num_line)
+        n = text->num_line;
+    if (n <= text->_nest.valid) return 1;
+    if (!_reserve(text, text->num_line)) return 0;
+    nest_node_t *tree = text->_nest.tree;
+    size_t size = text->_nest.size;
+    for (size_t i = text->_nest.scanned; i < n; i++)
+        tree[size + i] = _leaf(&text->lines[i]);
+    if (n > text->_nest.scanned)
+        text->_nest.scanned = n;
+    // every node over the new lines, the ones that also cover lines past n are only right
+    // once those are validated too
+    for (size_t a = (size + text->_nest.valid) >> 1, b = (size + n - 1) >> 1; a; a >>= 1, b >>= 1){
+        for (size_t p = a; p <= b; p++)
+            tree[p] = _join(tree[2 * p], tree[2 * p + 1]);
+    }
+    text->_nest.valid = n;
+    return 1;
+}
+
+// the nodes that cover lines from to to in order, at most two per level
+static size_t _cover(size_t size, size_t from, size_t to, size_t *nodes){
+    size_t left[64], right[64], nl = 0, nr = 0;
+    for (size_t l = from + size, r = to + size; l < r; l >>= 1, r >>= 1){
+        if (l & 1)
+            left[nl++] = l++;
+        if (r & 1)
+            right[nr++] = --r;
+    }
+    memcpy(nodes, left, nl * sizeof(size_t));
+    for (size_t i = 0; i < nr; i++)
+        nodes[nl + i] = right[nr - 1 - i];
+    return nl + nr;
+}
+
+// depth at the start of line, it has to be validated
+static long _prefix(const photon_text_t *text, size_t line){
+    size_t nodes[128], n = _cover(text->_nest.size, 0, line, nodes);
+    long depth = 0;
+    for (size_t i = 0; i < n; i++)
+        depth += text->_nest.tree[nodes[i]].depth;
+    return depth;
+}
+
+// the first line from from on that gets down to depth (or to indent unless that's -1), *at
+// goes from the depth at the start of from to the one at the start of that line. reads
+// further down as needed, num_line if there's none
+static size_t _first(photon_text_t *text, size_t from, long depth, int indent, long *at){
+    while (from < text->num_line){
+        size_t to = text->_nest.valid;
+        if (to <= from){
+            to = from + (from > EXTEND_MIN ? from : EXTEND_MIN);
+            if (!_validate(text, to)) return text->num_line;
+            to = text->_nest.valid;
+        }
+        const nest_node_t *tree = text->_nest.tree;
+        size_t nodes[128], n = _cover(text->_nest.size, from, to, nodes);
+        for (size_t i = 0; i < n; i++){
+            size_t p = nodes[i];
+            int hit = indent >= 0 ? tree[p].indent <= indent : *at + tree[p].low <= depth;
+            if (!hit){
+                *at += tree[p].depth;
+                continue;
+            }
+            while (p < text->_nest.size){
+                p *= 2;
+                if (indent >= 0 ? tree[p].indent > indent : *at + tree[p].low > depth){
+                    *at += tree[p].depth;
+                    p++;
+                }
+            }
+            return p - text->_nest.size;
+        }
+        from = to;
+    }
+    return text->num_line;
+}
+
+// the last line before before that gets down to depth, num_line if there's none
+static size_t _last(photon_text_t *text, size_t before, long depth, long *at){
+    if (!_validate(text, before)) return text->num_line;
+    const nest_node_t *tree = text->_nest.tree;
+    size_t nodes[128], n = _cover(text->_nest.size, 0, before, nodes);
+    long end = _prefix(text, before);
+    for (size_t i = n; i--;){
+        size_t p = nodes[i];
+        long start = end - tree[p].depth;
+        if (start + tree[p].low > depth){
+            end = start;
+            continue;
+        }
+        while (p < text->_nest.size){
+            p *= 2;
+            long mid = start + tree[p].depth;
+            if (mid + tree[p + 1].low <= depth){
+                start = mid;
+                p++;
+            }
+        }
+        *at = start;
+        return p - text->_nest.size;
+    }
+    return text->num_line;
+}
+
+static long _depth(photon_text_t *text, size_t line){
+    if (line > text->num_line)
+        line = text->num_line;
+    if (_validate(text, line))
+        return _prefix(text, line);
+    // the slow way
+    long depth = 0;
+    for (size_t i = 0; i < line; i++)
+        depth += _leaf(&text->lines[i]).depth;
+    return depth;
+}
+
+long photon_nest_depth(photon_buffer_t *buf, size_t line){
+    return _depth(buf->text, line);
+}
+
+// where the depth gets down to depth again from line, col on (at is the depth before it)
+static int _close(photon_text_t *text, size_t line, size_t col, long at, long depth, size_t *match_line, size_t *match_col){
+    for (;;){
+        const char *s = photon_line_str(&text->lines[line]);
+        for (size_t i = col; i < (size_t)text->lines[line].length; i++){
+            at += _delta(s[i]);
+            if (at <= depth){
+                *match_line = line;
+                *match_col = i;
+                return 1;
+            }
+        }
+        line = _first(text, line + 1, depth, -1, &at);
+        if (line >= text->num_line) return 0;
+        col = 0;
+    }
+}
+
+int photon_nest_match(photon_buffer_t *buf, size_t line, size_t col, size_t *match_line, size_t *match_col){
+    photon_text_t *text = buf->text;
+    if (line >= text->num_line || col >= (size_t)text->lines[line].length) return 0;
+    const char *s = photon_line_str(&text->lines[line]);
+    int d = _delta(s[col]);
+    if (!d) return 0;
+    long at = _depth(text, line);
+    for (size_t i = 0; i < col; i++)
+        at += _delta(s[i]);
+    if (d > 0)
+        return _close(text, line, col + 1, at + 1, at, match_line, match_col);
+
+    // back to where the depth was last this low, the open bracket right after it
+    long depth = at - 1;
+    for (size_t i = col; i--;){
+        at -= _delta(s[i]);
+        if (at == depth && _delta(s[i]) > 0){
+            *match_line = line;
+            *match_col = i;
+            return 1;
+        }
+    }
+    if (!line) return 0;
+    line = _last(text, line, depth, &at);
+    if (line >= text->num_line) return 0;
+    // the last time it's that low in there is before the bracket
+    s = photon_line_str(&text->lines[line]);
+    size_t found = SIZE_MAX;
+    for (size_t i = 0; i < (size_t)text->lines[line].length; i++){
+        int dd = _delta(s[i]);
+        if (dd > 0 && at == depth)
+            found = i;
+        at += dd;
+    }
+    if (found == SIZE_MAX) return 0;
+    *match_line = line;
+    *match_col = found;
+    return 1;
+}
+
+int photon_nest_block(photon_buffer_t *buf, size_t line, size_t *last){
+    photon_text_t *text = buf->text;
+    if (line >= text->num_line) return 0;
+    // the first bracket on the line that it doesn't close again: going back from the end,
+    // one that opens from lower than the depth ever gets after it
+    const char *s = photon_line_str(&text->lines[line]);
+    size_t open = SIZE_MAX;
+    long at = _leaf(&text->lines[line]).depth, low = at;
+    for (size_t i = text->lines[line].length; i--;){
+        int d = _delta(s[i]);
+        at -= d;
+        if (d > 0 && at < low)
+            open = i;
+        if (at < low)
+            low = at;
+    }
+    size_t match_line, match_col;
+    if (open != SIZE_MAX && photon_nest_match(buf, line, open, &match_line, &match_col)){
+        if (match_line <= line + 1) return 0;
+        *last = match_line - 1;
+        return 1;
+    }
+
+    // the lines after it that are indented more
+    uint16_t indent = _leaf(&text->lines[line]).indent;
+    if (indent == PHOTON_NEST_BLANK) return 0;
+    long ignored = 0;
+    size_t end_line = _first(text, line + 1, 0, indent, &ignored);
+    while (end_line > line + 1 && _leaf(&text->lines[end_line - 1]).indent == PHOTON_NEST_BLANK)
+        end_line--;
+    if (end_line <= line + 1) return 0;
+    *last = end_line - 1;
+    return 1;
+}
+
+void photon_nest_edit(photon_text_t *text, size_t first, size_t last, long delta){
+    size_t scanned = text->_nest.scanned, size = text->_nest.size;
+    if (first >= scanned) return;
+    if (!delta){
+        // same lines, only theirs and the nodes over them change
+        nest_node_t *tree = text->_nest.tree;
+        for (size_t i = first; i <= last && i < scanned; i++){
+            tree[size + i] = _leaf(&text->lines[i]);
+            if (i >= text->_nest.valid) continue;
+            for (size_t p = (size + i) >> 1; p; p >>= 1)
+                tree[p] = _join(tree[2 * p], tree[2 * p + 1]);
+        }
+        return;
+    }
+    // the entries of the lines after the edit move with them, the tree over them is put
+    // back together when it's needed
+    if (text->_nest.valid > first)
+        text->_nest.valid = first;
+    size_t oldNext = (size_t)((long)last + 1 - delta), next = last + 1;
+    if (oldNext >= scanned || !_reserve(text, scanned + (delta > 0 ? delta : 0))){
+        text->_nest.scanned = first;
+        return;
+    }
+    nest_node_t *leaves = text->_nest.tree + text->_nest.size;
+    memmove(leaves + next, leaves + oldNext, (scanned - oldNext) * sizeof(nest_node_t));
+    text->_nest.scanned = scanned + delta;
+    for (size_t i = first; i <= last; i++)
+        text->_nest.tree[text->_nest.size + i] = _leaf(&text->lines[i]);
+}
+
+void photon_nest_reset(photon_text_t *text){
+    text->_nest.scanned = text->_nest.valid = 0;
+}
+
+void photon_nest_free(photon_text_t *text){
+    free(text->_nest.tree);
+    text->_nest.tree = NULL;
+    text->_nest.size = text->_nest.scanned = text->_nest.valid = 0;
+}
@@ -0,0 +1,35 @@
+#ifndef __NEST_H__
+#define __NEST_H__
+#include <stddef.h>
+#include <stdint.h>
+
+// the text's nesting: every line's bracket depth change ((, [ and { all open one level and
+// any closing one closes it, strings and comments aren't told apart), the lowest the depth
+// gets within it and its indent, in a segment tree over the lines. that gives the depth at
+// any line, the first line after one that gets down to a depth (or an indent) and the last
+// one before it that does in O(log n), which is what matching a bracket and finding where
+// a block ends come down to. lines are read as far down as a query needs, edits within
+// lines update the tree right away and ones that add or remove lines move the lines' entries
+// along and leave the tree after them to be put back together lazily, like wrap.h does.
+
+typedef struct photon_buffer photon_buffer_t;
+typedef struct photon_text photon_text_t;
+
+// a line of only spaces and tabs, it's in whatever block is around it
+#define PHOTON_NEST_BLANK UINT16_MAX
+
+// brackets still open at the start of line (or closed too many, then it's negative)
+long photon_nest_depth(photon_buffer_t *buf, size_t line);
+// the bracket matching the one at line, col. 0 if there's no bracket there or no match
+int photon_nest_match(photon_buffer_t *buf, size_t line, size_t col, size_t *match_line, size_t *match_col);
+// the block that starts at line: up to the line before the one closing the first bracket
+// left open on it, or else the lines after it indented more than it is (without the blank
+// ones at the end). 0 if that's no lines
+int photon_nest_block(photon_buffer_t *buf, size_t line, size_t *last);
+
+// the buffer calls these like photon_highlight_edit
+void photon_nest_edit(photon_text_t *text, size_t first, size_t last, long delta);
+void photon_nest_reset(photon_text_t *text);
+void photon_nest_free(photon_text_t *text);
+
+#endif//__NEST_H__
@@ -0,0 +1,325 @@
+#include "pack.h"
+#include "lz.h"
+#include "photon.h"
+#include "line_alloc.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct pack_block {
+    photon_packed_t head; // what packed lines point at
+    struct photon_pack *pack;
+    size_t first, num;    // its lines
+    size_t raw, size;     // bytes of text and what they packed to
+    char stored;          // it didn't compress, data is the text as is
+    char out;             // the lines have their text, they don't point here
+    unsigned char *data;
+} pack_block_t;
+
+typedef struct photon_pack {
+    photon_text_t *text;
+    pack_block_t *blocks;
+    size_t num_block;
+    size_t built;   // blocks packed so far, the lines don't point at them until they all are
+    size_t num_out; // blocks that are out
+    size_t raw, size;
+    size_t failed;  // unpacks that ran out of memory, see _unpack
+} photon_pack_t;
+
+// where blocks are put together and unpacked into, only ever used by the main thread.
+// it never shrinks and building a block makes it one byte bigger than the block's text, so
+// any block that's been built can always be unpacked into it
+static char *scratch;
+static size_t cap_scratch;
+
+static uint64_t _now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static char *_scratch(size_t n){
+    if (n <= cap_scratch) return scratch;
+    char *p = realloc(scratch, n);
+    if (!p) return NULL;
+    scratch = p;
+    cap_scratch = n;
+    return p;
+}
+
+// what the text takes: its lines, their text and the blocks
+static size_t _bytes(const photon_text_t *text){
+    size_t n = text->cap_line * sizeof(photon_line_t) + text->alloc->bytes;
+    if (text->pack)
+        n += text->pack->size + text->pack->num_block * sizeof(pack_block_t);
+    return n;
+}
+
+static int _unpack_block(pack_block_t *b){
+    photon_text_t *text = b->pack->text;
+    const char *p = b->data ? (const char *)b->data : "";
+    // all of its lines are empty then, there's nothing to decompress
+    if (!b->stored && b->raw){
+        char *raw = _scratch(b->raw);
+        if (!raw || !photon_lz_decompress(b->data, b->size, raw, b->raw)) return 0;
+        p = raw;
+    }
+    photon_line_t *lines = text->lines + b->first;
+    size_t spill = 0;
+    for (size_t i = 0; i < b->num; i++){
+        if (lines[i].length >= PHOTON_LINE_INLINE)
+            spill += lines[i].length + 1;
+    }
+    // the same as a load, short lines go inline and the rest into the arena
+    char *arena = spill ? photon_line_alloc_text(text->alloc, spill) : NULL;
+    if (spill && !arena) return 0;
+    for (size_t i = 0; i < b->num; i++){
+        photon_line_t *line = &lines[i];
+        size_t len = line->length;
+        if (len < PHOTON_LINE_INLINE){
+            memcpy(line->small, p, len);
+            line->small[len] = 0;
+            line->capacity = PHOTON_LINE_SMALL;
+        } else {
+            memcpy(arena, p, len);
+            arena[len] = 0;
+            line->line = arena;
+            line->capacity = 0;
+            arena += len + 1;
+        }
+        p += len;
+    }
+    b->out = 1;
+    b->pack->num_out++;
+    return 1;
+}
+
+// just line's text out of b into scratch, without anything to allocate
+static char *_unpack_line(pack_block_t *b, photon_line_t *line){
+    // a block that's all empty lines never needed scratch
+    static char none[1];
+    if (!line->length) return none;
+    photon_line_t *lines = b->pack->text->lines + b->first;
+    size_t at = 0;
+    for (photon_line_t *l = lines; l < line; l++)
+        at += l->length;
+    char *raw = _scratch(b->raw + 1);
+    if (b->stored)
+        memcpy(raw, b->data + at, line->length);
+    else if (b->raw && photon_lz_decompress(b->data, b->size, raw, b->raw))
+        memmove(raw, raw + at, line->length);
+    else
+        memset(raw, 0, line->length);
+    raw[line->length] = 0;
+    return raw;
+}
+
+// photon_line_str for a packed line
+static char *_unpack(photon_line_t *line){
+    pack_block_t *b = (pack_block_t *)line->line;
+    if (_unpack_block(b)) return photon_line_str(line);
+    // no room for the block's text. the caller is going to read line->length bytes, so it
+    // gets them out of scratch and the line stays packed: they're only good until the next
+    // unpack, but the editor keeps going with the edits it's holding. the stats count it
+    b->pack->failed++;
+    return _unpack_line(b, line);
+}
+
+static int _build_block(pack_block_t *b){
+    photon_line_t *lines = b->pack->text->lines + b->first;
+    size_t raw = 0;
+    for (size_t i = 0; i < b->num; i++)
+        raw += lines[i].length;
+    size_t size = 0;
+    unsigned char *data = NULL;
+    if (raw){
+        char *p = _scratch(raw + 1);
+        if (!p) return 0;
+        for (size_t i = 0, at = 0; i < b->num; at += lines[i].length, i++)
+            memcpy(p + at, photon_line_str(&lines[i]), lines[i].length);
+        if (!(data = malloc(PHOTON_LZ_BOUND(raw)))) return 0;
+        size = photon_lz_compress(p, raw, data, PHOTON_LZ_BOUND(raw));
+        if (!size || size >= raw){
+            memcpy(data, p, raw);
+            size = raw;
+            b->stored = 1;
+        }
+        unsigned char *fit = realloc(data, size);
+        data = fit ? fit : data;
+    }
+    b->data = data;
+    b->raw = raw;
+    b->size = size;
+    b->pack->raw += raw;
+    b->pack->size += size;
+    b->pack->built++;
+    return 1;
+}
+
+static photon_pack_t *_pack_new(photon_text_t *text){
+    size_t num = (text->num_line + PHOTON_PACK_BLOCK - 1) / PHOTON_PACK_BLOCK;
+    photon_pack_t *pack = calloc(1, sizeof(photon_pack_t));
+    pack_block_t *blocks = calloc(num, sizeof(pack_block_t));
+    if (!pack || !blocks){
+        free(pack);
+        free(blocks);
+        return NULL;
+    }
+    for (size_t i = 0; i < num; i++){
+        blocks[i].head.unpack = &_unpack;
+        blocks[i].pack = pack;
+        blocks[i].first = i * PHOTON_PACK_BLOCK;
+        blocks[i].num = i + 1 < num ? PHOTON_PACK_BLOCK : text->num_line - blocks[i].first;
+        blocks[i].out = 1;
+    }
+    pack->text = text;
+    pack->blocks = blocks;
+    pack->num_block = pack->num_out = num;
+    text->pack = pack;
+    return pack;
+}
+
+// every line that's out points at its block again and their text goes
+static void _commit(photon_text_t *text){
+    photon_pack_t *pack = text->pack;
+    for (size_t i = 0; i < pack->num_block; i++){
+        pack_block_t *b = &pack->blocks[i];
+        if (!b->out) continue;
+        for (size_t k = 0; k < b->num; k++){
+            photon_line_t *line = &text->lines[b->first + k];
+            line->line = (char *)&b->head;
+            line->capacity = PHOTON_LINE_PACKED;
+        }
+        b->out = 0;
+    }
+    pack->num_out = 0;
+    photon_line_alloc_destroy(text->alloc);
+    // room edits left over isn't needed until it's edited again
+    photon_line_t *lines = text->cap_line > text->num_line ? realloc(text->lines, text->num_line * sizeof(photon_line_t)) : NULL;
+    if (lines){
+        text->lines = lines;
+        text->cap_line = text->num_line;
+    }
+    // the blocks don't know which lines were the same
+    text->dedup_lines = text->dedup_bytes = 0;
+}
+
+// builds blocks until until_ns (0 for no limit), commits once they're all built. 1 when
+// it's packed, 0 if it ran out of time, -1 out of memory
+static int _pack(photon_text_t *text, uint64_t until_ns){
+    photon_pack_t *pack = text->pack ? text->pack : _pack_new(text);
+    if (!pack) return -1;
+    while (pack->built < pack->num_block){
+        if (!_build_block(&pack->blocks[pack->built])) return -1;
+        if (until_ns && pack->built < pack->num_block && _now_ns() >= until_ns) return 0;
+    }
+    _commit(text);
+    return 1;
+}
+
+void photon_pack_touch(photon_text_t *text){
+    text->touched_ns = _now_ns();
+}
+
+void photon_pack_free(photon_text_t *text){
+    photon_pack_t *pack = text->pack;
+    if (!pack) return;
+    for (size_t i = 0; i < pack->num_block; i++)
+        free(pack->blocks[i].data);
+    free(pack->blocks);
+    free(pack);
+    text->pack = NULL;
+}
+
+int photon_pack_thaw(photon_text_t *text){
+    photon_pack_t *pack = text->pack;
+    if (!pack) return 1;
+    for (size_t i = 0; i < pack->num_block; i++){
+        if (!pack->blocks[i].out && !_unpack_block(&pack->blocks[i])) return 0;
+    }
+    photon_pack_free(text);
+    return 1;
+}
+
+int photon_pack_text(photon_text_t *text){
+    return _pack(text, 0) > 0;
+}
+
+// the text that's halfway through, or the one that's been left alone the longest of the
+// ones that can be packed. NULL if there's none or there's no need to, *due is when the
+// next one can be
+static photon_text_t *_due(const photon_editor_t *editor, uint64_t now, uint64_t *due){
+    *due = UINT64_MAX;
+    for (size_t i = 0; i < editor->num_buf; i++){
+        const photon_pack_t *pack = editor->bufs[i]->text->pack;
+        if (pack && pack->built < pack->num_block)
+            return editor->bufs[i]->text;
+    }
+    if (editor->pack.after <= 0) return NULL;
+    uint64_t after = (uint64_t)editor->pack.after * 1000000000;
+    size_t total = 0;
+    photon_text_t *oldest = NULL;
+    for (size_t i = 0; i < editor->num_buf; i++){
+        photon_text_t *text = editor->bufs[i]->text;
+        // once for every text
+        if (text->views != editor->bufs[i]) continue;
+        size_t bytes = _bytes(text);
+        total += bytes;
+        if (bytes < PHOTON_PACK_MIN || (text->pack && text->pack->built == text->pack->num_block && !text->pack->num_out))
+            continue;
+        uint64_t at = text->touched_ns + after;
+        if (at > now){
+            if (at < *due)
+                *due = at;
+        } else if (!oldest || text->touched_ns < oldest->touched_ns){
+            oldest = text;
+        }
+    }
+    if (editor->pack.budget && total <= editor->pack.budget){
+        *due = UINT64_MAX;
+        return NULL;
+    }
+    return oldest;
+}
+
+void photon_pack_step(photon_editor_t *editor, uint64_t budget_ns){
+    uint64_t until = _now_ns() + budget_ns, due;
+    photon_text_t *text;
+    while ((text = _due(editor, _now_ns(), &due))){
+        int packed = _pack(text, until);
+        if (packed < 0){
+            // out of memory, it gets another go later
+            photon_pack_free(text);
+            photon_pack_touch(text);
+        }
+        if (packed <= 0 || _now_ns() >= until) return;
+    }
+}
+
+int photon_pack_pending(const photon_editor_t *editor){
+    uint64_t due;
+    const photon_text_t *text = _due(editor, _now_ns(), &due);
+    return text && text->pack && text->pack->built < text->pack->num_block;
+}
+
+int photon_pack_timeout(const photon_editor_t *editor){
+    uint64_t now = _now_ns(), due;
+    if (_due(editor, now, &due)) return 0;
+    if (due == UINT64_MAX) return -1;
+    return (int)((due - now + 999999) / 1000000);
+}
+
+void photon_pack_stats(const photon_buffer_t *buf, photon_pack_stats_t *stats){
+    const photon_text_t *text = buf->text;
+    const photon_pack_t *pack = text->pack;
+    memset(stats, 0, sizeof(*stats));
+    stats->bytes = _bytes(text);
+    if (pack)
+        stats->failed = pack->failed;
+    if (pack && pack->built == pack->num_block){
+        stats->raw = pack->raw;
+        stats->packed = pack->size;
+        stats->blocks = pack->num_block;
+        stats->unpacked = pack->num_out;
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef __PACK_H__
+#define __PACK_H__
+#include <stddef.h>
+#include <stdint.h>
+
+// texts nobody has looked at for editor->pack.after seconds get their lines compressed
+// (lz.h) in blocks of PHOTON_PACK_BLOCK lines, least recently drawn first and only while
+// all of them together take more than editor->pack.budget (if there is one). it happens
+// while the editor is idle, a block at a time, and the lines only switch over once every
+// block is done: then their text lives in the blocks and the line allocator is emptied.
+// the photon_line_t's stay (lengths and highlighting states are still there), a packed
+// one points at its block and photon_line_str unpacks the whole block on the spot, so
+// drawing or searching a region only unpacks its blocks. the blocks are kept and the
+// ones unpacked again are packed again once the text's been left alone for long enough.
+// an edit unpacks everything and drops the blocks first.
+
+typedef struct photon_editor photon_editor_t;
+typedef struct photon_buffer photon_buffer_t;
+typedef struct photon_text photon_text_t;
+typedef struct photon_pack_stats photon_pack_stats_t;
+
+#define PHOTON_PACK_BLOCK 256
+// texts that take less than this are left alone
+#define PHOTON_PACK_MIN (256 << 10)
+
+// the text was drawn (or made), it isn't packed for another editor->pack.after seconds.
+// one that's being packed carries on, the editor draws after every idle slice
+void photon_pack_touch(photon_text_t *text);
+// unpacks all of it and drops the blocks, the buffer calls this before an edit. returns 0
+// if out of memory, the text's fine either way
+int photon_pack_thaw(photon_text_t *text);
+// packs the whole text now, 0 if out of memory
+int photon_pack_text(photon_text_t *text);
+// drops the blocks without unpacking, only for when the lines are going anyway
+void photon_pack_free(photon_text_t *text);
+
+// packs what's due for at most budget_ns
+void photon_pack_step(photon_editor_t *editor, uint64_t budget_ns);
+// a text is halfway through being packed
+int photon_pack_pending(const photon_editor_t *editor);
+// ms until a text is due to be packed, -1 if none is
+int photon_pack_timeout(const photon_editor_t *editor);
+// what the text of buf takes
+void photon_pack_stats(const photon_buffer_t *buf, photon_pack_stats_t *stats);
+
+#endif//__PACK_H__
@@ -18,12 +18,39 @@ typedef struct photon_buf_options {
     const char *name;
 } photon_buf_options_t;
 
+// lines shorter than this are stored inside photon_line_t itself, in the bytes the pointer
+// to a longer line's text takes and the 4 after it that would otherwise be padding, so the
+// struct is 24 bytes either way
+#define PHOTON_LINE_INLINE 12
+#define PHOTON_LINE_SMALL (-1)
+#define PHOTON_LINE_PACKED (-2)
+
 typedef struct photon_line {
-    char *line;
+    union {
+        char *line;
+        struct {
+            char small[PHOTON_LINE_INLINE];
+            uint32_t hl_state; // the lexer's state at the end of the line, see highlight.h
+        };
+    };
     int length;
+    // PHOTON_LINE_SMALL if the text is in small, 0 if it isn't owned by the line
+    // (bulk loaded), it's copied on the first edit. PHOTON_LINE_PACKED if it's
+    // compressed, line points at a photon_packed_t then (see pack.h)
     int capacity;
 } photon_line_t;
 
+typedef struct photon_packed {
+    char *(*unpack)(photon_line_t *line); // the line's text, after unpacking it
+} photon_packed_t;
+
+// always go through this, line->line is garbage for small lines
+static inline char *photon_line_str(photon_line_t *line){
+    if (line->capacity >= 0) return line->line;
+    if (line->capacity == PHOTON_LINE_SMALL) return line->small;
+    return ((photon_packed_t *)line->line)->unpack(line);
+}
+
 #define BUF_FILE 0
 #define BUF_SCRATCH 1
 
@@ -31,22 +58,162 @@ typedef struct photon_api photon_api_t;
 typedef struct photon_editor photon_editor_t;
 typedef struct photon_buffer photon_buffer_t;
 
+// what to keep instead of a buffer pointer, see api->buffer.get. 0 is never a buffer
+typedef uint64_t photon_buf_id_t;
+
+// immutable copy of a buffer's text, safe to read from any thread
+typedef struct photon_snapshot {
+    size_t num_line;
+    const char *text;      // every line is NUL terminated
+    const size_t *offsets; // line i starts at text + offsets[i], there are num_line + 1 of them
+} photon_snapshot_t;
+
+// run is called on a worker thread, done is called on the ui thread before the next pre_frame
+typedef void (*photon_job_run_t)(const photon_snapshot_t *snapshot, void *userdata);
+typedef void (*photon_job_done_t)(const photon_api_t *api, void *userdata);
+
 typedef void (*photon_buf_draw_t)(const photon_api_t *api, photon_buffer_t *self);
 
-struct photon_buffer {
-    char type;
+// token kinds a grammar marks text with, each has a color in editor->theme.syntax
+#define PHOTON_TOK_NORMAL 0
+#define PHOTON_TOK_KEYWORD 1
+#define PHOTON_TOK_TYPE 2
+#define PHOTON_TOK_STRING 3
+#define PHOTON_TOK_NUMBER 4
+#define PHOTON_TOK_COMMENT 5
+#define PHOTON_TOK_PREPROC 6
+#define PHOTON_TOK_COUNT 7
+
+// lexes one line starting in state (0 for the first line) and returns the state the next
+// line starts in. fills kinds[0..length) with PHOTON_TOK_* unless kinds is NULL, then only
+// the state is wanted. it can't look at anything but its arguments
+typedef uint32_t (*photon_lex_t)(uint32_t state, const char *text, int length, unsigned char *kinds);
+
+typedef struct photon_match {
+    size_t line;
+    int col, length;
+} photon_match_t;
+
+// the pattern is a regex (see src/regex.h for the syntax) instead of plain text
+#define PHOTON_SEARCH_REGEX 1
+
+// where pattern (a regex, see src/regex.h) matches is marked as kind. with an end pattern
+// it's a region (a block comment, a string...) that goes on until end matches, over as
+// many lines as it takes. the rule matching first wins, the one listed first on a tie
+typedef struct photon_hl_rule {
+    const char *pattern, *end;
+    int kind;
+} photon_hl_rule_t;
+
+// one edit of a batch (see photon_buffer_replace): the text from line, col up to end_line,
+// end_col goes and text (newlines and all) takes its place
+typedef struct photon_edit {
+    size_t line, col;
+    size_t end_line, end_col;
+    const char *text;
+    size_t length;
+} photon_edit_t;
+
+// one of a buffer's cursors, what's between it and the anchor is selected
+typedef struct photon_cursor {
+    size_t line, col;
+    size_t anchor_line, anchor_col;
+} photon_cursor_t;
+
+typedef struct photon_grammar {
+    const char *name;
+    const char *suffixes; // file extensions it's for, space separated: "c h"
+    photon_lex_t lex;
+    const photon_hl_rule_t *rules; // used when lex is NULL, ends with a NULL pattern
+} photon_grammar_t;
+
+// the text itself and what goes with it, shared by every buffer showing it (see
+// photon_buffer_split). it goes with the last of them
+typedef struct photon_text {
     photon_line_t *lines;
     size_t num_line;
     size_t cap_line;
+
+    struct photon_line_alloc *alloc;
+
+    struct {
+        const photon_grammar_t *grammar;
+        struct photon_hl_rules *rules; // the grammar's rules compiled, NULL for a lexer
+        size_t clean; // lines before this have the right hl_state
+        size_t lexed; // lines before this have been lexed at some point
+        size_t dirty; // lines from clean up to this may have new text since
+    } _hl;
+
+    struct {
+        struct photon_undo_step **steps; // oldest first, the ones from done on were undone
+        size_t done, num, cap;
+        size_t bytes; // text the steps keep
+    } _undo;
+
+    struct photon_journal *journal; // NULL unless edits are journaled, see journal.h
+
+    // what loading the file with editor->dedup_lines saved: the lines that got the text of
+    // an identical one instead of their own copy, and the bytes those copies would've taken
+    size_t dedup_lines, dedup_bytes;
+
+    struct photon_pack *pack; // NULL unless its lines are (being) compressed, see pack.h
+    uint64_t touched_ns;      // when it was last drawn
+
+    struct {
+        struct photon_text_words *words; // its own counts, see complete.h
+        size_t valid; // lines before this are in the index
+    } _complete;
+
+    struct {
+        struct photon_nest_node *tree; // segment tree over the lines, see nest.h
+        size_t size;    // leaves, a power of 2
+        size_t scanned; // lines before this have their leaf
+        size_t valid;   // and the tree over them is right
+    } _nest;
+
+    photon_buffer_t *views; // the buffers showing it, through next_view
+} photon_text_t;
+
+// lines first + 1 to last hidden behind first, see fold.h
+typedef struct photon_fold {
+    size_t first, last;
+} photon_fold_t;
+
+// a view of a text: where it is on screen, how far it's scrolled, its cursors and what
+// it keeps about the text's layout
+struct photon_buffer {
+    char type;
+    photon_buf_id_t id;
+    photon_text_t *text;
     char *name;
 
-    int scroll;
+    int scroll;        // the line at the top of the view
+    size_t scroll_off; // where in it the view starts, see wrap.h
 
     photon_buf_draw_t draw;
     void *userdata;
 
-    photon_buffer_t *prev;
-    photon_buffer_t *next;
+    struct {
+        int width;      // the counts are for lines this wide
+        uint32_t *rows; // visual rows of every line
+        uint64_t *tree; // Fenwick tree over rows, 1 based
+        size_t valid;   // lines before this are counted
+        size_t cap;
+    } _wrap;
+
+    struct {
+        photon_fold_t *folds; // the closed ones in order, none inside another
+        size_t num, cap;
+    } _fold;
+
+    // every cursor in order when there's more than _gap's or a selection, see cursors.h
+    photon_cursor_t *cursors;
+    size_t num_cursor, cap_cursor;
+
+    struct photon_search *search; // NULL unless something is being searched for, see search.h
+    struct photon_follow *follow; // NULL unless the file is being followed, see follow.h
+
+    photon_buffer_t *next_view; // the next one showing the same text
 
     int y, x, rows, cols;
 
@@ -80,7 +247,11 @@ typedef union photon_hooks {
 typedef struct photon_extension {
     int errorValue;
 
+    char  *path;
     void  *handle;
+    unsigned flags; // what the library exports, see extensions.h
+    char loaded;    // on_load has been called
+
     void (*on_load)(const photon_api_t *);
     void (*pre_frame)(const photon_api_t *);
     void (*on_unload)(const photon_api_t *);
@@ -99,6 +270,35 @@ typedef struct {
 
 typedef int (*photon_pre_draw_t)(photon_draw_req_t *req);
 
+// what a buffer's text takes, see api->pack.stats
+typedef struct photon_pack_stats {
+    size_t bytes;    // in memory: its lines, their text and the packed blocks
+    size_t raw;      // text that's packed, 0 if it isn't
+    size_t packed;   // what it packed down to
+    size_t blocks;
+    size_t unpacked; // blocks that were unpacked again since, to draw or search them
+    size_t failed;   // times a line had to be read without unpacking its block, out of memory
+} photon_pack_stats_t;
+
+// a word from api->complete.query
+typedef struct photon_completion {
+    const char *word;
+    size_t length;
+    size_t count; // times it's in the open buffers
+} photon_completion_t;
+
+// what a frame cost, always collected
+typedef struct photon_frame_stats {
+    uint32_t cells_drawn;   // cells written to the back buffer
+    uint32_t cells_changed; // cells that differed from what's on screen
+    uint32_t sequences;     // escape sequences emitted
+    uint32_t bytes;         // bytes sent to the terminal
+    uint32_t writes;        // write calls
+    uint32_t color_lookups;
+    uint32_t color_misses;  // lookups that had to quantize
+    uint64_t draw_ns, pre_frame_ns, diff_ns, flush_ns;
+} photon_frame_stats_t;
+
 struct photon_api {
     photon_editor_t *editor;
     photon_hooks_t *hooks;
@@ -112,6 +312,15 @@ struct photon_api {
 #else
         void (*delete)(photon_editor_t *editor, photon_buffer_t *buffer);
 #endif
+        int (*insert)(photon_editor_t *editor, photon_buffer_t *buffer, size_t line, size_t col, const char *str, size_t n);
+        int (*erase)(photon_editor_t *editor, photon_buffer_t *buffer, size_t line, size_t col, size_t n);
+        // another view of the buffer's text where options say (type and name are ignored),
+        // with its own scroll and cursors. the text goes with the last one deleted
+        photon_buffer_t *(*split)(photon_editor_t *editor, photon_buffer_t *buffer, const photon_buf_options_t *options);
+        // the buffer with that id, NULL once it's been deleted
+        photon_buffer_t *(*get)(const photon_editor_t *editor, photon_buf_id_t id);
+        // one named name, NULL if there's none
+        photon_buffer_t *(*find)(const photon_editor_t *editor, const char *name);
     } buffer;
     struct {
         void (*draw_str)(photon_editor_t *editor, const char *str);
@@ -121,22 +330,117 @@ struct photon_api {
         int width;
         int height;
     } ui;
+    struct {
+        // buffer can be NULL if the job doesn't need any text, returns 0 on failure
+        int (*submit)(photon_editor_t *editor, photon_buffer_t *buffer, photon_job_run_t run, photon_job_done_t done, void *userdata);
+        int workers;
+    } jobs;
+    struct {
+        const photon_frame_stats_t *last;    // the frame that was just shown
+        const photon_frame_stats_t *average; // over the last PHOTON_STATS_WINDOW frames
+    } stats;
+    struct {
+        // the grammar has to stay around until the editor exits, returns 0 on failure
+        int (*add_grammar)(photon_editor_t *editor, const photon_grammar_t *grammar);
+        // by name, NULL turns highlighting off for the buffer
+        int (*set_grammar)(photon_editor_t *editor, photon_buffer_t *buffer, const char *name);
+    } highlight;
+    struct {
+        // finds the matches on screen and carries on with the rest while the editor is idle,
+        // n == 0 stops. flags are PHOTON_SEARCH_*, returns 0 on failure
+        int (*start)(photon_editor_t *editor, photon_buffer_t *buffer, const char *pattern, size_t n, int flags);
+        // the closest match after (dir > 0) or before (dir < 0) line, col, wrapping. 0 if there's none
+        int (*next)(photon_buffer_t *buffer, size_t line, int col, int dir, photon_match_t *match);
+        // *done is set once the whole buffer has been searched
+        size_t (*count)(const photon_buffer_t *buffer, int *done);
+    } search;
+    struct {
+        // searches every file under dir (a file is fine too) on the workers, the matching
+        // lines go into the scratch buffer it returns as they're found. NULL on failure
+        photon_buffer_t *(*start)(photon_editor_t *editor, const char *dir, const char *pattern, size_t n, int flags);
+        // stops every grep, the results so far stay
+        void (*stop)(photon_editor_t *editor);
+    } grep;
+    struct {
+        // appends what's written to a file buffer's file from now on, keeping the view at the
+        // bottom if it's there. returns 0 on failure
+        int (*start)(photon_editor_t *editor, photon_buffer_t *buffer);
+        void (*stop)(photon_editor_t *editor, photon_buffer_t *buffer);
+    } follow;
+    struct {
+        // edits sorted by position and not overlapping, made in one pass as one undo step.
+        // the cursors end up after each edit's text, returns 0 on failure
+        int (*replace)(photon_editor_t *editor, photon_buffer_t *buffer, const photon_edit_t *edits, size_t n);
+        // 0 if there's nothing to undo (redo) or it failed
+        int (*undo)(photon_editor_t *editor, photon_buffer_t *buffer);
+        int (*redo)(photon_editor_t *editor, photon_buffer_t *buffer);
+    } edit;
+    struct {
+        // another cursor, or a selection from anchor to line, col. returns 0 on failure
+        int (*add)(photon_editor_t *editor, photon_buffer_t *buffer, size_t line, size_t col);
+        int (*select)(photon_editor_t *editor, photon_buffer_t *buffer, size_t anchor_line, size_t anchor_col, size_t line, size_t col);
+        // a selection on every match of the buffer's search
+        int (*select_matches)(photon_editor_t *editor, photon_buffer_t *buffer);
+        // back to the one cursor
+        void (*clear)(photon_buffer_t *buffer);
+        // types str at every cursor, over the selections
+        int (*insert)(photon_editor_t *editor, photon_buffer_t *buffer, const char *str, size_t n);
+        // erases the selections, or n bytes after the cursors without one
+        int (*erase)(photon_editor_t *editor, photon_buffer_t *buffer, size_t n);
+    } cursors;
+    struct {
+        void (*stats)(const photon_buffer_t *buffer, photon_pack_stats_t *stats);
+    } pack;
+    struct {
+        // up to k of the most frequent words in the open buffers starting with prefix, most
+        // frequent first. they're good until the next edit or idle slice
+        size_t (*query)(photon_editor_t *editor, const char *prefix, size_t n, photon_completion_t *out, size_t k);
+    } complete;
+    struct {
+        // brackets open at the start of line
+        long (*depth)(photon_buffer_t *buffer, size_t line);
+        // the bracket matching the one at line, col. returns 0 if there's none
+        int (*match)(photon_buffer_t *buffer, size_t line, size_t col, size_t *match_line, size_t *match_col);
+        // the last line of the block starting at line. returns 0 if there's none
+        int (*block)(photon_buffer_t *buffer, size_t line, size_t *last);
+    } nest;
+    struct {
+        // folds the block starting at line, or unfolds it. returns 0 on failure
+        int (*toggle)(photon_editor_t *editor, photon_buffer_t *buffer, size_t line);
+        // the closed folds that end at line or after, in order
+        const photon_fold_t *(*from)(const photon_buffer_t *buffer, size_t line, size_t *count);
+        void (*clear)(photon_buffer_t *buffer);
+    } fold;
 };
 
+#define PHOTON_STATS_WINDOW 64
+
 typedef struct photon_theme_attr {
     int bg, fg;
     char style;
 } photon_theme_attr_t;
 
 typedef struct photon_editor {
-    photon_buffer_t *first_buf;
+    photon_buffer_t *cur_buf; // the one that's shown, with the other views of its text
+    photon_buffer_t **bufs;   // every buffer in no particular order, see handles.h
+    size_t num_buf, cap_buf;
+    struct photon_handles *handles;
     photon_extension_t *first_ext;
+    photon_extension_t *cur_ext;
     photon_api_t api;
 
+    struct photon_pool *pool;
+    struct photon_grep *grep; // the ones still running, see grep.h
+    struct photon_complete *complete; // the words in every buffer, see complete.h
+    int inotify; // where followed files say they changed, -1 until the first one
+
     char should_quit;
 
     struct {
         photon_theme_attr_t normal;
+        photon_theme_attr_t syntax[PHOTON_TOK_COUNT]; // only fg and style are used
+        photon_theme_attr_t match, current_match;
+        photon_theme_attr_t selection; // and the extra cursors
     } theme;
 
     photon_theme_attr_t ui_hints;
@@ -144,6 +448,26 @@ typedef struct photon_editor {
     int error;
     
     photon_pre_draw_t pre_draw;
+
+    char show_stats; // overlay with the frame stats averages
+    char dedup_lines; // file loads keep one copy of each long line's text, see HACKING.md
+
+    struct {
+        int after;     // seconds a text isn't drawn before it's packed, 0 never packs
+        size_t budget; // bytes all the texts can take before they're packed, 0 is no limit
+    } pack;
+
+    const photon_grammar_t **grammars; // later ones win
+    struct photon_hl_rules **grammar_rules; // same order, NULL for the ones with a lexer
+    int num_grammar;
+
+    struct {
+        char pattern[256];
+        int length;
+        char prompting; // after ^F, keys go into the pattern
+        char regex;     // ^R while prompting
+        char invalid;   // the regex doesn't compile
+    } find;
 } photon_editor_t;
 
 #endif//__PHOTON_H__
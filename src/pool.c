@@ -0,0 +1,277 @@
+#include "pool.h"
+#include "trace.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+
+typedef struct deque {
+    pthread_mutex_t lock;
+    photon_task_t **tasks;
+    size_t head, tail; // head is where thieves take from, tail is the owner's end
+    size_t cap;
+} deque_t;
+
+struct photon_pool {
+    int n;       // deques, fixed before any worker starts
+    int running; // workers that actually started, the others' deques just get stolen from
+    pthread_t *threads;
+    deque_t *deques;
+
+    pthread_mutex_t idle_lock;
+    pthread_cond_t idle;
+    atomic_size_t pending;
+    atomic_int quit;
+    atomic_uint next;
+
+    photon_mpsc_t done;
+    int wake[2];
+    atomic_int signalled;
+};
+
+static _Thread_local photon_pool_t *self_pool;
+static _Thread_local int self_id = -1;
+
+void photon_mpsc_init(photon_mpsc_t *q){
+    atomic_store(&q->stub.next, NULL);
+    atomic_store(&q->head, &q->stub);
+    q->tail = &q->stub;
+}
+
+void photon_mpsc_push(photon_mpsc_t *q, photon_mpsc_node_t *node){
+    atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+    photon_mpsc_node_t *prev = atomic_exchange_explicit(&q->head, node, memory_order_acq_rel);
+    atomic_store_explicit(&prev->next, node, memory_order_release);
+}
+
+// returns NULL when empty *or* when a producer is halfway through a push,
+// photon_mpsc_empty tells the two apart
+photon_mpsc_node_t *photon_mpsc_pop(photon_mpsc_t *q){
+    photon_mpsc_node_t *tail = q->tail;
+    photon_mpsc_node_t *next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    if (tail == &q->stub){
+        if (!next) return NULL;
+        q->tail = next;
+        tail = next;
+        next = atomic_load_explicit(&next->next, memory_order_acquire);
+    }
+    if (next){
+        q->tail = next;
+        return tail;
+    }
+    if (tail != atomic_load_explicit(&q->head, memory_order_acquire))
+        return NULL;
+    photon_mpsc_push(q, &q->stub);
+    next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    if (next){
+        q->tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+int photon_mpsc_empty(photon_mpsc_t *q){
+    return q->tail == &q->stub && atomic_load_explicit(&q->head, memory_order_acquire) == &q->stub;
+}
+
+static int _deque_push(deque_t *d, photon_task_t *task){
+    pthread_mutex_lock(&d->lock);
+    if (d->tail - d->head == d->cap){
+        size_t newCap = d->cap ? d->cap << 1 : 64;
+        photon_task_t **tasks = malloc(newCap * sizeof(photon_task_t *));
+        if (!tasks){
+            pthread_mutex_unlock(&d->lock);
+            return 0;
+        }
+        for (size_t i = d->head; i != d->tail; i++)
+            tasks[i - d->head] = d->tasks[i % d->cap];
+        free(d->tasks);
+        d->tail -= d->head;
+        d->head = 0;
+        d->tasks = tasks;
+        d->cap = newCap;
+    }
+    d->tasks[d->tail++ % d->cap] = task;
+    pthread_mutex_unlock(&d->lock);
+    return 1;
+}
+
+static photon_task_t *_deque_pop(deque_t *d, int steal){
+    photon_task_t *task = NULL;
+    pthread_mutex_lock(&d->lock);
+    if (d->head != d->tail){
+        // the owner works newest first (cache is still warm), thieves take the oldest
+        if (steal)
+            task = d->tasks[d->head++ % d->cap];
+        else
+            task = d->tasks[--d->tail % d->cap];
+    }
+    pthread_mutex_unlock(&d->lock);
+    return task;
+}
+
+static photon_task_t *_pool_take(photon_pool_t *pool, int id){
+    photon_task_t *task = _deque_pop(&pool->deques[id], 0);
+    for (int i = 1; !task && i < pool->n; i++)
+        task = _deque_pop(&pool->deques[(id + i) % pool->n], 1);
+    if (task)
+        atomic_fetch_sub(&pool->pending, 1);
+    return task;
+}
+
+typedef struct {
+    photon_pool_t *pool;
+    int id;
+} worker_arg_t;
+
+static void *_pool_worker(void *p){
+    worker_arg_t arg = *(worker_arg_t *)p;
+    free(p);
+    photon_pool_t *pool = arg.pool;
+    self_pool = pool;
+    self_id = arg.id;
+    char name[16];
+    snprintf(name, sizeof(name), "worker %d", arg.id);
+    photon_trace_thread_name(name);
+    while (1){
+        photon_task_t *task = _pool_take(pool, arg.id);
+        if (task){
+            PHOTON_TRACE_BEGIN("pool.task", 0, 0);
+            task->run(task);
+            PHOTON_TRACE_END("pool.task");
+            continue;
+        }
+        pthread_mutex_lock(&pool->idle_lock);
+        while (!atomic_load(&pool->pending) && !atomic_load(&pool->quit))
+            pthread_cond_wait(&pool->idle, &pool->idle_lock);
+        int quit = atomic_load(&pool->quit) && !atomic_load(&pool->pending);
+        pthread_mutex_unlock(&pool->idle_lock);
+        if (quit) break;
+    }
+    return NULL;
+}
+
+photon_pool_t *photon_pool_create(int nthreads){
+    if (nthreads <= 0){
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = cores > 0 ? (int)cores : 1;
+    }
+    photon_pool_t *pool = calloc(1, sizeof(photon_pool_t));
+    if (!pool) return NULL;
+    pool->threads = calloc(nthreads, sizeof(pthread_t));
+    pool->deques = calloc(nthreads, sizeof(deque_t));
+    if (!pool->threads || !pool->deques || pipe(pool->wake) == -1){
+        free(pool->threads);
+        free(pool->deques);
+        free(pool);
+        return NULL;
+    }
+    fcntl(pool->wake[0], F_SETFL, O_NONBLOCK);
+    fcntl(pool->wake[1], F_SETFL, O_NONBLOCK);
+    fcntl(pool->wake[0], F_SETFD, FD_CLOEXEC);
+    fcntl(pool->wake[1], F_SETFD, FD_CLOEXEC);
+    pthread_mutex_init(&pool->idle_lock, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+    photon_mpsc_init(&pool->done);
+    for (int i = 0; i < nthreads; i++)
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+    pool->n = nthreads;
+    for (int i = 0; i < nthreads; i++){
+        worker_arg_t *arg = malloc(sizeof(worker_arg_t));
+        if (!arg) break;
+        arg->pool = pool;
+        arg->id = i;
+        if (pthread_create(&pool->threads[i], NULL, _pool_worker, arg) != 0){
+            free(arg);
+            break;
+        }
+        pool->running++;
+    }
+    if (!pool->running){
+        photon_pool_destroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+void photon_pool_stop(photon_pool_t *pool){
+    if (atomic_exchange(&pool->quit, 1)) return;
+    pthread_mutex_lock(&pool->idle_lock);
+    pthread_cond_broadcast(&pool->idle);
+    pthread_mutex_unlock(&pool->idle_lock);
+    for (int i = 0; i < pool->running; i++)
+        pthread_join(pool->threads[i], NULL);
+}
+
+void photon_pool_destroy(photon_pool_t *pool){
+    if (!pool) return;
+    photon_pool_stop(pool);
+    for (int i = 0; i < pool->n; i++){
+        pthread_mutex_destroy(&pool->deques[i].lock);
+        free(pool->deques[i].tasks);
+    }
+    pthread_mutex_destroy(&pool->idle_lock);
+    pthread_cond_destroy(&pool->idle);
+    close(pool->wake[0]);
+    close(pool->wake[1]);
+    free(pool->threads);
+    free(pool->deques);
+    free(pool);
+}
+
+int photon_pool_size(photon_pool_t *pool){
+    return pool->running;
+}
+
+int photon_pool_submit(photon_pool_t *pool, photon_task_t *task){
+    int id;
+    // tasks spawned from a worker stay on that worker, everything else is spread out
+    if (self_pool == pool)
+        id = self_id;
+    else
+        id = atomic_fetch_add(&pool->next, 1) % pool->n;
+    atomic_fetch_add(&pool->pending, 1);
+    if (!_deque_push(&pool->deques[id], task)){
+        atomic_fetch_sub(&pool->pending, 1);
+        return 0;
+    }
+    pthread_mutex_lock(&pool->idle_lock);
+    pthread_cond_signal(&pool->idle);
+    pthread_mutex_unlock(&pool->idle_lock);
+    return 1;
+}
+
+static void _pool_signal(photon_pool_t *pool){
+    if (atomic_exchange(&pool->signalled, 1)) return;
+    char c = 0;
+    while (write(pool->wake[1], &c, 1) == -1 && errno == EINTR);
+}
+
+void photon_pool_complete(photon_pool_t *pool, photon_mpsc_node_t *node){
+    photon_mpsc_push(&pool->done, node);
+    _pool_signal(pool);
+}
+
+photon_mpsc_node_t *photon_pool_next_done(photon_pool_t *pool){
+    photon_mpsc_node_t *node = photon_mpsc_pop(&pool->done);
+    // a producer is mid push, come back around on the next wake up
+    if (!node && !photon_mpsc_empty(&pool->done))
+        _pool_signal(pool);
+    return node;
+}
+
+int photon_pool_wake_fd(photon_pool_t *pool){
+    return pool->wake[0];
+}
+
+void photon_pool_notify(photon_pool_t *pool){
+    _pool_signal(pool);
+}
+
+void photon_pool_ack(photon_pool_t *pool){
+    char drain[64];
+    atomic_store(&pool->signalled, 0);
+    while (read(pool->wake[0], drain, sizeof(drain)) > 0);
+}
@@ -0,0 +1,48 @@
+#ifndef __POOL_H__
+#define __POOL_H__
+#include <stdatomic.h>
+
+typedef struct photon_pool photon_pool_t;
+
+typedef struct photon_task photon_task_t;
+typedef void (*photon_task_fn_t)(photon_task_t *task);
+
+// intrusive, embed this in whatever the job needs
+struct photon_task {
+    photon_task_fn_t run;
+};
+
+// intrusive multi producer single consumer queue (Vyukov style)
+typedef struct photon_mpsc_node {
+    _Atomic(struct photon_mpsc_node *) next;
+} photon_mpsc_node_t;
+
+typedef struct photon_mpsc {
+    _Atomic(photon_mpsc_node_t *) head;
+    photon_mpsc_node_t *tail;
+    photon_mpsc_node_t stub;
+} photon_mpsc_t;
+
+void photon_mpsc_init(photon_mpsc_t *q);
+void photon_mpsc_push(photon_mpsc_t *q, photon_mpsc_node_t *node);
+photon_mpsc_node_t *photon_mpsc_pop(photon_mpsc_t *q);
+int photon_mpsc_empty(photon_mpsc_t *q);
+
+// nthreads <= 0 picks one worker per core
+photon_pool_t *photon_pool_create(int nthreads);
+// runs everything already submitted then joins the workers, completions stay queued
+void photon_pool_stop(photon_pool_t *pool);
+void photon_pool_destroy(photon_pool_t *pool);
+int photon_pool_size(photon_pool_t *pool);
+int photon_pool_submit(photon_pool_t *pool, photon_task_t *task);
+
+// completions go back to the ui thread through here
+void photon_pool_complete(photon_pool_t *pool, photon_mpsc_node_t *node);
+photon_mpsc_node_t *photon_pool_next_done(photon_pool_t *pool);
+// readable whenever there are completions waiting, call photon_pool_ack before draining
+int photon_pool_wake_fd(photon_pool_t *pool);
+void photon_pool_ack(photon_pool_t *pool);
+// wakes the ui thread without a completion, for work that hands its results over itself
+void photon_pool_notify(photon_pool_t *pool);
+
+#endif//__POOL_H__
@@ -0,0 +1,850 @@
+#include "regex.h"
+#include "search.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// how big a pattern can get
+#define MAX_REPEAT 1000
+#define MAX_INST 20000
+#define MAX_DEPTH 256
+#define MAX_PREFIX 64
+
+typedef struct byteset {
+    uint32_t bits[8];
+} byteset_t;
+
+// the parse tree, nodes point at each other by index
+enum { N_EMPTY, N_SET, N_BOL, N_EOL, N_WORDB, N_NWORDB, N_CAT, N_ALT, N_REPEAT };
+
+typedef struct node {
+    int type;
+    int a, b; // children, a is the one repeated
+    int set;
+    int min, max; // max < 0 when there's no limit
+    int greedy;
+} node_t;
+
+// the NFA. the line is read a byte at a time and then an end symbol. ^, $, \b and \B are
+// about the symbols on either side, so they're only resolved on the step that reads the
+// next one. they go by the direction it's read in: ^ is I_BEGIN forwards and I_END backwards
+enum { I_SET, I_ANY, I_BEGIN, I_END, I_WORDB, I_NWORDB, I_SPLIT, I_LOOP, I_JMP, I_MATCH };
+
+typedef struct inst {
+    int op;
+    int x, y; // I_SET: the set. I_SPLIT, I_LOOP (the split at the top of a loop): x goes
+              // before y. I_JMP: x, and for the jump back to an I_LOOP y is where the loop
+              // comes out (0 for other jumps)
+} inst_t;
+
+typedef struct prog {
+    inst_t *v;
+    int n, cap;
+} prog_t;
+
+typedef struct dstate {
+    size_t pc;   // where its instructions are in dfa->pcs, in priority order
+    int n;
+    int matched; // a match ended right before the symbol that led here
+    int flags;   // BEGIN and WORD, only kept when the pattern can tell
+    uint32_t hash;
+} dstate_t;
+
+#define BEGIN 1 // nothing has been read yet and this is where the line starts (or ends, backwards)
+#define WORD 2  // the symbol before was a word byte
+
+#define DEAD 0
+#define UNKNOWN -1
+#define NO_MEM -2
+
+typedef struct dfa {
+    prog_t prog;
+    int longest; // keeps going after a match instead of dropping the threads behind it
+    dstate_t *states;
+    int num_state, cap_state;
+    int *trans; // num_state rows of nclass, UNKNOWN until first taken
+    int *pcs;
+    size_t num_pc, cap_pc;
+    int *table; // state + 1, 0 is empty
+    size_t cap_table;
+    int start[4]; // by flags
+    // scratch for building a state
+    int *list, *keep, *stack, *stack2;
+    unsigned *seen, *queued, gen;
+    int cut;
+} dfa_t;
+
+struct photon_regex {
+    byteset_t *sets;
+    int num_set;
+    int flags; // the state flags the pattern cares about
+    // bytes no set tells apart share a class, the end of the line comes after them
+    unsigned short cls[256];
+    unsigned char rep[256]; // a byte of each class
+    unsigned char word[257];
+    int nbyte, nclass;
+    dfa_t fwd; // unanchored, finds where the leftmost-first match ends
+    dfa_t rev; // the pattern backwards from that end, finds where it starts
+    photon_search_pat_t prefix; // every match starts with it, empty if there's no such thing
+};
+
+static void _add(byteset_t *s, int c){
+    s->bits[c >> 5] |= 1u << (c & 31);
+}
+
+static int _has(const byteset_t *s, int c){
+    return s->bits[c >> 5] >> (c & 31) & 1;
+}
+
+static void _add_range(byteset_t *s, int lo, int hi){
+    for (int c = lo; c <= hi; c++)
+        _add(s, c);
+}
+
+static void _invert(byteset_t *s){
+    for (int i = 0; i < 8; i++)
+        s->bits[i] = ~s->bits[i];
+}
+
+static void _fold(byteset_t *s){
+    for (int c = 'a'; c <= 'z'; c++){
+        if (_has(s, c) || _has(s, c - 32)){
+            _add(s, c);
+            _add(s, c - 32);
+        }
+    }
+}
+
+static int _is_word(int c){
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// the one byte in s, -1 if there's more or none
+static int _single(const byteset_t *s){
+    int found = -1;
+    for (int c = 0; c < 256; c++){
+        if (!_has(s, c)) continue;
+        if (found >= 0) return -1;
+        found = c;
+    }
+    return found;
+}
+
+typedef struct parser {
+    const char *p, *end;
+    int icase, depth;
+    node_t *nodes;
+    int num_node, cap_node;
+    byteset_t *sets;
+    int num_set, cap_set;
+    const char *error;
+} parser_t;
+
+static int _fail(parser_t *ps, const char *error){
+    if (!ps->error)
+        ps->error = error;
+    return -1;
+}
+
+static int _node(parser_t *ps, int type, int a, int b){
+    if (ps->num_node == ps->cap_node){
+        int cap = ps->cap_node ? ps->cap_node * 2 : 32;
+        node_t *nodes = realloc(ps->nodes, cap * sizeof(node_t));
+        if (!nodes) return _fail(ps, "out of memory");
+        ps->nodes = nodes;
+        ps->cap_node = cap;
+    }
+    ps->nodes[ps->num_node] = (node_t){ .type = type, .a = a, .b = b, .set = -1, .min = 1, .max = 1, .greedy = 1 };
+    return ps->num_node++;
+}
+
+static int _set_node(parser_t *ps, const byteset_t *set){
+    if (ps->num_set == ps->cap_set){
+        int cap = ps->cap_set ? ps->cap_set * 2 : 16;
+        byteset_t *sets = realloc(ps->sets, cap * sizeof(byteset_t));
+        if (!sets) return _fail(ps, "out of memory");
+        ps->sets = sets;
+        ps->cap_set = cap;
+    }
+    int node = _node(ps, N_SET, -1, -1);
+    if (node < 0) return -1;
+    ps->sets[ps->num_set] = *set;
+    ps->nodes[node].set = ps->num_set++;
+    return node;
+}
+
+// \d \w \s and their negations into s, 0 if c isn't one of them
+static int _class_escape(byteset_t *s, char c){
+    byteset_t t = {0};
+    switch (c){
+    case 'd': case 'D':
+        _add_range(&t, '0', '9');
+        break;
+    case 'w': case 'W':
+        for (int i = 0; i < 256; i++)
+            if (_is_word(i)) _add(&t, i);
+        break;
+    case 's': case 'S':
+        _add(&t, ' '); _add(&t, '\t'); _add(&t, '\n'); _add(&t, '\r'); _add(&t, '\f'); _add(&t, '\v');
+        break;
+    default:
+        return 0;
+    }
+    if (c >= 'A' && c <= 'Z')
+        _invert(&t);
+    for (int i = 0; i < 8; i++)
+        s->bits[i] |= t.bits[i];
+    return 1;
+}
+
+static int _hex(char c){
+    if (c >= '0' && c <= '9') return c - '0';
+    if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') return (c | 0x20) - 'a' + 10;
+    return -1;
+}
+
+// the byte a backslash (already skipped) stands for
+static int _escape_byte(parser_t *ps){
+    if (ps->p == ps->end) return _fail(ps, "trailing backslash");
+    char c = *ps->p++;
+    switch (c){
+    case 't': return '\t';
+    case 'n': return '\n';
+    case 'r': return '\r';
+    case 'f': return '\f';
+    case 'v': return '\v';
+    case 'e': return 27;
+    case 'x': {
+        int hi, lo;
+        if (ps->end - ps->p < 2 || (hi = _hex(ps->p[0])) < 0 || (lo = _hex(ps->p[1])) < 0)
+            return _fail(ps, "bad \\x escape");
+        ps->p += 2;
+        return hi << 4 | lo;
+    }
+    }
+    if (_is_word(c))
+        return _fail(ps, "unknown escape");
+    return (unsigned char)c;
+}
+
+// one byte of a [class], -2 if it was a whole class like \d that went straight into s
+static int _class_byte(parser_t *ps, byteset_t *s){
+    char c = *ps->p++;
+    if (c != '\\') return (unsigned char)c;
+    if (ps->p < ps->end && _class_escape(s, *ps->p)){
+        ps->p++;
+        return -2;
+    }
+    return _escape_byte(ps);
+}
+
+static int _parse_class(parser_t *ps){
+    byteset_t s = {0};
+    int negate = ps->p < ps->end && *ps->p == '^';
+    ps->p += negate;
+    for (int first = 1; ; first = 0){
+        if (ps->p == ps->end) return _fail(ps, "missing ]");
+        if (*ps->p == ']' && !first){
+            ps->p++;
+            break;
+        }
+        int lo = _class_byte(ps, &s);
+        if (lo == -1) return -1;
+        if (lo == -2) continue;
+        if (ps->end - ps->p >= 2 && ps->p[0] == '-' && ps->p[1] != ']'){
+            ps->p++;
+            int hi = _class_byte(ps, &s);
+            if (hi == -1) return -1;
+            if (hi < lo) return _fail(ps, "bad range");
+            _add_range(&s, lo, hi);
+        } else {
+            _add(&s, lo);
+        }
+    }
+    if (ps->icase)
+        _fold(&s);
+    if (negate)
+        _invert(&s);
+    return _set_node(ps, &s);
+}
+
+static int _parse_alt(parser_t *ps);
+
+static int _parse_atom(parser_t *ps){
+    byteset_t s = {0};
+    int c = (unsigned char)*ps->p++;
+    switch (c){
+    case '(': {
+        if (++ps->depth > MAX_DEPTH) return _fail(ps, "too deeply nested");
+        if (ps->end - ps->p >= 2 && ps->p[0] == '?' && ps->p[1] == ':')
+            ps->p += 2;
+        int node = _parse_alt(ps);
+        if (node < 0) return -1;
+        if (ps->p == ps->end || *ps->p != ')') return _fail(ps, "missing )");
+        ps->p++;
+        ps->depth--;
+        return node;
+    }
+    case '[':
+        return _parse_class(ps);
+    case '.':
+        _add_range(&s, 0, 255);
+        return _set_node(ps, &s);
+    case '^':
+        return _node(ps, N_BOL, -1, -1);
+    case '$':
+        return _node(ps, N_EOL, -1, -1);
+    case '*': case '+': case '?':
+        return _fail(ps, "nothing to repeat");
+    case '\\':
+        if (ps->p < ps->end && (*ps->p == 'b' || *ps->p == 'B'))
+            return _node(ps, *ps->p++ == 'b' ? N_WORDB : N_NWORDB, -1, -1);
+        if (ps->p < ps->end && _class_escape(&s, *ps->p)){
+            ps->p++;
+            return _set_node(ps, &s);
+        }
+        if ((c = _escape_byte(ps)) < 0) return -1;
+        break;
+    }
+    _add(&s, c);
+    if (ps->icase)
+        _fold(&s);
+    return _set_node(ps, &s);
+}
+
+// {m}, {m,} or {m,n}, 0 (and nothing's read) if it isn't one, the brace is a plain byte then
+static int _parse_count(parser_t *ps, int *min, int *max){
+    const char *p = ps->p + 1;
+    int m = 0, x, digits = 0;
+    for (; p < ps->end && *p >= '0' && *p <= '9'; p++, digits++)
+        m = m > MAX_REPEAT ? m : m * 10 + *p - '0';
+    if (!digits) return 0;
+    x = m;
+    if (p < ps->end && *p == ','){
+        x = -1;
+        for (p++; p < ps->end && *p >= '0' && *p <= '9'; p++)
+            x = x < 0 ? *p - '0' : x > MAX_REPEAT ? x : x * 10 + *p - '0';
+    }
+    if (p == ps->end || *p != '}') return 0;
+    ps->p = p + 1;
+    *min = m;
+    *max = x;
+    return 1;
+}
+
+static int _parse_repeat(parser_t *ps){
+    int node = _parse_atom(ps);
+    while (node >= 0 && ps->p < ps->end){
+        int min, max;
+        char c = *ps->p;
+        if (c == '*'){
+            min = 0, max = -1;
+        } else if (c == '+'){
+            min = 1, max = -1;
+        } else if (c == '?'){
+            min = 0, max = 1;
+        } else if (c != '{' || !_parse_count(ps, &min, &max)){
+            break;
+        }
+        if (c != '{')
+            ps->p++;
+        if (min > MAX_REPEAT || max > MAX_REPEAT) return _fail(ps, "repeat count too big");
+        if (max >= 0 && min > max) return _fail(ps, "bad repeat count");
+        int greedy = !(ps->p < ps->end && *ps->p == '?');
+        ps->p += !greedy;
+        int repeat = _node(ps, N_REPEAT, node, -1);
+        if (repeat < 0) return -1;
+        ps->nodes[repeat].min = min;
+        ps->nodes[repeat].max = max;
+        ps->nodes[repeat].greedy = greedy;
+        node = repeat;
+    }
+    return node;
+}
+
+static int _parse_cat(parser_t *ps){
+    int node = -1;
+    while (ps->p < ps->end && *ps->p != '|' && *ps->p != ')'){
+        int next = _parse_repeat(ps);
+        if (next < 0) return -1;
+        if ((node = node < 0 ? next : _node(ps, N_CAT, node, next)) < 0) return -1;
+    }
+    return node < 0 ? _node(ps, N_EMPTY, -1, -1) : node;
+}
+
+static int _parse_alt(parser_t *ps){
+    int node = _parse_cat(ps);
+    while (node >= 0 && ps->p < ps->end && *ps->p == '|'){
+        ps->p++;
+        int next = _parse_cat(ps);
+        if (next < 0) return -1;
+        node = _node(ps, N_ALT, node, next);
+    }
+    return node;
+}
+
+// the literal every match of node starts with goes into buf, returns 1 if that's all
+// node is (so whatever comes after it counts too)
+static int _prefix(const parser_t *ps, int node, char *buf, size_t *n){
+    const node_t *nd = &ps->nodes[node];
+    int c;
+    switch (nd->type){
+    case N_EMPTY: case N_WORDB: case N_NWORDB:
+        return 1;
+    case N_SET:
+        if ((c = _single(&ps->sets[nd->set])) < 0 || *n == MAX_PREFIX) return 0;
+        buf[(*n)++] = (char)c;
+        return 1;
+    case N_CAT:
+        return _prefix(ps, nd->a, buf, n) && _prefix(ps, nd->b, buf, n);
+    case N_REPEAT:
+        if (nd->min > 0)
+            _prefix(ps, nd->a, buf, n);
+        return 0;
+    }
+    return 0;
+}
+
+static int _inst(prog_t *pg, int op, int x, int y){
+    if (pg->n == pg->cap){
+        if (pg->cap >= MAX_INST) return -1;
+        int cap = pg->cap ? pg->cap * 2 : 64;
+        inst_t *v = realloc(pg->v, cap * sizeof(inst_t));
+        if (!v) return -1;
+        pg->v = v;
+        pg->cap = cap;
+    }
+    pg->v[pg->n] = (inst_t){ .op = op, .x = x, .y = y };
+    return pg->n++;
+}
+
+// the body of a split comes right after it
+static void _patch(prog_t *pg, int split, int out, int greedy){
+    pg->v[split].x = greedy ? split + 1 : out;
+    pg->v[split].y = greedy ? out : split + 1;
+}
+
+// reverse emits concatenations back to front, for reading the text backwards
+static int _emit(const parser_t *ps, prog_t *pg, int node, int reverse){
+    const node_t nd = ps->nodes[node];
+    switch (nd.type){
+    case N_EMPTY:
+        return 1;
+    case N_SET:
+        return _inst(pg, I_SET, nd.set, 0) >= 0;
+    case N_BOL:
+        return _inst(pg, reverse ? I_END : I_BEGIN, 0, 0) >= 0;
+    case N_EOL:
+        return _inst(pg, reverse ? I_BEGIN : I_END, 0, 0) >= 0;
+    case N_WORDB:
+        return _inst(pg, I_WORDB, 0, 0) >= 0;
+    case N_NWORDB:
+        return _inst(pg, I_NWORDB, 0, 0) >= 0;
+    case N_CAT:
+        return _emit(ps, pg, reverse ? nd.b : nd.a, reverse) && _emit(ps, pg, reverse ? nd.a : nd.b, reverse);
+    case N_ALT: {
+        int split = _inst(pg, I_SPLIT, 0, 0);
+        if (split < 0 || !_emit(ps, pg, nd.a, reverse)) return 0;
+        int jmp = _inst(pg, I_JMP, 0, 0);
+        if (jmp < 0) return 0;
+        pg->v[split].x = split + 1;
+        pg->v[split].y = pg->n;
+        if (!_emit(ps, pg, nd.b, reverse)) return 0;
+        pg->v[jmp].x = pg->n;
+        return 1;
+    }
+    case N_REPEAT:
+        for (int i = 0; i < nd.min; i++){
+            if (!_emit(ps, pg, nd.a, reverse)) return 0;
+        }
+        if (nd.max < 0){
+            int split = _inst(pg, I_LOOP, 0, 0), jmp;
+            if (split < 0 || !_emit(ps, pg, nd.a, reverse) || (jmp = _inst(pg, I_JMP, split, 0)) < 0) return 0;
+            _patch(pg, split, pg->n, nd.greedy);
+            pg->v[jmp].y = pg->n;
+            return 1;
+        }
+        // x{0,3} is (x(x(x)?)?)?, each split can skip straight to the end. they're chained
+        // through x until the end is known
+        int chain = -1;
+        for (int i = nd.min; i < nd.max; i++){
+            int split = _inst(pg, I_SPLIT, chain, 0);
+            if (split < 0 || !_emit(ps, pg, nd.a, reverse)) return 0;
+            chain = split;
+        }
+        for (int out = pg->n; chain >= 0; ){
+            int prev = pg->v[chain].x;
+            _patch(pg, chain, out, nd.greedy);
+            chain = prev;
+        }
+        return 1;
+    }
+    return 0;
+}
+
+static void _classes(photon_regex_t *re){
+    unsigned char edge[256] = {0};
+    for (int i = 0; i < re->num_set; i++){
+        for (int c = 1; c < 256; c++)
+            edge[c] |= _has(&re->sets[i], c) != _has(&re->sets[i], c - 1);
+    }
+    for (int c = 1; re->flags & WORD && c < 256; c++)
+        edge[c] |= _is_word(c) != _is_word(c - 1);
+    int k = 0;
+    for (int c = 0; c < 256; c++){
+        if (c && edge[c])
+            k++;
+        if (!c || edge[c])
+            re->rep[k] = (unsigned char)c;
+        re->cls[c] = (unsigned short)k;
+    }
+    re->nbyte = k + 1;
+    re->nclass = re->nbyte + 1;
+    for (int i = 0; i < re->nbyte; i++)
+        re->word[i] = (unsigned char)_is_word(re->rep[i]);
+}
+
+static int _matches(const photon_regex_t *re, const inst_t *in, int c){
+    switch (in->op){
+    case I_ANY: return 1;
+    case I_SET: return c < re->nbyte && _has(&re->sets[in->x], re->rep[c]);
+    }
+    return 0;
+}
+
+static size_t _dfa_bytes(const photon_regex_t *re, const dfa_t *d){
+    return (size_t)d->num_state * (sizeof(dstate_t) + re->nclass * sizeof(int)) + d->num_pc * sizeof(int);
+}
+
+static uint32_t _hash(const int *list, int n, int matched, int flags){
+    uint32_t h = 2166136261u ^ (uint32_t)(matched | flags << 1);
+    for (int i = 0; i < n; i++){
+        h ^= (uint32_t)list[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static int _grow_table(dfa_t *d){
+    size_t cap = d->cap_table ? d->cap_table * 2 : 64;
+    int *table = calloc(cap, sizeof(int));
+    if (!table) return 0;
+    for (int s = 0; s < d->num_state; s++){
+        size_t i = d->states[s].hash & (cap - 1);
+        while (table[i])
+            i = (i + 1) & (cap - 1);
+        table[i] = s + 1;
+    }
+    free(d->table);
+    d->table = table;
+    d->cap_table = cap;
+    return 1;
+}
+
+// the state with these instructions, made if there's none yet
+static int _intern(photon_regex_t *re, dfa_t *d, const int *list, int n, int matched, int flags){
+    uint32_t h = _hash(list, n, matched, flags);
+    size_t mask = d->cap_table - 1, i;
+    for (i = h & mask; d->cap_table && d->table[i]; i = (i + 1) & mask){
+        const dstate_t *st = &d->states[d->table[i] - 1];
+        if (st->hash == h && st->n == n && st->matched == matched && st->flags == flags && (!n || !memcmp(d->pcs + st->pc, list, n * sizeof(int))))
+            return d->table[i] - 1;
+    }
+    if ((size_t)(d->num_state + 1) * 2 > d->cap_table && !_grow_table(d)) return NO_MEM;
+    if (d->num_state == d->cap_state){
+        int cap = d->cap_state ? d->cap_state * 2 : 16;
+        dstate_t *states = realloc(d->states, cap * sizeof(dstate_t));
+        if (!states) return NO_MEM;
+        d->states = states;
+        int *trans = realloc(d->trans, (size_t)cap * re->nclass * sizeof(int));
+        if (!trans) return NO_MEM;
+        d->trans = trans;
+        d->cap_state = cap;
+    }
+    if (d->num_pc + n > d->cap_pc){
+        size_t cap = d->cap_pc ? d->cap_pc : 256;
+        while (cap < d->num_pc + n)
+            cap <<= 1;
+        int *pcs = realloc(d->pcs, cap * sizeof(int));
+        if (!pcs) return NO_MEM;
+        d->pcs = pcs;
+        d->cap_pc = cap;
+    }
+    int s = d->num_state++;
+    if (n)
+        memcpy(d->pcs + d->num_pc, list, n * sizeof(int));
+    d->states[s] = (dstate_t){ .pc = d->num_pc, .n = n, .matched = matched, .flags = flags, .hash = h };
+    d->num_pc += n;
+    for (int c = 0; c < re->nclass; c++)
+        d->trans[(size_t)s * re->nclass + c] = UNKNOWN;
+    mask = d->cap_table - 1;
+    for (i = h & mask; d->table[i]; i = (i + 1) & mask);
+    d->table[i] = s + 1;
+    return s;
+}
+
+static void _next_gen(dfa_t *d){
+    if (++d->gen) return;
+    memset(d->seen, 0, d->prog.n * sizeof(unsigned));
+    memset(d->queued, 0, d->prog.n * sizeof(unsigned));
+    d->gen = 1;
+}
+
+// where a jump goes. one back to a loop that's been through here already without reading
+// anything is an iteration that matched nothing, and that ends the loop right there the way
+// perl does it: what comes after the loop goes before whatever else the iteration could do.
+// the loops a closure goes through are on its list too, so the step after it still knows
+static inline int _jump(const inst_t *in, const unsigned *visited, unsigned gen){
+    return in->y && visited[in->x] == gen ? in->y : in->x;
+}
+
+// what pc leads to without reading anything goes on the list, in priority order. it stops
+// at whatever needs the next symbol: consuming instructions, assertions and matches
+static void _closure(dfa_t *d, int pc, int *list, int *n){
+    int *stack = d->stack2, top = 0;
+    stack[top++] = pc;
+    while (top){
+        pc = stack[--top];
+        if (d->queued[pc] == d->gen) continue;
+        d->queued[pc] = d->gen;
+        const inst_t *in = &d->prog.v[pc];
+        if (in->op == I_JMP){
+            stack[top++] = _jump(in, d->queued, d->gen);
+        } else if (in->op == I_SPLIT || in->op == I_LOOP){
+            if (in->op == I_LOOP)
+                list[(*n)++] = pc;
+            stack[top++] = in->y;
+            stack[top++] = in->x;
+        } else {
+            list[(*n)++] = pc;
+            // anything after a match is lower priority, it would never get looked at
+            if (in->op == I_MATCH && !d->longest){
+                d->cut = 1;
+                return;
+            }
+        }
+    }
+}
+
+// empties the cache down to the dead and start states
+static int _dfa_reset(photon_regex_t *re, dfa_t *d){
+    d->num_state = 0;
+    d->num_pc = 0;
+    if (d->table)
+        memset(d->table, 0, d->cap_table * sizeof(int));
+    if (_intern(re, d, NULL, 0, 0, 0) != DEAD) return 0;
+    for (int flags = 0; flags < 4; flags++){
+        int n = 0;
+        _next_gen(d);
+        d->cut = 0;
+        _closure(d, 0, d->list, &n);
+        if ((d->start[flags] = _intern(re, d, d->list, n, 0, flags & re->flags)) < 0) return 0;
+    }
+    return 1;
+}
+
+// the state s goes to on class c
+static int _compute(photon_regex_t *re, dfa_t *d, int s, int c){
+    if (_dfa_bytes(re, d) > PHOTON_REGEX_CACHE){
+        // the cache is full, start over keeping s
+        dstate_t st = d->states[s];
+        memcpy(d->keep, d->pcs + st.pc, st.n * sizeof(int));
+        if (!_dfa_reset(re, d) || (s = _intern(re, d, d->keep, st.n, st.matched, st.flags)) < 0)
+            return NO_MEM;
+    }
+    const dstate_t st = d->states[s];
+    const int *items = d->pcs + st.pc;
+    int prev = !!(st.flags & WORD), word = re->word[c], matched = 0, n = 0;
+    _next_gen(d);
+    d->cut = 0;
+    for (int i = 0; i < st.n && !d->cut && !(matched && !d->longest); i++){
+        // a loop the closure went through, what it led to is on the list after it
+        if (d->prog.v[items[i]].op == I_LOOP){
+            d->seen[items[i]] = d->gen;
+            continue;
+        }
+        int *stack = d->stack, top = 0;
+        stack[top++] = items[i];
+        while (top && !d->cut){
+            int pc = stack[--top];
+            if (d->seen[pc] == d->gen) continue;
+            d->seen[pc] = d->gen;
+            const inst_t *in = &d->prog.v[pc];
+            switch (in->op){
+            case I_JMP:
+                stack[top++] = _jump(in, d->seen, d->gen);
+                break;
+            case I_SPLIT: case I_LOOP:
+                stack[top++] = in->y;
+                stack[top++] = in->x;
+                break;
+            case I_BEGIN:
+                if (st.flags & BEGIN)
+                    stack[top++] = pc + 1;
+                break;
+            case I_END:
+                if (c == re->nbyte)
+                    stack[top++] = pc + 1;
+                break;
+            case I_WORDB: case I_NWORDB:
+                if ((prev != word) == (in->op == I_WORDB))
+                    stack[top++] = pc + 1;
+                break;
+            case I_MATCH:
+                matched = 1;
+                if (!d->longest)
+                    top = 0;
+                break;
+            default:
+                if (_matches(re, in, c))
+                    _closure(d, pc + 1, d->list, &n);
+            }
+        }
+    }
+    int t = _intern(re, d, d->list, n, matched, word ? WORD & re->flags : 0);
+    if (t >= 0)
+        d->trans[(size_t)s * re->nclass + c] = t;
+    return t;
+}
+
+static inline int _next(photon_regex_t *re, dfa_t *d, int s, int c){
+    int t = d->trans[(size_t)s * re->nclass + c];
+    return t != UNKNOWN ? t : _compute(re, d, s, c);
+}
+
+// where the leftmost-first match starting at from or later ends, -1 if there's none
+static long _forward(photon_regex_t *re, const unsigned char *text, size_t n, size_t from){
+    dfa_t *d = &re->fwd;
+    int s = d->start[from ? (_is_word(text[from - 1]) ? WORD : 0) : BEGIN];
+    long last = -1;
+    for (size_t v = from; v < n; v++){
+        if (re->prefix.n && (s == d->start[0] || s == d->start[WORD])){
+            // nothing under way, skip to where a match could start
+            const char *p = photon_search_find(&re->prefix, (const char *)text + v, n - v);
+            if (!p) return last;
+            if ((size_t)((const unsigned char *)p - text) != v){
+                v = (const unsigned char *)p - text;
+                s = d->start[_is_word(text[v - 1]) ? WORD : 0];
+            }
+        }
+        int c = re->cls[text[v]];
+        int t = d->trans[(size_t)s * re->nclass + c];
+        if (t == UNKNOWN && (t = _compute(re, d, s, c)) < 0) return NO_MEM;
+        s = t;
+        if (d->states[s].matched)
+            last = (long)v;
+        if (s == DEAD) return last;
+    }
+    if ((s = _next(re, d, s, re->nbyte)) < 0) return NO_MEM;
+    return d->states[s].matched ? (long)n : last;
+}
+
+// where the longest match ending at end and starting at from or later starts
+static long _reverse(photon_regex_t *re, const unsigned char *text, size_t n, size_t from, size_t end){
+    dfa_t *d = &re->rev;
+    int s = d->start[end == n ? BEGIN : _is_word(text[end]) ? WORD : 0];
+    long first = -1;
+    for (size_t v = end; ; v--){
+        // once v is from the byte before it is only read to see whether a match ends at v
+        int c = v ? re->cls[text[v - 1]] : re->nbyte;
+        if ((s = _next(re, d, s, c)) < 0) return NO_MEM;
+        if (d->states[s].matched)
+            first = (long)v;
+        if (s == DEAD || v == from) break;
+    }
+    return first;
+}
+
+int photon_regex_find(photon_regex_t *re, const char *text, size_t n, size_t from, size_t *start, size_t *end){
+    if (from > n) return 0;
+    const unsigned char *s = (const unsigned char *)text;
+    long e = _forward(re, s, n, from);
+    if (e < 0) return e == NO_MEM ? -1 : 0;
+    long b = _reverse(re, s, n, from, (size_t)e);
+    if (b < 0) return b == NO_MEM ? -1 : 0;
+    *start = (size_t)b;
+    *end = (size_t)e;
+    return 1;
+}
+
+static int _dfa_init(photon_regex_t *re, dfa_t *d, int longest){
+    size_t n = d->prog.n;
+    d->longest = longest;
+    d->list = malloc(n * sizeof(int));
+    d->keep = malloc(n * sizeof(int));
+    // every instruction is expanded once per step, pushing at most two more
+    d->stack = malloc((2 * n + 2) * sizeof(int));
+    d->stack2 = malloc((2 * n + 2) * sizeof(int));
+    d->seen = calloc(n, sizeof(unsigned));
+    d->queued = calloc(n, sizeof(unsigned));
+    if (!d->list || !d->keep || !d->stack || !d->stack2 || !d->seen || !d->queued) return 0;
+    return _dfa_reset(re, d);
+}
+
+static void _dfa_free(dfa_t *d){
+    free(d->prog.v);
+    free(d->states);
+    free(d->trans);
+    free(d->pcs);
+    free(d->table);
+    free(d->list);
+    free(d->keep);
+    free(d->stack);
+    free(d->stack2);
+    free(d->seen);
+    free(d->queued);
+}
+
+photon_regex_t *photon_regex_compile(const char *pattern, size_t n, int flags, const char **error){
+    parser_t ps = { .p = pattern, .end = pattern + n, .icase = flags & PHOTON_REGEX_ICASE };
+    if (n >= 4 && !memcmp(pattern, "(?i)", 4)){
+        ps.icase = 1;
+        ps.p += 4;
+    }
+    photon_regex_t *re = calloc(1, sizeof(photon_regex_t));
+    int root = re ? _parse_alt(&ps) : _fail(&ps, "out of memory");
+    if (root >= 0 && ps.p != ps.end)
+        root = _fail(&ps, "unmatched )");
+    if (root >= 0){
+        char prefix[MAX_PREFIX];
+        size_t len = 0;
+        _prefix(&ps, root, prefix, &len);
+        re->sets = ps.sets;
+        re->num_set = ps.num_set;
+        ps.sets = NULL;
+        for (int i = 0; i < ps.num_node; i++){
+            int type = ps.nodes[i].type;
+            re->flags |= type == N_WORDB || type == N_NWORDB ? WORD : type == N_BOL || type == N_EOL ? BEGIN : 0;
+        }
+        // forwards it's as if the pattern started with a lazy .*, so it can match anywhere
+        prog_t *fwd = &re->fwd.prog, *rev = &re->rev.prog;
+        int ok = _inst(fwd, I_SPLIT, 3, 1) >= 0 && _inst(fwd, I_ANY, 0, 0) >= 0 && _inst(fwd, I_JMP, 0, 0) >= 0
+              && _emit(&ps, fwd, root, 0) && _inst(fwd, I_MATCH, 0, 0) >= 0
+              && _emit(&ps, rev, root, 1) && _inst(rev, I_MATCH, 0, 0) >= 0;
+        if (!ok){
+            _fail(&ps, "pattern too big");
+        } else {
+            _classes(re);
+            if (!_dfa_init(re, &re->fwd, 0) || !_dfa_init(re, &re->rev, 1) || (len && !photon_search_compile(&re->prefix, prefix, len)))
+                _fail(&ps, "out of memory");
+        }
+    }
+    free(ps.nodes);
+    free(ps.sets);
+    if (ps.error){
+        if (error)
+            *error = ps.error;
+        photon_regex_free(re);
+        return NULL;
+    }
+    return re;
+}
+
+void photon_regex_free(photon_regex_t *re){
+    if (!re) return;
+    free(re->sets);
+    _dfa_free(&re->fwd);
+    _dfa_free(&re->rev);
+    photon_search_free(&re->prefix);
+    free(re);
+}
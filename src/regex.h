@@ -0,0 +1,32 @@
+#ifndef __REGEX_H__
+#define __REGEX_H__
+#include <stddef.h>
+
+// line regexes: a pattern is parsed into an NFA and run as a DFA that's built lazily, one
+// state at a time as the text needs it, so a search takes time linear in the line whatever
+// the pattern is. matches are leftmost-first like perl's, lazy quantifiers and loops whose body
+// matches nothing included. one thread per NFA state can't tell apart two iterations of a
+// {m,n} that meet in the same place inside a * though, so there perl can stop a step earlier.
+// the syntax:
+//   . [abc] [^a-z] | () (?:) * + ? {m} {m,} {m,n} (lazy with a trailing ?)
+//   ^ $ \b \B \d \D \w \W \s \S \t \n \r \xHH, a backslash before anything else is literal
+//   (?i) at the very start makes it case insensitive (ascii only)
+// a regex caches its DFA states, so it can't be used from two threads at once.
+
+typedef struct photon_regex photon_regex_t;
+
+#define PHOTON_REGEX_ICASE 1
+
+// bytes of DFA states a regex keeps before the cache is thrown away and built again
+#define PHOTON_REGEX_CACHE (1 << 20)
+
+// NULL on failure, *error (if not NULL) then says what's wrong with the pattern
+photon_regex_t *photon_regex_compile(const char *pattern, size_t n, int flags, const char **error);
+void photon_regex_free(photon_regex_t *re);
+
+// the first match in text[from..n), text being a whole line (^ only matches at 0). returns
+// 1 and sets *start, *end, 0 if there's none, -1 if out of memory. matches can be empty,
+// look again from *end + 1 then
+int photon_regex_find(photon_regex_t *re, const char *text, size_t n, size_t from, size_t *start, size_t *end);
+
+#endif//__REGEX_H__
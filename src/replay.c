@@ -0,0 +1,242 @@
+#include "replay.h"
+#include "photon.h"
+#include "input.h"
+#include "ui.h"
+#include "ui_headless.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#define RECORDING_MAGIC "photon-recording 1"
+
+// after the text header the input is a list of chunks, in host byte order:
+// uint64_t ns since the recording started, uint32_t length, then the bytes
+typedef struct chunk_hdr {
+    uint64_t ns;
+    uint32_t len;
+} chunk_hdr_t;
+
+static uint64_t _now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static const char *_basename(const char *path){
+    const char *slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+static struct {
+    FILE *f;
+    uint64_t start;
+} rec;
+
+static void _record_tap(const unsigned char *buf, size_t n){
+    chunk_hdr_t hdr = { .ns = _now_ns() - rec.start, .len = (uint32_t)n };
+    fwrite(&hdr.ns, sizeof(hdr.ns), 1, rec.f);
+    fwrite(&hdr.len, sizeof(hdr.len), 1, rec.f);
+    fwrite(buf, 1, n, rec.f);
+    // a session that ends in a crash is the one worth having
+    fflush(rec.f);
+}
+
+int photon_record_start(photon_editor_t *editor, const char *path, const char *file){
+    if (!(rec.f = fopen(path, "wb")))
+        return 0;
+    fprintf(rec.f, RECORDING_MAGIC "\nsize %d %d\n", photon_ui_height(), photon_ui_width());
+    if (file)
+        fprintf(rec.f, "file %s\n", file);
+    for (photon_extension_t *it = editor->first_ext; it; it = it->next)
+        fprintf(rec.f, "ext %s\n", _basename(it->path));
+    fputs("input\n", rec.f);
+    rec.start = _now_ns();
+    photon_input_set_tap(&_record_tap);
+    return 1;
+}
+
+void photon_record_stop(void){
+    if (!rec.f) return;
+    photon_input_set_tap(NULL);
+    fclose(rec.f);
+    rec.f = NULL;
+}
+
+typedef struct frame {
+    uint64_t at;   // when the input that caused it was recorded
+    uint64_t ns;
+    size_t bytes;
+} frame_t;
+
+static struct {
+    char *data;
+    size_t size, pos;
+    char *file;
+    char **exts;
+    int num_ext;
+    uint64_t last_at;  // timestamp of the chunk read last
+    frame_t *frames;
+    size_t num_frame, cap_frame;
+    uint64_t begin;    // 0 when no frame is being timed
+} play;
+
+static ssize_t _replay_read(unsigned char *buf, size_t n){
+    chunk_hdr_t hdr;
+    if (play.size - play.pos < sizeof(hdr.ns) + sizeof(hdr.len))
+        return 0;
+    memcpy(&hdr.ns, play.data + play.pos, sizeof(hdr.ns));
+    memcpy(&hdr.len, play.data + play.pos + sizeof(hdr.ns), sizeof(hdr.len));
+    size_t at = play.pos + sizeof(hdr.ns) + sizeof(hdr.len);
+    if (play.size - at < hdr.len)
+        return 0;
+    // chunks are never bigger than the input buffer, but don't count on it
+    size_t take = hdr.len < n ? hdr.len : n;
+    memcpy(buf, play.data + at, take);
+    if (take < hdr.len){
+        // leave the rest as a shorter chunk in place
+        hdr.len -= (uint32_t)take;
+        play.pos = at + take - sizeof(hdr.ns) - sizeof(hdr.len);
+        memcpy(play.data + play.pos, &hdr.ns, sizeof(hdr.ns));
+        memcpy(play.data + play.pos + sizeof(hdr.ns), &hdr.len, sizeof(hdr.len));
+    } else {
+        play.pos = at + hdr.len;
+    }
+    play.last_at = hdr.ns;
+    return (ssize_t)take;
+}
+
+static char *_next_line(void){
+    char *line = play.data + play.pos;
+    char *nl = memchr(line, '\n', play.size - play.pos);
+    if (!nl) return NULL;
+    *nl = 0;
+    play.pos = nl + 1 - play.data;
+    return line;
+}
+
+int photon_replay_open(const char *path, const char **file){
+    FILE *f = fopen(path, "rb");
+    if (!f) return 0;
+    // read it all up front so the disk isn't part of the timings
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (size < 0 || !(play.data = malloc(size ? size : 1)) || fread(play.data, 1, size, f) != (size_t)size){
+        fclose(f);
+        photon_replay_close();
+        return 0;
+    }
+    fclose(f);
+    play.size = size;
+
+    int rows = 0, cols = 0;
+    char *line = _next_line();
+    if (!line || strcmp(line, RECORDING_MAGIC) != 0)
+        goto bad;
+    while ((line = _next_line()) && strcmp(line, "input") != 0){
+        if (!strncmp(line, "size ", 5)){
+            sscanf(line + 5, "%d %d", &rows, &cols);
+        } else if (!strncmp(line, "file ", 5)){
+            play.file = line + 5;
+        } else if (!strncmp(line, "ext ", 4)){
+            char **exts = realloc(play.exts, (play.num_ext + 1) * sizeof(char *));
+            if (!exts) goto bad;
+            play.exts = exts;
+            play.exts[play.num_ext++] = line + 4;
+        }
+    }
+    if (!line || rows < 1 || cols < 1)
+        goto bad;
+
+    photon_ui_set_backend(&photon_ui_headless);
+    photon_headless_set_size(rows, cols);
+    photon_input_set_reader(&_replay_read);
+    *file = play.file;
+    return 1;
+bad:
+    photon_replay_close();
+    return 0;
+}
+
+void photon_replay_check_extensions(photon_editor_t *editor){
+    for (photon_extension_t *it = editor->first_ext; it; it = it->next){
+        int found = 0;
+        for (int i = 0; i < play.num_ext && !found; i++)
+            found = !strcmp(play.exts[i], _basename(it->path));
+        if (!found)
+            fprintf(stderr, "replay: extension %s wasn't installed when recording\n", _basename(it->path));
+    }
+    for (int i = 0; i < play.num_ext; i++){
+        int found = 0;
+        for (photon_extension_t *it = editor->first_ext; it && !found; it = it->next)
+            found = !strcmp(play.exts[i], _basename(it->path));
+        if (!found)
+            fprintf(stderr, "replay: extension %s was installed when recording but isn't now\n", play.exts[i]);
+    }
+}
+
+int photon_replay_done(void){
+    return play.pos >= play.size && !photon_input_pending();
+}
+
+void photon_replay_frame_begin(void){
+    if (!play.begin)
+        play.begin = _now_ns();
+}
+
+void photon_replay_frame_end(void){
+    size_t bytes;
+    photon_headless_output(&bytes);
+    photon_headless_reset();
+    if (!play.begin) return;
+    if (play.num_frame == play.cap_frame){
+        size_t cap = play.cap_frame ? play.cap_frame * 2 : 256;
+        frame_t *frames = realloc(play.frames, cap * sizeof(frame_t));
+        if (!frames) return;
+        play.frames = frames;
+        play.cap_frame = cap;
+    }
+    play.frames[play.num_frame++] = (frame_t){ .at = play.last_at, .ns = _now_ns() - play.begin, .bytes = bytes };
+    play.begin = 0;
+}
+
+static int _cmp_u64(const void *a, const void *b){
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+void photon_replay_report(void){
+    size_t n = play.num_frame;
+    fprintf(stderr, "frame\tat_ms\tlatency_us\tbytes\n");
+    uint64_t *sorted = malloc((n ? n : 1) * sizeof(uint64_t));
+    uint64_t total = 0;
+    size_t bytes = 0, maxBytes = 0;
+    for (size_t i = 0; i < n; i++){
+        const frame_t *fr = &play.frames[i];
+        fprintf(stderr, "%zu\t%.1f\t%.1f\t%zu\n", i, fr->at / 1e6, fr->ns / 1e3, fr->bytes);
+        if (sorted) sorted[i] = fr->ns;
+        total += fr->ns;
+        bytes += fr->bytes;
+        if (fr->bytes > maxBytes) maxBytes = fr->bytes;
+    }
+    if (!n || !sorted){
+        fprintf(stderr, "# no frames\n");
+        free(sorted);
+        return;
+    }
+    qsort(sorted, n, sizeof(uint64_t), _cmp_u64);
+    fprintf(stderr, "# %zu frames, latency us: mean %.1f p50 %.1f p90 %.1f p99 %.1f max %.1f\n",
+            n, total / 1e3 / n, sorted[n / 2] / 1e3, sorted[n * 9 / 10] / 1e3, sorted[n * 99 / 100] / 1e3, sorted[n - 1] / 1e3);
+    fprintf(stderr, "# output bytes: total %zu mean %.1f max %zu\n", bytes, (double)bytes / n, maxBytes);
+    free(sorted);
+}
+
+void photon_replay_close(void){
+    photon_input_set_reader(NULL);
+    free(play.data);
+    free(play.exts);
+    free(play.frames);
+    memset(&play, 0, sizeof(play));
+}
@@ -0,0 +1,29 @@
+#ifndef __REPLAY_H__
+#define __REPLAY_H__
+#include <stddef.h>
+
+typedef struct photon_editor photon_editor_t;
+
+// recordings hold the raw input stream with timestamps, the terminal size,
+// the file that was open and which extensions were loaded
+
+// call once the ui and extensions are up, returns 0 if the file can't be written
+int photon_record_start(photon_editor_t *editor, const char *path, const char *file);
+void photon_record_stop(void);
+
+// call before photon_ui_init, switches to the headless backend at the recorded
+// size and feeds the recording to photon_input_read_key. *file gets the file
+// that was open when recording (or NULL)
+int photon_replay_open(const char *path, const char **file);
+// warns on stderr if the loaded extensions differ from the recorded ones
+void photon_replay_check_extensions(photon_editor_t *editor);
+// all recorded input has been consumed
+int photon_replay_done(void);
+// frame timing: begin when a key is ready, end after photon_ui_refresh
+void photon_replay_frame_begin(void);
+void photon_replay_frame_end(void);
+// per frame latency and output bytes, then a summary, all on stderr
+void photon_replay_report(void);
+void photon_replay_close(void);
+
+#endif//__REPLAY_H__
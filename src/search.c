@@ -0,0 +1,355 @@
+#include "search.h"
+#include "photon.h"
+#include "regex.h"
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define err_and_ret(edit, err, val) edit->error = err; return val;
+
+// lines per slice of the background scan, the time budget is checked in between
+#define STEP_LINES 4096
+
+typedef struct match_vec {
+    photon_match_t *v;
+    size_t n, cap;
+} match_vec_t;
+
+struct photon_search {
+    photon_search_pat_t pat;
+    photon_regex_t *re; // instead of pat for PHOTON_SEARCH_REGEX
+    match_vec_t matches; // in line, col order
+    size_t back, fwd;    // lines back to fwd - 1 have been scanned
+    int turn;            // which way the next slice goes
+};
+
+// backward slices and rescanned lines are collected here before going in
+static match_vec_t scratch;
+
+static uint64_t _now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+int photon_search_compile(photon_search_pat_t *pat, const char *pattern, size_t n){
+    memset(pat, 0, sizeof(photon_search_pat_t));
+    if (!n || !(pat->str = malloc(n))) return 0;
+    memcpy(pat->str, pattern, n);
+    pat->n = n;
+    if (n > PHOTON_SEARCH_LONG){
+        for (int c = 0; c < 256; c++)
+            pat->skip[c] = n;
+        for (size_t i = 0; i + 1 < n; i++)
+            pat->skip[(unsigned char)pattern[i]] = n - 1 - i;
+    }
+    return 1;
+}
+
+void photon_search_free(photon_search_pat_t *pat){
+    free(pat->str);
+    pat->str = NULL;
+    pat->n = 0;
+}
+
+static const char *_find_horspool(const photon_search_pat_t *pat, const char *text, size_t n){
+    size_t m = pat->n;
+    unsigned char last = (unsigned char)pat->str[m - 1];
+    for (size_t i = 0; i + m <= n; ){
+        unsigned char c = (unsigned char)text[i + m - 1];
+        if (c == last && !memcmp(text + i, pat->str, m - 1))
+            return text + i;
+        i += pat->skip[c];
+    }
+    return NULL;
+}
+
+// only positions where both the first and the last byte match get compared in full,
+// which is rare enough that this runs about as fast as the text can be read
+static const char *_find_short(const photon_search_pat_t *pat, const char *text, size_t n){
+    size_t m = pat->n;
+    const char *str = pat->str;
+    if (m == 1)
+        return memchr(text, str[0], n);
+    size_t i = 0, end = n - m + 1; // candidate starts
+#if defined(__SSE2__)
+    const __m128i first = _mm_set1_epi8(str[0]), last = _mm_set1_epi8(str[m - 1]);
+    for (; i + 16 <= end; i += 16){
+        __m128i a = _mm_loadu_si128((const __m128i *)(text + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(text + i + m - 1));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        while (mask){
+            size_t at = i + __builtin_ctz(mask);
+            if (!memcmp(text + at + 1, str + 1, m - 2))
+                return text + at;
+            mask &= mask - 1;
+        }
+    }
+#endif
+    // the tail, or all of it without SSE2: memchr does the skipping
+    while (i < end){
+        const char *p = memchr(text + i, str[0], end - i);
+        if (!p) return NULL;
+        i = p - text;
+        if (text[i + m - 1] == str[m - 1] && !memcmp(p + 1, str + 1, m - 2))
+            return p;
+        i++;
+    }
+    return NULL;
+}
+
+const char *photon_search_find(const photon_search_pat_t *pat, const char *text, size_t n){
+    if (n < pat->n) return NULL;
+    if (pat->n > PHOTON_SEARCH_LONG)
+        return _find_horspool(pat, text, n);
+    return _find_short(pat, text, n);
+}
+
+static int _reserve(match_vec_t *vec, size_t n){
+    if (n <= vec->cap) return 1;
+    size_t cap = vec->cap ? vec->cap : 64;
+    while (cap < n)
+        cap <<= 1;
+    photon_match_t *v = realloc(vec->v, cap * sizeof(photon_match_t));
+    if (!v) return 0;
+    vec->v = v;
+    vec->cap = cap;
+    return 1;
+}
+
+static int _insert(match_vec_t *vec, size_t at, const photon_match_t *src, size_t n){
+    if (!n) return 1;
+    if (!_reserve(vec, vec->n + n)) return 0;
+    memmove(&vec->v[at + n], &vec->v[at], (vec->n - at) * sizeof(photon_match_t));
+    memcpy(&vec->v[at], src, n * sizeof(photon_match_t));
+    vec->n += n;
+    return 1;
+}
+
+// first match at or after line, col
+static size_t _lower_bound(const match_vec_t *vec, size_t line, int col){
+    size_t lo = 0, hi = vec->n;
+    while (lo < hi){
+        size_t mid = lo + (hi - lo) / 2;
+        const photon_match_t *m = &vec->v[mid];
+        if (m->line < line || (m->line == line && m->col < col))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static int _push(match_vec_t *out, size_t line, size_t col, size_t length){
+    if (!_reserve(out, out->n + 1)) return 0;
+    out->v[out->n++] = (photon_match_t){ .line = line, .col = (int)col, .length = (int)length };
+    return 1;
+}
+
+// regex matches that are empty can't be seen or jumped between, so they're left out
+static int _scan_regex(photon_regex_t *re, size_t i, const char *text, size_t n, match_vec_t *out){
+    size_t from = 0, start, end;
+    int found;
+    while ((found = photon_regex_find(re, text, n, from, &start, &end)) > 0){
+        if (end > start && !_push(out, i, start, end - start)) return 0;
+        from = end > start ? end : end + 1;
+    }
+    return found == 0;
+}
+
+// appends the matches on lines from to to - 1, non overlapping
+static int _scan(photon_search_t *s, photon_buffer_t *buf, size_t from, size_t to, match_vec_t *out){
+    const photon_search_pat_t *pat = &s->pat;
+    for (size_t i = from; i < to; i++){
+        photon_line_t *line = &buf->text->lines[i];
+        if (s->re){
+            if (!_scan_regex(s->re, i, photon_line_str(line), line->length, out)) return 0;
+            continue;
+        }
+        if ((size_t)line->length < pat->n) continue;
+        const char *text = photon_line_str(line), *p = text, *end = text + line->length;
+        while ((p = photon_search_find(pat, p, end - p))){
+            if (!_push(out, i, p - text, pat->n)) return 0;
+            p += pat->n;
+        }
+    }
+    return 1;
+}
+
+static int _scan_forward(photon_buffer_t *buf){
+    photon_search_t *s = buf->search;
+    size_t to = s->fwd + STEP_LINES < buf->text->num_line ? s->fwd + STEP_LINES : buf->text->num_line;
+    if (!_scan(s, buf, s->fwd, to, &s->matches)) return 0;
+    s->fwd = to;
+    return 1;
+}
+
+static int _scan_backward(photon_buffer_t *buf){
+    photon_search_t *s = buf->search;
+    size_t from = s->back > STEP_LINES ? s->back - STEP_LINES : 0;
+    scratch.n = 0;
+    if (!_scan(s, buf, from, s->back, &scratch) || !_insert(&s->matches, 0, scratch.v, scratch.n))
+        return 0;
+    s->back = from;
+    return 1;
+}
+
+int photon_search_start(photon_editor_t *editor, photon_buffer_t *buf, const char *pattern, size_t n, int flags){
+    photon_search_stop(buf);
+    if (!n) return 1;
+    if (memchr(pattern, '\n', n)){
+        err_and_ret(editor, PHOTON_BAD_PARAM, 0);
+    }
+    photon_search_t *s = calloc(1, sizeof(photon_search_t));
+    if (!s){
+        err_and_ret(editor, PHOTON_NO_MEM, 0);
+    }
+    if (flags & PHOTON_SEARCH_REGEX){
+        const char *error;
+        if (!(s->re = photon_regex_compile(pattern, n, 0, &error))){
+            free(s);
+            err_and_ret(editor, strcmp(error, "out of memory") ? PHOTON_BAD_PARAM : PHOTON_NO_MEM, 0);
+        }
+    } else if (!photon_search_compile(&s->pat, pattern, n)){
+        free(s);
+        err_and_ret(editor, PHOTON_NO_MEM, 0);
+    }
+    buf->search = s;
+    // what's on screen is needed right away, the rest can wait
+    size_t top = buf->scroll < 0 ? 0 : (size_t)buf->scroll;
+    size_t bottom = top + (buf->rows > 0 ? buf->rows : 0);
+    s->back = top < buf->text->num_line ? top : buf->text->num_line;
+    s->fwd = bottom < buf->text->num_line ? bottom : buf->text->num_line;
+    PHOTON_TRACE("search.start(from,to)", s->back, s->fwd);
+    if (!_scan(s, buf, s->back, s->fwd, &s->matches)){
+        photon_search_stop(buf);
+        err_and_ret(editor, PHOTON_NO_MEM, 0);
+    }
+    return 1;
+}
+
+void photon_search_stop(photon_buffer_t *buf){
+    photon_search_t *s = buf->search;
+    if (!s) return;
+    photon_search_free(&s->pat);
+    photon_regex_free(s->re);
+    free(s->matches.v);
+    free(s);
+    buf->search = NULL;
+}
+
+int photon_search_pending(const photon_buffer_t *buf){
+    const photon_search_t *s = buf->search;
+    return s && (s->back > 0 || s->fwd < buf->text->num_line);
+}
+
+int photon_search_step(photon_buffer_t *buf, uint64_t budget_ns){
+    photon_search_t *s = buf->search;
+    if (!photon_search_pending(buf)) return 0;
+    PHOTON_TRACE_BEGIN("search.step(back,fwd)", s->back, s->fwd);
+    uint64_t until = _now_ns() + budget_ns;
+    do {
+        // forward and backward take turns so the scanned part grows around the screen
+        s->turn ^= 1;
+        int ok = (s->turn && s->fwd < buf->text->num_line) || !s->back ? _scan_forward(buf) : _scan_backward(buf);
+        if (!ok){
+            // out of memory, keep what was found and give up on the rest
+            s->back = 0;
+            s->fwd = buf->text->num_line;
+            break;
+        }
+    } while (photon_search_pending(buf) && _now_ns() < until);
+    PHOTON_TRACE_END("search.step");
+    return photon_search_pending(buf);
+}
+
+// where line v ended up, lines first + 1 to first - delta are gone when delta is negative
+static size_t _shift(size_t v, size_t first, long delta){
+    if (v <= first) return v;
+    if (delta >= 0) return v + delta;
+    size_t gone = (size_t)-delta;
+    return v > first + gone ? v - gone : first;
+}
+
+void photon_search_edit(photon_buffer_t *buf, size_t first, size_t last, long delta){
+    photon_search_t *s = buf->search;
+    if (!s) return;
+    match_vec_t *vec = &s->matches;
+    // matches on the lines that were there before (first to last - delta) go, the ones
+    // after move along
+    size_t oldLast = (size_t)((long)last - delta);
+    size_t lo = _lower_bound(vec, first, 0), hi = _lower_bound(vec, oldLast + 1, 0);
+    if (hi > lo){
+        memmove(&vec->v[lo], &vec->v[hi], (vec->n - hi) * sizeof(photon_match_t));
+        vec->n -= hi - lo;
+    }
+    for (size_t i = lo; i < vec->n; i++)
+        vec->v[i].line += delta;
+    s->back = _shift(s->back, first, delta);
+    s->fwd = _shift(s->fwd, first, delta);
+    // the new lines are scanned again if they're in the scanned part, the rest waits its turn
+    size_t from = first > s->back ? first : s->back;
+    size_t to = last + 1 < s->fwd ? last + 1 : s->fwd;
+    if (from >= to) return;
+    scratch.n = 0;
+    if (!_scan(s, buf, from, to, &scratch) || !_insert(vec, lo, scratch.v, scratch.n)){
+        // out of memory, these lines go back to being unscanned
+        if (from == s->back){
+            s->back = to;
+        } else {
+            vec->n = lo;
+            s->fwd = from;
+        }
+    }
+}
+
+size_t photon_search_count(const photon_buffer_t *buf, int *done){
+    if (done)
+        *done = !photon_search_pending(buf);
+    return buf->search ? buf->search->matches.n : 0;
+}
+
+int photon_search_next(photon_buffer_t *buf, size_t line, int col, int dir, photon_match_t *match){
+    photon_search_t *s = buf->search;
+    if (!s) return 0;
+    match_vec_t *vec = &s->matches;
+    if (dir > 0){
+        size_t i;
+        // the answer might be somewhere that hasn't been scanned yet
+        while ((i = _lower_bound(vec, line, col + 1)) == vec->n && s->fwd < buf->text->num_line && _scan_forward(buf));
+        if (i == vec->n){
+            // wrap around to the first one
+            while (s->back && _scan_backward(buf));
+            i = 0;
+        }
+        if (i == vec->n) return 0;
+        *match = vec->v[i];
+        return 1;
+    }
+    size_t i;
+    while ((i = _lower_bound(vec, line, col)) == 0 && s->back && _scan_backward(buf));
+    if (i == 0){
+        while (s->fwd < buf->text->num_line && _scan_forward(buf));
+        i = vec->n;
+    }
+    if (i == 0) return 0;
+    *match = vec->v[i - 1];
+    return 1;
+}
+
+const photon_match_t *photon_search_range(const photon_buffer_t *buf, size_t first, size_t last, size_t *n){
+    const photon_search_t *s = buf->search;
+    *n = 0;
+    if (!s) return NULL;
+    size_t lo = _lower_bound(&s->matches, first, 0), hi = _lower_bound(&s->matches, last, 0);
+    *n = hi - lo;
+    return *n ? &s->matches.v[lo] : NULL;
+}
+
+size_t photon_search_rank(const photon_buffer_t *buf, size_t line, int col){
+    return buf->search ? _lower_bound(&buf->search->matches, line, col) : 0;
+}
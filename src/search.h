@@ -0,0 +1,51 @@
+#ifndef __SEARCH_H__
+#define __SEARCH_H__
+#include <stddef.h>
+#include <stdint.h>
+
+// buffer search: a started search scans the lines on screen right away and the rest
+// outward from the cursor a slice at a time (photon_search_step) while the editor is
+// idle. the matches found so far are kept in order and follow edits, only the lines
+// that changed are scanned again.
+
+typedef struct photon_editor photon_editor_t;
+typedef struct photon_buffer photon_buffer_t;
+typedef struct photon_match photon_match_t;
+typedef struct photon_search photon_search_t;
+
+// patterns longer than this use Horspool instead of the first/last byte filter
+#define PHOTON_SEARCH_LONG 32
+
+typedef struct photon_search_pat {
+    char *str;
+    size_t n;
+    size_t skip[256]; // Horspool shifts, only for long patterns
+} photon_search_pat_t;
+
+// returns 0 and sets editor->error on failure (PHOTON_BAD_PARAM for a bad regex), n == 0
+// stops searching. flags are PHOTON_SEARCH_*, patterns can't contain newlines
+int photon_search_start(photon_editor_t *editor, photon_buffer_t *buf, const char *pattern, size_t n, int flags);
+void photon_search_stop(photon_buffer_t *buf);
+// scans for about budget_ns, returns 1 if there's still some of the buffer left
+int photon_search_step(photon_buffer_t *buf, uint64_t budget_ns);
+int photon_search_pending(const photon_buffer_t *buf);
+
+// the buffer calls this like photon_highlight_edit, after the text changed
+void photon_search_edit(photon_buffer_t *buf, size_t first, size_t last, long delta);
+
+// the matches found so far, *done is set once the whole buffer was scanned
+size_t photon_search_count(const photon_buffer_t *buf, int *done);
+// the closest match after (dir > 0) or before (dir < 0) line, col, wrapping around. 0 if
+// there's none, scans as much of the buffer as it takes to know
+int photon_search_next(photon_buffer_t *buf, size_t line, int col, int dir, photon_match_t *match);
+// matches on lines first to last - 1, *n gets how many
+const photon_match_t *photon_search_range(const photon_buffer_t *buf, size_t first, size_t last, size_t *n);
+// how many matches come before line, col
+size_t photon_search_rank(const photon_buffer_t *buf, size_t line, int col);
+
+// the scanner itself, first occurrence of the pattern in text or NULL
+int photon_search_compile(photon_search_pat_t *pat, const char *pattern, size_t n);
+void photon_search_free(photon_search_pat_t *pat);
+const char *photon_search_find(const photon_search_pat_t *pat, const char *text, size_t n);
+
+#endif//__SEARCH_H__
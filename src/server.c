@@ -0,0 +1,564 @@
+#define _GNU_SOURCE // struct ucred
+#include "server.h"
+#include "photon.h"
+#include "buffer.h"
+#include "handles.h"
+#include "input.h"
+#include "journal.h"
+#include "ui.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+
+// the client says hello with six lines: the magic, "rows cols stop", its working
+// directory, the file to open (or nothing), TERM and COLORTERM. keys come after that
+#define HELLO_MAGIC "photon 1"
+#define HELLO_LINES 6
+#define HELLO_MAX (2 * PATH_MAX + 512)
+#define HELLO_TIMEOUT_MS 1000
+// clients that haven't finished saying hello, a new one pushes the oldest out. with the
+// listening socket and the editor's own fds that's still within PHOTON_INPUT_MAX_FDS
+#define PENDING_MAX 4
+// frames the attached client hasn't taken yet, it's dropped if it lets more pile up
+#define OUT_MAX (8 << 20)
+
+// the client's terminal goes to the alternate screen while it's attached
+#define TERM_ENTER "\x1b[?1049h\x1b[2J\x1b[H"
+#define TERM_LEAVE "\x1b[?1049l\x1b[0m"
+
+typedef struct pending {
+    int fd; // -1 for a free slot
+    size_t n;
+    int lines;
+    uint64_t since_ns;
+    char hello[HELLO_MAX];
+} pending_t;
+
+static int listen_fd = -1, client_fd = -1;
+static int client_rows = 24, client_cols = 80;
+static int stopping;
+static char sock_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+static pending_t pending[PENDING_MAX];
+static char *out;
+static size_t out_len, cap_out;
+
+static uint64_t _now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void _detach(void){
+    if (client_fd == -1) return;
+    close(client_fd);
+    client_fd = -1;
+    out_len = 0;
+    photon_input_set_fd(-1);
+    photon_input_wait_writable(0);
+}
+
+// as much of what's queued as the socket takes. 0 if the client's gone
+static int _flush(void){
+    size_t at = 0;
+    while (at < out_len){
+        ssize_t w = send(client_fd, out + at, out_len - at, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (w == -1){
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            _detach();
+            return 0;
+        }
+        at += (size_t)w;
+    }
+    memmove(out, out + at, out_len - at);
+    out_len -= at;
+    // the main loop wakes up to send the rest once it can
+    photon_input_wait_writable(out_len != 0);
+    return 1;
+}
+
+// frames go to whoever is attached, with nobody there they go nowhere. they never wait
+// for the client, what it doesn't take straight away is queued. a client that went away
+// is noticed when its keys run out
+static int _srv_init(void){
+    return 1;
+}
+
+static void _srv_end(void){
+}
+
+static ssize_t _srv_write(const char *data, size_t n){
+    if (client_fd == -1) return (ssize_t)n;
+    if (out_len + n > OUT_MAX){
+        _detach();
+        return (ssize_t)n;
+    }
+    if (out_len + n > cap_out){
+        size_t cap = cap_out ? cap_out : 4096;
+        while (cap < out_len + n)
+            cap *= 2;
+        char *p = realloc(out, cap);
+        if (!p){
+            _detach();
+            return (ssize_t)n;
+        }
+        out = p;
+        cap_out = cap;
+    }
+    memcpy(out + out_len, data, n);
+    out_len += n;
+    _flush();
+    return (ssize_t)n;
+}
+
+static int _srv_size(int *r, int *c){
+    *r = client_rows;
+    *c = client_cols;
+    return 1;
+}
+
+static const photon_ui_backend_t server_backend = {
+    .init = _srv_init,
+    .end = _srv_end,
+    .write = _srv_write,
+    .size = _srv_size
+};
+
+void photon_server_socket_path(char *out, size_t n){
+    const char *run = getenv("XDG_RUNTIME_DIR");
+    if (run && *run)
+        snprintf(out, n, "%s/photon.sock", run);
+    else
+        snprintf(out, n, "/tmp/photon-%u/photon.sock", (unsigned)getuid());
+}
+
+// the socket's directory has to be ours and nobody else's, or whoever can get at it can
+// drive the editor (or be the daemon a client talks to). made if it isn't there yet
+static int _private_dir(const char *path){
+    char dir[sizeof(sock_path)];
+    const char *slash = strrchr(path, '/');
+    if (!slash || slash == path || (size_t)(slash - path) >= sizeof(dir)) return 0;
+    memcpy(dir, path, slash - path);
+    dir[slash - path] = 0;
+    struct stat st;
+    if (mkdir(dir, 0700) == -1 && errno != EEXIST) return 0;
+    if (lstat(dir, &st) == -1 || !S_ISDIR(st.st_mode) || st.st_uid != getuid() || (st.st_mode & 077)){
+        fprintf(stderr, "photon: %s isn't a directory only you can get at, not using it\n", dir);
+        return 0;
+    }
+    return 1;
+}
+
+// the other end of a connection is running as us
+static int _peer_ok(int fd){
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0 && cred.uid == getuid();
+}
+
+static int _address(const char *path, struct sockaddr_un *addr){
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) return 0;
+    strcpy(addr->sun_path, path);
+    return 1;
+}
+
+static int _connect(const char *path){
+    struct sockaddr_un addr;
+    if (!_address(path, &addr)) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || !_peer_ok(fd)){
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int _bind(const char *path){
+    struct sockaddr_un addr;
+    if (!_address(path, &addr)){
+        fprintf(stderr, "photon: socket path too long: %s\n", path);
+        return 0;
+    }
+    if (!_private_dir(path)) return 0;
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (listen_fd == -1){
+        perror("photon: socket");
+        return 0;
+    }
+    // only we can connect, whatever the umask was
+    mode_t mask = umask(077);
+    int bound = bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+    if (!bound && errno == EADDRINUSE){
+        // a daemon that's still there answers, one that crashed left the socket behind
+        int fd = _connect(path);
+        if (fd != -1){
+            close(fd);
+            fprintf(stderr, "photon: a daemon is already running on %s\n", path);
+            close(listen_fd);
+            listen_fd = -1;
+            return 0;
+        }
+        unlink(path);
+        bound = bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+    }
+    umask(mask);
+    if (!bound || listen(listen_fd, 8) == -1){
+        perror(path);
+        close(listen_fd);
+        listen_fd = -1;
+        return 0;
+    }
+    return 1;
+}
+
+int photon_server_start(const char *path){
+    if (!_bind(path)) return 0;
+    strcpy(sock_path, path);
+    for (int i = 0; i < PENDING_MAX; i++)
+        pending[i].fd = -1;
+    // the parent returns once the socket is there, so a client can connect right away
+    pid_t pid = fork();
+    if (pid == -1){
+        perror("photon: fork");
+        photon_server_stop();
+        return 0;
+    }
+    if (pid)
+        _exit(EXIT_SUCCESS);
+    setsid();
+    int null = open("/dev/null", O_RDWR | O_CLOEXEC);
+    if (null != -1){
+        dup2(null, STDIN_FILENO);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        close(null);
+    }
+    photon_ui_set_backend(&server_backend);
+    photon_input_set_fd(-1);
+    return 1;
+}
+
+int photon_server_fds(int *fds){
+    if (listen_fd == -1) return 0;
+    int n = 0;
+    fds[n++] = listen_fd;
+    for (int i = 0; i < PENDING_MAX; i++){
+        if (pending[i].fd != -1)
+            fds[n++] = pending[i].fd;
+    }
+    return n;
+}
+
+// buffers that went down to the bottom (or the right edge) of the screen still do, a
+// full screen one stays that way and the right one of a split takes the new width
+static void _resize(photon_editor_t *editor, int r, int c){
+    int oldRows = photon_ui_height(), oldCols = photon_ui_width();
+    client_rows = r;
+    client_cols = c;
+    if (!photon_ui_resize(editor)) return;
+    for (size_t i = 0; i < editor->num_buf; i++){
+        photon_buffer_t *buf = editor->bufs[i];
+        if (buf->y + buf->rows == oldRows && buf->y < r)
+            buf->rows = r - buf->y;
+        if (buf->x + buf->cols == oldCols && buf->x < c)
+            buf->cols = c - buf->x;
+    }
+}
+
+// "a", "./a" and "dir/../a" all come out the same, so they're one buffer. a file that
+// doesn't exist yet has its directory resolved
+static void _canonical(char *path){
+    char real[PATH_MAX];
+    if (realpath(path, real)){
+        strcpy(path, real);
+        return;
+    }
+    char *slash = strrchr(path, '/');
+    if (!slash || slash == path) return;
+    *slash = 0;
+    int ok = realpath(path, real) && strlen(real) + strlen(slash + 1) + 2 <= PATH_MAX;
+    *slash = '/';
+    if (!ok) return;
+    strcat(real, slash);
+    strcpy(path, real);
+}
+
+// a file that's open already is just shown, relative paths are the client's
+static void _open(photon_editor_t *editor, const char *cwd, const char *file){
+    char path[PATH_MAX];
+    if (file[0] == '/' || !cwd[0])
+        snprintf(path, sizeof(path), "%s", file);
+    else
+        snprintf(path, sizeof(path), "%s/%s", cwd, file);
+    _canonical(path);
+    photon_buffer_t *buf = photon_buffer_find(editor, path);
+    if (buf && buf->type == BUF_FILE){
+        editor->cur_buf = buf;
+        return;
+    }
+    photon_buf_options_t options = { .type = BUF_FILE, .x = 0, .y = 0, .rows = photon_ui_height(), .cols = photon_ui_width(), .name = path };
+    if (!(buf = photon_create_buffer(editor, &options))) return;
+    PHOTON_TRACE_BEGIN("server.load_file", 0, 0);
+    // a path that doesn't exist yet is a new file, as on the command line
+    photon_buffer_load_file(editor, buf, path);
+    photon_journal_start(editor, buf);
+    PHOTON_TRACE_END("server.load_file");
+}
+
+// whatever of the hello has come in, a byte at a time so none of the keys after it are
+// taken. 1 once it's all there, 0 if there's more to come and -1 if it's no good
+static int _read_hello(pending_t *p){
+    while (p->lines < HELLO_LINES){
+        if (p->n + 1 >= HELLO_MAX) return -1;
+        ssize_t got = read(p->fd, &p->hello[p->n], 1);
+        if (got == -1 && errno == EINTR) continue;
+        if (got == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+        if (got != 1) return -1;
+        if (p->hello[p->n++] == '\n')
+            p->lines++;
+    }
+    p->hello[p->n] = 0;
+    return 1;
+}
+
+static void _drop(pending_t *p){
+    close(p->fd);
+    p->fd = -1;
+}
+
+// the hello's all there, the client attaches (or stops the daemon)
+static void _attach(photon_editor_t *editor, pending_t *p){
+    char *lines[HELLO_LINES];
+    lines[0] = p->hello;
+    for (int i = 1; i < HELLO_LINES; i++){
+        char *nl = strchr(lines[i - 1], '\n');
+        *nl = 0;
+        lines[i] = nl + 1;
+    }
+    *strchr(lines[HELLO_LINES - 1], '\n') = 0;
+    int r, c, stop;
+    if (strcmp(lines[0], HELLO_MAGIC) || sscanf(lines[1], "%d %d %d", &r, &c, &stop) != 3 || r <= 0 || c <= 0){
+        _drop(p);
+        return;
+    }
+    if (stop){
+        _drop(p);
+        stopping = 1;
+        editor->should_quit = 1;
+        return;
+    }
+    PHOTON_TRACE("server.attach(rows,cols)", r, c);
+    // the terminal that was attached lets go
+    _detach();
+    client_fd = p->fd;
+    p->fd = -1;
+    photon_input_set_fd(client_fd);
+    photon_ui_set_color_mode(photon_ui_detect_color(lines[4], lines[5]));
+    _resize(editor, r, c);
+    if (lines[3][0])
+        _open(editor, lines[2], lines[3]);
+}
+
+void photon_server_poll(photon_editor_t *editor){
+    if (listen_fd == -1) return;
+    if (client_fd != -1 && out_len)
+        _flush();
+    uint64_t now = _now_ns();
+    int fd;
+    while ((fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1){
+        if (!_peer_ok(fd)){
+            close(fd);
+            continue;
+        }
+        // a free slot, or the one that's been at it the longest
+        pending_t *p = &pending[0];
+        for (int i = 1; i < PENDING_MAX && p->fd != -1; i++){
+            if (pending[i].fd == -1 || pending[i].since_ns < p->since_ns)
+                p = &pending[i];
+        }
+        if (p->fd != -1)
+            _drop(p);
+        *p = (pending_t){ .fd = fd, .since_ns = now };
+    }
+    // nothing here waits on a client, one that's slow with its hello gets HELLO_TIMEOUT_MS
+    // for all of it
+    for (int i = 0; i < PENDING_MAX && !editor->should_quit; i++){
+        pending_t *p = &pending[i];
+        if (p->fd == -1) continue;
+        int got = _read_hello(p);
+        if (got > 0)
+            _attach(editor, p);
+        else if (got < 0 || now - p->since_ns > (uint64_t)HELLO_TIMEOUT_MS * 1000000)
+            _drop(p);
+    }
+}
+
+int photon_server_read_key(photon_editor_t *editor){
+    int key = photon_input_read_key();
+    if (key == EOF){
+        _detach();
+        return PHOTON_INVALID_KEY;
+    }
+    if (key == PHOTON_KRESIZE){
+        int r, c;
+        photon_input_size(&r, &c);
+        _resize(editor, r, c);
+        return PHOTON_INVALID_KEY;
+    }
+    return key;
+}
+
+int photon_server_quit(void){
+    if (stopping) return 1;
+    _detach();
+    return 0;
+}
+
+void photon_server_stop(void){
+    _detach();
+    for (int i = 0; i < PENDING_MAX; i++){
+        if (pending[i].fd != -1)
+            _drop(&pending[i]);
+    }
+    if (listen_fd == -1) return;
+    close(listen_fd);
+    listen_fd = -1;
+    unlink(sock_path);
+}
+
+static int _write_all(int fd, const char *data, size_t n){
+    while (n){
+        ssize_t w = write(fd, data, n);
+        if (w == -1){
+            if (errno == EINTR) continue;
+            return 0;
+        }
+        data += w;
+        n -= (size_t)w;
+    }
+    return 1;
+}
+
+// runs this binary as a daemon, it returns once the socket is bound
+static int _spawn_daemon(void){
+    pid_t pid = fork();
+    if (pid == -1) return 0;
+    if (!pid){
+        execl("/proc/self/exe", "photon", "--daemon", (char *)NULL);
+        _exit(127);
+    }
+    int status;
+    return waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static volatile sig_atomic_t resized;
+
+static void _on_winch(int sig){
+    (void)sig;
+    resized = 1;
+}
+
+static void _term_size(int *r, int *c){
+    struct winsize sz;
+    if (ioctl(STDIN_FILENO, TIOCGWINSZ, &sz) == 0 && sz.ws_row && sz.ws_col){
+        *r = sz.ws_row;
+        *c = sz.ws_col;
+    }
+}
+
+int photon_client_run(const char *path, const char *file, int stop){
+    if (!_private_dir(path)) return EXIT_FAILURE;
+    int fd = _connect(path);
+    if (fd == -1 && !stop && _spawn_daemon())
+        fd = _connect(path);
+    if (fd == -1){
+        if (stop)
+            fprintf(stderr, "photon: no daemon is running on %s\n", path);
+        else
+            fprintf(stderr, "photon: can't reach a daemon on %s\n", path);
+        return EXIT_FAILURE;
+    }
+    int r = 24, c = 80;
+    _term_size(&r, &c);
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd)))
+        cwd[0] = 0;
+    const char *term = getenv("TERM"), *colorterm = getenv("COLORTERM");
+    char hello[HELLO_MAX];
+    int n = snprintf(hello, sizeof(hello), HELLO_MAGIC "\n%d %d %d\n%s\n%s\n%s\n%s\n", r, c, stop, cwd,
+                     file ? file : "", term ? term : "", colorterm ? colorterm : "");
+    if (n < 0 || (size_t)n >= sizeof(hello) || !_write_all(fd, hello, (size_t)n)){
+        fprintf(stderr, "photon: can't talk to the daemon on %s\n", path);
+        close(fd);
+        return EXIT_FAILURE;
+    }
+    if (stop){
+        close(fd);
+        return EXIT_SUCCESS;
+    }
+
+    struct termios old, raw;
+    int tty = tcgetattr(STDIN_FILENO, &old) == 0;
+    if (tty){
+        raw = old;
+        cfmakeraw(&raw);
+        tcsetattr(STDIN_FILENO, TCSADRAIN, &raw);
+    }
+    _write_all(STDOUT_FILENO, TERM_ENTER, sizeof(TERM_ENTER) - 1);
+    // no SA_RESTART, poll comes back with EINTR. a daemon that's gone is a failed write,
+    // not a signal that leaves the terminal raw
+    struct sigaction sa = { .sa_handler = _on_winch };
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGWINCH, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    char data[16 << 10];
+    int stdinOpen = 1;
+    while (1){
+        if (resized){
+            resized = 0;
+            _term_size(&r, &c);
+            char report[32];
+            int len = snprintf(report, sizeof(report), "\x1b[8;%d;%dt", r, c);
+            if (!_write_all(fd, report, (size_t)len)) break;
+        }
+        struct pollfd p[2] = { { .fd = fd, .events = POLLIN }, { .fd = stdinOpen ? STDIN_FILENO : -1, .events = POLLIN } };
+        if (poll(p, 2, -1) == -1){
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (p[0].revents){
+            ssize_t got = read(fd, data, sizeof(data));
+            if (got <= 0 || !_write_all(STDOUT_FILENO, data, (size_t)got)) break;
+        }
+        if (p[1].revents){
+            ssize_t got = read(STDIN_FILENO, data, sizeof(data));
+            if (got <= 0)
+                stdinOpen = 0;
+            else if (!_write_all(fd, data, (size_t)got))
+                break;
+        }
+    }
+    close(fd);
+    _write_all(STDOUT_FILENO, TERM_LEAVE, sizeof(TERM_LEAVE) - 1);
+    if (tty)
+        tcsetattr(STDIN_FILENO, TCSADRAIN, &old);
+    return EXIT_SUCCESS;
+}
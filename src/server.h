@@ -0,0 +1,41 @@
+#ifndef __SERVER_H__
+#define __SERVER_H__
+#include <stddef.h>
+
+// client/server mode: `photon --daemon` keeps one editor (its buffers, extensions and
+// caches) running in the background behind a unix socket, `photon -a [file]` attaches
+// a terminal to it. the client only puts the terminal in raw mode, passes keys (and
+// size changes) on and writes out what comes back, which is the frame diffs
+// photon_ui_refresh makes for the client's size. opening a file the session already has
+// doesn't load it again. one terminal is attached at a time, a new one takes over from
+// the last. ^Q detaches, `photon --stop` ends the daemon.
+
+typedef struct photon_editor photon_editor_t;
+
+// $XDG_RUNTIME_DIR/photon.sock, /tmp/photon-<uid>/photon.sock without it. the directory
+// has to be the user's alone (it's made 0700 if it isn't there), the socket is too and
+// both ends check the other one is running as the same user
+void photon_server_socket_path(char *out, size_t n);
+
+// binds the socket, goes into the background and switches the ui and input over to the
+// clients. call before photon_ui_init, returns 0 with a message on stderr if it can't
+// (another daemon is running, say)
+int photon_server_start(const char *path);
+// the listening socket and the clients halfway through their hello, readable when
+// photon_server_poll has something to do. returns how many it put in fds, at most 5
+int photon_server_fds(int *fds);
+void photon_server_poll(photon_editor_t *editor);
+// photon_input_read_key for the attached client, PHOTON_INVALID_KEY for what the server
+// takes care of itself (the client going away, a resize)
+int photon_server_read_key(photon_editor_t *editor);
+// ^Q was pressed: detaches the client and returns 0 so the daemon keeps going, 1 if a
+// client asked it to stop
+int photon_server_quit(void);
+// the socket goes
+void photon_server_stop(void);
+
+// the client, runs until the daemon lets go of it and returns the exit status. starts a
+// daemon if none is running, unless stop is set: then it asks the one running to stop
+int photon_client_run(const char *path, const char *file, int stop);
+
+#endif//__SERVER_H__
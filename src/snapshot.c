@@ -0,0 +1,216 @@
+#include "snapshot.h"
+#include <stdlib.h>
+#include <string.h>
+
+// identical cells shorter than this don't end a span, the span header costs 6 bytes
+#define SPAN_GAP 4
+
+static unsigned char *_put16(unsigned char *p, uint32_t v){
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    return p + 2;
+}
+
+static unsigned char *_put32(unsigned char *p, uint32_t v){
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = (v >> 24) & 0xff;
+    return p + 4;
+}
+
+static uint32_t _get16(const unsigned char *p){
+    return p[0] | (uint32_t)p[1] << 8;
+}
+
+static uint32_t _get32(const unsigned char *p){
+    return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static unsigned char *_put_cell(unsigned char *p, const photon_snap_cell_t *cell){
+    p = _put32(p, (uint32_t)cell->fg);
+    p = _put32(p, (uint32_t)cell->bg);
+    *p++ = (unsigned char)cell->style;
+    *p++ = (unsigned char)cell->ch;
+    return p;
+}
+
+static const unsigned char *_get_cell(const unsigned char *p, photon_snap_cell_t *cell){
+    cell->fg = (int)_get32(p);
+    cell->bg = (int)_get32(p + 4);
+    cell->style = (char)p[8];
+    cell->ch = (char)p[9];
+    return p + PHOTON_SNAP_CELL_SIZE;
+}
+
+static int _same(const photon_snap_cell_t *a, const photon_snap_cell_t *b){
+    return a->ch == b->ch && a->fg == b->fg && a->bg == b->bg && a->style == b->style;
+}
+
+static int _snap_alloc(photon_snap_t *snap){
+    size_t area = (size_t)snap->rows * snap->cols;
+    snap->cur = calloc(area, sizeof(photon_snap_cell_t));
+    snap->prev = calloc(area, sizeof(photon_snap_cell_t));
+    // worst case delta is bigger than a key frame, but then a key frame is written instead
+    snap->scratch_cap = area * PHOTON_SNAP_CELL_SIZE + 64;
+    snap->scratch = malloc(snap->scratch_cap);
+    return snap->cur && snap->prev && snap->scratch;
+}
+
+int photon_snap_create(photon_snap_t *snap, const char *path, int rows, int cols){
+    memset(snap, 0, sizeof(photon_snap_t));
+    if (rows < 1 || cols < 1 || rows > 0xffff || cols > 0xffff)
+        return 0;
+    snap->rows = rows;
+    snap->cols = cols;
+    if (!_snap_alloc(snap) || !(snap->f = fopen(path, "wb"))){
+        photon_snap_close(snap);
+        return 0;
+    }
+    unsigned char hdr[12];
+    memcpy(hdr, PHOTON_SNAP_MAGIC, 8);
+    _put16(_put16(hdr + 8, rows), cols);
+    if (fwrite(hdr, 1, sizeof(hdr), snap->f) != sizeof(hdr)){
+        photon_snap_close(snap);
+        return 0;
+    }
+    return 1;
+}
+
+photon_snap_cell_t *photon_snap_next(photon_snap_t *snap){
+    return snap->cur;
+}
+
+// spans of changed cells, NULL if they wouldn't be smaller than the whole frame
+static unsigned char *_encode_delta(photon_snap_t *snap, unsigned char *p){
+    unsigned char *count = p;
+    unsigned char *end = snap->scratch + snap->scratch_cap - (6 + (size_t)snap->cols * PHOTON_SNAP_CELL_SIZE);
+    uint32_t spans = 0;
+    p += 4;
+    for (int y = 0; y < snap->rows; y++){
+        const photon_snap_cell_t *cur = &snap->cur[y * snap->cols];
+        const photon_snap_cell_t *prev = &snap->prev[y * snap->cols];
+        int x = 0;
+        while (x < snap->cols){
+            if (_same(&cur[x], &prev[x])){
+                x++;
+                continue;
+            }
+            int start = x, last = x;
+            for (x++; x < snap->cols && x - last <= SPAN_GAP; x++){
+                if (!_same(&cur[x], &prev[x]))
+                    last = x;
+            }
+            x = last + 1;
+            if (p > end) return NULL;
+            p = _put16(_put16(_put16(p, y), start), x - start);
+            for (int i = start; i < x; i++)
+                p = _put_cell(p, &cur[i]);
+            spans++;
+        }
+    }
+    _put32(count, spans);
+    if ((size_t)(p - count) >= (size_t)snap->rows * snap->cols * PHOTON_SNAP_CELL_SIZE)
+        return NULL;
+    return p;
+}
+
+int photon_snap_commit(photon_snap_t *snap, uint32_t frame){
+    unsigned char *p = snap->scratch + 9;
+    char kind = 'D';
+    unsigned char *end = NULL;
+    if (snap->frames % PHOTON_SNAP_KEY_EVERY != 0)
+        end = _encode_delta(snap, p);
+    if (!end){
+        kind = 'K';
+        end = p;
+        for (size_t i = 0, n = (size_t)snap->rows * snap->cols; i < n; i++)
+            end = _put_cell(end, &snap->cur[i]);
+    }
+    snap->scratch[0] = kind;
+    _put32(_put32(snap->scratch + 1, frame), (uint32_t)(end - p));
+    size_t n = end - snap->scratch;
+    if (fwrite(snap->scratch, 1, n, snap->f) != n)
+        return 0;
+    photon_snap_cell_t *tmp = snap->prev;
+    snap->prev = snap->cur;
+    snap->cur = tmp;
+    snap->frames++;
+    return 1;
+}
+
+int photon_snap_open(photon_snap_t *snap, const char *path){
+    memset(snap, 0, sizeof(photon_snap_t));
+    if (!(snap->f = fopen(path, "rb")))
+        return 0;
+    unsigned char hdr[12];
+    if (fread(hdr, 1, sizeof(hdr), snap->f) != sizeof(hdr) || memcmp(hdr, PHOTON_SNAP_MAGIC, 8) != 0){
+        photon_snap_close(snap);
+        return 0;
+    }
+    snap->rows = (int)_get16(hdr + 8);
+    snap->cols = (int)_get16(hdr + 10);
+    if (!snap->rows || !snap->cols || !_snap_alloc(snap)){
+        photon_snap_close(snap);
+        return 0;
+    }
+    return 1;
+}
+
+int photon_snap_read(photon_snap_t *snap, uint32_t *frame, char *kind){
+    unsigned char hdr[9];
+    size_t got = fread(hdr, 1, sizeof(hdr), snap->f);
+    if (got == 0) return 0;
+    if (got != sizeof(hdr)) return -1;
+    uint32_t size = _get32(hdr + 5);
+    if (size > snap->scratch_cap) return -1;
+    if (fread(snap->scratch, 1, size, snap->f) != size) return -1;
+    size_t area = (size_t)snap->rows * snap->cols;
+    photon_snap_cell_t *tmp = snap->prev;
+    snap->prev = snap->cur;
+    snap->cur = tmp;
+    const unsigned char *p = snap->scratch, *end = p + size;
+    if (hdr[0] == 'K'){
+        if (size != area * PHOTON_SNAP_CELL_SIZE) return -1;
+        for (size_t i = 0; i < area; i++)
+            p = _get_cell(p, &snap->cur[i]);
+    } else if (hdr[0] == 'D'){
+        if (!snap->frames || size < 4) return -1;
+        memcpy(snap->cur, snap->prev, area * sizeof(photon_snap_cell_t));
+        uint32_t spans = _get32(p);
+        p += 4;
+        while (spans--){
+            if (end - p < 6) return -1;
+            uint32_t y = _get16(p), x = _get16(p + 2), n = _get16(p + 4);
+            p += 6;
+            if (y >= (uint32_t)snap->rows || x + n > (uint32_t)snap->cols || (size_t)(end - p) < n * PHOTON_SNAP_CELL_SIZE)
+                return -1;
+            for (uint32_t i = 0; i < n; i++)
+                p = _get_cell(p, &snap->cur[y * snap->cols + x + i]);
+        }
+    } else {
+        return -1;
+    }
+    snap->frames++;
+    *frame = _get32(hdr + 1);
+    if (kind)
+        *kind = (char)hdr[0];
+    return 1;
+}
+
+const photon_snap_cell_t *photon_snap_cells(const photon_snap_t *snap){
+    return snap->cur;
+}
+
+const photon_snap_cell_t *photon_snap_prev(const photon_snap_t *snap){
+    return snap->prev;
+}
+
+void photon_snap_close(photon_snap_t *snap){
+    if (snap->f)
+        fclose(snap->f);
+    free(snap->cur);
+    free(snap->prev);
+    free(snap->scratch);
+    memset(snap, 0, sizeof(photon_snap_t));
+}
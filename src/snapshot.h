@@ -0,0 +1,51 @@
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+#include <stdio.h>
+#include <stdint.h>
+
+// framebuffer snapshots, one file holds any number of frames. the first frame
+// (and every PHOTON_SNAP_KEY_EVERY-th one) is stored whole, the rest only as
+// the spans of each row that changed. everything is little endian with no
+// padding so files can be read anywhere, tools/snap.c is the reader.
+//
+//   "PHSNAP02" u16 rows u16 cols
+//   frames: u8 kind ('K' or 'D'), u32 frame number, u32 payload size, payload
+//     K: rows * cols cells
+//     D: u32 spans, then per span u16 y, u16 x, u16 n, n cells
+//   cell: i32 fg, i32 bg, u8 style, u8 ch
+
+#define PHOTON_SNAP_MAGIC "PHSNAP02"
+#define PHOTON_SNAP_KEY_EVERY 256
+#define PHOTON_SNAP_CELL_SIZE 10
+
+typedef struct photon_snap_cell {
+    int fg, bg;
+    char style;
+    char ch;
+} photon_snap_cell_t;
+
+typedef struct photon_snap {
+    FILE *f;
+    int rows, cols;
+    int frames;
+    photon_snap_cell_t *cur, *prev;
+    unsigned char *scratch; // encoded payload
+    size_t scratch_cap;
+} photon_snap_t;
+
+// writing: fill photon_snap_next() with the whole frame, then commit it
+int photon_snap_create(photon_snap_t *snap, const char *path, int rows, int cols);
+photon_snap_cell_t *photon_snap_next(photon_snap_t *snap);
+int photon_snap_commit(photon_snap_t *snap, uint32_t frame);
+
+// reading: frames come out whole, photon_snap_cells() has the one just read
+int photon_snap_open(photon_snap_t *snap, const char *path);
+// returns 1 with a frame, 0 at the end and -1 if the file is broken
+int photon_snap_read(photon_snap_t *snap, uint32_t *frame, char *kind);
+const photon_snap_cell_t *photon_snap_cells(const photon_snap_t *snap);
+// the frame before the one just read
+const photon_snap_cell_t *photon_snap_prev(const photon_snap_t *snap);
+
+void photon_snap_close(photon_snap_t *snap);
+
+#endif//__SNAPSHOT_H__
@@ -0,0 +1,217 @@
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#define TRACE_MAGIC "PHTRACE1"
+// records per thread, a power of two. when the writer falls behind records are dropped, never waited on
+#define RING_SIZE 32768
+#define FLUSH_MS 10
+
+typedef struct trace_ring {
+    struct trace_ring *next;
+    uint32_t tid;
+    char name[32];
+    atomic_size_t head, tail;
+    atomic_size_t dropped;
+    photon_trace_rec_t recs[RING_SIZE];
+} trace_ring_t;
+
+typedef struct trace_site {
+    const char *name, *file;
+    int line;
+} trace_site_t;
+
+atomic_int photon_trace_enabled;
+
+static struct {
+    FILE *f;
+    pthread_t writer;
+    pthread_mutex_t lock; // rings, sites and waking the writer
+    pthread_cond_t wake;
+    int stop;
+    trace_ring_t *rings;
+    uint32_t num_ring;
+    trace_site_t *sites;
+    uint32_t num_site, cap_site;
+} tr = { .lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER };
+
+static _Thread_local trace_ring_t *self;
+
+static uint64_t _now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void _put_block(const char *tag, uint32_t a, uint32_t b){
+    fwrite(tag, 1, 4, tr.f);
+    fwrite(&a, sizeof(a), 1, tr.f);
+    fwrite(&b, sizeof(b), 1, tr.f);
+}
+
+static void _put_str(const char *str){
+    uint16_t len = (uint16_t)strlen(str);
+    fwrite(&len, sizeof(len), 1, tr.f);
+    fwrite(str, 1, len, tr.f);
+}
+
+// only the writer (or stop, once the writer is gone) consumes
+static void _drain(trace_ring_t *r){
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+    if (head == tail) return;
+    _put_block("EVTS", r->tid, (uint32_t)(head - tail));
+    size_t from = tail & (RING_SIZE - 1);
+    size_t n = head - tail;
+    size_t first = n < RING_SIZE - from ? n : RING_SIZE - from;
+    fwrite(&r->recs[from], sizeof(photon_trace_rec_t), first, tr.f);
+    fwrite(&r->recs[0], sizeof(photon_trace_rec_t), n - first, tr.f);
+    atomic_store_explicit(&r->tail, head, memory_order_release);
+}
+
+static void _drain_all(void){
+    pthread_mutex_lock(&tr.lock);
+    trace_ring_t *rings = tr.rings;
+    pthread_mutex_unlock(&tr.lock);
+    // rings are only ever pushed at the front, the ones we saw stay put
+    for (trace_ring_t *r = rings; r; r = r->next)
+        _drain(r);
+}
+
+static void *_trace_writer(void *p){
+    (void)p;
+    photon_trace_thread_name("trace writer");
+    pthread_mutex_lock(&tr.lock);
+    while (!tr.stop){
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += FLUSH_MS * 1000000l;
+        if (until.tv_nsec >= 1000000000l){
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000l;
+        }
+        pthread_cond_timedwait(&tr.wake, &tr.lock, &until);
+        pthread_mutex_unlock(&tr.lock);
+        _drain_all();
+        pthread_mutex_lock(&tr.lock);
+    }
+    pthread_mutex_unlock(&tr.lock);
+    return NULL;
+}
+
+static trace_ring_t *_trace_register(void){
+    trace_ring_t *r = calloc(1, sizeof(trace_ring_t));
+    if (!r) return NULL;
+    pthread_mutex_lock(&tr.lock);
+    r->tid = ++tr.num_ring;
+    r->next = tr.rings;
+    tr.rings = r;
+    pthread_mutex_unlock(&tr.lock);
+    self = r;
+    return r;
+}
+
+int photon_trace_start(const char *path){
+    if (tr.f) return 0;
+    if (!(tr.f = fopen(path, "wb")))
+        return 0;
+    fwrite(TRACE_MAGIC, 1, 8, tr.f);
+    uint64_t start = _now_ns();
+    fwrite(&start, sizeof(start), 1, tr.f);
+    tr.stop = 0;
+    atomic_store(&photon_trace_enabled, 1);
+    if (pthread_create(&tr.writer, NULL, _trace_writer, NULL) != 0){
+        atomic_store(&photon_trace_enabled, 0);
+        fclose(tr.f);
+        tr.f = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+void photon_trace_stop(void){
+    if (!tr.f) return;
+    atomic_store(&photon_trace_enabled, 0);
+    pthread_mutex_lock(&tr.lock);
+    tr.stop = 1;
+    pthread_cond_signal(&tr.wake);
+    pthread_mutex_unlock(&tr.lock);
+    pthread_join(tr.writer, NULL);
+    _drain_all();
+
+    _put_block("SITE", tr.num_site, 0);
+    for (uint32_t i = 0; i < tr.num_site; i++){
+        uint32_t line = tr.sites[i].line;
+        fwrite(&line, sizeof(line), 1, tr.f);
+        _put_str(tr.sites[i].name);
+        _put_str(tr.sites[i].file);
+    }
+    _put_block("THRD", tr.num_ring, 0);
+    trace_ring_t *r = tr.rings;
+    while (r){
+        trace_ring_t *next = r->next;
+        uint64_t dropped = atomic_load(&r->dropped);
+        fwrite(&r->tid, sizeof(r->tid), 1, tr.f);
+        fwrite(&dropped, sizeof(dropped), 1, tr.f);
+        _put_str(r->name);
+        free(r);
+        r = next;
+    }
+    fclose(tr.f);
+    tr.f = NULL;
+    tr.rings = NULL;
+    tr.num_ring = 0;
+    // sites stay, their ids are cached at the call sites
+    self = NULL;
+}
+
+void photon_trace_thread_name(const char *name){
+    if (!atomic_load_explicit(&photon_trace_enabled, memory_order_relaxed)) return;
+    trace_ring_t *r = self ? self : _trace_register();
+    if (!r) return;
+    snprintf(r->name, sizeof(r->name), "%s", name);
+}
+
+uint32_t photon_trace_site(_Atomic uint32_t *site, const char *name, const char *file, int line){
+    pthread_mutex_lock(&tr.lock);
+    // someone else might have got here first
+    uint32_t id = atomic_load(site);
+    if (!id){
+        if (tr.num_site == tr.cap_site){
+            uint32_t cap = tr.cap_site ? tr.cap_site * 2 : 64;
+            trace_site_t *sites = realloc(tr.sites, cap * sizeof(trace_site_t));
+            if (!sites){
+                pthread_mutex_unlock(&tr.lock);
+                return 0;
+            }
+            tr.sites = sites;
+            tr.cap_site = cap;
+        }
+        tr.sites[tr.num_site++] = (trace_site_t){ .name = name, .file = file, .line = line };
+        id = tr.num_site;
+        atomic_store(site, id);
+    }
+    pthread_mutex_unlock(&tr.lock);
+    return id;
+}
+
+void photon_trace_emit(uint32_t site, int phase, int64_t a, int64_t b){
+    if (!site) return;
+    trace_ring_t *r = self ? self : _trace_register();
+    if (!r) return;
+    size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&r->tail, memory_order_acquire) == RING_SIZE){
+        atomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    photon_trace_rec_t *rec = &r->recs[head & (RING_SIZE - 1)];
+    rec->ts = _now_ns();
+    rec->site = site;
+    rec->phase = (uint32_t)phase;
+    rec->a = a;
+    rec->b = b;
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+}
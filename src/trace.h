@@ -0,0 +1,56 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+#include <stdint.h>
+#include <stdatomic.h>
+
+// binary event tracing, cheap enough to stay compiled into release builds:
+// with tracing off a trace point is one relaxed load and a branch. with it on
+// each thread appends fixed size records to its own lock free ring and a
+// background thread writes them out. tools/trace2json.py turns the file into
+// chrome://tracing (or Perfetto) json.
+//
+// call site names can list up to two argument names, "ui.move_cursor(y,x)",
+// the decoder uses them to label the arguments.
+
+// phases, same letters chrome uses
+#define PHOTON_TRACE_PH_INSTANT 'i'
+#define PHOTON_TRACE_PH_BEGIN   'B'
+#define PHOTON_TRACE_PH_END     'E'
+#define PHOTON_TRACE_PH_COUNTER 'C'
+
+// records are written as is, see tools/trace2json.py for the file layout
+typedef struct photon_trace_rec {
+    uint64_t ts;   // ns, CLOCK_MONOTONIC
+    uint32_t site;
+    uint32_t phase;
+    int64_t a, b;
+} photon_trace_rec_t;
+
+extern atomic_int photon_trace_enabled;
+
+// starts writing to path, returns 0 if it can't be opened
+int photon_trace_start(const char *path);
+// flushes and closes, call once nothing else is tracing (after the pool is stopped)
+void photon_trace_stop(void);
+// shows up as the thread's name in the trace
+void photon_trace_thread_name(const char *name);
+
+uint32_t photon_trace_site(_Atomic uint32_t *site, const char *name, const char *file, int line);
+void photon_trace_emit(uint32_t site, int phase, int64_t a, int64_t b);
+
+#define PHOTON_TRACE_AT(phase, name, a, b) do { \
+        if (atomic_load_explicit(&photon_trace_enabled, memory_order_relaxed)){ \
+            static _Atomic uint32_t _site; \
+            uint32_t _s = atomic_load_explicit(&_site, memory_order_relaxed); \
+            if (!_s) _s = photon_trace_site(&_site, name, __FILE__, __LINE__); \
+            photon_trace_emit(_s, phase, (int64_t)(a), (int64_t)(b)); \
+        } \
+    } while (0)
+
+#define PHOTON_TRACE(name, a, b) PHOTON_TRACE_AT(PHOTON_TRACE_PH_INSTANT, name, a, b)
+#define PHOTON_TRACE_BEGIN(name, a, b) PHOTON_TRACE_AT(PHOTON_TRACE_PH_BEGIN, name, a, b)
+// ends the innermost open span on this thread
+#define PHOTON_TRACE_END(name) PHOTON_TRACE_AT(PHOTON_TRACE_PH_END, name, 0, 0)
+#define PHOTON_TRACE_COUNT(name, value) PHOTON_TRACE_AT(PHOTON_TRACE_PH_COUNTER, name, value, 0)
+
+#endif//__TRACE_H__
@@ -1,5 +1,7 @@
 #include "ui.h"
 #include "photon_debug.h"
+#include "trace.h"
+#include "snapshot.h"
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -10,6 +12,7 @@
 #include <sys/ioctl.h>
 #include <math.h>
 #include <ctype.h>
+#include <time.h>
 
 typedef struct ansi_seq {
     unsigned int P[32];
@@ -22,29 +25,22 @@ typedef struct ansi_seq {
 #define OPT_REMOVE_TRAILING_0 2
 
 static int _ui_buf_eval(const ansi_seq_t *seq, char *buf, int n);
-static int __ui_buf_put(const ansi_seq_t *seq
-    PHOTON_DEBUG_OPT(, const char *fname)
-);
-
-#if PHOTON_DEBUG
-#define _ui_buf_put(seq) __ui_buf_put((seq), __func__)
+static int _ui_buf_put(const ansi_seq_t *seq);
 
 static int frame_number;
-#else
-#define _ui_buf_put(seq) __ui_buf_put((seq))
-#endif
 
-#ifdef UI_DEBUG_REFRESH
-#define REC_REFRESH(...) PHOTON_DEBUG_OPT(photon_debug_record(PHOTON_UI_REFRESH_NUM, __VA_ARGS__))
-#else
-#define REC_REFRESH(...)
-#endif
-#ifdef UI_DEBUG_CALLS
-#define REC_CALLS(...) PHOTON_DEBUG_OPT(photon_debug_record(PHOTON_UI_CALLS_NUM, __VA_ARGS__))
-#else
-#define REC_CALLS(...)
-#endif
-#define REC_BROADCAST(...) REC_CALLS(__VA_ARGS__); REC_REFRESH(__VA_ARGS__);
+// the frame being built, then the last one and a rolling window of them
+static photon_frame_stats_t stats, stats_last, stats_avg, stats_sum;
+static photon_frame_stats_t stats_window[PHOTON_STATS_WINDOW];
+static int stats_frames;
+
+static photon_snap_t capture;
+
+static uint64_t _ui_now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
 
 #define _ui_buf_calc_len(seq) _ui_buf_eval((seq), 0, 0)
 #define _ui_buf_put_shorter(first, ...) _ui_put_shorter(first, __VA_ARGS__, NULL)
@@ -118,9 +114,8 @@ static int _ui_buf_eval(const ansi_seq_t *seqPtr, char *buf, int n){
     _ui_pap(&buf, &totalLength, &n, "%c", seq.ch);
     return totalLength;
 }
-static int __ui_buf_put(const ansi_seq_t *seq
-    PHOTON_DEBUG_OPT(, const char *fname)
-){
+static int _ui_buf_put(const ansi_seq_t *seq){
+    stats.sequences++;
     int len = _ui_buf_eval(seq, evalBuf, sizeof(evalBuf));
     int newCapacity = cap;
     while (newCapacity < len + top)
@@ -132,7 +127,7 @@ static int __ui_buf_put(const ansi_seq_t *seq
         buf = newBuffer;
         cap = newCapacity;
     }
-    REC_REFRESH("%s(): %.*s\n", fname, len, evalBuf);
+    PHOTON_TRACE("ui.seq(final,len)", seq->ch, len);
     memcpy(&buf[top], evalBuf, len);
     top += len;
     return 1;
@@ -148,13 +143,58 @@ static int _ui_buf_putch(char c){
     buf[top++] = c;
     return 1;
 }
+static int _tty_init(void){
+    printf("\x1b[?1049h\x1b[2J\x1b[H");
+    fflush(stdout);
+    tcgetattr(STDIN_FILENO, &old);
+    struct termios raw = old;
+    cfmakeraw(&raw);
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &raw);
+    return 1;
+}
+
+static void _tty_end(void){
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &old);
+    printf("\x1b[?1049l\x1b[0m");
+    fflush(stdout);
+}
+
+static ssize_t _tty_write(const char *data, size_t n){
+    return write(STDOUT_FILENO, data, n);
+}
+
+static int _tty_size(int *r, int *c){
+    struct winsize sz;
+    if (ioctl(STDIN_FILENO, TIOCGWINSZ, &sz) == -1)
+        return 0;
+    *r = sz.ws_row;
+    *c = sz.ws_col;
+    return 1;
+}
+
+const photon_ui_backend_t photon_ui_tty = {
+    .init = _tty_init,
+    .end = _tty_end,
+    .write = _tty_write,
+    .size = _tty_size
+};
+
+static const photon_ui_backend_t *backend = &photon_ui_tty;
+
+void photon_ui_set_backend(const photon_ui_backend_t *newBackend){
+    backend = newBackend ? newBackend : &photon_ui_tty;
+}
+
 static int _ui_buf_flush(void){
+    PHOTON_TRACE_COUNT("ui.flush_bytes", top);
+    stats.bytes += top;
     int ntotal = 0;
     while (ntotal != top){
-        int n = write(STDOUT_FILENO, &buf[ntotal], top - ntotal);
+        stats.writes++;
+        ssize_t n = backend->write(&buf[ntotal], top - ntotal);
         if (n == -1)
             return -1;
-        ntotal += n;
+        ntotal += (int)n;
     }
     top = 0;
     return ntotal;
@@ -231,93 +271,55 @@ int has_color(void){
     return has_color_;
 }
 
-static void _ui_set_color(ansi_seq_t *seq, int color, int bg){
-    int *p = (bg ? &state.bg : &state.fg);
-    int value = *p;
+#define COLOR_VALUE   PHOTON_UI_COLOR_VALUE
+#define COLOR_TRUE    PHOTON_UI_COLOR_TRUE
+#define COLOR_INDEXED PHOTON_UI_COLOR_INDEXED
+#define COLOR_BASIC   PHOTON_UI_COLOR_BASIC
+
+// what the terminal actually gets told for an rgb color, as a COLOR_* kind | value
+static int _ui_quantize(int color){
     int r = (color >> 16) & 0xff;
     int g = (color >> 8)  & 0xff;
     int b =  color        & 0xff;
-    if (!has_color_){
-        if (bg){
-            hsv_t hsv;
-            _to_hsv(r, g, b, &hsv);
-            if (hsv.v > 0.5){
-                seq->P[seq->num_params++] = 7;
-            }
-        }
-        return;
-    }
     if (has_true_color){
-        if (value == color) return;
         rgb_t val;
         val.r = r;
         val.g = g;
         val.b = b;
         // check if it's in the defined range, and if so just use the index
         for (int i = 0; i < 240; i++){
-            if (memcmp(&val, &defined_range_rgb[i], sizeof(rgb_t)) == 0){
-                seq->P[seq->num_params++] = 38 + bg * 10;
-                seq->P[seq->num_params++] = 5;
-                seq->P[seq->num_params++] = i + 16;
-                *p = color;
-                return;
-            }
+            if (memcmp(&val, &defined_range_rgb[i], sizeof(rgb_t)) == 0)
+                return COLOR_INDEXED | (i + 16);
         }
-        seq->P[seq->num_params++] = 38 + bg * 10;
-        seq->P[seq->num_params++] = 2;
-        seq->P[seq->num_params++] = r;
-        seq->P[seq->num_params++] = g;
-        seq->P[seq->num_params++] = b;
-        *p = color;
-        return;
+        return COLOR_TRUE | (color & COLOR_VALUE);
     }
-    // grayscale;
     hsv_t hsv;
     _to_hsv(r, g, b, &hsv);
     if (hsv.s <= 0.01){
         // grayscale
         if (is_4bit_color){
             // black, dark gray, very light gray, or white?
-            // is it closer to black?
-            if (hsv.v < 0.25){
-                seq->P[seq->num_params] = 30;
-            }
-            // is it closer to dark gray?
-            else if (hsv.v < 0.5){
-                seq->P[seq->num_params] = 90;
-            }
-            // is it closer to light gray?
-            else if (hsv.v < 0.75){
-                seq->P[seq->num_params] = 37;
-            }
-            // white
-            else seq->P[seq->num_params] = 97;
-
-            if (bg)
-                seq->P[seq->num_params] += 10;
-            if (value == seq->P[seq->num_params])
-                *p = seq->P[seq->num_params++];
-        } else {
-            int closest;
-            float closeness = INFINITY;
-            for (int i = 0; i < 24; i++){
-                float f;
-                if ((f = fabs(hsv.v - defined_range[216 + i].v)) < closeness){
-                    closeness = f;
-                    closest = i;
-                }
+            if (hsv.v < 0.25)
+                return COLOR_BASIC | 30;
+            if (hsv.v < 0.5)
+                return COLOR_BASIC | 90;
+            if (hsv.v < 0.75)
+                return COLOR_BASIC | 37;
+            return COLOR_BASIC | 97;
+        }
+        int closest = 0;
+        float closeness = INFINITY;
+        for (int i = 0; i < 24; i++){
+            float f;
+            if ((f = fabs(hsv.v - defined_range[216 + i].v)) < closeness){
+                closeness = f;
+                closest = i;
             }
-            int x = 216 + closest % 8;
-            if (value == x) return;
-            *p = x;
-            seq->P[seq->num_params++] = 38 + bg * 10;
-            seq->P[seq->num_params++] = 5;
-            seq->P[seq->num_params++] = x + 16;
         }
-        return;
+        return COLOR_INDEXED | (216 + closest + 16);
     }
     if (is_4bit_color){
-        int closest;
+        int closest = 0;
         float closeness = INFINITY;
         for (int i = 0; i < 16; i++){
             float cmp = _hsv_cmp(&hsv, &palette[i]);
@@ -326,13 +328,9 @@ static void _ui_set_color(ansi_seq_t *seq, int color, int bg){
                 closeness = cmp;
             }
         }
-        int x = ((closest < 8) ? 30 : 90) + bg * 10 + closest % 8;
-        if (value == x) return;
-        seq->P[seq->num_params++] = x;
-        *p = x;
-        return;
+        return COLOR_BASIC | (((closest < 8) ? 30 : 90) + closest % 8);
     }
-    int closest;
+    int closest = 0;
     float closeness = INFINITY;
     for (int i = 0; i < 240; i++){
         float cmp = _hsv_cmp(&hsv, &defined_range[i]);
@@ -341,11 +339,86 @@ static void _ui_set_color(ansi_seq_t *seq, int color, int bg){
             closeness = cmp;
         }
     }
-    if (value == closest) return;
-    seq->P[seq->num_params++] = 38 + bg * 10;
-    seq->P[seq->num_params++] = 5;
-    seq->P[seq->num_params++] = closest + 16;
-    *p = closest;
+    return COLOR_INDEXED | (closest + 16);
+}
+
+// quantizing is a linear search so remember recent answers, themes only use a handful of colors
+#define QCACHE_SIZE 256
+static struct {
+    int color, q;
+} qcache[QCACHE_SIZE];
+
+static void _ui_qcache_reset(void){
+    for (int i = 0; i < QCACHE_SIZE; i++)
+        qcache[i].color = -1;
+}
+
+int photon_ui_color(int color){
+    color &= COLOR_VALUE;
+    if (!has_color_) return -1;
+    unsigned h = ((unsigned)color * 2654435761u) >> 24;
+    stats.color_lookups++;
+    if (qcache[h].color != color){
+        stats.color_misses++;
+        qcache[h].color = color;
+        qcache[h].q = _ui_quantize(color);
+    }
+    return qcache[h].q;
+}
+
+static void _ui_set_color(ansi_seq_t *seq, int color, int bg){
+    if (!has_color_){
+        // the best we can do for a light background is reverse video
+        if (bg){
+            hsv_t hsv;
+            _to_hsv((color >> 16) & 0xff, (color >> 8) & 0xff, color & 0xff, &hsv);
+            int reverse = hsv.v > 0.5;
+            if (state.bg == reverse) return;
+            state.bg = reverse;
+            seq->P[seq->num_params++] = reverse ? 7 : 27;
+        }
+        return;
+    }
+    int *p = (bg ? &state.bg : &state.fg);
+    int q = photon_ui_color(color);
+    if (*p == q) return;
+    *p = q;
+    int v = q & COLOR_VALUE;
+    switch (q & ~COLOR_VALUE){
+    case COLOR_TRUE:
+        seq->P[seq->num_params++] = 38 + bg * 10;
+        seq->P[seq->num_params++] = 2;
+        seq->P[seq->num_params++] = (v >> 16) & 0xff;
+        seq->P[seq->num_params++] = (v >> 8) & 0xff;
+        seq->P[seq->num_params++] = v & 0xff;
+        break;
+    case COLOR_INDEXED:
+        seq->P[seq->num_params++] = 38 + bg * 10;
+        seq->P[seq->num_params++] = 5;
+        seq->P[seq->num_params++] = v;
+        break;
+    case COLOR_BASIC:
+        seq->P[seq->num_params++] = v + bg * 10;
+        break;
+    }
+}
+
+int photon_ui_detect_color(const char *term, const char *colorterm){
+    if (colorterm && strcmp(colorterm, "truecolor") == 0)
+        return PHOTON_COLOR_TRUE;
+    if (!term)
+        term = "";
+    if (strncmp(term, "xterm", 5) && strcmp(term, "ansi") && !strstr(term, "color"))
+        return PHOTON_COLOR_NONE;
+    return strstr(term, "256") ? PHOTON_COLOR_256 : PHOTON_COLOR_16;
+}
+
+void photon_ui_set_color_mode(int mode){
+    has_color_ = mode != PHOTON_COLOR_NONE;
+    has_true_color = mode == PHOTON_COLOR_TRUE;
+    is_4bit_color = mode == PHOTON_COLOR_16;
+    state.fg = state.bg = -1;
+    _ui_qcache_reset();
 }
 
 typedef struct ui_cell {
@@ -355,35 +428,29 @@ typedef struct ui_cell {
 } ui_cell_t;
 
 static ui_cell_t *front, *back;
+static int wrap_pending;
 static int did_resize;
 static int rows, cols;
 
 static void _ui_get_size(void){
-    struct winsize sz;
-    if (ioctl(STDIN_FILENO, TIOCGWINSZ, &sz) == -1){
+    int r, c;
+    if (!backend->size(&r, &c)){
         did_resize = -1;
         return;
     }
     did_resize = 1;
-    rows = sz.ws_row;
-    cols = sz.ws_col;
+    rows = r;
+    cols = c;
 }
 
 int photon_ui_init(photon_editor_t *editor){
-#ifdef UI_DEBUG_CALLS
-    photon_debug_begin_rec(PHOTON_UI_CALLS_NUM, UI_DEBUG_CALLS);
-#endif
-#ifdef UI_DEBUG_REFRESH
-    photon_debug_begin_rec(PHOTON_UI_REFRESH_NUM, UI_DEBUG_REFRESH);
-#endif
-    REC_BROADCAST("Frame #%d\n", frame_number);
     // set impossible state color values
     state.fg = state.bg = -1;
 
     for (int i = 0; i < 216; i++){
         uint8_t r, g, b;
         r = i / 36 * 51;
-        g = (i / 6) % 36 * 51;
+        g = (i / 6) % 6 * 51;
         b = i % 6 * 51;
         defined_range_rgb[i] = (rgb_t){
             .r = r,
@@ -425,13 +492,7 @@ int photon_ui_init(photon_editor_t *editor){
 #ifdef _WIN32
 #error "Windows is not supported yet"
 #else
-    char *s = getenv("COLORTERM");
-    has_true_color = s && strcmp(s, "truecolor") == 0;
-    if (!has_true_color){
-        char *s = getenv("TERM");
-        has_color_ = strncmp(s, "xterm", 5) == 0 || strcmp(s, "ansi") == 0 || strstr(s, "color") != NULL;
-        is_4bit_color = strstr(s, "256") == NULL;
-    } else has_color_ = has_true_color;
+    photon_ui_set_color_mode(photon_ui_detect_color(getenv("TERM"), getenv("COLORTERM")));
 #endif
 
     buf = malloc(INITIAL_CAPACITY);
@@ -440,12 +501,11 @@ int photon_ui_init(photon_editor_t *editor){
     }
     cap = INITIAL_CAPACITY;
 
-    printf("\x1b[?1049h\x1b[2J\x1b[H");
-    fflush(stdout);
-    tcgetattr(STDIN_FILENO, &old);
-    struct termios raw = old;
-    cfmakeraw(&raw);
-    tcsetattr(STDIN_FILENO, TCSADRAIN, &raw);
+    if (!backend->init()){
+        free(buf);
+        buf = NULL;
+        err_and_ret(editor, PHOTON_BAD_PARAM, 0);
+    }
 
     _ui_get_size();
     did_resize = 0;
@@ -460,6 +520,41 @@ int photon_ui_init(photon_editor_t *editor){
         buf = NULL;
         err_and_ret(editor, PHOTON_NO_MEM, 0);
     }
+    // we don't know what the terminal's default colors are, so the first frame paints everything
+    for (int i = 0; i < area; i++)
+        front[i].fg = front[i].bg = -1;
+    state.x = state.y = 0;
+    wrap_pending = 0;
+    return 1;
+}
+
+int photon_ui_resize(photon_editor_t *editor){
+    int r, c;
+    if (!backend->size(&r, &c) || r <= 0 || c <= 0){
+        err_and_ret(editor, PHOTON_BAD_PARAM, 0);
+    }
+    ui_cell_t *newBack = calloc((size_t)r * c, sizeof(ui_cell_t));
+    ui_cell_t *newFront = calloc((size_t)r * c, sizeof(ui_cell_t));
+    if (!newBack || !newFront){
+        free(newBack);
+        free(newFront);
+        err_and_ret(editor, PHOTON_NO_MEM, 0);
+    }
+    free(back);
+    free(front);
+    back = newBack;
+    front = newFront;
+    rows = r;
+    cols = c;
+    // a capture is all one size
+    photon_ui_capture_stop();
+    // nothing is known about the screen, as on init
+    for (int i = 0; i < r * c; i++)
+        front[i].fg = front[i].bg = -1;
+    state.fg = state.bg = -1;
+    state.x = state.y = 0;
+    c_y = c_x = 0;
+    wrap_pending = 0;
     return 1;
 }
 
@@ -475,12 +570,12 @@ static void photon_request(photon_editor_t *editor, photon_draw_req_t *req){
     cell.ch = req->ch;
     cell.style = req->style;
     back[req->y * cols + req->x] = cell;
+    stats.cells_drawn++;
 }
 
 void photon_move_ui_cursor(int y, int x){
     c_y = y;
     c_x = x;
-    REC_CALLS("cursor moved to %d, %d\n", y, x);
 }
 
 void photon_ui_cursor_loc(int *y, int *x){
@@ -494,19 +589,9 @@ void photon_draw_str(photon_editor_t *editor, const char *str){
     photon_draw_nstr(editor, str, strlen(str));
 }
 
-#define TRUNC_LEN 32
-
 void photon_draw_nstr(photon_editor_t *editor, const char *str, size_t sz){
-#ifdef UI_DEBUG_CALLS
     photon_draw_req_t req = {0};
-    char trunc[TRUNC_LEN + 10] = {0};
-    if (sz > TRUNC_LEN){
-        sprintf(trunc, "%.32s...", str);
-    } else {
-        memcpy(trunc, str, sz > TRUNC_LEN ? TRUNC_LEN : sz);
-    }
-    REC_CALLS("attempting to draw string \"%.*s\" size of %zu bytes with color #%06x\n", sz > TRUNC_LEN ? TRUNC_LEN : (int)sz, trunc, sz, editor->ui_hints.fg);
-#endif
+    PHOTON_TRACE("ui.draw_nstr(len,fg)", sz, editor->ui_hints.fg);
     while (sz){
         int p = c_y * cols + c_x;
         req.style = editor->ui_hints.style;
@@ -528,11 +613,12 @@ void photon_draw_nstr(photon_editor_t *editor, const char *str, size_t sz){
     photon_request(editor, &req);
 }
 
-void photon_draw_box(photon_editor_t *editor, int rows, int cols){
+void photon_draw_box(photon_editor_t *editor, int h, int w){
     photon_draw_req_t req = {0};
-    REC_CALLS("attempting to draw box size of %dx%d, with color #%06x\n", cols, rows, editor->ui_hints.bg);
-    for (int r = 0; r < rows; r++)
-        for (int c = 0; c < cols; c++){
+    PHOTON_TRACE("ui.draw_box(rows,cols)", h, w);
+    for (int r = 0; r < h; r++)
+        for (int c = 0; c < w; c++){
+            // the screen's cols, not the box's
             int p = (c_y + r) * cols + (c_x + c);
             req.fg = back[p].fg;
             req.bg = editor->ui_hints.bg;
@@ -562,7 +648,7 @@ static void _ui_gen_ar_pair(char c, ansi_seq_t *abs, ansi_seq_t *rel, int diff,
         ansi_seq_t moveRel = moveAbs;
         moveRel.num_params = 1;
         char relCh;
-        if (c == 'H'){
+        if (c == 'd'){
             relCh = diff < 0 ? 'A' : 'B';
         } else {
             relCh = diff < 0 ? 'D' : 'C';
@@ -574,7 +660,13 @@ static void _ui_gen_ar_pair(char c, ansi_seq_t *abs, ansi_seq_t *rel, int diff,
 }
 
 static void _ui_move_cursor(unsigned int y, unsigned int x){
-    REC_REFRESH("_ui_move_cursor(%u, %u) called, cursor already at %u, %u\n", y, x, state.y, state.x);
+    PHOTON_TRACE("ui.move_cursor(y,x)", y, x);
+    if (wrap_pending){
+        // after printing in the last column terminals park the cursor in limbo, \r gets it back
+        _ui_buf_putch('\r');
+        state.x = 0;
+        wrap_pending = 0;
+    }
     int diffX = (int)(x - state.x);
     int diffY = (int)(y - state.y);
     if (!diffX && !diffY) return;
@@ -614,7 +706,7 @@ static void _ui_move_cursor(unsigned int y, unsigned int x){
 
         ansi_seq_t moveRelY = {0};
         ansi_seq_t moveRelX = {0};
-        _ui_gen_ar_pair('H', NULL, &moveRelY, diffY, y);
+        _ui_gen_ar_pair('d', NULL, &moveRelY, diffY, y);
         _ui_gen_ar_pair('G', NULL, &moveRelX, diffX, x);
         int totalLen = _ui_buf_calc_len(&moveRelY) + _ui_buf_calc_len(&moveRelX);
         int moveLen = _ui_buf_calc_len(&moveAbs);
@@ -632,60 +724,140 @@ static void _ui_move_cursor(unsigned int y, unsigned int x){
     } else if (diffY){
         ansi_seq_t moveAbs = {0};
         ansi_seq_t moveRel = moveAbs;
-        _ui_gen_ar_pair('H', &moveAbs, &moveRel, diffY, y);
+        _ui_gen_ar_pair('d', &moveAbs, &moveRel, diffY, y);
         _ui_buf_put_shorter(&moveAbs, &moveRel);
     }
     state.x = x;
     state.y = y;
 }
 
+static int _ui_blank(const ui_cell_t *cell){
+    return !cell->ch || isspace((unsigned char)cell->ch);
+}
+
+// same thing on screen, the foreground of a blank doesn't matter
+static int _ui_same(const ui_cell_t *a, const ui_cell_t *b){
+    if (a->bg != b->bg || a->style != b->style) return 0;
+    if (_ui_blank(a)) return _ui_blank(b);
+    return a->ch == b->ch && a->fg == b->fg;
+}
+
+static void _ui_put_cell(int y, int x, const ui_cell_t *cell){
+    stats.cells_changed++;
+    ansi_seq_t mSeq = {0};
+    mSeq.ch = 'm';
+    int blank = _ui_blank(cell);
+    if (!blank)
+        _ui_set_color(&mSeq, cell->fg, 0);
+    _ui_set_color(&mSeq, cell->bg, 1);
+    if (mSeq.num_params > 0)
+        _ui_buf_put(&mSeq);
+    _ui_move_cursor(y, x);
+    _ui_buf_putch(blank ? ' ' : cell->ch);
+    if (state.x + 1 != cols)
+        state.x++;
+    else
+        wrap_pending = 1;
+}
+
+// a blank tail shorter than this is cheaper to just print
+#define CLEAR_MIN 4
+
+static void _ui_snap_fill(photon_snap_t *snap, const ui_cell_t *cells){
+    photon_snap_cell_t *out = photon_snap_next(snap);
+    for (int i = 0; i < rows * cols; i++){
+        out[i].fg = cells[i].fg;
+        out[i].bg = cells[i].bg;
+        out[i].style = cells[i].style;
+        out[i].ch = cells[i].ch;
+    }
+}
+
+#define STATS_FIELDS(X) X(cells_drawn) X(cells_changed) X(sequences) X(bytes) X(writes) \
+    X(color_lookups) X(color_misses) X(draw_ns) X(pre_frame_ns) X(diff_ns) X(flush_ns)
+
+static void _ui_stats_commit(void){
+    photon_frame_stats_t *old = &stats_window[frame_number % PHOTON_STATS_WINDOW];
+    if (stats_frames < PHOTON_STATS_WINDOW)
+        stats_frames++;
+#define X(f) stats_sum.f += stats.f - old->f; stats_avg.f = stats_sum.f / stats_frames;
+    STATS_FIELDS(X)
+#undef X
+    *old = stats;
+    stats_last = stats;
+    memset(&stats, 0, sizeof(stats));
+}
+
+photon_frame_stats_t *photon_ui_stats(void){
+    return &stats;
+}
+
+const photon_frame_stats_t *photon_ui_stats_last(void){
+    return &stats_last;
+}
+
+const photon_frame_stats_t *photon_ui_stats_average(void){
+    return &stats_avg;
+}
+
 void photon_ui_refresh(void){
+    PHOTON_TRACE_BEGIN("ui.refresh(frame)", frame_number, 0);
+    if (capture.f){
+        _ui_snap_fill(&capture, back);
+        if (!photon_snap_commit(&capture, frame_number))
+            photon_ui_capture_stop();
+    }
+    uint64_t start = _ui_now_ns();
     for (int y = 0; y < rows; y++){
-        int n = 0;
-        int can_clear = 0;
-        for (int x = 0; x < cols; x++){
-            int i = y * cols + x;
-            ui_cell_t *log, *cur;
-            cur = &front[i];
-            log = &back [i];
-            if (memcmp(cur, log, sizeof(*cur)) == 0) continue;
-            else can_clear = 1;
-            ansi_seq_t mSeq = {0};
-            mSeq.ch = 'm';
-            int oldFg = state.fg;
-            int oldBg = state.bg;
-            if (log->fg != cur->fg)
-                _ui_set_color(&mSeq, log->fg, 0);
-            if (log->bg != cur->bg)
-                _ui_set_color(&mSeq, log->bg, 1);
-            if (mSeq.num_params > 0){
-                _ui_buf_put(&mSeq);
-                REC_REFRESH("set color to (#%06x, #%06x) called, were set to #%06x #%06x\n", log->fg, log->bg, oldFg, oldBg);
-            }
-            _ui_move_cursor(y, x);
-            REC_REFRESH("printing '%c'\n", log->ch);
-            if (log->ch && !isspace(log->ch)){
-                _ui_buf_putch(log->ch);
-                n = state.x + 1;
-            }/* else if (cur->ch || mSeq.num_params > 0) {
-                _ui_buf_putch(' ');
-            }*/ else _ui_buf_putch(' ');
-            if (state.x + 1 != cols){
-                state.x++;
-            }
-
-            *cur = *log;
+        ui_cell_t *cur = &front[y * cols];
+        ui_cell_t *log = &back [y * cols];
+        // trailing blanks that share a background can all be painted by one EL
+        int tail = cols;
+        while (tail > 0 && _ui_blank(&log[tail - 1]) && log[tail - 1].bg == log[cols - 1].bg && log[tail - 1].style == log[cols - 1].style)
+            tail--;
+        int clear = 0;
+        if (cols - tail >= CLEAR_MIN){
+            for (int x = tail; x < cols && !clear; x++)
+                clear = !_ui_same(&cur[x], &log[x]);
+        }
+        int end = clear ? tail : cols;
+        for (int x = 0; x < end; x++){
+            if (_ui_same(&cur[x], &log[x])) continue;
+            _ui_put_cell(y, x, &log[x]);
+            cur[x] = log[x];
         }
-        if (!can_clear) continue;
-        _ui_move_cursor(state.y, n);
+        if (!clear) continue;
+        for (int x = tail; x < cols; x++)
+            stats.cells_changed += !_ui_same(&cur[x], &log[x]);
+        // EL paints with the current background
+        ansi_seq_t mSeq = {0};
+        mSeq.ch = 'm';
+        _ui_set_color(&mSeq, log[cols - 1].bg, 1);
+        if (mSeq.num_params > 0)
+            _ui_buf_put(&mSeq);
+        _ui_move_cursor(y, tail);
         ansi_seq_t clearLine = {0};
         clearLine.ch = 'K';
         _ui_buf_put(&clearLine);
+        memcpy(&cur[tail], &log[tail], (cols - tail) * sizeof(ui_cell_t));
     }
-    _ui_move_cursor(c_y, c_x);
+    // text that filled the last row leaves the cursor below it, a \n there would scroll
+    _ui_move_cursor(c_y < rows ? c_y : rows - 1, c_x < cols ? c_x : cols - 1);
+    uint64_t diffEnd = _ui_now_ns();
     _ui_buf_flush();
+    stats.diff_ns += diffEnd - start;
+    stats.flush_ns += _ui_now_ns() - diffEnd;
+    _ui_stats_commit();
     frame_number++;
-    REC_BROADCAST("\nFrame #%d\n", frame_number);
+    PHOTON_TRACE_END("ui.refresh");
+}
+
+void photon_ui_expected_cell(int y, int x, int *fg, int *bg, char *ch){
+    const ui_cell_t *cell = &back[y * cols + x];
+    int blank = _ui_blank(cell);
+    *ch = blank ? ' ' : cell->ch;
+    *fg = blank ? -1 : photon_ui_color(cell->fg);
+    *bg = photon_ui_color(cell->bg);
 }
 
 void photon_tint_line(photon_editor_t *editor, int y, int x, int n){
@@ -702,18 +874,17 @@ void photon_tint_line(photon_editor_t *editor, int y, int x, int n){
 }
 
 void photon_ui_end(void){
-#ifdef UI_DEBUG_CALLS
-    photon_debug_end_rec(PHOTON_UI_CALLS_NUM);
-#endif
-#ifdef UI_DEBUG_REFRESH
-    photon_debug_end_rec(PHOTON_UI_REFRESH_NUM);
-#endif
+    // already torn down (or never set up)
+    if (!buf) return;
+    photon_ui_capture_stop();
     cap = top = 0;
     free(buf);
     buf = NULL;
+    free(front);
+    free(back);
+    front = back = NULL;
 
-    tcsetattr(STDIN_FILENO, TCSADRAIN, &old);
-    printf("\x1b[?1049l\x1b[0m");
+    backend->end();
 }
 
 int photon_ui_width(void){
@@ -723,40 +894,29 @@ int photon_ui_height(void){
     return rows;
 }
 
-#if PHOTON_DEBUG
 int photon_ui_frame_number(void){
     return frame_number;
 }
 
-int photon_ui_snapshot(const char *fpath, const char *bpath){
-    FILE *backfp = fopen(bpath, "wb");
-    if (!backfp) return 0;
-    FILE *frontfp = fopen(fpath, "wb");
-    if (!frontfp){
-        fclose(backfp);
+int photon_ui_snapshot(const char *path){
+    photon_snap_t snap;
+    if (!photon_snap_create(&snap, path, rows, cols))
         return 0;
-    }
-    int area = rows * cols;
-    int values[4] = {
-        (int)0xDECAFC0F,
-        rows,
-        cols,
-        area
-    };
-    if (fwrite(values, 4, sizeof(int), backfp) < 4 || fwrite(values, 4, sizeof(int), frontfp) < 4) {
-        goto err;
-    }
-    if (fwrite(front, sizeof(ui_cell_t), area, frontfp) < area || fwrite(back, sizeof(ui_cell_t), area, backfp) < area){
-        goto err;
-    }
-
-    int c = 0;
-    goto skip;
-err:
-    c = 1;
-skip:
-    fclose(backfp);
-    fclose(frontfp);
-    return c;
+    // what's on screen, then what the next refresh will put there
+    _ui_snap_fill(&snap, front);
+    int ok = photon_snap_commit(&snap, frame_number);
+    _ui_snap_fill(&snap, back);
+    ok = ok && photon_snap_commit(&snap, frame_number + 1);
+    photon_snap_close(&snap);
+    return ok;
+}
+
+int photon_ui_capture_start(const char *path){
+    if (capture.f) return 0;
+    return photon_snap_create(&capture, path, rows, cols);
+}
+
+void photon_ui_capture_stop(void){
+    if (capture.f)
+        photon_snap_close(&capture);
 }
-#endif
@@ -1,29 +1,70 @@
 #ifndef __UI_H__
 #define __UI_H__
 #include <stddef.h>
+#include <sys/types.h>
 
 typedef struct photon_editor photon_editor_t;
 
+// where frames go, set it before photon_ui_init
+typedef struct photon_ui_backend {
+    int (*init)(void);
+    void (*end)(void);
+    ssize_t (*write)(const char *data, size_t n);
+    int (*size)(int *rows, int *cols);
+} photon_ui_backend_t;
+
+extern const photon_ui_backend_t photon_ui_tty;
+void photon_ui_set_backend(const photon_ui_backend_t *backend);
+
+#define PHOTON_COLOR_NONE 0
+#define PHOTON_COLOR_16 1
+#define PHOTON_COLOR_256 2
+#define PHOTON_COLOR_TRUE 3
+
+// overrides what was detected from the environment, call after photon_ui_init
+void photon_ui_set_color_mode(int mode);
+// what a terminal with these TERM and COLORTERM (either can be NULL) supports
+int photon_ui_detect_color(const char *term, const char *colorterm);
+
+// photon_ui_color results are kind | value, -1 if the terminal has no colors
+#define PHOTON_UI_COLOR_VALUE   0xffffff
+#define PHOTON_UI_COLOR_TRUE    0x1000000 // rgb
+#define PHOTON_UI_COLOR_INDEXED 0x2000000 // 256 color palette index
+#define PHOTON_UI_COLOR_BASIC   0x3000000 // SGR foreground code, 30-37 or 90-97
+int photon_ui_color(int rgb);
+// what the terminal should show at y, x once the frame is out, fg is -1 for blanks
+void photon_ui_expected_cell(int y, int x, int *fg, int *bg, char *ch);
+
 int photon_ui_init(photon_editor_t *editor);
+// takes the backend's size again and forgets what's on screen, so the next refresh
+// paints everything. returns 0 and sets editor->error on failure
+int photon_ui_resize(photon_editor_t *editor);
 
 void photon_move_ui_cursor(int y, int x);
 void photon_ui_cursor_loc(int *y, int *x);
 void photon_draw_str(photon_editor_t *editor, const char *str);
 void photon_draw_nstr(photon_editor_t *editor, const char *str, size_t sz);
-void photon_draw_box(photon_editor_t *editor, int rows, int cols);
+void photon_draw_box(photon_editor_t *editor, int h, int w);
 void photon_tint_line(photon_editor_t *editor, int y, int x, int n);
 void photon_ui_refresh(void);
 void photon_ui_clear(void);
 int photon_ui_width(void);
 int photon_ui_height(void);
 
-#if PHOTON_DEBUG
-int photon_ui_snapshot(const char *fpath, const char *bpath);
 int photon_ui_frame_number(void);
 
-#define PHOTON_UI_CALLS_NUM 0
-#define PHOTON_UI_REFRESH_NUM 1
-#endif
+typedef struct photon_frame_stats photon_frame_stats_t;
+// the frame being built, for adding the time spent outside ui.c
+photon_frame_stats_t *photon_ui_stats(void);
+// updated by photon_ui_refresh
+const photon_frame_stats_t *photon_ui_stats_last(void);
+const photon_frame_stats_t *photon_ui_stats_average(void);
+
+// writes what's on screen and the frame that's about to replace it, see snapshot.h
+int photon_ui_snapshot(const char *path);
+// every frame from now on goes into one file
+int photon_ui_capture_start(const char *path);
+void photon_ui_capture_stop(void);
 
 void photon_ui_end(void);
 
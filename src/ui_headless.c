@@ -0,0 +1,299 @@
+#include "ui_headless.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct vt_cell {
+    int fg, bg;
+    char ch;
+} vt_cell_t;
+
+#define VT_GROUND 0
+#define VT_ESC 1
+#define VT_CSI 2
+
+static int rows = 24, cols = 80;
+static vt_cell_t *grid;
+static int cy, cx, wrap_pending;
+static int fg = -1, bg = -1;
+
+static struct {
+    int state;
+    int P[32];
+    int n;
+    int has_digit;
+    char private;
+} parser;
+
+static char *out;
+static size_t out_len, out_cap;
+static size_t writes;
+
+void photon_headless_set_size(int r, int c){
+    rows = r;
+    cols = c;
+}
+
+static void _vt_clear(int from, int to){
+    for (int i = from; i < to; i++){
+        grid[i].ch = ' ';
+        grid[i].fg = -1;
+        grid[i].bg = bg;
+    }
+}
+
+static void _vt_line_feed(void){
+    if (cy + 1 < rows){
+        cy++;
+        return;
+    }
+    memmove(grid, grid + cols, (size_t)(rows - 1) * cols * sizeof(vt_cell_t));
+    _vt_clear((rows - 1) * cols, rows * cols);
+}
+
+static void _vt_print(char ch){
+    if (wrap_pending){
+        wrap_pending = 0;
+        cx = 0;
+        _vt_line_feed();
+    }
+    vt_cell_t *cell = &grid[cy * cols + cx];
+    cell->ch = ch;
+    cell->fg = ch == ' ' ? -1 : fg;
+    cell->bg = bg;
+    if (cx + 1 == cols)
+        wrap_pending = 1;
+    else
+        cx++;
+}
+
+static int _vt_param(int i, int def){
+    return i < parser.n && parser.P[i] ? parser.P[i] : def;
+}
+
+static int _vt_clamp(int v, int max){
+    return v < 0 ? 0 : v >= max ? max - 1 : v;
+}
+
+static void _vt_sgr(void){
+    if (parser.n == 0){
+        fg = bg = -1;
+        return;
+    }
+    for (int i = 0; i < parser.n; i++){
+        int p = parser.P[i];
+        if (p == 0){
+            fg = bg = -1;
+        } else if (p == 38 || p == 48){
+            int *target = p == 38 ? &fg : &bg;
+            if (i + 2 < parser.n && parser.P[i + 1] == 5){
+                *target = PHOTON_UI_COLOR_INDEXED | parser.P[i + 2];
+                i += 2;
+            } else if (i + 4 < parser.n && parser.P[i + 1] == 2){
+                *target = PHOTON_UI_COLOR_TRUE | (parser.P[i + 2] & 0xff) << 16 | (parser.P[i + 3] & 0xff) << 8 | (parser.P[i + 4] & 0xff);
+                i += 4;
+            } else break;
+        } else if (p == 39){
+            fg = -1;
+        } else if (p == 49){
+            bg = -1;
+        } else if ((p >= 30 && p <= 37) || (p >= 90 && p <= 97)){
+            fg = PHOTON_UI_COLOR_BASIC | p;
+        } else if ((p >= 40 && p <= 47) || (p >= 100 && p <= 107)){
+            bg = PHOTON_UI_COLOR_BASIC | (p - 10);
+        }
+        // attributes (bold, reverse...) aren't tracked
+    }
+}
+
+static void _vt_csi(char final){
+    wrap_pending = 0;
+    if (parser.private == '?'){
+        // alternate screen on/off, both start from a clean screen as far as we care
+        if ((final == 'h' || final == 'l') && _vt_param(0, 0) == 1049){
+            cy = cx = 0;
+            _vt_clear(0, rows * cols);
+        }
+        return;
+    }
+    switch (final){
+    case 'H':
+    case 'f':
+        cy = _vt_clamp(_vt_param(0, 1) - 1, rows);
+        cx = _vt_clamp(_vt_param(1, 1) - 1, cols);
+        break;
+    case 'A':
+        cy = _vt_clamp(cy - _vt_param(0, 1), rows);
+        break;
+    case 'B':
+        cy = _vt_clamp(cy + _vt_param(0, 1), rows);
+        break;
+    case 'C':
+        cx = _vt_clamp(cx + _vt_param(0, 1), cols);
+        break;
+    case 'D':
+        cx = _vt_clamp(cx - _vt_param(0, 1), cols);
+        break;
+    case 'G':
+        cx = _vt_clamp(_vt_param(0, 1) - 1, cols);
+        break;
+    case 'd':
+        cy = _vt_clamp(_vt_param(0, 1) - 1, rows);
+        break;
+    case 'K': {
+        int mode = _vt_param(0, 0);
+        int row = cy * cols;
+        if (mode == 0)
+            _vt_clear(row + cx, row + cols);
+        else if (mode == 1)
+            _vt_clear(row, row + cx + 1);
+        else
+            _vt_clear(row, row + cols);
+    } break;
+    case 'J': {
+        int mode = _vt_param(0, 0);
+        if (mode == 0)
+            _vt_clear(cy * cols + cx, rows * cols);
+        else if (mode == 1)
+            _vt_clear(0, cy * cols + cx + 1);
+        else
+            _vt_clear(0, rows * cols);
+    } break;
+    case 'm':
+        _vt_sgr();
+        break;
+    default: break;
+    }
+}
+
+static void _vt_feed(const char *data, size_t n){
+    for (size_t i = 0; i < n; i++){
+        unsigned char c = data[i];
+        switch (parser.state){
+        case VT_GROUND:
+            if (c == 27){
+                parser.state = VT_ESC;
+            } else if (c == '\r'){
+                cx = 0;
+                wrap_pending = 0;
+            } else if (c == '\n'){
+                wrap_pending = 0;
+                _vt_line_feed();
+            } else if (c == '\b'){
+                wrap_pending = 0;
+                if (cx) cx--;
+            } else if (c >= 0x20 && c != 0x7f){
+                _vt_print(c);
+            }
+            break;
+        case VT_ESC:
+            if (c == '['){
+                parser.state = VT_CSI;
+                parser.n = 0;
+                parser.has_digit = 0;
+                parser.private = 0;
+                memset(parser.P, 0, sizeof(parser.P));
+            } else parser.state = VT_GROUND;
+            break;
+        case VT_CSI:
+            if (c >= '0' && c <= '9'){
+                if (!parser.has_digit && parser.n < 32)
+                    parser.n++;
+                parser.has_digit = 1;
+                if (parser.n <= 32)
+                    parser.P[parser.n - 1] = parser.P[parser.n - 1] * 10 + (c - '0');
+            } else if (c == ';'){
+                if (!parser.has_digit && parser.n < 32)
+                    parser.n++;
+                parser.has_digit = 0;
+            } else if (c == '?' || c == '>' || c == '='){
+                parser.private = c;
+            } else if (c >= 0x40 && c <= 0x7e){
+                _vt_csi(c);
+                parser.state = VT_GROUND;
+            }
+            break;
+        }
+    }
+}
+
+static int _headless_init(void){
+    grid = malloc((size_t)rows * cols * sizeof(vt_cell_t));
+    if (!grid) return 0;
+    fg = bg = -1;
+    cy = cx = wrap_pending = 0;
+    memset(&parser, 0, sizeof(parser));
+    _vt_clear(0, rows * cols);
+    photon_headless_reset();
+    return 1;
+}
+
+static void _headless_end(void){
+    free(grid);
+    grid = NULL;
+    free(out);
+    out = NULL;
+    out_len = out_cap = 0;
+}
+
+static ssize_t _headless_write(const char *data, size_t n){
+    if (out_len + n > out_cap){
+        size_t newCap = out_cap ? out_cap : 4096;
+        while (newCap < out_len + n)
+            newCap <<= 1;
+        char *newOut = realloc(out, newCap);
+        if (!newOut) return -1;
+        out = newOut;
+        out_cap = newCap;
+    }
+    memcpy(out + out_len, data, n);
+    out_len += n;
+    writes++;
+    _vt_feed(data, n);
+    return (ssize_t)n;
+}
+
+static int _headless_size(int *r, int *c){
+    *r = rows;
+    *c = cols;
+    return 1;
+}
+
+const photon_ui_backend_t photon_ui_headless = {
+    .init = _headless_init,
+    .end = _headless_end,
+    .write = _headless_write,
+    .size = _headless_size
+};
+
+const char *photon_headless_output(size_t *n){
+    *n = out_len;
+    return out;
+}
+
+size_t photon_headless_writes(void){
+    return writes;
+}
+
+void photon_headless_reset(void){
+    out_len = 0;
+    writes = 0;
+}
+
+int photon_headless_check(int *y, int *x){
+    int bad = 0;
+    for (int r = 0; r < rows; r++){
+        for (int c = 0; c < cols; c++){
+            int efg, ebg;
+            char ech;
+            photon_ui_expected_cell(r, c, &efg, &ebg, &ech);
+            const vt_cell_t *cell = &grid[r * cols + c];
+            int same = cell->ch == ech && (efg == -1 || cell->fg == efg) && (ebg == -1 || cell->bg == ebg);
+            if (same) continue;
+            if (!bad++){
+                if (y) *y = r;
+                if (x) *x = c;
+            }
+        }
+    }
+    return bad;
+}
@@ -0,0 +1,22 @@
+#ifndef __UI_HEADLESS_H__
+#define __UI_HEADLESS_H__
+#include <stddef.h>
+#include "ui.h"
+
+// renders into memory instead of a terminal, the byte stream is also run
+// through a small vt emulator so the result can be checked against the frame
+extern const photon_ui_backend_t photon_ui_headless;
+
+// size the fake terminal reports, call before photon_ui_init
+void photon_headless_set_size(int rows, int cols);
+
+// everything written since the last reset
+const char *photon_headless_output(size_t *n);
+size_t photon_headless_writes(void);
+void photon_headless_reset(void);
+
+// compares the emulated screen with what ui.c meant to draw, returns the
+// number of cells that differ and where the first one is
+int photon_headless_check(int *y, int *x);
+
+#endif//__UI_HEADLESS_H__
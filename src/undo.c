@@ -0,0 +1,90 @@
+#include "undo.h"
+#include "buffer.h"
+#include "cursors.h"
+#include <stdlib.h>
+#include <string.h>
+
+photon_undo_step_t *photon_undo_step_new(size_t num_edit, size_t bytes){
+    photon_undo_step_t *step = malloc(sizeof(photon_undo_step_t) + num_edit * sizeof(photon_edit_t) + bytes);
+    if (!step) return NULL;
+    step->bytes = bytes;
+    step->num_edit = num_edit;
+    return step;
+}
+
+// steps from..to go, the ones after move down
+static void _drop(photon_buffer_t *buf, size_t from, size_t to){
+    if (from == to) return;
+    for (size_t i = from; i < to; i++){
+        buf->text->_undo.bytes -= buf->text->_undo.steps[i]->bytes;
+        free(buf->text->_undo.steps[i]);
+    }
+    memmove(&buf->text->_undo.steps[from], &buf->text->_undo.steps[to], (buf->text->_undo.num - to) * sizeof(photon_undo_step_t *));
+    buf->text->_undo.num -= to - from;
+    if (buf->text->_undo.done > to)
+        buf->text->_undo.done -= to - from;
+    else if (buf->text->_undo.done > from)
+        buf->text->_undo.done = from;
+}
+
+void photon_undo_push(photon_buffer_t *buf, photon_undo_step_t *step){
+    _drop(buf, buf->text->_undo.done, buf->text->_undo.num);
+    if (!step || step->bytes > PHOTON_UNDO_BYTES){
+        // can't go back past this one
+        free(step);
+        photon_undo_clear(buf);
+        return;
+    }
+    if (buf->text->_undo.num == buf->text->_undo.cap){
+        size_t cap = buf->text->_undo.cap ? buf->text->_undo.cap * 2 : 16;
+        photon_undo_step_t **steps = realloc(buf->text->_undo.steps, cap * sizeof(photon_undo_step_t *));
+        if (!steps){
+            free(step);
+            photon_undo_clear(buf);
+            return;
+        }
+        buf->text->_undo.steps = steps;
+        buf->text->_undo.cap = cap;
+    }
+    buf->text->_undo.steps[buf->text->_undo.num++] = step;
+    buf->text->_undo.done = buf->text->_undo.num;
+    buf->text->_undo.bytes += step->bytes;
+    // the oldest ones are forgotten first, never the one just pushed
+    size_t old = 0, bytes = buf->text->_undo.bytes;
+    while (buf->text->_undo.num - old > PHOTON_UNDO_STEPS || bytes > PHOTON_UNDO_BYTES)
+        bytes -= buf->text->_undo.steps[old++]->bytes;
+    if (old)
+        _drop(buf, 0, old);
+}
+
+// applies step i and puts what takes that back in its place
+static int _apply(photon_editor_t *editor, photon_buffer_t *buf, size_t i){
+    photon_undo_step_t *step = buf->text->_undo.steps[i];
+    photon_undo_step_t *back = photon_buffer_apply(editor, buf, step->edits, step->num_edit);
+    if (!back) return 0;
+    // what came back is selected, so it's easy to see and to do over
+    photon_cursors_place(buf, back->edits, back->num_edit, 1);
+    buf->text->_undo.bytes += back->bytes - step->bytes;
+    buf->text->_undo.steps[i] = back;
+    free(step);
+    return 1;
+}
+
+int photon_undo(photon_editor_t *editor, photon_buffer_t *buf){
+    if (!buf->text->_undo.done || !_apply(editor, buf, buf->text->_undo.done - 1)) return 0;
+    buf->text->_undo.done--;
+    return 1;
+}
+
+int photon_redo(photon_editor_t *editor, photon_buffer_t *buf){
+    if (buf->text->_undo.done == buf->text->_undo.num || !_apply(editor, buf, buf->text->_undo.done)) return 0;
+    buf->text->_undo.done++;
+    return 1;
+}
+
+void photon_undo_clear(photon_buffer_t *buf){
+    for (size_t i = 0; i < buf->text->_undo.num; i++)
+        free(buf->text->_undo.steps[i]);
+    free(buf->text->_undo.steps);
+    memset(&buf->text->_undo, 0, sizeof(buf->text->_undo));
+}
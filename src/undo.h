@@ -0,0 +1,32 @@
+#ifndef __UNDO_H__
+#define __UNDO_H__
+#include <stddef.h>
+#include "photon.h"
+
+// undo history: every edit is kept as what takes it back, a batch of edits that puts the
+// erased text back where the inserted text ended up. a batch made with photon_buffer_replace
+// (all the cursors typing at once) is a single step, and undoing a step is a batch too,
+// whose own inverse is what redo makes. steps past PHOTON_UNDO_STEPS, or that would keep
+// more than PHOTON_UNDO_BYTES of text, are forgotten oldest first.
+
+#define PHOTON_UNDO_STEPS 1024
+#define PHOTON_UNDO_BYTES (64 << 20)
+
+typedef struct photon_undo_step {
+    size_t bytes; // of text, it's right after the edits
+    size_t num_edit;
+    photon_edit_t edits[];
+} photon_undo_step_t;
+
+// room for num_edit edits and bytes of their text, NULL if out of memory
+photon_undo_step_t *photon_undo_step_new(size_t num_edit, size_t bytes);
+// the buffer just made an edit, step undoes it. what was undone can't be redone anymore,
+// and a NULL step (there was no memory for it) clears the history
+void photon_undo_push(photon_buffer_t *buf, photon_undo_step_t *step);
+
+// return 0 if there's nothing to undo (redo) or it failed, editor->error is set then
+int photon_undo(photon_editor_t *editor, photon_buffer_t *buf);
+int photon_redo(photon_editor_t *editor, photon_buffer_t *buf);
+void photon_undo_clear(photon_buffer_t *buf);
+
+#endif//__UNDO_H__
@@ -0,0 +1,198 @@
+#include "wrap.h"
+#include "photon.h"
+#include "fold.h"
+#include <stdlib.h>
+
+// lines counted at a time when a row further down than the tree reaches is looked for
+#define EXTEND_MIN 4096
+
+static size_t _width(const photon_buffer_t *buf){
+    return buf->cols > 0 ? (size_t)buf->cols : 1;
+}
+
+static uint32_t _count(size_t length, size_t width){
+    return length ? (uint32_t)((length + width - 1) / width) : 1;
+}
+
+size_t photon_wrap_rows(const photon_buffer_t *buf, size_t i){
+    if (photon_fold_visible(buf, i) != i) return 0;
+    return _count(buf->text->lines[i].length, _width(buf));
+}
+
+// rows of the lines before j, j is at most valid
+static uint64_t _prefix(const photon_buffer_t *buf, size_t j){
+    uint64_t sum = 0;
+    for (; j; j &= j - 1)
+        sum += buf->_wrap.tree[j];
+    return sum;
+}
+
+static int _reserve(photon_buffer_t *buf, size_t n){
+    if (n <= buf->_wrap.cap) return 1;
+    size_t cap = buf->_wrap.cap ? buf->_wrap.cap : 256;
+    while (cap < n)
+        cap <<= 1;
+    uint32_t *rows = realloc(buf->_wrap.rows, cap * sizeof(uint32_t));
+    if (!rows) return 0;
+    buf->_wrap.rows = rows;
+    uint64_t *tree = realloc(buf->_wrap.tree, (cap + 1) * sizeof(uint64_t));
+    if (!tree) return 0;
+    buf->_wrap.tree = tree;
+    buf->_wrap.cap = cap;
+    return 1;
+}
+
+// makes the first n lines counted, 0 if out of memory
+static int _validate(photon_buffer_t *buf, size_t n){
+    if (buf->_wrap.width != (int)_width(buf)){
+        buf->_wrap.width = (int)_width(buf);
+        buf->_wrap.valid = 0;
+    }
+    if (n > buf->text->num_line)
+        n = buf->text->num_line;
+    if (n <= buf->_wrap.valid) return 1;
+    if (!_reserve(buf, buf->text->num_line)) return 0;
+    size_t width = buf->_wrap.width;
+    uint32_t *rows = buf->_wrap.rows;
+    uint64_t *tree = buf->_wrap.tree;
+    uint64_t sum = _prefix(buf, buf->_wrap.valid);
+    // folds along the way, the lines they hide take no rows
+    size_t count;
+    const photon_fold_t *fold = photon_fold_from(buf, buf->_wrap.valid, &count);
+    // an entry covers the lines from j - lowbit(j) up to j, everything below is counted
+    for (size_t j = buf->_wrap.valid + 1; j <= n; j++){
+        while (count && fold->last < j - 1){
+            fold++;
+            count--;
+        }
+        rows[j - 1] = count && fold->first < j - 1 ? 0 : _count(buf->text->lines[j - 1].length, width);
+        sum += rows[j - 1];
+        tree[j] = sum - _prefix(buf, j & (j - 1));
+        buf->_wrap.valid = j;
+    }
+    return 1;
+}
+
+static uint64_t _rows_before(photon_buffer_t *buf, size_t line){
+    if (_validate(buf, line))
+        return _prefix(buf, line);
+    // no memory for the tree, the slow way still works
+    uint64_t sum = 0;
+    for (size_t i = 0; i < line; i++)
+        sum += photon_wrap_rows(buf, i);
+    return sum;
+}
+
+uint64_t photon_wrap_row(photon_buffer_t *buf, size_t line, size_t col){
+    if (line >= buf->text->num_line)
+        return photon_wrap_total(buf);
+    size_t sub = col / _width(buf), rows = photon_wrap_rows(buf, line);
+    uint64_t before = _rows_before(buf, line);
+    if (!rows) // folded away, it's where the fold's last row is
+        return before ? before - 1 : 0;
+    return before + (sub < rows ? sub : rows - 1);
+}
+
+uint64_t photon_wrap_total(photon_buffer_t *buf){
+    return _rows_before(buf, buf->text->num_line);
+}
+
+void photon_wrap_locate(photon_buffer_t *buf, uint64_t row, size_t *line, size_t *offset){
+    size_t width = _width(buf);
+    // count lines until the row is among them
+    size_t n = buf->_wrap.width == (int)width ? buf->_wrap.valid : 0;
+    while (n < buf->text->num_line && (!n || _prefix(buf, n) <= row)){
+        n += n > EXTEND_MIN ? n : EXTEND_MIN;
+        if (!_validate(buf, n)){
+            // the slow way
+            size_t i = 0;
+            for (; i + 1 < buf->text->num_line && row >= photon_wrap_rows(buf, i); i++)
+                row -= photon_wrap_rows(buf, i);
+            *line = photon_fold_visible(buf, i);
+            size_t rows = photon_wrap_rows(buf, *line);
+            *offset = (row < rows && *line == i ? row : rows - 1) * width;
+            return;
+        }
+        n = buf->_wrap.valid;
+    }
+    // the most lines that all end before row, row is then how far into the next one it is
+    size_t pos = 0, step = 1;
+    while (step <= n / 2)
+        step <<= 1;
+    for (; step; step >>= 1){
+        if (pos + step <= n && buf->_wrap.tree[pos + step] <= row){
+            pos += step;
+            row -= buf->_wrap.tree[pos];
+        }
+    }
+    if (pos >= buf->text->num_line){
+        *line = photon_fold_visible(buf, buf->text->num_line - 1);
+        *offset = (photon_wrap_rows(buf, *line) - 1) * width;
+    } else {
+        *line = pos;
+        *offset = row * width;
+    }
+}
+
+uint64_t photon_wrap_top(photon_buffer_t *buf){
+    if (buf->scroll < 0)
+        return 0;
+    return photon_wrap_row(buf, buf->scroll, buf->scroll_off);
+}
+
+void photon_wrap_set_top(photon_buffer_t *buf, uint64_t row){
+    size_t line;
+    photon_wrap_locate(buf, row, &line, &buf->scroll_off);
+    buf->scroll = (int)line;
+}
+
+int photon_wrap_at_bottom(photon_buffer_t *buf){
+    return photon_wrap_top(buf) + buf->rows >= photon_wrap_total(buf);
+}
+
+void photon_wrap_to_bottom(photon_buffer_t *buf){
+    uint64_t total = photon_wrap_total(buf);
+    photon_wrap_set_top(buf, total > (uint64_t)buf->rows ? total - buf->rows : 0);
+}
+
+void photon_wrap_edit(photon_buffer_t *buf, size_t first, size_t last, long delta){
+    size_t valid = buf->_wrap.valid;
+    if (buf->_wrap.width != (int)_width(buf)){
+        buf->_wrap.valid = 0;
+        return;
+    }
+    // lines moved, everything after them has to be counted again
+    if (delta || first >= valid){
+        if (first < valid)
+            buf->_wrap.valid = first;
+        return;
+    }
+    // same lines, new lengths: only the ones that changed rows are updated
+    for (size_t i = first; i <= last && i < valid; i++){
+        uint32_t rows = (uint32_t)photon_wrap_rows(buf, i);
+        uint64_t diff = (uint64_t)rows - buf->_wrap.rows[i]; // wraps around for fewer, adds up the same
+        if (!diff) continue;
+        buf->_wrap.rows[i] = rows;
+        for (size_t j = i + 1; j <= valid; j += j & -j)
+            buf->_wrap.tree[j] += diff;
+    }
+}
+
+void photon_wrap_invalidate(photon_buffer_t *buf, size_t first){
+    if (first < buf->_wrap.valid)
+        buf->_wrap.valid = first;
+}
+
+void photon_wrap_reset(photon_buffer_t *buf){
+    buf->_wrap.valid = 0;
+    buf->scroll = 0;
+    buf->scroll_off = 0;
+}
+
+void photon_wrap_free(photon_buffer_t *buf){
+    free(buf->_wrap.rows);
+    free(buf->_wrap.tree);
+    buf->_wrap.rows = NULL;
+    buf->_wrap.tree = NULL;
+    buf->_wrap.cap = buf->_wrap.valid = 0;
+}
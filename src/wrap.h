@@ -0,0 +1,40 @@
+#ifndef __WRAP_H__
+#define __WRAP_H__
+#include <stddef.h>
+#include <stdint.h>
+
+// soft wrap: a line takes as many screen rows as it needs at the buffer's width, so the
+// view starts at a line (buf->scroll) and an offset into it (buf->scroll_off, always the
+// start of one of its rows) and a long line scrolls row by row like any other text. to
+// go between visual rows and lines every line's row count is kept in a Fenwick tree,
+// which gives either direction in O(log n). edits that keep the line count only update
+// the lines they touched, anything else (and a new width) invalidates from the first
+// changed line on and the tree is brought back up to date lazily, only as far as a
+// query needs it. drawing never needs it: the view goes down from its top line.
+
+typedef struct photon_buffer photon_buffer_t;
+
+// visual rows line i takes, 0 if it's folded away (see fold.h)
+size_t photon_wrap_rows(const photon_buffer_t *buf, size_t i);
+// the visual row line, col is on. past the end of the line is its last row
+uint64_t photon_wrap_row(photon_buffer_t *buf, size_t line, size_t col);
+// the line visual row is on and the offset that row starts at, rows past the end of the
+// text give the last one
+void photon_wrap_locate(photon_buffer_t *buf, uint64_t row, size_t *line, size_t *offset);
+uint64_t photon_wrap_total(photon_buffer_t *buf);
+
+// the visual row at the top of the view, and moving it there
+uint64_t photon_wrap_top(photon_buffer_t *buf);
+void photon_wrap_set_top(photon_buffer_t *buf, uint64_t row);
+// the view at the end of the text, like a terminal's
+int photon_wrap_at_bottom(photon_buffer_t *buf);
+void photon_wrap_to_bottom(photon_buffer_t *buf);
+
+// the buffer calls these like photon_highlight_edit
+void photon_wrap_edit(photon_buffer_t *buf, size_t first, size_t last, long delta);
+void photon_wrap_reset(photon_buffer_t *buf);
+// lines from first on have to be counted again, the folds changed there
+void photon_wrap_invalidate(photon_buffer_t *buf, size_t first);
+void photon_wrap_free(photon_buffer_t *buf);
+
+#endif//__WRAP_H__
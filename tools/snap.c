@@ -0,0 +1,233 @@
+// photon_snap: reads the snapshots written by ^S (debug builds) and PHOTON_CAPTURE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/snapshot.h"
+
+static void _usage(void){
+    fprintf(stderr,
+        "usage: photon_snap info <file>\n"
+        "       photon_snap scan <file>            changed cells and rows of every frame\n"
+        "       photon_snap diff <file> [a [b]] [-v] cells that differ between frames a and b (the last two by default)\n"
+        "       photon_snap show <file> <frame>     print a frame with colors\n");
+}
+
+static int _same(const photon_snap_cell_t *a, const photon_snap_cell_t *b){
+    return a->ch == b->ch && a->fg == b->fg && a->bg == b->bg && a->style == b->style;
+}
+
+static void _print_cell(const photon_snap_cell_t *c){
+    int fg = c->fg < 0 ? 0xffffff : c->fg, bg = c->bg < 0 ? 0 : c->bg;
+    char ch = c->ch >= ' ' && c->ch < 127 ? c->ch : ' ';
+    printf("\x1b[38;2;%d;%d;%d;48;2;%d;%d;%dm%c", fg >> 16 & 0xff, fg >> 8 & 0xff, fg & 0xff, bg >> 16 & 0xff, bg >> 8 & 0xff, bg & 0xff, ch);
+}
+
+static void _describe_cell(const photon_snap_cell_t *c){
+    printf("Cell(fg=#%06x, bg=#%06x, style=%d, ch=%d)", c->fg & 0xffffff, c->bg & 0xffffff, c->style, c->ch);
+}
+
+static int _open(photon_snap_t *snap, const char *path){
+    if (photon_snap_open(snap, path)) return 1;
+    fprintf(stderr, "photon_snap: %s is not a snapshot\n", path);
+    return 0;
+}
+
+static int _broken(photon_snap_t *snap, const char *path){
+    fprintf(stderr, "photon_snap: %s is truncated or corrupt after %d frames\n", path, snap->frames);
+    photon_snap_close(snap);
+    return EXIT_FAILURE;
+}
+
+static int _info(const char *path){
+    photon_snap_t snap;
+    if (!_open(&snap, path)) return EXIT_FAILURE;
+    uint32_t frame, first = 0, last = 0;
+    char kind;
+    int r, keys = 0;
+    unsigned long long changed = 0;
+    size_t area = (size_t)snap.rows * snap.cols;
+    while ((r = photon_snap_read(&snap, &frame, &kind)) == 1){
+        if (snap.frames == 1) first = frame;
+        last = frame;
+        keys += kind == 'K';
+        if (snap.frames == 1) continue;
+        const photon_snap_cell_t *cur = photon_snap_cells(&snap), *prev = photon_snap_prev(&snap);
+        for (size_t i = 0; i < area; i++)
+            changed += !_same(&cur[i], &prev[i]);
+    }
+    long size = ftell(snap.f);
+    if (r < 0) return _broken(&snap, path);
+    printf("%dx%d, %d frames (%u to %u), %d key frames\n", snap.rows, snap.cols, snap.frames, first, last, keys);
+    printf("%ld bytes, %.1f per frame, %.1f for a whole frame\n", size, snap.frames ? (double)size / snap.frames : 0.0, (double)area * PHOTON_SNAP_CELL_SIZE);
+    if (snap.frames > 1)
+        printf("%.1f cells changed per frame\n", (double)changed / (snap.frames - 1));
+    photon_snap_close(&snap);
+    return EXIT_SUCCESS;
+}
+
+static int _scan(const char *path){
+    photon_snap_t snap;
+    if (!_open(&snap, path)) return EXIT_FAILURE;
+    uint32_t frame;
+    char kind;
+    int r;
+    printf("frame\tkind\tcells\trows\n");
+    while ((r = photon_snap_read(&snap, &frame, &kind)) == 1){
+        const photon_snap_cell_t *cur = photon_snap_cells(&snap), *prev = photon_snap_prev(&snap);
+        int cells = 0, rowsChanged = 0;
+        for (int y = 0; y < snap.rows; y++){
+            int before = cells;
+            for (int x = 0; x < snap.cols; x++){
+                int i = y * snap.cols + x;
+                cells += snap.frames == 1 || !_same(&cur[i], &prev[i]);
+            }
+            rowsChanged += cells != before;
+        }
+        printf("%u\t%c\t%d\t%d\n", frame, kind, cells, rowsChanged);
+    }
+    if (r < 0) return _broken(&snap, path);
+    photon_snap_close(&snap);
+    return EXIT_SUCCESS;
+}
+
+// finds frames a and b (by number), -1 means the second to last/last frame
+static int _load_pair(photon_snap_t *snap, const char *path, long a, long b, photon_snap_cell_t *first, photon_snap_cell_t *second){
+    size_t bytes = (size_t)snap->rows * snap->cols * sizeof(photon_snap_cell_t);
+    int haveA = 0, haveB = 0, r;
+    uint32_t frame;
+    while ((r = photon_snap_read(snap, &frame, NULL)) == 1){
+        if (a < 0){
+            // keep sliding the last two along
+            if (snap->frames > 1){
+                memcpy(first, photon_snap_prev(snap), bytes);
+                haveA = 1;
+            }
+            memcpy(second, photon_snap_cells(snap), bytes);
+            haveB = 1;
+            continue;
+        }
+        if (frame == (uint32_t)a){
+            memcpy(first, photon_snap_cells(snap), bytes);
+            haveA = 1;
+        }
+        if (frame == (uint32_t)b){
+            memcpy(second, photon_snap_cells(snap), bytes);
+            haveB = 1;
+        }
+        if (haveA && haveB) break;
+    }
+    if (r < 0){
+        _broken(snap, path);
+        return 0;
+    }
+    if (!haveA || !haveB){
+        fprintf(stderr, "photon_snap: %s doesn't have those frames\n", path);
+        return 0;
+    }
+    return 1;
+}
+
+static int _diff(const char *path, long a, long b, int verbose){
+    photon_snap_t snap;
+    if (!_open(&snap, path)) return EXIT_FAILURE;
+    size_t area = (size_t)snap.rows * snap.cols;
+    photon_snap_cell_t *first = malloc(area * sizeof(photon_snap_cell_t));
+    photon_snap_cell_t *second = malloc(area * sizeof(photon_snap_cell_t));
+    int ok = first && second && _load_pair(&snap, path, a, b, first, second);
+    int diffs = 0;
+    for (int y = 0; ok && y < snap.rows; y++){
+        int x = 0;
+        while (x < snap.cols){
+            int i = y * snap.cols + x;
+            if (_same(&first[i], &second[i])){
+                x++;
+                continue;
+            }
+            int start = x;
+            while (x < snap.cols && !_same(&first[y * snap.cols + x], &second[y * snap.cols + x]))
+                x++;
+            diffs += x - start;
+            if (verbose){
+                for (int c = start; c < x; c++){
+                    const photon_snap_cell_t *from = &first[y * snap.cols + c], *to = &second[y * snap.cols + c];
+                    printf("%d, %d: ", y, c);
+                    _print_cell(from);
+                    printf("\x1b[0m -> ");
+                    _print_cell(to);
+                    printf("\x1b[0m\t");
+                    _describe_cell(from);
+                    printf(" -> ");
+                    _describe_cell(to);
+                    printf("\n");
+                }
+                continue;
+            }
+            printf("diff at %d, %d, %d cells:\n", y, start, x - start);
+            for (int c = start; c < x; c++)
+                _print_cell(&first[y * snap.cols + c]);
+            printf("\x1b[0m\n");
+            for (int c = start; c < x; c++)
+                _print_cell(&second[y * snap.cols + c]);
+            printf("\x1b[0m\n");
+        }
+    }
+    if (ok)
+        printf("%d cells differ\n", diffs);
+    free(first);
+    free(second);
+    photon_snap_close(&snap);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int _show(const char *path, long want){
+    photon_snap_t snap;
+    if (!_open(&snap, path)) return EXIT_FAILURE;
+    uint32_t frame;
+    int r;
+    while ((r = photon_snap_read(&snap, &frame, NULL)) == 1){
+        if (frame != (uint32_t)want) continue;
+        const photon_snap_cell_t *cells = photon_snap_cells(&snap);
+        for (int y = 0; y < snap.rows; y++){
+            for (int x = 0; x < snap.cols; x++)
+                _print_cell(&cells[y * snap.cols + x]);
+            printf("\x1b[0m\n");
+        }
+        photon_snap_close(&snap);
+        return EXIT_SUCCESS;
+    }
+    if (r < 0) return _broken(&snap, path);
+    fprintf(stderr, "photon_snap: no frame %ld in %s\n", want, path);
+    photon_snap_close(&snap);
+    return EXIT_FAILURE;
+}
+
+int main(int argc, char **argv){
+    if (argc < 3){
+        _usage();
+        return EXIT_FAILURE;
+    }
+    const char *cmd = argv[1], *path = argv[2];
+    if (!strcmp(cmd, "info"))
+        return _info(path);
+    if (!strcmp(cmd, "scan"))
+        return _scan(path);
+    if (!strcmp(cmd, "diff")){
+        long frames[2] = { -1, -1 };
+        int n = 0, verbose = 0;
+        for (int i = 3; i < argc; i++){
+            if (!strcmp(argv[i], "-v"))
+                verbose = 1;
+            else if (n < 2)
+                frames[n++] = strtol(argv[i], NULL, 10);
+        }
+        if (n == 1){
+            // one frame means it against the one after it
+            frames[1] = frames[0] + 1;
+        }
+        return _diff(path, frames[0], frames[1], verbose);
+    }
+    if (!strcmp(cmd, "show") && argc > 3)
+        return _show(path, strtol(argv[3], NULL, 10));
+    _usage();
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,116 @@
+#!/usr/bin/env python3
+# turns a PHOTON_TRACE file into chrome trace json (chrome://tracing, ui.perfetto.dev)
+#
+# layout, everything in host byte order:
+#   "PHTRACE1", u64 start ns
+#   blocks of tag[4], u32 a, u32 b:
+#     EVTS  a = thread id, b = count, then count records of u64 ts, u32 site, u32 phase, i64 a, i64 b
+#     SITE  a = count, then per site (ids start at 1): u32 line, str name, str file
+#     THRD  a = count, then per thread: u32 id, u64 dropped, str name
+#   str is u16 length + bytes
+import sys
+import json
+import struct
+
+argv = sys.argv
+argc = len(argv)
+
+if argc < 2:
+    print("usage: trace2json.py <trace> [out.json]")
+    raise SystemExit(1)
+
+class NotATrace(Exception):
+    def __init__(self, *args, **kwargs):
+        super().__init__(*args, **kwargs)
+
+REC = struct.Struct("=QIIqq")
+
+class Reader:
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+    def left(self):
+        return len(self.data) - self.pos
+    def take(self, fmt):
+        size = struct.calcsize("=" + fmt)
+        if self.left() < size:
+            raise NotATrace("truncated")
+        values = struct.unpack_from("=" + fmt, self.data, self.pos)
+        self.pos += size
+        return values
+    def string(self):
+        n, = self.take("H")
+        s = self.data[self.pos:self.pos + n].decode(errors="replace")
+        self.pos += n
+        return s
+
+def parse(file_path):
+    with open(file_path, "rb") as file:
+        r = Reader(file.read())
+    if r.data[:8] != b"PHTRACE1":
+        raise NotATrace()
+    r.pos = 8
+    start, = r.take("Q")
+    events = []
+    sites = {}
+    threads = {}
+    while r.left() >= 12:
+        tag = r.data[r.pos:r.pos + 4]
+        r.pos += 4
+        a, b = r.take("II")
+        if tag == b"EVTS":
+            for _ in range(b):
+                if r.left() < REC.size:
+                    raise NotATrace("truncated")
+                events.append((a, *REC.unpack_from(r.data, r.pos)))
+                r.pos += REC.size
+        elif tag == b"SITE":
+            for i in range(a):
+                line, = r.take("I")
+                name = r.string()
+                sites[i + 1] = (name, r.string(), line)
+        elif tag == b"THRD":
+            for _ in range(a):
+                tid, dropped = r.take("IQ")
+                threads[tid] = (r.string(), dropped)
+        else:
+            raise NotATrace(f"unknown block {tag!r}")
+    return start, events, sites, threads
+
+def split_name(name):
+    # "ui.move_cursor(y,x)" -> "ui.move_cursor", ["y", "x"]
+    if name.endswith(")") and "(" in name:
+        base, args = name[:-1].split("(", 1)
+        return base, [a.strip() for a in args.split(",") if a.strip()]
+    return name, []
+
+start, events, sites, threads = parse(argv[1])
+out = []
+for tid, (name, dropped) in threads.items():
+    out.append({"name": "thread_name", "ph": "M", "pid": 1, "tid": tid, "args": {"name": name or f"thread {tid}"}})
+    if dropped:
+        print(f"warning: {dropped} events dropped on thread {name or tid}, the writer couldn't keep up", file=sys.stderr)
+
+for tid, ts, site, phase, a, b in sorted(events, key=lambda e: e[1]):
+    name, file, line = sites.get(site, (f"site {site}", "?", 0))
+    base, names = split_name(name)
+    ph = chr(phase)
+    ev = {"name": base, "ph": ph, "pid": 1, "tid": tid, "ts": (ts - start) / 1000}
+    if ph == "C":
+        ev["args"] = {base: a}
+    elif ph != "E":
+        args = {}
+        for n, v in zip(names, (a, b)):
+            args[n] = v
+        args["at"] = f"{file.rsplit('/', 1)[-1]}:{line}"
+        ev["args"] = args
+        if ph == "i":
+            ev["s"] = "t"
+    out.append(ev)
+
+result = json.dumps({"traceEvents": out, "displayTimeUnit": "ns"})
+if argc > 2:
+    with open(argv[2], "w") as file:
+        file.write(result)
+else:
+    print(result)